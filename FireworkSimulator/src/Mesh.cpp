@@ -223,83 +223,42 @@ void Mesh::createOBBMesh(const glm::vec3& center, const glm::vec3& halfSize, con
 
 }
 
-// only after OpenGL 4.5
-// void Mesh::init()
-// {
-//   glCreateBuffers(1, &_posVbo); // Generate a GPU buffer to store the positions of the vertices
-//   size_t vertexBufferSize = sizeof(glm::vec3)*_vertexPositions.size(); // Gather the size of the buffer from the CPU-side vector
-//   glNamedBufferStorage(_posVbo, vertexBufferSize, _vertexPositions.data(), GL_DYNAMIC_STORAGE_BIT); // Create a data store on the GPU
-
-//   glCreateBuffers(1, &_normalVbo); // Same for normal
-//   glNamedBufferStorage(_normalVbo, vertexBufferSize, _vertexNormals.data(), GL_DYNAMIC_STORAGE_BIT);
-
-//   glCreateBuffers(1, &_texCoordVbo); // Same for texture coordinates
-//   size_t texCoordBufferSize = sizeof(glm::vec2)*_vertexTexCoords.size();
-//   glNamedBufferStorage(_texCoordVbo, texCoordBufferSize, _vertexTexCoords.data(), GL_DYNAMIC_STORAGE_BIT);
-
-//   glCreateBuffers(1, &_ibo); // Same for the index buffer, that stores the list of indices of the triangles forming the mesh
-//   size_t indexBufferSize = sizeof(glm::uvec3)*_triangleIndices.size();
-//   glNamedBufferStorage(_ibo, indexBufferSize, _triangleIndices.data(), GL_DYNAMIC_STORAGE_BIT);
-
-//   glCreateVertexArrays(1, &_vao); // Create a single handle that joins together attributes (vertex positions, normals) and connectivity (triangles indices)
-//   glBindVertexArray(_vao);
-
-//   glEnableVertexAttribArray(0);
-//   glBindBuffer(GL_ARRAY_BUFFER, _posVbo);
-//   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(GLfloat), 0);
-
-//   glEnableVertexAttribArray(1);
-//   glBindBuffer(GL_ARRAY_BUFFER, _normalVbo);
-//   glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3*sizeof(GLfloat), 0);
-
-//   glEnableVertexAttribArray(2);
-//   glBindBuffer(GL_ARRAY_BUFFER, _texCoordVbo);
-//   glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2*sizeof(GLfloat), 0);
-
-//   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ibo);
-//   glBindVertexArray(0); // Desactive the VAO just created. Will be activated at rendering time.
-// }
+// Interleave and quantize the vertices (see VertexFormat.h) into the CPU-side staging buffers
+void Mesh::packBuffers(std::vector<PackedVertex> &vertices, std::vector<unsigned char> &indices)
+{
+    vertices.resize(_vertexPositions.size());
+    for (size_t v = 0; v < _vertexPositions.size(); ++v)
+        vertices[v] = packVertex(
+            _vertexPositions[v],
+            v < _vertexNormals.size() ? _vertexNormals[v] : glm::vec3(0.f, 0.f, 1.f),
+            v < _vertexTexCoords.size() ? _vertexTexCoords[v] : glm::vec2(0.f));
+    _indexType = packIndices(_triangleIndices, _vertexPositions.size(), indices);
+}
 
 void Mesh::init()
 {
-    // Generate a GPU buffer to store the positions of the vertices
-    size_t vertexBufferSize = sizeof(glm::vec3) * _vertexPositions.size();
-    glGenBuffers(1, &_posVbo);
-    glBindBuffer(GL_ARRAY_BUFFER, _posVbo);
-    glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, _vertexPositions.data(), GL_DYNAMIC_READ);
-
-    // Same for normal
-    glGenBuffers(1, &_normalVbo);
-    glBindBuffer(GL_ARRAY_BUFFER, _normalVbo);
-    glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, _vertexNormals.data(), GL_DYNAMIC_READ);
-
-    // Same for texture coordinates
-    size_t texCoordBufferSize = sizeof(glm::vec2) * _vertexTexCoords.size();
-    glGenBuffers(1, &_texCoordVbo);
-    glBindBuffer(GL_ARRAY_BUFFER, _texCoordVbo);
-    glBufferData(GL_ARRAY_BUFFER, texCoordBufferSize, _vertexTexCoords.data(), GL_DYNAMIC_READ);
+    clearGPU();
+    std::vector<PackedVertex> vertices;
+    std::vector<unsigned char> indices;
+    packBuffers(vertices, indices);
+
+    // Generate a GPU buffer to store the interleaved vertices, written once and drawn many times
+    // (glBufferStorage would make it immutable, but it needs OpenGL 4.4)
+    glGenBuffers(1, &_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(PackedVertex), vertices.data(), GL_STATIC_DRAW);
 
     // Same for the index buffer that stores the list of indices of the triangles forming the mesh
-    size_t indexBufferSize = sizeof(glm::uvec3) * _triangleIndices.size();
     glGenBuffers(1, &_ibo);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ibo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, _triangleIndices.data(), GL_DYNAMIC_READ);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size(), indices.data(), GL_STATIC_DRAW);
 
     // Create a single handle that joins together attributes (vertex positions, normals) and connectivity (triangles indices)
     glGenVertexArrays(1, &_vao);
     glBindVertexArray(_vao);
 
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, _posVbo);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
-
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, _normalVbo);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
-
-    glEnableVertexAttribArray(2);
-    glBindBuffer(GL_ARRAY_BUFFER, _texCoordVbo);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), 0);
+    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    setPackedVertexAttributes();
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ibo);
 
@@ -309,7 +268,12 @@ void Mesh::init()
 void Mesh::render()
 {
     glBindVertexArray(_vao); // Activate the VAO storing geometry data
-    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_triangleIndices.size() * 3), GL_UNSIGNED_INT, 0);
+    draw();
+}
+
+void Mesh::draw() const
+{
+    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_triangleIndices.size() * 3), _indexType, 0);
     // Call for rendering: stream the current GPU geometry through the current GPU program
 }
 
@@ -319,25 +283,20 @@ void Mesh::clear()
     _vertexNormals.clear();
     _vertexTexCoords.clear();
     _triangleIndices.clear();
+    clearGPU();
+}
+
+void Mesh::clearGPU()
+{
     if (_vao)
     {
         glDeleteVertexArrays(1, &_vao);
         _vao = 0;
     }
-    if (_posVbo)
-    {
-        glDeleteBuffers(1, &_posVbo);
-        _posVbo = 0;
-    }
-    if (_normalVbo)
-    {
-        glDeleteBuffers(1, &_normalVbo);
-        _normalVbo = 0;
-    }
-    if (_texCoordVbo)
+    if (_vbo)
     {
-        glDeleteBuffers(1, &_texCoordVbo);
-        _texCoordVbo = 0;
+        glDeleteBuffers(1, &_vbo);
+        _vbo = 0;
     }
     if (_ibo)
     {
@@ -9,6 +9,8 @@
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
+#include "VertexFormat.h"
+
 class Mesh
 {
 public:
@@ -36,6 +38,9 @@ public:
 
     void init();
     void render();
+    // As render(), with vertexArray() already bound, e.g. by a RenderState
+    void draw() const;
+    GLuint vertexArray() const { return _vao; }
     void clear();
 
     void addPlane(const float square_half_side = 1.0f);
@@ -47,11 +52,13 @@ private:
     std::vector<glm::vec2> _vertexTexCoords;
     std::vector<glm::uvec3> _triangleIndices;
 
+    void packBuffers(std::vector<PackedVertex> &vertices, std::vector<unsigned char> &indices);
+    void clearGPU();
+
     GLuint _vao = 0;
-    GLuint _posVbo = 0;
-    GLuint _normalVbo = 0;
-    GLuint _texCoordVbo = 0;
+    GLuint _vbo = 0; // interleaved PackedVertex
     GLuint _ibo = 0;
+    GLenum _indexType = GL_UNSIGNED_INT;
 };
 
 // utility: loader
@@ -0,0 +1,444 @@
+#include "Profiler.h"
+
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+// 3x5 pixel font, rows from the top, 3 bits per row with the left pixel in the highest bit.
+// Lower case letters are drawn in upper case, DEL (127) is a full block used for the bars.
+struct Glyph
+{
+    char c;
+    uint16_t rows;
+};
+
+#define GLYPH(c, r0, r1, r2, r3, r4) {c, (0##r0 << 12) | (0##r1 << 9) | (0##r2 << 6) | (0##r3 << 3) | 0##r4}
+
+// rows written as octal digits of 3 bits, e.g. 7 = 111, 5 = 101
+const Glyph font[] = {
+    GLYPH('0', 7, 5, 5, 5, 7), GLYPH('1', 2, 6, 2, 2, 7), GLYPH('2', 7, 1, 7, 4, 7), GLYPH('3', 7, 1, 7, 1, 7),
+    GLYPH('4', 5, 5, 7, 1, 1), GLYPH('5', 7, 4, 7, 1, 7), GLYPH('6', 7, 4, 7, 5, 7), GLYPH('7', 7, 1, 1, 1, 1),
+    GLYPH('8', 7, 5, 7, 5, 7), GLYPH('9', 7, 5, 7, 1, 7),
+    GLYPH('A', 2, 5, 7, 5, 5), GLYPH('B', 6, 5, 6, 5, 6), GLYPH('C', 3, 4, 4, 4, 3), GLYPH('D', 6, 5, 5, 5, 6),
+    GLYPH('E', 7, 4, 6, 4, 7), GLYPH('F', 7, 4, 6, 4, 4), GLYPH('G', 3, 4, 5, 5, 3), GLYPH('H', 5, 5, 7, 5, 5),
+    GLYPH('I', 7, 2, 2, 2, 7), GLYPH('J', 1, 1, 1, 5, 2), GLYPH('K', 5, 5, 6, 5, 5), GLYPH('L', 4, 4, 4, 4, 7),
+    GLYPH('M', 5, 7, 7, 5, 5), GLYPH('N', 6, 5, 5, 5, 5), GLYPH('O', 2, 5, 5, 5, 2), GLYPH('P', 6, 5, 6, 4, 4),
+    GLYPH('Q', 2, 5, 5, 6, 3), GLYPH('R', 6, 5, 6, 5, 5), GLYPH('S', 3, 4, 2, 1, 6), GLYPH('T', 7, 2, 2, 2, 2),
+    GLYPH('U', 5, 5, 5, 5, 7), GLYPH('V', 5, 5, 5, 5, 2), GLYPH('W', 5, 5, 7, 7, 5), GLYPH('X', 5, 5, 2, 5, 5),
+    GLYPH('Y', 5, 5, 2, 2, 2), GLYPH('Z', 7, 1, 2, 4, 7),
+    GLYPH('.', 0, 0, 0, 0, 2), GLYPH(':', 0, 2, 0, 2, 0), GLYPH('-', 0, 0, 7, 0, 0), GLYPH('_', 0, 0, 0, 0, 7),
+    GLYPH('/', 1, 1, 2, 4, 4), GLYPH('(', 1, 2, 2, 2, 1), GLYPH(')', 4, 2, 2, 2, 4), GLYPH('%', 5, 1, 2, 4, 5),
+    GLYPH('?', 7, 1, 2, 0, 2), GLYPH('<', 1, 2, 4, 2, 1), GLYPH('>', 4, 2, 1, 2, 4), GLYPH('\x7f', 7, 7, 7, 7, 7)};
+
+#undef GLYPH
+
+// glyph cells of the font texture: 4x6 texels for the characters 32 to 127
+const int firstChar = 32;
+const int numChars = 96;
+const int cellWidth = 4;
+const int cellHeight = 6;
+
+// size of a font texel on screen, in pixels
+const float textScale = 2.0f;
+const float charAdvance = cellWidth * textScale;
+const float lineHeight = (cellHeight + 1) * textScale;
+
+struct OverlayVertex
+{
+    float x, y; // pixels from the top left corner
+    float u, v;
+    unsigned char color[4];
+};
+
+void addQuad(std::vector<OverlayVertex> &vertices, float x, float y, float w, float h,
+             float u0, float v0, float u1, float v1, const unsigned char color[4])
+{
+    const OverlayVertex corners[4] = {
+        {x, y, u0, v0, {color[0], color[1], color[2], color[3]}},
+        {x + w, y, u1, v0, {color[0], color[1], color[2], color[3]}},
+        {x + w, y + h, u1, v1, {color[0], color[1], color[2], color[3]}},
+        {x, y + h, u0, v1, {color[0], color[1], color[2], color[3]}}};
+    const int order[6] = {0, 1, 2, 0, 2, 3};
+    for (int i : order)
+        vertices.push_back(corners[i]);
+}
+
+void addText(std::vector<OverlayVertex> &vertices, float x, float y, const char *text, const unsigned char color[4])
+{
+    for (; *text; ++text, x += charAdvance)
+    {
+        int c = std::toupper(static_cast<unsigned char>(*text));
+        if (c == ' ')
+            continue;
+        if (c < firstChar || c >= firstChar + numChars)
+            c = '?';
+        const float u0 = static_cast<float>((c - firstChar) * cellWidth) / (numChars * cellWidth);
+        const float u1 = u0 + 3.0f / (numChars * cellWidth);
+        addQuad(vertices, x, y, 3 * textScale, 5 * textScale, u0, 0.0f, u1, 5.0f / cellHeight, color);
+    }
+}
+
+void addBar(std::vector<OverlayVertex> &vertices, float x, float y, float w, float h, const unsigned char color[4])
+{
+    // the middle of the full block glyph
+    const float u = (0x7f - firstChar + 0.5f) * cellWidth / (numChars * cellWidth);
+    const float v = 2.5f / cellHeight;
+    addQuad(vertices, x, y, w, h, u, v, u, v, color);
+}
+
+// exponential moving average, the first value is taken as is
+double smooth(double average, double value)
+{
+    return average < 0 ? value : average + 0.05 * (value - average);
+}
+} // namespace
+
+Profiler::Profiler() : _epoch(std::chrono::steady_clock::now())
+{
+}
+
+Profiler::~Profiler()
+{
+    for (GpuFrame &gpuFrame : _gpuFrames)
+        if (!gpuFrame.queries.empty())
+            glDeleteQueries(static_cast<GLsizei>(gpuFrame.queries.size()), gpuFrame.queries.data());
+    if (_fontTexture)
+        glDeleteTextures(1, &_fontTexture);
+    if (_overlayVbo)
+        glDeleteBuffers(1, &_overlayVbo);
+    if (_overlayVao)
+        glDeleteVertexArrays(1, &_overlayVao);
+}
+
+double Profiler::now() const
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - _epoch).count();
+}
+
+void Profiler::beginFrame()
+{
+    const double t = now();
+    if (_frameStart >= 0)
+        _frameTime = smooth(_frameTime, (t - _frameStart) / 1000.0);
+    _frameStart = t;
+    ++_frame;
+
+    // the queries of numGpuFrames frames ago, normally done by now
+    _gpuFrame = &_gpuFrames[_frame % numGpuFrames];
+    resolve(*_gpuFrame);
+    _gpuFrame->used = 0;
+    _gpuFrame->frame = _frame;
+    _gpuFrame->cpuTime = now();
+    glGetInteger64v(GL_TIMESTAMP, &_gpuFrame->gpuTime);
+
+    if (tracing() && _frame >= _traceEndFrame + numGpuFrames - 1)
+        writeTrace();
+}
+
+void Profiler::endFrame()
+{
+    while (!_stack.empty())
+        pop();
+
+    Event frame = {"frame", 0, false, _frameStart, now() - _frameStart};
+    record(frame, _frame);
+
+    // sums over the frame of the scopes with the same name and depth
+    for (Stat &s : _stats)
+        s.cpuFrame = 0;
+    for (const Event &event : _frameEvents)
+        stat(event.name, event.depth).cpuFrame += event.duration / 1000.0;
+    for (Stat &s : _stats)
+        s.cpu = smooth(s.cpu, s.cpuFrame);
+    _frameEvents.clear();
+}
+
+void Profiler::push(const char *name, Target target)
+{
+    OpenScope scope;
+    scope.name = name;
+    scope.target = target;
+    scope.query = static_cast<size_t>(-1);
+    stat(name, static_cast<unsigned int>(_stack.size())); // listed in the order the scopes are opened
+
+    if (target == CPU_GPU && _gpuFrame)
+    {
+        GpuFrame &gpuFrame = *_gpuFrame;
+        if (2 * gpuFrame.used + 2 > gpuFrame.queries.size())
+        {
+            GLuint queries[2];
+            glGenQueries(2, queries);
+            gpuFrame.queries.push_back(queries[0]);
+            gpuFrame.queries.push_back(queries[1]);
+            gpuFrame.names.push_back(nullptr);
+            gpuFrame.depths.push_back(0);
+        }
+        scope.query = gpuFrame.used++;
+        gpuFrame.names[scope.query] = name;
+        gpuFrame.depths[scope.query] = static_cast<unsigned int>(_stack.size());
+        gpuFrame.pending = true;
+        glQueryCounter(gpuFrame.queries[2 * scope.query], GL_TIMESTAMP);
+    }
+
+    scope.start = now();
+    _stack.push_back(scope);
+}
+
+void Profiler::pop()
+{
+    if (_stack.empty())
+        return;
+    const OpenScope scope = _stack.back();
+    _stack.pop_back();
+
+    const Event event = {scope.name, static_cast<unsigned int>(_stack.size()), false, scope.start, now() - scope.start};
+    if (scope.query != static_cast<size_t>(-1))
+        glQueryCounter(_gpuFrame->queries[2 * scope.query + 1], GL_TIMESTAMP);
+    _frameEvents.push_back(event);
+    record(event, _frame);
+}
+
+void Profiler::resolve(GpuFrame &gpuFrame)
+{
+    if (!gpuFrame.pending)
+        return;
+    gpuFrame.pending = false;
+
+    // never wait: a frame the GPU has not finished yet is dropped
+    for (size_t i = 0; i < 2 * gpuFrame.used; ++i)
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(gpuFrame.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            ++_droppedGpuFrames;
+            return;
+        }
+    }
+
+    for (Stat &s : _stats)
+        s.gpuFrame = -1;
+    for (size_t i = 0; i < gpuFrame.used; ++i)
+    {
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(gpuFrame.queries[2 * i], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(gpuFrame.queries[2 * i + 1], GL_QUERY_RESULT, &end);
+        // on the CPU time line, from the clocks read at the beginning of the frame
+        const Event event = {gpuFrame.names[i], gpuFrame.depths[i], true,
+                             gpuFrame.cpuTime + (static_cast<GLint64>(begin) - gpuFrame.gpuTime) / 1000.0,
+                             (end - begin) / 1000.0};
+        record(event, gpuFrame.frame);
+        Stat &s = stat(event.name, event.depth);
+        s.gpuFrame = std::max(s.gpuFrame, 0.0) + event.duration / 1000.0;
+    }
+    for (Stat &s : _stats)
+        if (s.gpuFrame >= 0)
+            s.gpu = smooth(s.gpu, s.gpuFrame);
+}
+
+void Profiler::record(const Event &event, uint64_t frame)
+{
+    if (tracing() && frame >= _traceFirstFrame && frame < _traceEndFrame)
+        _traceEvents.push_back(event);
+}
+
+Profiler::Stat &Profiler::stat(const char *name, unsigned int depth)
+{
+    for (Stat &s : _stats)
+        if (s.depth == depth && (s.name == name || std::strcmp(s.name, name) == 0))
+            return s;
+    Stat s;
+    s.name = name;
+    s.depth = depth;
+    _stats.push_back(s);
+    return _stats.back();
+}
+
+void Profiler::traceFrames(const std::string &filename, unsigned int numFrames)
+{
+    if (tracing() || numFrames == 0)
+        return;
+    _traceFilename = filename;
+    _traceFirstFrame = _frame + 1;
+    _traceEndFrame = _traceFirstFrame + numFrames;
+    _traceEvents.clear();
+}
+
+void Profiler::writeTrace()
+{
+    std::ofstream output(_traceFilename.c_str());
+    if (!output)
+    {
+        std::cerr << "[Profiler][writeTrace] Cannot write " << _traceFilename << std::endl;
+    }
+    else
+    {
+        // complete events ("X") in us, the CPU scopes on thread 1 and the GPU passes on thread 2
+        output << "{\"traceEvents\":[" << std::endl
+               << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}}," << std::endl
+               << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+        char line[256];
+        for (const Event &event : _traceEvents)
+        {
+            std::snprintf(line, sizeof(line),
+                          ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                          event.name, event.gpu ? "gpu" : "cpu", event.start, event.duration, event.gpu ? 2 : 1);
+            output << line;
+        }
+        output << std::endl
+               << "],\"displayTimeUnit\":\"ms\"}" << std::endl;
+        std::cout << "Trace of " << _traceEndFrame - _traceFirstFrame << " frames written to " << _traceFilename
+                  << std::endl;
+    }
+    _traceFilename.clear();
+    _traceEvents.clear();
+}
+
+void Profiler::setOverlayProgram(const std::shared_ptr<ShaderProgram> &program)
+{
+    _overlayProgram = program;
+    _overlayScreenSize = program->uniform<glm::vec2>("screenSize");
+    _overlayFont = program->uniform<int>("font");
+
+    // one row of glyph cells, rows from the top
+    std::vector<unsigned char> texels(numChars * cellWidth * cellHeight, 0);
+    for (const Glyph &glyph : font)
+    {
+        const int x0 = (glyph.c - firstChar) * cellWidth;
+        for (int row = 0; row < 5; ++row)
+            for (int col = 0; col < 3; ++col)
+                if (glyph.rows & (1 << ((4 - row) * 3 + (2 - col))))
+                    texels[row * numChars * cellWidth + x0 + col] = 255;
+    }
+
+    GLint previous, alignment;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glGenTextures(1, &_fontTexture);
+    glBindTexture(GL_TEXTURE_2D, _fontTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, numChars * cellWidth, cellHeight, 0, GL_RED, GL_UNSIGNED_BYTE, texels.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    glBindTexture(GL_TEXTURE_2D, previous);
+
+    GLint previousVao;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVao);
+    glGenVertexArrays(1, &_overlayVao);
+    glGenBuffers(1, &_overlayVbo);
+    glBindVertexArray(_overlayVao);
+    glBindBuffer(GL_ARRAY_BUFFER, _overlayVbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(OverlayVertex), (void *)offsetof(OverlayVertex, x));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(OverlayVertex), (void *)offsetof(OverlayVertex, u));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(OverlayVertex), (void *)offsetof(OverlayVertex, color));
+    glBindVertexArray(previousVao);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Profiler::drawOverlay(int width, int height)
+{
+    if (!_overlayVisible || !_overlayProgram || width <= 0 || height <= 0)
+        return;
+
+    static const unsigned char background[4] = {0, 0, 0, 160};
+    static const unsigned char white[4] = {255, 255, 255, 255};
+    static const unsigned char grey[4] = {170, 170, 170, 255};
+    static const unsigned char cpuColor[4] = {90, 220, 90, 255};
+    static const unsigned char gpuColor[4] = {250, 160, 50, 255};
+    const int nameColumns = 22;
+    const float barWidth = 120.0f; // for a full frame
+
+    std::vector<OverlayVertex> vertices;
+    const float x = 8.0f + 4.0f, lineCount = static_cast<float>(_stats.size() + 2);
+    const float panelWidth = (nameColumns + 18) * charAdvance + barWidth + 16.0f;
+    addBar(vertices, 8.0f, 8.0f, panelWidth, lineCount * lineHeight + 8.0f, background);
+
+    char line[128];
+    float y = 12.0f;
+    std::snprintf(line, sizeof(line), "frame %7.2f ms %6.1f fps%s", frameTime(),
+                  frameTime() > 0 ? 1000.0 / frameTime() : 0.0, tracing() ? "  tracing" : "");
+    addText(vertices, x, y, line, white);
+    y += lineHeight;
+    std::snprintf(line, sizeof(line), "%-*s  cpu ms   gpu ms", nameColumns, "");
+    addText(vertices, x, y, line, grey);
+    y += lineHeight;
+
+    for (const Stat &s : _stats)
+    {
+        char gpu[16] = "      -";
+        if (s.gpu >= 0)
+            std::snprintf(gpu, sizeof(gpu), "%7.2f", s.gpu);
+        std::snprintf(line, sizeof(line), "%*s%-*.*s %7.2f  %s", 2 * s.depth, "",
+                      std::max(nameColumns - 2 * static_cast<int>(s.depth), 1),
+                      std::max(nameColumns - 2 * static_cast<int>(s.depth), 1), s.name, std::max(s.cpu, 0.0), gpu);
+        addText(vertices, x, y, line, white);
+
+        const float barX = x + (nameColumns + 18) * charAdvance;
+        const float frame = static_cast<float>(std::max(frameTime(), 1e-3));
+        addBar(vertices, barX, y, barWidth * std::min(static_cast<float>(std::max(s.cpu, 0.0)) / frame, 1.0f),
+               2.0f * textScale, cpuColor);
+        if (s.gpu >= 0)
+            addBar(vertices, barX, y + 3.0f * textScale, barWidth * std::min(static_cast<float>(s.gpu) / frame, 1.0f),
+                   2.0f * textScale, gpuColor);
+        y += lineHeight;
+    }
+
+    // state changed here, restored at the end
+    GLint previousProgram, previousVao, previousTexture, activeTexture, polygonMode[2];
+    glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVao);
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+    glGetIntegerv(GL_POLYGON_MODE, polygonMode);
+    const GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    const GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+    const GLboolean blend = glIsEnabled(GL_BLEND);
+
+    // last unit of the 16 every GL 3.3 implementation has, the apps take the first ones
+    const GLint fontUnit = 15;
+    glActiveTexture(GL_TEXTURE0 + fontUnit);
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+    glBindTexture(GL_TEXTURE_2D, _fontTexture);
+
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+    _overlayProgram->use();
+    _overlayScreenSize.set(glm::vec2(width, height));
+    _overlayFont.set(fontUnit);
+
+    const GLsizeiptr size = static_cast<GLsizeiptr>(vertices.size() * sizeof(OverlayVertex));
+    glBindVertexArray(_overlayVao);
+    glBindBuffer(GL_ARRAY_BUFFER, _overlayVbo);
+    glBufferData(GL_ARRAY_BUFFER, std::max(size, _overlayVboSize), nullptr, GL_STREAM_DRAW); // orphan
+    _overlayVboSize = std::max(size, _overlayVboSize);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, vertices.data());
+    glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(vertices.size()));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindVertexArray(previousVao);
+    glUseProgram(previousProgram);
+    glBindTexture(GL_TEXTURE_2D, previousTexture);
+    glActiveTexture(activeTexture);
+    glPolygonMode(GL_FRONT_AND_BACK, polygonMode[0]);
+    if (depthTest)
+        glEnable(GL_DEPTH_TEST);
+    if (cullFace)
+        glEnable(GL_CULL_FACE);
+    if (!blend)
+        glDisable(GL_BLEND);
+}
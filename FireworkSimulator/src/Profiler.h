@@ -0,0 +1,153 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/gl.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+
+#include "ShaderProgram.h"
+
+// Frame profiler: nested CPU scopes, GPU passes timed with GL timestamp queries, an on-screen
+// overlay of the smoothed timings and Chrome trace files (chrome://tracing, ui.perfetto.dev).
+//
+// The queries of a frame are read back when their set comes around again, numGpuFrames frames
+// later: if the GPU has not reached them by then, their results are dropped instead of waiting.
+class Profiler
+{
+public:
+    enum Target
+    {
+        CPU = 0,    // the scope is timed on the CPU only
+        CPU_GPU = 1 // the GL commands issued in the scope are timed on the GPU as well
+    };
+
+    // A valid OpenGL context must be active
+    Profiler();
+    ~Profiler();
+
+    // Frame boundaries, e.g. around the body of the main loop
+    void beginFrame();
+    void endFrame();
+
+    // Nested scopes, see ProfileScope. name must outlive the profiler, e.g. a string literal.
+    void push(const char *name, Target target = CPU);
+    void pop();
+
+    // On-screen text, drawn with the given program (profilerVertexShader.glsl / profilerFragmentShader.glsl)
+    void setOverlayProgram(const std::shared_ptr<ShaderProgram> &program);
+    void toggleOverlay() { _overlayVisible = !_overlayVisible; }
+    // Draw the overlay into the current framebuffer if visible, before the buffers are swapped
+    void drawOverlay(int width, int height);
+
+    // Record the next numFrames frames into a Chrome trace JSON file, written once the GPU
+    // timings of the last frame are known
+    void traceFrames(const std::string &filename, unsigned int numFrames);
+    bool tracing() const { return !_traceFilename.empty(); }
+
+    // Smoothed time of the frame, from one beginFrame to the next, in ms
+    double frameTime() const { return _frameTime < 0 ? 0 : _frameTime; }
+    uint64_t numDroppedGpuFrames() const { return _droppedGpuFrames; }
+
+private:
+    Profiler(const Profiler &) = delete;
+    Profiler &operator=(const Profiler &) = delete;
+
+    static const unsigned int numGpuFrames = 2;
+
+    struct Event
+    {
+        const char *name;
+        unsigned int depth;
+        bool gpu;
+        double start;    // in us since the creation of the profiler
+        double duration; // in us
+    };
+
+    struct OpenScope
+    {
+        const char *name;
+        Target target;
+        double start;
+        size_t query; // index of the query pair in the frame set
+    };
+
+    struct GpuFrame
+    {
+        std::vector<GLuint> queries; // begin and end of each pass
+        std::vector<const char *> names;
+        std::vector<unsigned int> depths;
+        size_t used = 0;             // pairs of queries issued this frame
+        uint64_t frame = 0;
+        double cpuTime = 0;          // CPU and GPU clocks at the beginning of the frame
+        GLint64 gpuTime = 0;
+        bool pending = false;
+    };
+
+    // Smoothed timings shown in the overlay, in the order the scopes were first seen
+    struct Stat
+    {
+        const char *name;
+        unsigned int depth;
+        double cpu = -1;      // ms
+        double gpu = -1;      // ms, negative if not timed on the GPU
+        double cpuFrame = 0;  // sums over the last frame
+        double gpuFrame = -1;
+    };
+
+    double now() const;
+    void resolve(GpuFrame &gpuFrame);
+    void record(const Event &event, uint64_t frame);
+    Stat &stat(const char *name, unsigned int depth);
+    void writeTrace();
+
+    std::chrono::steady_clock::time_point _epoch;
+    uint64_t _frame = 0;
+    double _frameStart = -1;
+    double _frameTime = -1;
+    std::vector<OpenScope> _stack;
+    GpuFrame _gpuFrames[numGpuFrames];
+    GpuFrame *_gpuFrame = nullptr;
+    uint64_t _droppedGpuFrames = 0;
+
+    std::vector<Stat> _stats;
+    std::vector<Event> _frameEvents;
+
+    // trace being recorded
+    std::string _traceFilename;
+    uint64_t _traceFirstFrame = 0;
+    uint64_t _traceEndFrame = 0; // first frame not recorded
+    std::vector<Event> _traceEvents;
+
+    // overlay
+    bool _overlayVisible = false;
+    std::shared_ptr<ShaderProgram> _overlayProgram;
+    ShaderProgram::Uniform<glm::vec2> _overlayScreenSize;
+    ShaderProgram::Uniform<int> _overlayFont;
+    GLuint _fontTexture = 0;
+    GLuint _overlayVao = 0;
+    GLuint _overlayVbo = 0;
+    GLsizeiptr _overlayVboSize = 0;
+};
+
+// Times the enclosing block
+class ProfileScope
+{
+public:
+    ProfileScope(Profiler &profiler, const char *name, Profiler::Target target = Profiler::CPU) : _profiler(profiler)
+    {
+        _profiler.push(name, target);
+    }
+    ~ProfileScope() { _profiler.pop(); }
+
+private:
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+    Profiler &_profiler;
+};
+
+#endif // PROFILER_H
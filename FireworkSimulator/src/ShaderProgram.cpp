@@ -1,4 +1,5 @@
 #include "ShaderProgram.h"
+#include "UniformBuffer.h"
 
 #include <iostream>
 #include <fstream>
@@ -6,6 +7,57 @@
 
 #include <exception>
 #include <ios>
+#include <cstring>
+#include <cstdio>
+#include <iomanip>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#elif defined(_WIN32)
+#include <direct.h>
+#endif
+
+// GL_ARB_get_program_binary, core in OpenGL 4.1, is not part of the 3.3 loader
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+namespace
+{
+typedef void(KHRONOS_APIENTRY *GetProgramBinaryProc)(GLuint, GLsizei, GLsizei *, GLenum *, void *);
+typedef void(KHRONOS_APIENTRY *ProgramBinaryProc)(GLuint, GLenum, const void *, GLsizei);
+typedef void(KHRONOS_APIENTRY *ProgramParameteriProc)(GLuint, GLenum, GLint);
+
+struct BinaryCache
+{
+    std::string dir; // empty while disabled
+    std::string driver;
+    GetProgramBinaryProc getProgramBinary = nullptr;
+    ProgramBinaryProc programBinary = nullptr;
+    ProgramParameteriProc programParameteri = nullptr;
+} g_binaryCache;
+
+const char programBinaryMagic[8] = {'G', 'L', 'P', 'R', 'O', 'G', 'B', 'N'};
+
+struct ProgramBinaryHeader
+{
+    char magic[8]; // "GLPROGBN"
+    uint32_t format;
+    uint32_t length;
+};
+
+std::string glString(GLenum name)
+{
+    const GLubyte *s = glGetString(name);
+    return s ? std::string(reinterpret_cast<const char *>(s)) : std::string();
+}
+} // namespace
 
 // Create a GPU program i.e., a graphics pipeline
 ShaderProgram::ShaderProgram() : _id(glCreateProgram()) {}
@@ -27,9 +79,13 @@ std::string ShaderProgram::file2String(const std::string &filename)
 
 void ShaderProgram::loadShader(GLenum type, const std::string &shaderFilename)
 {
-    // Loads and compile a shader, before attaching it to a program
-    GLuint shader = glCreateShader(type);                         // Create the shader, e.g., a vertex shader to be applied to every single vertex of a mesh
-    std::string shaderSourceString = file2String(shaderFilename); // Loads the shader source from a file to a C++ string
+    compileShader(type, file2String(shaderFilename), shaderFilename); // Loads the shader source from a file to a C++ string
+}
+
+void ShaderProgram::compileShader(GLenum type, const std::string &shaderSourceString, const std::string &shaderFilename)
+{
+    // Compile a shader, before attaching it to a program
+    GLuint shader = glCreateShader(type); // Create the shader, e.g., a vertex shader to be applied to every single vertex of a mesh
     if (shaderSourceString.empty())
     {
         std::cerr << "No content in shader " << shaderFilename << std::endl;
@@ -62,9 +118,271 @@ std::shared_ptr<ShaderProgram> ShaderProgram::genBasicShaderProgram(
     const std::string &fragmentShaderFilename)
 {
     std::shared_ptr<ShaderProgram> shaderProgramPtr = std::make_shared<ShaderProgram>();
-    shaderProgramPtr->loadShader(GL_VERTEX_SHADER, vertexShaderFilename);
-    shaderProgramPtr->loadShader(GL_FRAGMENT_SHADER, fragmentShaderFilename);
-    shaderProgramPtr->link();
+    const std::string vertexSource = shaderProgramPtr->file2String(vertexShaderFilename);
+    const std::string fragmentSource = shaderProgramPtr->file2String(fragmentShaderFilename);
+
+    const std::string cacheFile = binaryCacheFile(vertexSource, fragmentSource);
+    if (!cacheFile.empty() && shaderProgramPtr->loadBinary(cacheFile))
+    {
+        shaderProgramPtr->setupLinkedProgram();
+    }
+    else
+    {
+        shaderProgramPtr->compileShader(GL_VERTEX_SHADER, vertexSource, vertexShaderFilename);
+        shaderProgramPtr->compileShader(GL_FRAGMENT_SHADER, fragmentSource, fragmentShaderFilename);
+        if (!cacheFile.empty())
+            g_binaryCache.programParameteri(shaderProgramPtr->_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        shaderProgramPtr->link();
+        if (!cacheFile.empty())
+            shaderProgramPtr->saveBinary(cacheFile);
+    }
     shaderProgramPtr->use();
     return shaderProgramPtr;
 }
+
+bool ShaderProgram::enableBinaryCache(const std::string &cacheDir, ProcAddressLoader load)
+{
+    g_binaryCache = BinaryCache();
+
+    // glGetIntegerv leaves the value untouched on drivers without the enum
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    while (glGetError() != GL_NO_ERROR)
+        ;
+    if (cacheDir.empty() || numFormats <= 0)
+        return false;
+
+    g_binaryCache.getProgramBinary = reinterpret_cast<GetProgramBinaryProc>(load("glGetProgramBinary"));
+    g_binaryCache.programBinary = reinterpret_cast<ProgramBinaryProc>(load("glProgramBinary"));
+    g_binaryCache.programParameteri = reinterpret_cast<ProgramParameteriProc>(load("glProgramParameteri"));
+    if (!g_binaryCache.getProgramBinary || !g_binaryCache.programBinary || !g_binaryCache.programParameteri)
+    {
+        g_binaryCache = BinaryCache();
+        return false;
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    mkdir(cacheDir.c_str(), 0755);
+#elif defined(_WIN32)
+    _mkdir(cacheDir.c_str());
+#endif
+    g_binaryCache.dir = cacheDir;
+    // a binary is only valid for the driver that produced it
+    g_binaryCache.driver = glString(GL_VENDOR) + "\n" + glString(GL_RENDERER) + "\n" + glString(GL_VERSION) + "\n" +
+                           glString(GL_SHADING_LANGUAGE_VERSION);
+    return true;
+}
+
+std::string ShaderProgram::binaryCacheFile(const std::string &vertexSource, const std::string &fragmentSource)
+{
+    if (g_binaryCache.dir.empty())
+        return std::string();
+    const std::string key = g_binaryCache.driver + "\n#vertex\n" + vertexSource + "\n#fragment\n" + fragmentSource;
+    std::stringstream filename;
+    filename << g_binaryCache.dir << "/" << std::hex << std::setw(16) << std::setfill('0') << hashName(key.c_str())
+             << ".glbin";
+    return filename.str();
+}
+
+bool ShaderProgram::loadBinary(const std::string &filename)
+{
+    std::FILE *file = std::fopen(filename.c_str(), "rb");
+    if (!file)
+        return false;
+    ProgramBinaryHeader header;
+    std::vector<char> binary;
+    bool ok = std::fread(&header, sizeof(header), 1, file) == 1 &&
+              std::memcmp(header.magic, programBinaryMagic, sizeof(programBinaryMagic)) == 0 && header.length > 0;
+    if (ok)
+    {
+        binary.resize(header.length);
+        ok = std::fread(binary.data(), binary.size(), 1, file) == 1;
+    }
+    std::fclose(file);
+    if (!ok)
+        return false;
+
+    g_binaryCache.programBinary(_id, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+    GLint linked = GL_FALSE;
+    glGetProgramiv(_id, GL_LINK_STATUS, &linked);
+    if (!linked)
+    {
+        // e.g. after a driver update that kept the same version strings
+        std::cerr << "[Shader Program][loadBinary] " << filename << " rejected by the driver, compiling" << std::endl;
+        while (glGetError() != GL_NO_ERROR)
+            ;
+        return false;
+    }
+    return true;
+}
+
+void ShaderProgram::saveBinary(const std::string &filename) const
+{
+    GLint linked = GL_FALSE, length = 0;
+    glGetProgramiv(_id, GL_LINK_STATUS, &linked);
+    glGetProgramiv(_id, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (!linked || length <= 0)
+        return;
+
+    ProgramBinaryHeader header;
+    std::memcpy(header.magic, programBinaryMagic, sizeof(programBinaryMagic));
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    g_binaryCache.getProgramBinary(_id, length, &length, &format, binary.data());
+    header.format = format;
+    header.length = static_cast<uint32_t>(length);
+
+    // written under a temporary name first, so that a partial file is never loaded
+    const std::string tmpFilename = filename + ".tmp";
+    std::FILE *file = std::fopen(tmpFilename.c_str(), "wb");
+    bool ok = file && std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+              std::fwrite(binary.data(), header.length, 1, file) == 1;
+    if (file)
+        ok = std::fclose(file) == 0 && ok;
+    if (!ok || std::rename(tmpFilename.c_str(), filename.c_str()) != 0)
+    {
+        std::remove(tmpFilename.c_str());
+        std::cerr << "[Shader Program][saveBinary] Cannot write " << filename << std::endl;
+    }
+}
+
+void ShaderProgram::link()
+{
+    glLinkProgram(_id);
+    GLint linked;
+    glGetProgramiv(_id, GL_LINK_STATUS, &linked);
+    if (!linked)
+    {
+        GLsizei len;
+        glGetProgramiv(_id, GL_INFO_LOG_LENGTH, &len);
+        std::vector<GLchar> log(len + 1, 0);
+        glGetProgramInfoLog(_id, len, &len, log.data());
+        std::cerr << "Link error in shader program " << _id << " : " << std::endl
+                  << log.data() << std::endl;
+    }
+    setupLinkedProgram();
+}
+
+void ShaderProgram::setupLinkedProgram()
+{
+    reflectUniforms();
+
+    // connect the shared blocks to their binding points
+    for (int b = 0; b < NUM_UNIFORM_BLOCK_BINDINGS; ++b)
+    {
+        const GLuint index = glGetUniformBlockIndex(_id, uniformBlockName(static_cast<UniformBlockBinding>(b)));
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(_id, index, b);
+    }
+}
+
+void ShaderProgram::reflectUniforms()
+{
+    _uniformTable.clear();
+    _uniformInfos.clear();
+
+    GLint numUniforms = 0, maxNameLength = 0;
+    glGetProgramiv(_id, GL_ACTIVE_UNIFORMS, &numUniforms);
+    glGetProgramiv(_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+    std::vector<GLchar> nameBuffer(maxNameLength + 1, 0);
+
+    for (GLint i = 0; i < numUniforms; ++i)
+    {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(_id, static_cast<GLuint>(i), maxNameLength, &length, &size, &type, nameBuffer.data());
+        std::string name(nameBuffer.data(), length);
+
+        // members of uniform blocks have no location
+        const GLint location = glGetUniformLocation(_id, name.c_str());
+        if (location < 0)
+            continue;
+
+        // arrays are reported once as "name[0]": register every element, and the bare name
+        const size_t bracket = name.rfind("[0]");
+        if (bracket != std::string::npos && bracket + 3 == name.size())
+        {
+            const std::string base = name.substr(0, bracket);
+            addUniform(base, location, type);
+            addUniform(name, location, type);
+            for (GLint e = 1; e < size; ++e)
+            {
+                const std::string element = base + "[" + std::to_string(e) + "]";
+                addUniform(element, glGetUniformLocation(_id, element.c_str()), type);
+            }
+        }
+        else
+            addUniform(name, location, type);
+    }
+}
+
+void ShaderProgram::addUniform(const std::string &name, GLint location, GLenum type)
+{
+    if (find(name.c_str()))
+        return;
+    UniformInfo info;
+    info.name = name;
+    info.location = location;
+    info.type = type;
+    _uniformTable.insert(std::make_pair(hashName(name.c_str()), _uniformInfos.size()));
+    _uniformInfos.push_back(info);
+}
+
+const ShaderProgram::UniformInfo *ShaderProgram::find(const char *name) const
+{
+    auto range = _uniformTable.equal_range(hashName(name));
+    for (auto it = range.first; it != range.second; ++it)
+        if (std::strcmp(_uniformInfos[it->second].name.c_str(), name) == 0)
+            return &_uniformInfos[it->second];
+    return nullptr;
+}
+
+GLint ShaderProgram::getLocation(const char *name) const
+{
+    const UniformInfo *info = find(name);
+    return info ? info->location : -1;
+}
+
+void ShaderProgram::reportTypeMismatch(const std::string &name) const
+{
+    std::cerr << "[Shader Program][uniform] " << name << " is declared with another type in program " << _id << std::endl;
+}
+
+uint64_t ShaderProgram::hashName(const char *name)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (; *name; ++name)
+    {
+        h ^= static_cast<unsigned char>(*name);
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+bool ShaderProgram::accepts(GLenum type, const int *)
+{
+    // glUniform1i sets integers, booleans and the texture unit of samplers
+    switch (type)
+    {
+    case GL_INT:
+    case GL_BOOL:
+    case GL_SAMPLER_1D:
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_3D:
+    case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_1D_SHADOW:
+    case GL_SAMPLER_2D_SHADOW:
+    case GL_SAMPLER_2D_ARRAY:
+    case GL_SAMPLER_2D_ARRAY_SHADOW:
+    case GL_SAMPLER_CUBE_SHADOW:
+    case GL_SAMPLER_2D_RECT:
+    case GL_SAMPLER_BUFFER:
+    case GL_SAMPLER_2D_MULTISAMPLE:
+    case GL_INT_SAMPLER_2D:
+    case GL_UNSIGNED_INT_SAMPLER_2D:
+        return true;
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,427 @@
+#include "TextureLoader.h"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TEXTURE_CACHE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#elif defined(_WIN32)
+#include <direct.h>
+#endif
+
+namespace
+{
+const char textureCacheMagic[8] = {'T', 'E', 'X', 'C', 'A', 'C', 'H', 'E'};
+const uint32_t textureCacheVersion = 1;
+
+uint64_t fnv1a(const unsigned char *data, const size_t size)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool readFile(const std::string &filename, std::vector<unsigned char> &bytes)
+{
+    std::FILE *file = std::fopen(filename.c_str(), "rb");
+    if (!file)
+        return false;
+    std::fseek(file, 0, SEEK_END);
+    const long size = std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+    bytes.resize(size > 0 ? static_cast<size_t>(size) : 0);
+    const bool ok = !bytes.empty() && std::fread(&bytes[0], bytes.size(), 1, file) == 1;
+    std::fclose(file);
+    return ok;
+}
+
+GLenum textureFormat(const uint32_t channels)
+{
+    // greyscale images are stored in the RED channel
+    return channels == 1 ? GL_RED : channels == 2 ? GL_RG : channels == 3 ? GL_RGB : GL_RGBA;
+}
+
+// Weights of the source texels covered by each texel of a level half the size: 2 texels, or 3
+// when the source size is odd so that every source texel contributes by its covered area
+void boxWeights(const uint32_t size, const uint32_t dstSize, std::vector<uint32_t> &first, std::vector<float> &weights)
+{
+    first.resize(dstSize);
+    weights.assign(3 * dstSize, 0.0f);
+    const double scale = static_cast<double>(size) / dstSize;
+    for (uint32_t i = 0; i < dstSize; ++i)
+    {
+        const double begin = i * scale, end = (i + 1) * scale;
+        first[i] = static_cast<uint32_t>(begin);
+        for (uint32_t k = 0; k < 3 && first[i] + k < size; ++k)
+        {
+            const double texel = first[i] + k;
+            const double covered = std::min(end, texel + 1) - std::max(begin, texel);
+            weights[3 * i + k] = covered > 0 ? static_cast<float>(covered / scale) : 0.0f;
+        }
+    }
+}
+
+// Box filter down to the next level
+void downsample(const unsigned char *src, const uint32_t width, const uint32_t height, const uint32_t channels,
+                unsigned char *dst, const uint32_t dstWidth, const uint32_t dstHeight)
+{
+    std::vector<uint32_t> firstX, firstY;
+    std::vector<float> weightsX, weightsY;
+    boxWeights(width, dstWidth, firstX, weightsX);
+    boxWeights(height, dstHeight, firstY, weightsY);
+
+    std::vector<float> sum(channels);
+    for (uint32_t y = 0; y < dstHeight; ++y)
+    {
+        for (uint32_t x = 0; x < dstWidth; ++x)
+        {
+            std::fill(sum.begin(), sum.end(), 0.0f);
+            for (uint32_t j = 0; j < 3; ++j)
+            {
+                const float wy = weightsY[3 * y + j];
+                if (wy == 0.0f)
+                    continue;
+                const unsigned char *row = src + static_cast<size_t>(firstY[y] + j) * width * channels;
+                for (uint32_t i = 0; i < 3; ++i)
+                {
+                    const float w = wy * weightsX[3 * x + i];
+                    if (w == 0.0f)
+                        continue;
+                    const unsigned char *texel = row + (firstX[x] + i) * channels;
+                    for (uint32_t c = 0; c < channels; ++c)
+                        sum[c] += w * texel[c];
+                }
+            }
+            for (uint32_t c = 0; c < channels; ++c)
+                *dst++ = static_cast<unsigned char>(std::min(sum[c] + 0.5f, 255.0f));
+        }
+    }
+}
+} // namespace
+
+TextureLoader::TextureLoader(const std::string &cacheDir, unsigned int numThreads) : _cacheDir(cacheDir)
+{
+    if (!_cacheDir.empty())
+    {
+#if defined(TEXTURE_CACHE_MMAP)
+        mkdir(_cacheDir.c_str(), 0755);
+#elif defined(_WIN32)
+        _mkdir(_cacheDir.c_str());
+#endif
+    }
+
+    glGenBuffers(1, &_pbo);
+    for (unsigned int i = 0; i < std::max(numThreads, 1u); ++i)
+        _threads.push_back(std::thread(&TextureLoader::run, this));
+}
+
+TextureLoader::~TextureLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+        _requests.clear();
+    }
+    _requested.notify_all();
+    for (std::thread &thread : _threads)
+        thread.join();
+
+    for (Image &image : _ready)
+        release(image);
+    glDeleteBuffers(1, &_pbo);
+}
+
+GLuint TextureLoader::load(const std::string &filename, const glm::u8vec4 &placeholder)
+{
+    GLint previous;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+
+    GLuint texID;
+    glGenTextures(1, &texID);
+    glBindTexture(GL_TEXTURE_2D, texID);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &placeholder[0]);
+    glBindTexture(GL_TEXTURE_2D, previous);
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Request request;
+        request.texture = texID;
+        request.filename = filename;
+        _requests.push_back(request);
+    }
+    _requested.notify_one();
+    ++_pending;
+    return texID;
+}
+
+void TextureLoader::update(size_t maxBytes)
+{
+    size_t uploaded = 0;
+    while (_pending > 0 && uploaded < std::max<size_t>(maxBytes, 1))
+    {
+        Image image;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_ready.empty())
+                return;
+            std::swap(image, _ready.front());
+            _ready.pop_front();
+        }
+        uploaded += image.size;
+        upload(image);
+        release(image);
+        --_pending;
+    }
+}
+
+void TextureLoader::finish()
+{
+    while (_pending > 0)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _decodedImage.wait(lock, [this] { return !_ready.empty(); });
+        }
+        update(~size_t(0));
+    }
+}
+
+void TextureLoader::run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        _requested.wait(lock, [this] { return _stop || !_requests.empty(); });
+        if (_stop)
+            return;
+
+        const Request request = _requests.front();
+        _requests.pop_front();
+        lock.unlock();
+
+        Image image;
+        process(request, image);
+
+        lock.lock();
+        _ready.push_back(Image());
+        std::swap(_ready.back(), image);
+        _decodedImage.notify_all();
+    }
+}
+
+void TextureLoader::process(const Request &request, Image &image) const
+{
+    image.texture = request.texture;
+    image.filename = request.filename;
+
+    std::vector<unsigned char> source;
+    if (!readFile(request.filename, source))
+    {
+        std::cerr << "[TextureLoader][process] Cannot read " << request.filename << std::endl;
+        return;
+    }
+
+    // decoded before under the same hash
+    const uint64_t hash = fnv1a(&source[0], source.size());
+    std::string cachePath;
+    if (!_cacheDir.empty())
+    {
+        std::stringstream path;
+        path << _cacheDir << "/" << std::hex << std::setw(16) << std::setfill('0') << hash << ".tex";
+        cachePath = path.str();
+        if (readCache(cachePath, hash, source.size(), image))
+            return;
+    }
+
+    int width, height, numComponents;
+    unsigned char *data = stbi_load_from_memory(&source[0], static_cast<int>(source.size()),
+                                                &width, &height, &numComponents, 0);
+    if (!data)
+    {
+        // stbi_failure_reason() is shared by all the threads in this version of stb_image
+        std::cerr << "[TextureLoader][process] Cannot decode " << request.filename << std::endl;
+        return;
+    }
+
+    TextureCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, textureCacheMagic, sizeof(textureCacheMagic));
+    header.version = textureCacheVersion;
+    header.channels = static_cast<uint32_t>(numComponents);
+    header.width = static_cast<uint32_t>(width);
+    header.height = static_cast<uint32_t>(height);
+    header.sourceHash = hash;
+    header.sourceSize = source.size();
+
+    // level sizes, down to 1x1
+    uint64_t offset = sizeof(TextureCacheHeader);
+    uint32_t w = header.width, h = header.height;
+    while (header.numLevels < maxTextureLevels)
+    {
+        header.levelOffset[header.numLevels++] = offset;
+        offset += static_cast<uint64_t>(w) * h * header.channels;
+        if (w == 1 && h == 1)
+            break;
+        w = std::max(w / 2, 1u);
+        h = std::max(h / 2, 1u);
+    }
+    header.fileSize = offset;
+
+    // rows kept in the order of the file, as glTexImage2D always received them here
+    image.owned.resize(header.fileSize);
+    std::memcpy(&image.owned[0], &header, sizeof(header));
+    std::memcpy(&image.owned[header.levelOffset[0]], data, static_cast<size_t>(width) * height * numComponents);
+    stbi_image_free(data);
+
+    w = header.width;
+    h = header.height;
+    for (uint32_t level = 1; level < header.numLevels; ++level)
+    {
+        const uint32_t dw = std::max(w / 2, 1u), dh = std::max(h / 2, 1u);
+        downsample(&image.owned[header.levelOffset[level - 1]], w, h, header.channels,
+                   &image.owned[header.levelOffset[level]], dw, dh);
+        w = dw;
+        h = dh;
+    }
+    image.data = &image.owned[0];
+    image.size = image.owned.size();
+
+    if (!cachePath.empty())
+        writeCache(cachePath, image);
+}
+
+bool TextureLoader::readCache(const std::string &path, uint64_t hash, uint64_t sourceSize, Image &image) const
+{
+#ifdef TEXTURE_CACHE_MMAP
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(TextureCacheHeader))
+    {
+        void *data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            image.data = static_cast<const unsigned char *>(data);
+            image.size = static_cast<size_t>(st.st_size);
+            image.mapped = true;
+        }
+    }
+    close(fd);
+#else
+    if (readFile(path, image.owned) && image.owned.size() >= sizeof(TextureCacheHeader))
+    {
+        image.data = &image.owned[0];
+        image.size = image.owned.size();
+    }
+#endif
+    if (!image.data)
+        return false;
+
+    TextureCacheHeader header;
+    std::memcpy(&header, image.data, sizeof(header));
+    if (std::memcmp(header.magic, textureCacheMagic, sizeof(textureCacheMagic)) != 0 ||
+        header.version != textureCacheVersion || header.sourceHash != hash || header.sourceSize != sourceSize ||
+        header.fileSize != image.size || header.numLevels == 0 || header.numLevels > maxTextureLevels ||
+        header.channels == 0 || header.channels > 4)
+    {
+        release(image);
+        return false;
+    }
+    image.fromCache = true;
+    return true;
+}
+
+void TextureLoader::writeCache(const std::string &path, const Image &image) const
+{
+    // written under a temporary name first, so that another process never maps a partial file
+    std::stringstream tmpPath;
+    tmpPath << path << "." << std::this_thread::get_id() << ".tmp";
+    std::FILE *file = std::fopen(tmpPath.str().c_str(), "wb");
+    bool ok = file && std::fwrite(image.data, image.size, 1, file) == 1;
+    if (file)
+        ok = std::fclose(file) == 0 && ok;
+    if (ok)
+        ok = std::rename(tmpPath.str().c_str(), path.c_str()) == 0;
+    if (!ok)
+    {
+        std::remove(tmpPath.str().c_str());
+        std::cerr << "[TextureLoader][writeCache] Cannot write " << path << std::endl;
+    }
+}
+
+void TextureLoader::upload(Image &image)
+{
+    if (!image.data)
+        return; // could not be loaded, the placeholder stays
+    (image.fromCache ? _fromCache : _decoded)++;
+
+    TextureCacheHeader header;
+    std::memcpy(&header, image.data, sizeof(header));
+    const GLenum format = textureFormat(header.channels);
+
+    // all the levels in one copy, the driver transfers them from the buffer asynchronously
+    const size_t first = header.levelOffset[0];
+    const GLsizeiptr size = static_cast<GLsizeiptr>(image.size - first);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!dst)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        std::cerr << "[TextureLoader][upload] Cannot map the pixel buffer for " << image.filename << std::endl;
+        return;
+    }
+    std::memcpy(dst, image.data + first, static_cast<size_t>(size));
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    GLint previous, alignment;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, image.texture);
+    GLsizei w = header.width, h = header.height;
+    for (uint32_t level = 0; level < header.numLevels; ++level)
+    {
+        glTexImage2D(GL_TEXTURE_2D, level, format, w, h, 0, format, GL_UNSIGNED_BYTE,
+                     reinterpret_cast<const void *>(static_cast<uintptr_t>(header.levelOffset[level] - first)));
+        w = std::max(w / 2, 1);
+        h = std::max(h / 2, 1);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header.numLevels - 1);
+    glBindTexture(GL_TEXTURE_2D, previous);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureLoader::release(Image &image)
+{
+#ifdef TEXTURE_CACHE_MMAP
+    if (image.mapped && image.data)
+        munmap(const_cast<unsigned char *>(image.data), image.size);
+#endif
+    image.data = nullptr;
+    image.size = 0;
+    image.mapped = false;
+    std::vector<unsigned char>().swap(image.owned);
+}
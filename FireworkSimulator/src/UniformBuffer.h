@@ -0,0 +1,82 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <glad/gl.h>
+#include <cstddef>
+
+// Binding points of the uniform blocks shared by all the programs. ShaderProgram::link binds the
+// blocks it finds by name, so a buffer bound once to a point is seen by every program.
+enum UniformBlockBinding
+{
+    FRAME_BLOCK_BINDING = 0,  // "FrameBlock": camera and lights, written once per frame
+    OBJECT_BLOCK_BINDING = 1, // "ObjectBlock": per-draw data, from a UniformRingBuffer
+    NUM_UNIFORM_BLOCK_BINDINGS
+};
+
+const char *uniformBlockName(UniformBlockBinding binding);
+
+// A uniform buffer of fixed size bound to a binding point, e.g. for data written once per frame.
+// The C++ struct written to it must follow the std140 layout of the block.
+class UniformBuffer
+{
+public:
+    // A valid OpenGL context must be active
+    UniformBuffer(GLsizeiptr size, GLuint binding);
+    ~UniformBuffer();
+
+    // Replace the content, the previous one may still be read by pending draws
+    void update(const void *data, GLsizeiptr size);
+    template <typename Block>
+    void update(const Block &block) { update(&block, sizeof(Block)); }
+
+    // Bind again to the binding point, e.g. after another buffer was bound there
+    void bind() const;
+
+    GLuint id() const { return _id; }
+
+private:
+    UniformBuffer(const UniformBuffer &) = delete;
+    UniformBuffer &operator=(const UniformBuffer &) = delete;
+
+    GLuint _id = 0;
+    GLsizeiptr _size;
+    GLuint _binding;
+};
+
+// Blocks of a fixed size written one after the other in a single buffer, for per-draw data.
+// Each frame starts on a fresh storage with beginFrame(), the old one being orphaned: the driver
+// keeps it alive for the draws in flight, so that the blocks are written without synchronization
+// and bound with glBindBufferRange. The ring never wraps within a frame: an offset returned by
+// push() stays valid until the next beginFrame().
+class UniformRingBuffer
+{
+public:
+    // A valid OpenGL context must be active
+    UniformRingBuffer(GLsizeiptr blockSize, GLuint binding, GLsizeiptr numBlocks = 1024);
+    ~UniformRingBuffer();
+
+    // Orphan the storage of the last frame, if any block was pushed since
+    void beginFrame();
+
+    // Write a block into the next slot, bind it and return its offset. Throws std::runtime_error
+    // beyond numBlocks blocks in a frame.
+    GLintptr push(const void *data);
+    template <typename Block>
+    GLintptr push(const Block &block) { return push(static_cast<const void *>(&block)); }
+
+    // Bind a block pushed before, e.g. to draw the same object in another pass
+    void bind(GLintptr offset) const;
+
+private:
+    UniformRingBuffer(const UniformRingBuffer &) = delete;
+    UniformRingBuffer &operator=(const UniformRingBuffer &) = delete;
+
+    GLuint _id = 0;
+    GLsizeiptr _blockSize;
+    GLsizeiptr _stride; // block size rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    GLsizeiptr _capacity;
+    GLintptr _head = 0;
+    GLuint _binding;
+};
+
+#endif // UNIFORM_BUFFER_H
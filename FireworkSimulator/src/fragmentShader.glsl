@@ -5,20 +5,31 @@ struct LightSource {
     vec3 color;
     float intensity;
 };
-uniform LightSource lightSrc;
 
-struct Material {
+// written once per frame (CPU side: FrameBlock in main.cpp), must be the same in every shader
+layout(std140) uniform FrameBlock {
+    mat4 viewMat;
+    mat4 projMat;
+    vec3 camPos;
+    LightSource lightSrc;
+};
+
+// written for each draw (CPU side: ObjectBlock in main.cpp), must be the same in every shader
+layout(std140) uniform ObjectBlock {
+    mat4 modelMat;
+    mat3 normMat;
     vec3 albedo;
-    sampler2D albedoTex;
     int albedoTexLoaded;
+    int normalTexLoaded;
+};
 
+// the textures, the rest of the material is in ObjectBlock
+struct Material {
+    sampler2D albedoTex;
     sampler2D normalTex;
-    int normalTexLoaded;
 };
 uniform Material material;
 
-uniform vec3 camPos;
-
 in vec3 fPositionModel;
 in vec3 fPosition;
 in vec3 fNormal;
@@ -26,20 +37,17 @@ in vec2 fTexCoord;
 
 out vec4 colorOut; // shader output: the color response attached to this fragment
 
-uniform mat4 modelMat;
-uniform mat3 normMat;
-
 void main() {
-    vec3 n = (material.normalTexLoaded == 1) ?
+    vec3 n = (normalTexLoaded == 1) ?
         normalize(normMat*((texture(material.normalTex, fTexCoord).rgb - 0.5)*2.0)) : // colors are in [0,1]^3, and normals are in [-1,1]^3
         normalize(fNormal);
 
     vec3 radiance = vec3(0, 0, 0);
     vec3 wi = normalize(lightSrc.position - fPosition); // unit vector pointing to the light source
     vec3 Li = lightSrc.color*lightSrc.intensity;
-    vec3 albedo = material.albedoTexLoaded==1 ? texture(material.albedoTex, fTexCoord).rgb : material.albedo;
+    vec3 color = albedoTexLoaded==1 ? texture(material.albedoTex, fTexCoord).rgb : albedo;
 
-    radiance += Li*albedo*max(dot(n, wi), 0);
+    radiance += Li*color*max(dot(n, wi), 0);
 
     colorOut = vec4(radiance, 1.0); // build an RGBA value from an RGB one
 }
@@ -21,20 +21,33 @@
 #include <memory>
 #include <algorithm>
 #include <exception>
-
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
+#include <chrono>
 
 // #include "Error.h" // OpenGL 4.3 or later
 #include "ShaderProgram.h"
+#include "UniformBuffer.h"
+#include "TextureLoader.h"
 #include "Camera.h"
 #include "Mesh.h"
+#include "Profiler.h"
+#include "Offscreen.h"
+#include "RenderQueue.h"
 
 // window parameters
 GLFWwindow *g_window = nullptr;
 int g_windowWidth = 1024;
 int g_windowHeight = 768;
 
+// offscreen rendering (--offscreen): no window, the frames are rendered into g_offscreenTarget
+unsigned int g_offscreenFrames = 0;
+std::unique_ptr<OffscreenContext> g_offscreenContext;
+std::unique_ptr<OffscreenTarget> g_offscreenTarget;
+
+// framebuffer of the main pass: the window's, or the offscreen target
+GLuint g_framebuffer = 0;
+// OpenGL entry points of the current context
+ShaderProgram::ProcAddressLoader g_procAddressLoader = glfwGetProcAddress;
+
 // pointer to the current camera model
 std::shared_ptr<Camera> g_cam;
 
@@ -61,47 +74,11 @@ unsigned int g_albedoTexOnGPU;
 GLuint g_normalTex;
 unsigned int g_normalTexOnGPU;
 
-GLuint loadTextureFromFileToGPU(const std::string &filename)
-{
-    int width, height, numComponents;
-    // Loading the image in CPU memory using stbd_image
-    unsigned char *data = stbi_load(
-        filename.c_str(),
-        &width,
-        &height,
-        &numComponents, // 1 for a 8 bit greyscale image, 3 for 24bits RGB image, 4 for 32bits RGBA image
-        0);
-
-    // Create a texture in GPU memory
-    GLuint texID;
-    glGenTextures(1, &texID);
-    glBindTexture(GL_TEXTURE_2D, texID);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    // Uploading the image data to GPU memory
-    glTexImage2D(
-        GL_TEXTURE_2D,
-        0,
-        (numComponents == 1 ? GL_RED : numComponents == 3 ? GL_RGB
-                                                          : GL_RGBA), // For greyscale images, we store them in the RED channel
-        width,
-        height,
-        0,
-        (numComponents == 1 ? GL_RED : numComponents == 3 ? GL_RGB
-                                                          : GL_RGBA), // For greyscale images, we store them in the RED channel
-        GL_UNSIGNED_BYTE,
-        data);
-
-    // Generating mipmaps for filtered texture fetch
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    // Freeing the now useless CPU memory
-    stbi_image_free(data);
-    glBindTexture(GL_TEXTURE_2D, 0); // unbind the texture
-    return texID;
-}
+// decodes the textures in the background, keeps the results in a disk cache
+std::unique_ptr<TextureLoader> g_textureLoader;
+
+// CPU and GPU timings of the frame, overlay and traces
+std::unique_ptr<Profiler> g_profiler;
 
 struct Light
 {
@@ -110,6 +87,36 @@ struct Light
     float intensity;
 };
 
+// std140 layout of the FrameBlock uniform block of the shaders
+struct FrameBlock
+{
+    glm::mat4 viewMat;
+    glm::mat4 projMat;
+    glm::vec3 camPos;
+    float pad0;
+    glm::vec3 lightPosition;
+    float pad1;
+    glm::vec3 lightColor;
+    float lightIntensity;
+};
+static_assert(sizeof(FrameBlock) == 176, "FrameBlock does not match the std140 layout");
+
+// std140 layout of the ObjectBlock uniform block of the shaders
+struct ObjectBlock
+{
+    glm::mat4 modelMat;
+    glm::mat3x4 normMat; // std140 stores each column of a mat3 as a vec4
+    glm::vec3 albedo;
+    int albedoTexLoaded;
+    int normalTexLoaded;
+    int pad[3];
+
+    ObjectBlock(const glm::mat4 &model, const glm::vec3 &color, bool albedoTex, bool normalTex)
+        : modelMat(model), normMat(glm::mat3(glm::inverseTranspose(model))), albedo(color),
+          albedoTexLoaded(albedoTex ? 1 : 0), normalTexLoaded(normalTex ? 1 : 0) {}
+};
+static_assert(sizeof(ObjectBlock) == 144, "ObjectBlock does not match the std140 layout");
+
 struct Scene
 {
     Light light;
@@ -130,46 +137,75 @@ struct Scene
     // shaders to render the meshes
     std::shared_ptr<ShaderProgram> mainShader;
 
+    // uniforms of mainShader, resolved once after linking
+    struct MainShaderUniforms
+    {
+        ShaderProgram::Uniform<int> albedoTex, normalTex;
+
+        void resolve(const ShaderProgram &program)
+        {
+            albedoTex = program.uniform<int>("material.albedoTex");
+            normalTex = program.uniform<int>("material.normalTex");
+        }
+    } mainUniforms;
+
+    // camera and light, shared by all the programs, and per-object data
+    std::unique_ptr<UniformBuffer> frameBuffer;
+    std::unique_ptr<UniformRingBuffer> objectBuffer;
+
+    // draws sorted by state, and their resources registered once
+    std::unique_ptr<RenderQueue> queue;
+    RenderState renderState;
+    unsigned int mainProgram = 0, planeMaterial = 0, planeMesh = 0;
+    // block of the back-wall, with its normal matrix
+    ObjectBlock planeObject = ObjectBlock(glm::mat4(1.0), glm::vec3(1.0), false, true);
+
     // useful for debug
     bool saveScreenShot = false;
     int savedCnt = 0;
+    int traceCnt = 0;
 
     void render()
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, g_framebuffer);
         glViewport(0, 0, g_windowWidth, g_windowHeight);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // clear the color and z buffers.
 
         // glDisable(GL_CULL_FACE);    // or
         glCullFace(GL_BACK);
 
-        mainShader->use();
+        ProfileScope mainPass(*g_profiler, "main pass", Profiler::CPU_GPU);
+        renderState.invalidate(); // changed by any code since the last frame
 
-        // camera
-        mainShader->set("camPos", g_cam->getPosition());
-        mainShader->set("viewMat", g_cam->computeViewMatrix());
-        mainShader->set("projMat", g_cam->computeProjectionMatrix());
-
-        // light
-        mainShader->set(std::string("lightSrc.position"), light.position);
-        mainShader->set(std::string("lightSrc.color"), light.color);
-        mainShader->set(std::string("lightSrc.intensity"), light.intensity);
+        // camera and light
+        FrameBlock frame;
+        frame.viewMat = g_cam->computeViewMatrix();
+        frame.projMat = g_cam->computeProjectionMatrix();
+        frame.camPos = g_cam->getPosition();
+        frame.lightPosition = light.position;
+        frame.lightColor = light.color;
+        frame.lightIntensity = light.intensity;
+        frameBuffer->update(frame);
+        objectBuffer->beginFrame();
 
         // back-wall
-        mainShader->set("material.albedo", glm::vec3(0.29, 0.51, 0.82)); // default value if the texture was not loaded
-        mainShader->set("material.albedoTexLoaded", 0);
-        mainShader->set("material.normalTex", (int)g_normalTexOnGPU);
-        mainShader->set("material.normalTexLoaded", 1);
-        mainShader->set("modelMat", planeMat);
-        mainShader->set("normMat", glm::mat3(glm::inverseTranspose(planeMat)));
-        plane->render();
-
-
+        queue->submit(mainProgram, planeMaterial, planeMesh, objectBuffer->push(planeObject));
+        queue->flush(renderState, *objectBuffer);
 
-        mainShader->stop();
+        renderState.useProgram(0);
 
     
     }
+
+    void traceFrames(unsigned int numFrames)
+    {
+        if (g_profiler->tracing())
+            return;
+        std::stringstream fpath;
+        fpath << "trace" << std::setw(4) << std::setfill('0') << traceCnt++ << ".json";
+        g_profiler->traceFrames(fpath.str(), numFrames);
+        std::cout << "Tracing " << numFrames << " frames to " << fpath.str() << std::endl;
+    }
 };
 
 Scene g_scene;
@@ -190,6 +226,8 @@ void printHelp()
               << "    * S: save a screenshot" << std::endl
               << "    * W: wireframe rendering" << std::endl
               << "    * F: surface rendering" << std::endl
+              << "    * F2: show/hide the profiler overlay" << std::endl
+              << "    * F3: trace the next 120 frames (chrome://tracing)" << std::endl
               << "    * ESC: quit the program" << std::endl;
 }
 
@@ -232,6 +270,14 @@ void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods
     {
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     }
+    else if (action == GLFW_PRESS && key == GLFW_KEY_F2)
+    {
+        g_profiler->toggleOverlay();
+    }
+    else if (action == GLFW_PRESS && key == GLFW_KEY_F3)
+    {
+        g_scene.traceFrames(120);
+    }
     else if (action == GLFW_PRESS && key == GLFW_KEY_ESCAPE)
     {
         glfwSetWindowShouldClose(window, true); // Closes the application if the escape key is pressed
@@ -305,7 +351,7 @@ void mouseButtonCallback(GLFWwindow *window, int button, int action, int mods)
     }
 }
 
-void initGLFW()
+void initGLFW(bool visible = true)
 {
     // Initialize GLFW, the library responsible for window management
     if (!glfwInit())
@@ -320,6 +366,7 @@ void initGLFW()
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_RESIZABLE, GL_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, visible ? GL_TRUE : GL_FALSE);
 
     // Create the window
     g_window = glfwCreateWindow(g_windowWidth, g_windowHeight, "A Simple Rigid Body Simulator", nullptr, nullptr);
@@ -353,10 +400,25 @@ void exitOnCriticalError(const std::string &message)
     std::exit(EXIT_FAILURE);
 }
 
+void initOffscreen()
+{
+    try
+    {
+        g_offscreenContext.reset(new OffscreenContext());
+        g_procAddressLoader = OffscreenContext::getProcAddress;
+    }
+    catch (std::exception &e)
+    {
+        // offscreen as well if GLFW is built with GLFW_USE_OSMESA, else needs a display
+        std::cerr << e.what() << ", using a hidden window" << std::endl;
+        initGLFW(false);
+    }
+}
+
 void initOpenGL()
 {
     // Load extensions for modern OpenGL
-    if (!gladLoadGL(glfwGetProcAddress))
+    if (!gladLoadGL(g_procAddressLoader))
         exitOnCriticalError("[Failed to initialize OpenGL context]");
 
     // supported from OpenGL 4.3
@@ -370,11 +432,20 @@ void initOpenGL()
     glEnable(GL_DEPTH_TEST);              // Enable the z-buffer test in the rasterization
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f); // specify the background color, used any time the framebuffer is cleared
 
+    // linked programs of the previous runs, when the driver can give them back
+    ShaderProgram::enableBinaryCache("shadercache", g_procAddressLoader);
+
     // Loads and compile the programmable shader pipeline
     try
     {
         g_scene.mainShader = ShaderProgram::genBasicShaderProgram("../src/vertexShader.glsl", "../src/fragmentShader.glsl");
+        g_scene.mainUniforms.resolve(*g_scene.mainShader);
         g_scene.mainShader->stop();
+        g_scene.frameBuffer.reset(new UniformBuffer(sizeof(FrameBlock), FRAME_BLOCK_BINDING));
+        g_scene.objectBuffer.reset(new UniformRingBuffer(sizeof(ObjectBlock), OBJECT_BLOCK_BINDING));
+        g_profiler.reset(new Profiler());
+        g_profiler->setOverlayProgram(
+            ShaderProgram::genBasicShaderProgram("../src/profilerVertexShader.glsl", "../src/profilerFragmentShader.glsl"));
     }
     catch (std::exception &e)
     {
@@ -385,10 +456,8 @@ void initOpenGL()
 void initScene()
 {
     // Init camera
-    int width, height;
-    glfwGetWindowSize(g_window, &width, &height);
     g_cam = std::make_shared<Camera>();
-    g_cam->setAspectRatio(static_cast<float>(width) / static_cast<float>(height));
+    g_cam->setAspectRatio(static_cast<float>(g_windowWidth) / static_cast<float>(g_windowHeight));
 
     // Load meshes in the scene
     {
@@ -407,8 +476,9 @@ void initScene()
 
     // Load textures
     {
-        g_albedoTex = loadTextureFromFileToGPU("../data/dice.png");
-        g_normalTex = loadTextureFromFileToGPU("../data/normal.png");
+        g_textureLoader.reset(new TextureLoader());
+        g_albedoTex = g_textureLoader->load("../data/dice.png");
+        g_normalTex = g_textureLoader->load("../data/normal.png", glm::u8vec4(128, 128, 255, 255));
     }
 
     // Setup textures on the GPU
@@ -425,6 +495,22 @@ void initScene()
         glBindTexture(GL_TEXTURE_2D, g_normalTex);
     }
 
+    // The samplers point to the units of the textures once
+    g_scene.mainShader->use();
+    g_scene.mainUniforms.albedoTex.set((int)g_albedoTexOnGPU);
+    g_scene.mainUniforms.normalTex.set((int)g_normalTexOnGPU);
+    g_scene.mainShader->stop();
+
+    // Resources of the draws
+    {
+        g_scene.queue.reset(new RenderQueue());
+        g_scene.mainProgram = g_scene.queue->addProgram(g_scene.mainShader);
+        g_scene.planeMaterial = g_scene.queue->addMaterial(
+            RenderMaterial().texture(g_albedoTexOnGPU, g_albedoTex).texture(g_normalTexOnGPU, g_normalTex));
+        g_scene.planeMesh = g_scene.queue->addMesh(g_scene.plane);
+        g_scene.planeObject = ObjectBlock(g_scene.planeMat, glm::vec3(0.29, 0.51, 0.82), false, true);
+    }
+
     // Setup light
     g_scene.light.position = glm::vec3(0.0, 1.0, 1.0);
     g_scene.light.color = glm::vec3(1.0, 1.0, 1.0);
@@ -439,7 +525,10 @@ void initScene()
 
 void init()
 {
-    initGLFW();   // Windowing system
+    if (g_offscreenFrames > 0)
+        initOffscreen(); // No window
+    else
+        initGLFW();   // Windowing system
     initOpenGL(); // OpenGL Context and shader pipeline
     initScene();  // Actual scene to render
 }
@@ -450,6 +539,13 @@ void clear()
     g_scene.rigid.reset();
     g_scene.plane.reset();
     g_scene.mainShader.reset();
+    g_scene.queue.reset();
+    g_scene.frameBuffer.reset();
+    g_scene.objectBuffer.reset();
+    g_textureLoader.reset();
+    g_profiler.reset();
+    g_offscreenTarget.reset();
+    g_offscreenContext.reset();
     glfwDestroyWindow(g_window);
     glfwTerminate();
 }
@@ -458,12 +554,18 @@ void clear()
 // The main rendering call
 void render()
 {
+    ProfileScope scope(*g_profiler, "render");
+    {
+        ProfileScope textures(*g_profiler, "textures");
+        g_textureLoader->update(); // textures decoded since the last frame
+    }
     g_scene.render();
 }
 
 // Update any accessible variable based on the current time
 void update(const float currentTime)
 {
+    ProfileScope scope(*g_profiler, "update");
 
     if (!g_appTimerStoppedP)
     {
@@ -476,16 +578,88 @@ void update(const float currentTime)
     }
 }
 
+// Render numFrames frames along a fixed camera path, with a fixed time step, into the offscreen
+// target. Prints the time and the image hash of each frame, then the statistics.
+void runOffscreen(unsigned int numFrames)
+{
+    try
+    {
+        g_offscreenTarget.reset(new OffscreenTarget(g_windowWidth, g_windowHeight));
+    }
+    catch (std::exception &e)
+    {
+        exitOnCriticalError(e.what());
+    }
+    g_framebuffer = g_offscreenTarget->framebuffer();
+
+    // the final textures from the first frame on, for the hashes to be reproducible
+    g_textureLoader->finish();
+
+    g_appTimerStoppedP = false;
+    g_appTimerLastClockTime = 0.0f;
+    RenderBenchmark benchmark;
+    std::vector<unsigned char> pixels;
+    for (unsigned int i = 0; i < numFrames; ++i)
+    {
+        // the camera swings around the scene and up, one period over the sequence
+        const float phase = static_cast<float>(2.0 * M_PI * i / numFrames);
+        g_cam->setRotation(glm::vec3(-0.2f * (1.0f - std::cos(phase)), 0.5f * std::sin(phase), 0.0f));
+
+        const auto start = std::chrono::steady_clock::now();
+        g_profiler->beginFrame();
+        update((i + 1) / 60.0f);
+        render();
+        glFinish();
+        g_profiler->endFrame();
+        const double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        g_offscreenTarget->read(pixels);
+        benchmark.addFrame(time, pixels);
+    }
+    benchmark.report(std::cout);
+}
+
+void usage(const char *command)
+{
+    std::cerr << "Usage : " << command << " [--offscreen <frames>] [--size <width>x<height>]" << std::endl;
+    std::exit(EXIT_FAILURE);
+}
+
 int main(int argc, char **argv)
 {
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        if (arg == "--offscreen" && i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+            g_offscreenFrames = static_cast<unsigned int>(std::atoi(argv[++i]));
+        else if (arg == "--size" && i + 1 < argc &&
+                 std::sscanf(argv[++i], "%dx%d", &g_windowWidth, &g_windowHeight) == 2 &&
+                 g_windowWidth > 0 && g_windowHeight > 0)
+            continue;
+        else
+            usage(argv[0]);
+    }
+
     init();
+    if (g_offscreenFrames > 0)
+    {
+        runOffscreen(g_offscreenFrames);
+        clear();
+        return EXIT_SUCCESS;
+    }
     while (!glfwWindowShouldClose(g_window))
     {
 
+        g_profiler->beginFrame();
         update(static_cast<float>(glfwGetTime()));
         render();
-        glfwSwapBuffers(g_window);
+        g_profiler->drawOverlay(g_windowWidth, g_windowHeight);
+        {
+            ProfileScope swap(*g_profiler, "swap");
+            glfwSwapBuffers(g_window);
+        }
         glfwPollEvents();
+        g_profiler->endFrame();
     }
     clear();
     std::cout << " > Quit" << std::endl;
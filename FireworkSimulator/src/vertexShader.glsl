@@ -1,21 +1,49 @@
 #version 330 core            // minimal GL version support expected from the GPU
 
 layout(location=0) in vec3 vPosition; // the 1st input attribute is the position (CPU side: glVertexAttrib 0)
-layout(location=1) in vec3 vNormal;
+layout(location=1) in vec2 vNormal; // octahedral encoding (CPU side: PackedVertex)
 layout(location=2) in vec2 vTexCoord;
 
-uniform mat4 modelMat, viewMat, projMat;
-uniform mat3 normMat;
+struct LightSource {
+    vec3 position;
+    vec3 color;
+    float intensity;
+};
+
+// written once per frame (CPU side: FrameBlock in main.cpp), must be the same in every shader
+layout(std140) uniform FrameBlock {
+    mat4 viewMat;
+    mat4 projMat;
+    vec3 camPos;
+    LightSource lightSrc;
+};
+
+// written for each draw (CPU side: ObjectBlock in main.cpp), must be the same in every shader
+layout(std140) uniform ObjectBlock {
+    mat4 modelMat;
+    mat3 normMat;
+    vec3 albedo;
+    int albedoTexLoaded;
+    int normalTexLoaded;
+};
 
 out vec3 fPositionModel;
 out vec3 fPosition;
 out vec3 fNormal;
 out vec2 fTexCoord;
 
+// inverse of octEncode in VertexFormat.h
+vec3 octDecode(vec2 e) {
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  float t = max(-n.z, 0.0);
+  n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+  return normalize(n);
+}
+
 void main() {
   fPositionModel = vPosition;
   fPosition = (modelMat*vec4(vPosition, 1.0)).xyz;
-  fNormal = normMat*vNormal;
+  fNormal = normMat*octDecode(vNormal);
   fTexCoord = vTexCoord;
 
   gl_Position =  projMat*viewMat*modelMat*vec4(vPosition, 1.0); // mandatory
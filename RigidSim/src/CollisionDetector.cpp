@@ -4,49 +4,53 @@
 
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <limits>
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
 // Project an obb onto an axis and return the min and max values
-void CollisionDetector::projectOBB(const OBB &obb, const glm::vec3 &axis, float &min, float &max)
+template <typename Policy>
+void CollisionDetectorT<Policy>::projectOBB(const OBBp &obb, const vec3l &axis, tPos &min, tPos &max)
 {
-    glm::vec3 vertex[8];
+    vec3p vertex[8];
     for (int i = 0; i < 8; ++i) 
     {
-        glm::vec3 offset = obb.Rotation * glm::vec3(obb.halfSize.x * ((i & 1) ? 1.0f : -1.0f),
-                                                    obb.halfSize.y * ((i & 2) ? 1.0f : -1.0f),
-                                                    obb.halfSize.z * ((i & 4) ? 1.0f : -1.0f));
-        vertex[i] = obb.center + offset;
+        vec3l offset = obb.Rotation * vec3l(obb.halfSize.x * ((i & 1) ? 1.0f : -1.0f),
+                                            obb.halfSize.y * ((i & 2) ? 1.0f : -1.0f),
+                                            obb.halfSize.z * ((i & 4) ? 1.0f : -1.0f));
+        vertex[i] = obb.center + vec3p(offset);
     }
-    min = max = glm::dot(axis, vertex[0]);
+    min = max = glm::dot(vec3p(axis), vertex[0]);
     for (int i = 1; i < 8; ++i) 
     {
-        float projection = glm::dot(axis, vertex[i]);
+        tPos projection = glm::dot(vec3p(axis), vertex[i]);
         min = std::min(min, projection);
         max = std::max(max, projection);
     }
 };
 
-void CollisionDetector::ContactPointFace(const OBB &obb1, const OBB &obb2, CollisionInfo &info, float threshold)
+template <typename Policy>
+void CollisionDetectorT<Policy>::ContactPointFace(const OBBp &obb1, const OBBp &obb2, Info &info, tLoc threshold)
 {
-    std::vector<glm::vec3> outVertex;
+    std::vector<vec3p> outVertex;
 
-    glm::vec3 vertex[8];
+    // vertices relative to the plane, the distances are small even far from the origin
+    vec3l vertex[8];
+    const vec3l center = vec3l(obb1.center - obb2.center);
     for (int i = 0; i < 8; ++i) 
     {
-        glm::vec3 offset = obb1.Rotation * glm::vec3(obb1.halfSize.x * ((i & 1) ? 1.0f : -1.0f),
-                                                    obb1.halfSize.y * ((i & 2) ? 1.0f : -1.0f),
-                                                    obb1.halfSize.z * ((i & 4) ? 1.0f : -1.0f));
-        vertex[i] = obb1.center + offset;
+        vec3l offset = obb1.Rotation * vec3l(obb1.halfSize.x * ((i & 1) ? 1.0f : -1.0f),
+                                             obb1.halfSize.y * ((i & 2) ? 1.0f : -1.0f),
+                                             obb1.halfSize.z * ((i & 4) ? 1.0f : -1.0f));
+        vertex[i] = center + offset;
     }
-    glm::vec3 pointOnPlane = obb2.center;
 
-    float d = FLT_MAX;
+    tLoc d = std::numeric_limits<tLoc>::max();
 
     for (int i = 0; i < 8; ++i) 
     {
-        glm::vec3 v = vertex[i] - pointOnPlane;
-        float distance = glm::dot(v, info.normal);
+        tLoc distance = glm::dot(vertex[i], info.normal);
         if (distance < d) 
         {
             d = distance;
@@ -55,63 +59,68 @@ void CollisionDetector::ContactPointFace(const OBB &obb1, const OBB &obb2, Colli
 
     for (int i = 0; i < 8; ++i) 
     {
-        glm::vec3 v = vertex[i] - pointOnPlane;
-        float distance = glm::dot(v, info.normal);
+        tLoc distance = glm::dot(vertex[i], info.normal);
         if (distance < d + threshold) 
         {
-            outVertex.push_back(vertex[i]);
+            outVertex.push_back(obb2.center + vec3p(vertex[i]));
         }
     }
 
     // check the result
     if (outVertex.size() == 0) 
     {
-        std::cout << "Error: no contact point found!" << std::endl;
+        if (verbose)
+            std::cout << "Error: no contact point found!" << std::endl;
     }
     else if (outVertex.size() == 1) 
     {
-        std::cout << "One contact point found!" << std::endl;
+        if (verbose)
+            std::cout << "One contact point found!" << std::endl;
         info.point = outVertex[0];
         info.type = VERTEX_FACE;
     }
     else if (outVertex.size() == 2) 
     {
-        std::cout << "Two contact points found!" << std::endl;
-        info.point = (outVertex[0] + outVertex[1]) * 0.5f;
+        if (verbose)
+            std::cout << "Two contact points found!" << std::endl;
+        info.point = (outVertex[0] + outVertex[1]) * tPos(0.5);
         info.type = EDGE_FACE;
     }
     else if (outVertex.size() == 4) 
     {
-        std::cout << "Four contact points found!" << std::endl;
-        info.point = (outVertex[0] + outVertex[1] + outVertex[2] + outVertex[3]) * 0.25f;
+        if (verbose)
+            std::cout << "Four contact points found!" << std::endl;
+        info.point = (outVertex[0] + outVertex[1] + outVertex[2] + outVertex[3]) * tPos(0.25);
         info.type = FACE_FACE;
     }
     else 
     {
-        std::cout << "Error: too many contact points found!" << std::endl;
-        info.point = glm::vec3(0.0f);
+        if (verbose)
+            std::cout << "Error: too many contact points found!" << std::endl;
+        info.point = vec3p(0.0f);
         info.type = OTHER;
     }
    
 };
 
-CollisionInfo CollisionDetector::SATcheckCollision(std::shared_ptr<Mesh> &mesh1, 
-                                                   std::shared_ptr<Mesh> &mesh2,
-                                                   glm::mat4 &worldMat1,
-                                                   glm::mat4 &worldMat2)
+template <typename Policy>
+typename CollisionDetectorT<Policy>::Info CollisionDetectorT<Policy>::SATcheckCollision(const std::shared_ptr<Mesh> &mesh1, 
+                                                                                        const std::shared_ptr<Mesh> &mesh2,
+                                                                                        const mat4p &worldMat1,
+                                                                                        const mat4p &worldMat2)
 {
-    CollisionInfo info;
+    Info info;
     info.hasCollision = false;
-    info.depth = FLT_MAX;
+    info.depth = std::numeric_limits<tLoc>::max();
 
-    OBB obb1 = OBB::ComputeOBBfromMesh(mesh1, worldMat1);
-    OBB obb2 = OBB::ComputeOBBfromMesh(mesh2, worldMat2);
+    OBBp obb1 = OBBp::ComputeOBBfromMesh(mesh1, worldMat1);
+    OBBp obb2 = OBBp::ComputeOBBfromMesh(mesh2, worldMat2);
     
     // find the axis: 15 axes, 3 from each mesh's OBB, 9 from cross product of each pair of axes
-    glm::vec3 axes1[] = {glm::vec3(obb1.Rotation[0]), glm::vec3(obb1.Rotation[1]), glm::vec3(obb1.Rotation[2])};
-    glm::vec3 axes2[] = {glm::vec3(obb2.Rotation[0]), glm::vec3(obb2.Rotation[1]), glm::vec3(obb2.Rotation[2])};
+    vec3l axes1[] = {vec3l(obb1.Rotation[0]), vec3l(obb1.Rotation[1]), vec3l(obb1.Rotation[2])};
+    vec3l axes2[] = {vec3l(obb2.Rotation[0]), vec3l(obb2.Rotation[1]), vec3l(obb2.Rotation[2])};
 
-    std::vector<glm::vec3> axes;
+    std::vector<vec3l> axes;
     for (int i = 0; i < 3; ++i) 
     {
         axes.push_back(axes1[i]);
@@ -125,7 +134,7 @@ CollisionInfo CollisionDetector::SATcheckCollision(std::shared_ptr<Mesh> &mesh1,
     // project the OBBs onto the axes
     for (const auto &axis : axes) 
     {
-        float min1, max1, min2, max2;
+        tPos min1, max1, min2, max2;
         projectOBB(obb1, axis, min1, max1);
         projectOBB(obb2, axis, min2, max2);
         if (max1 < min2 || max2 < min1) 
@@ -135,7 +144,9 @@ CollisionInfo CollisionDetector::SATcheckCollision(std::shared_ptr<Mesh> &mesh1,
         }
         else 
         {
-            float depth = std::min(max1, max2) - std::max(min1, min2);
+            // distance to move obb1 along the axis, either way, to separate the intervals;
+            // the overlap of the intervals would be 0 against a flat mesh such as the floor
+            tLoc depth = static_cast<tLoc>(std::min(max1 - min2, max2 - min1));
             if (depth < info.depth) 
             {
                 info.depth = depth;
@@ -146,7 +157,7 @@ CollisionInfo CollisionDetector::SATcheckCollision(std::shared_ptr<Mesh> &mesh1,
     info.hasCollision = true;
 
     // the direction of the normal is from obb2 to obb1
-    if (glm::dot(info.normal, obb1.center - obb2.center) < 0.0f) 
+    if (glm::dot(info.normal, vec3l(obb1.center - obb2.center)) < 0.0f) 
     {
         info.normal = -info.normal;
     }
@@ -156,11 +167,48 @@ CollisionInfo CollisionDetector::SATcheckCollision(std::shared_ptr<Mesh> &mesh1,
     return info;
 };
 
-void CollisionDetector::applyPenetrationCorrection(const CollisionInfo &info, float ratio, glm::mat4 &worldMat)
+template <typename Policy>
+std::vector<typename CollisionDetectorT<Policy>::Info> CollisionDetectorT<Policy>::narrowPhase(const std::vector<Pair> &pairs,
+                                                                                               ThreadPool &pool,
+                                                                                               unsigned int chunkSize)
 {
-    // TODO: FIX THIS ! The depth is too small.
-    glm::vec3 correction = info.normal * ratio;
-    worldMat = glm::translate(worldMat, correction);
+    chunkSize = std::max(1u, chunkSize);
+    const unsigned int numChunks = static_cast<unsigned int>((pairs.size() + chunkSize - 1) / chunkSize);
+
+    // one output buffer per chunk, so that no synchronization is needed while testing
+    std::vector<std::vector<Info>> chunkContacts(numChunks);
+    pool.parallelFor(numChunks, [&](unsigned int c)
+    {
+        const size_t begin = static_cast<size_t>(c) * chunkSize;
+        const size_t end = std::min(pairs.size(), begin + chunkSize);
+        std::vector<Info> &out = chunkContacts[c];
+        for (size_t i = begin; i < end; ++i)
+        {
+            const Pair &pair = pairs[i];
+            Info info = SATcheckCollision(pair.meshPtr1, pair.meshPtr2, pair.worldMat1, pair.worldMat2);
+            if (info.hasCollision)
+            {
+                info.meshPtr1 = pair.meshPtr1;
+                info.meshPtr2 = pair.meshPtr2;
+                out.push_back(info);
+            }
+        }
+    });
+
+    // merge in chunk order: the result does not depend on the scheduling
+    size_t total = 0;
+    for (const auto &out : chunkContacts)
+        total += out.size();
+    std::vector<Info> contacts;
+    contacts.reserve(total);
+    for (const auto &out : chunkContacts)
+        contacts.insert(contacts.end(), out.begin(), out.end());
+    return contacts;
 };
 
+// the policies used by the application and the precision benchmark
+template class CollisionDetectorT<FloatPrecision>;
+template class CollisionDetectorT<DoublePrecision>;
+template class CollisionDetectorT<MixedPrecision>;
+
 
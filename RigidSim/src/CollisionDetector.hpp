@@ -4,6 +4,8 @@
 
 #include "Mesh.h"
 #include "OBB.hpp"
+#include "ThreadPool.hpp"
+#include "typedefs.hpp"
 #include <vector>
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
@@ -17,41 +19,77 @@ enum CollisionType
 };
 
 // Collision information structure
-struct CollisionInfo 
+template <typename Policy>
+struct CollisionInfoT 
 {
     bool hasCollision;
     CollisionType type;      
-    glm::vec3 point;   
-    glm::vec3 normal;  
-    float depth;            
+    glm::vec<3, typename Policy::tPosition> point;   
+    glm::vec<3, typename Policy::tLocal> normal;  
+    typename Policy::tLocal depth;            
     std::shared_ptr<Mesh> meshPtr1;          
     std::shared_ptr<Mesh> meshPtr2;            
 };
 
+// Candidate pair produced by the broad phase, to be tested by the narrow phase
+template <typename Policy>
+struct CollisionPairT
+{
+    std::shared_ptr<Mesh> meshPtr1;
+    std::shared_ptr<Mesh> meshPtr2;
+    glm::mat<4, 4, typename Policy::tPosition> worldMat1;
+    glm::mat<4, 4, typename Policy::tPosition> worldMat2;
+};
+
 
-class CollisionDetector 
+// Collision detection templated on the precision policy (see typedefs.hpp).
+// Instantiated in CollisionDetector.cpp for FloatPrecision, DoublePrecision and MixedPrecision.
+template <typename Policy>
+class CollisionDetectorT 
 {
 public:
-    // Project an obb onto an axis and return the min and max values
-    void projectOBB(const OBB &obb, const glm::vec3 &axis, float &min, float &max);
+    typedef typename Policy::tPosition tPos;
+    typedef typename Policy::tLocal tLoc;
+    typedef glm::vec<3, tPos> vec3p;
+    typedef glm::vec<3, tLoc> vec3l;
+    typedef glm::mat<4, 4, tPos> mat4p;
+    typedef OBBT<Policy> OBBp;
+    typedef CollisionInfoT<Policy> Info;
+    typedef CollisionPairT<Policy> Pair;
 
-    // Apply penetration correction ONLY FOR THE MOVING RIGID
-    void applyPenetrationCorrection(const CollisionInfo &info, float ratio, glm::mat4 &worldMat);
+    CollisionDetectorT() : verbose(false) {}
+
+    // Project an obb onto an axis and return the min and max values
+    void projectOBB(const OBBp &obb, const vec3l &axis, tPos &min, tPos &max);
 
     // Find the contact point 
     // ONLY FOR VERTEX/EDGE/FACE - FACE COLLISIONS WITH ONE MOVING RIGID AND THE FLOOR / WALL /BOUNDARY
     // TODO: implement for other types of collisions 
-    void ContactPointFace(const OBB &obb1, const OBB &obb2, CollisionInfo &info, float threshold);
+    void ContactPointFace(const OBBp &obb1, const OBBp &obb2, Info &info, tLoc threshold);
 
     // Check for collision between two meshes: easy implementation for 2 meshes
-    CollisionInfo SATcheckCollision(std::shared_ptr<Mesh> &mesh1, 
-                                    std::shared_ptr<Mesh> &mesh2,
-                                    glm::mat4 &worldMat1,
-                                    glm::mat4 &worldMat2);
+    Info SATcheckCollision(const std::shared_ptr<Mesh> &mesh1, 
+                           const std::shared_ptr<Mesh> &mesh2,
+                           const mat4p &worldMat1,
+                           const mat4p &worldMat2);
+
+    // Run SAT and contact generation over a list of candidate pairs.
+    // Pairs are split into chunks processed on the pool, each chunk fills its own buffer,
+    // and the buffers are concatenated in chunk order: the output only holds the colliding
+    // pairs and is ordered as the input, whatever the number of threads.
+    std::vector<Info> narrowPhase(const std::vector<Pair> &pairs,
+                                  ThreadPool &pool,
+                                  unsigned int chunkSize = 16);
 
     // Check for collisions within a list of meshes
     // TODO: can be optimized by using a spatial data structure: octree, BVH, etc.
-    std::vector<CollisionInfo> checkCollisions(const std::vector<Mesh>& meshes);
+    std::vector<Info> checkCollisions(const std::vector<Mesh>& meshes);
+
+    bool verbose; // report the contact points found, off by default: the narrow phase may run on worker threads
 };
 
-#endif  /* _COLLISIONDETECTOR_HPP_ */
\ No newline at end of file
+typedef CollisionInfoT<tPrecision> CollisionInfo;
+typedef CollisionPairT<tPrecision> CollisionPair;
+typedef CollisionDetectorT<tPrecision> CollisionDetector;
+
+#endif  /* _COLLISIONDETECTOR_HPP_ */
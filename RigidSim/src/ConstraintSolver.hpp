@@ -0,0 +1,482 @@
+#ifndef _CONSTRAINTSOLVER_HPP_
+#define _CONSTRAINTSOLVER_HPP_
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cstdint>
+
+#include "typedefs.hpp"
+#include "Vector3.hpp"
+#include "Matrix3x3.hpp"
+#include "quaternion.hpp"
+#include "RigidSolver.hpp"
+#include "CollisionDetector.hpp"
+#include "RowBatch.hpp"
+
+enum JointType
+{
+    BALL_JOINT,   // the anchors coincide, free rotation
+    HINGE_JOINT,  // ball joint that only rotates around its axis
+    SLIDER_JOINT, // translation along the axis only, no rotation
+    FIXED_JOINT   // no relative motion
+};
+
+// Joint between two bodies of a ConstraintSolverT, bodyB may be the static world.
+// The anchor and the joint frame are kept in the space of each body so that they follow the bodies.
+template <typename Policy>
+struct JointT
+{
+    typedef typename Policy::tLocal tLoc;
+    typedef Vector3<typename Policy::tPosition> Vec3p;
+    typedef Vector3<tLoc> Vec3l;
+
+    JointType type;
+    tIndex bodyA, bodyB;
+    Vec3l anchorA, anchorB;     // anchor in body space
+    Vec3l frameA[3], frameB[3]; // joint frame in body space, frame[0] is the hinge/slider axis
+    Vec3p worldOrigin;          // anchor in world space, used when bodyB is the world
+    tLoc lambda[6];             // impulses of the rows at the last step, to warm start the next one
+};
+
+// Parameters of the constraint solver, the contacts use ContactSettingsT
+struct ConstraintSettings
+{
+    ConstraintSettings() : velocityIterations(10), positionIterations(4), jointBaumgarte(0.2),
+                           bounceThreshold(0.1), warmStarting(true) {}
+
+    tIndex velocityIterations; // Gauss-Seidel iterations on the velocities
+    tIndex positionIterations; // iterations of the split-impulse position pass
+    tReal jointBaumgarte;      // fraction of the joint error removed per step
+    tReal bounceThreshold;     // approach velocity below which contacts do not bounce
+    bool warmStarting;         // start the joint impulses from the ones of the last step
+};
+
+// Multi-body solver for joints and contacts.
+// Joints and contacts are turned into scalar rows sharing the same iterations: the rows are
+// colored so that rows of one color touch distinct bodies, and packed in batches of Width lanes.
+// Like RigidSolverT, the penetration and the joint drift are removed by a split-impulse pass on
+// pseudo velocities that move the bodies without changing their momenta.
+template <typename Policy, unsigned Width = 32 / sizeof(typename Policy::tLocal)>
+class ConstraintSolverT
+{
+public:
+    typedef BodyAttributesT<Policy> Body;
+    typedef JointT<Policy> Joint;
+    typedef CollisionInfoT<Policy> Info;
+    typedef typename Body::tPos tPos;
+    typedef typename Body::tLoc tLoc;
+    typedef typename Body::Vec3p Vec3p;
+    typedef typename Body::Vec3l Vec3l;
+    typedef typename Body::Mat3l Mat3l;
+    typedef typename Body::Quatl Quatl;
+    typedef RowBatchT<tLoc, Width> Batch;
+    typedef RowBatchKernel<tLoc, Width> Kernel;
+
+    static const tIndex WORLD = static_cast<tIndex>(-1); // static body, used as bodyB
+
+    explicit ConstraintSolverT(const Vec3l g = Vec3l(0, 0, 0)) : _g(g) {}
+
+    tIndex addBody(Body *body)
+    {
+        bodies.push_back(body);
+        return static_cast<tIndex>(bodies.size() - 1);
+    }
+
+    // Join the bodies a and b (or WORLD) at a world space anchor, in their current poses.
+    // axis is the hinge or slider axis in world space.
+    tIndex addJoint(const JointType type, const tIndex a, const tIndex b, const Vec3p &anchor,
+                    const Vec3l &axis = Vec3l(1, 0, 0))
+    {
+        Joint j;
+        j.type = type;
+        j.bodyA = a;
+        j.bodyB = b;
+        j.worldOrigin = anchor;
+        std::fill(j.lambda, j.lambda + 6, tLoc(0));
+
+        // world frame of the joint: the axis and two orthogonal directions
+        Vec3l u[3];
+        u[0] = axis.normalized();
+        u[1] = std::abs(u[0].x) < 0.9 ? u[0].crossProduct(Vec3l(1, 0, 0)) : u[0].crossProduct(Vec3l(0, 1, 0));
+        u[1].normalize();
+        u[2] = u[0].crossProduct(u[1]);
+
+        const Body &bodyA = *bodies[a];
+        j.anchorA = bodyA.R.transposedMul(static_cast<Vec3l>(anchor - bodyA.X));
+        for (int k = 0; k < 3; ++k)
+            j.frameA[k] = bodyA.R.transposedMul(u[k]);
+
+        if (b == WORLD)
+        {
+            j.anchorB = Vec3l(0, 0, 0);
+            for (int k = 0; k < 3; ++k)
+                j.frameB[k] = u[k];
+        }
+        else
+        {
+            const Body &bodyB = *bodies[b];
+            j.anchorB = bodyB.R.transposedMul(static_cast<Vec3l>(anchor - bodyB.X));
+            for (int k = 0; k < 3; ++k)
+                j.frameB[k] = bodyB.R.transposedMul(u[k]);
+        }
+
+        joints.push_back(j);
+        return static_cast<tIndex>(joints.size() - 1);
+    }
+
+    // Contact between the body a and the body b (or WORLD) for the next step.
+    // The normal of the collision info goes from b to a.
+    void addContact(const tIndex a, const tIndex b, const Info &info)
+    {
+        if (!info.hasCollision)
+            return;
+        Contact c;
+        c.a = a;
+        c.b = b;
+        c.point = Vec3p(info.point.x, info.point.y, info.point.z);
+        c.normal = Vec3l(info.normal.x, info.normal.y, info.normal.z).normalize();
+        c.depth = info.depth;
+        _contacts.push_back(c);
+    }
+
+    void step(const tLoc dt)
+    {
+        const tIndex n = static_cast<tIndex>(bodies.size());
+
+        // velocities with gravity, the last slot is the world
+        _vel.assign(8 * (n + 1), tLoc(0));
+        _pseudoVel.assign(8 * (n + 1), tLoc(0));
+        _invMass.assign(n + 1, tLoc(0));
+        _Iinv.assign(n + 1, Mat3l(Vec3l(0, 0, 0)));
+        for (tIndex i = 0; i < n; ++i)
+        {
+            Body &body = *bodies[i];
+            body.V = body.P / body.M + _g * dt;                                           // v = p / m + dt * g
+            body.Iinv = body.R * body.I0inv * body.R.transposed();                        // Iinv = R * I0inv * R^T
+            body.omega = body.Iinv * body.L;                                              // omega = Iinv * L
+            for (int k = 0; k < 3; ++k)
+            {
+                _vel[8 * i + k] = body.V[k];
+                _vel[8 * i + 4 + k] = body.omega[k];
+            }
+            _invMass[i] = 1 / body.M;
+            _Iinv[i] = body.Iinv;
+        }
+
+        _rows.clear();
+        for (tIndex j = 0; j < joints.size(); ++j)
+            addJointRows(joints[j], dt);
+        for (tIndex c = 0; c < _contacts.size(); ++c)
+            addContactRow(_contacts[c], dt);
+        buildBatches();
+
+        // velocity pass
+        if (settings.warmStarting)
+            for (tIndex b = 0; b < _batches.size(); ++b)
+                Kernel::applyImpulse(_batches[b], &_vel[0], _batches[b].lambda);
+        for (tIndex it = 0; it < settings.velocityIterations; ++it)
+            for (tIndex b = 0; b < _batches.size(); ++b)
+                Kernel::solve(_batches[b], &_vel[0], _batches[b].target, _batches[b].lambda);
+
+        // position pass
+        for (tIndex it = 0; it < settings.positionIterations; ++it)
+            for (tIndex b = 0; b < _batches.size(); ++b)
+                Kernel::solve(_batches[b], &_pseudoVel[0], _batches[b].bias, _batches[b].lambdaPos);
+
+        for (tIndex b = 0; b < _batches.size(); ++b)
+            for (unsigned l = 0; l < Width; ++l)
+                if (_batches[b].store[l])
+                    *_batches[b].store[l] = _batches[b].lambda[l];
+
+        for (tIndex i = 0; i < n; ++i)
+            integrate(*bodies[i], i, dt);
+
+        _contacts.clear();
+    }
+
+    // Distance between the anchors of a joint (across the axis for a slider), 0 when satisfied
+    tLoc jointError(const tIndex j) const
+    {
+        const Joint &joint = joints[j];
+        Vec3p XA, XB;
+        Mat3l RA, RB;
+        pose(joint, false, XA, RA);
+        pose(joint, true, XB, RB);
+        Vec3l d = static_cast<Vec3l>(XB - XA) + RB * joint.anchorB - RA * joint.anchorA;
+        if (joint.type == SLIDER_JOINT)
+        {
+            const Vec3l axis = RB * joint.frameB[0];
+            d -= axis * d.dotProduct(axis);
+        }
+        return d.length();
+    }
+
+    std::vector<Body *> bodies;
+    std::vector<Joint> joints;
+    ContactSettingsT<Policy> contact;
+    ConstraintSettings settings;
+
+private:
+    // velocities of the bodies, 8 values per body: linear, 0, angular, 0 (see RowBatch.hpp)
+    static Vec3l linear(const std::vector<tLoc> &vel, const tIndex i) { return Vec3l(vel[8 * i], vel[8 * i + 1], vel[8 * i + 2]); }
+    static Vec3l angular(const std::vector<tLoc> &vel, const tIndex i) { return Vec3l(vel[8 * i + 4], vel[8 * i + 5], vel[8 * i + 6]); }
+
+    struct Contact
+    {
+        tIndex a, b;
+        Vec3p point;
+        Vec3l normal;
+        tLoc depth;
+    };
+
+    // scalar constraint row before it is packed into a batch
+    struct Row
+    {
+        tIndex a, b; // body slots
+        Vec3l J[4];  // linear A, angular A, linear B, angular B
+        tLoc target, bias, lo, hi, lambda;
+        tLoc *store;
+    };
+
+    tIndex slot(const tIndex body) const { return body == WORLD ? static_cast<tIndex>(bodies.size()) : body; }
+
+    void pose(const Joint &joint, const bool sideB, Vec3p &X, Mat3l &R) const
+    {
+        const tIndex body = sideB ? joint.bodyB : joint.bodyA;
+        if (body == WORLD)
+        {
+            X = joint.worldOrigin;
+            R = Mat3l::I();
+        }
+        else
+        {
+            X = bodies[body]->X;
+            R = bodies[body]->R;
+        }
+    }
+
+    void pushRow(const tIndex a, const tIndex b, const Vec3l &linA, const Vec3l &angA, const Vec3l &linB,
+                 const Vec3l &angB, const tLoc target, const tLoc bias, const tLoc lo, const tLoc hi, tLoc *store)
+    {
+        Row r;
+        r.a = a;
+        r.b = b;
+        r.J[0] = linA;
+        r.J[1] = angA;
+        r.J[2] = linB;
+        r.J[3] = angB;
+        r.target = target;
+        r.bias = bias;
+        r.lo = lo;
+        r.hi = hi;
+        r.lambda = (store && settings.warmStarting) ? *store : tLoc(0);
+        r.store = store;
+        _rows.push_back(r);
+    }
+
+    // Rows of a joint, C is the position error of the row and J its derivative:
+    //  point rows: C = (pB - pA) . e,                  J = [-e, -rA x e, e, rB x e]
+    //  slider rows: C = (pB - pA) . u, u attached to B, J = [-u, -rA x u, u, (rB - d) x u]
+    //  (the rail is B's: the lever arm of the sliding body A stays its anchor, however far it slides)
+    //  angular rows: C = angle around u,               J = [0, -u, 0, u]
+    void addJointRows(Joint &joint, const tLoc dt)
+    {
+        const tLoc inf = std::numeric_limits<tLoc>::infinity();
+        const tLoc beta = settings.jointBaumgarte / dt;
+        const tIndex a = slot(joint.bodyA), b = slot(joint.bodyB);
+        const Vec3l zero(0, 0, 0);
+
+        Vec3p XA, XB;
+        Mat3l RA, RB;
+        pose(joint, false, XA, RA);
+        pose(joint, true, XB, RB);
+        const Vec3l rA = RA * joint.anchorA;
+        const Vec3l rB = RB * joint.anchorB;
+        const Vec3l d = static_cast<Vec3l>(XB - XA) + rB - rA;                           // d = pB - pA
+
+        Vec3l uA[3], uB[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            uA[k] = RA * joint.frameA[k];
+            uB[k] = RB * joint.frameB[k];
+        }
+
+        tLoc *lambda = joint.lambda;
+        if (joint.type == SLIDER_JOINT)
+        {
+            for (int k = 1; k < 3; ++k)
+                pushRow(a, b, -uB[k], -rA.crossProduct(uB[k]), uB[k], (rB - d).crossProduct(uB[k]),
+                        0, -beta * d.dotProduct(uB[k]), -inf, inf, lambda++);
+        }
+        else
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                Vec3l e(0, 0, 0);
+                e[k] = 1;
+                pushRow(a, b, -e, -rA.crossProduct(e), e, rB.crossProduct(e),
+                        0, -beta * d[k], -inf, inf, lambda++);
+            }
+        }
+
+        if (joint.type == HINGE_JOINT)
+        {
+            // the axes stay aligned: the error is the rotation across the axis, a x b
+            const Vec3l err = uA[0].crossProduct(uB[0]);
+            for (int k = 1; k < 3; ++k)
+                pushRow(a, b, zero, -uA[k], zero, uA[k], 0, -beta * err.dotProduct(uA[k]), -inf, inf, lambda++);
+        }
+        else if (joint.type == SLIDER_JOINT || joint.type == FIXED_JOINT)
+        {
+            // the frames stay aligned: for a small rotation of angle theta around u,
+            // 0.5 * sum(a_k x b_k) = theta * u
+            const Vec3l err = (uA[0].crossProduct(uB[0]) + uA[1].crossProduct(uB[1]) + uA[2].crossProduct(uB[2])) * 0.5;
+            for (int k = 0; k < 3; ++k)
+                pushRow(a, b, zero, -uA[k], zero, uA[k], 0, -beta * err.dotProduct(uA[k]), -inf, inf, lambda++);
+        }
+    }
+
+    // Non-penetration row: the relative normal velocity stays >= 0, it bounces back when the
+    // approach is fast enough and the pseudo velocity pushes out the penetration beyond the slop
+    void addContactRow(const Contact &c, const tLoc dt)
+    {
+        const tIndex a = slot(c.a), b = slot(c.b);
+        const Vec3l rA = static_cast<Vec3l>(c.point - bodies[c.a]->X);
+        const Vec3l rB = c.b == WORLD ? Vec3l(0, 0, 0) : static_cast<Vec3l>(c.point - bodies[c.b]->X);
+        const Vec3l &n = c.normal;
+
+        const Vec3l linA = n, angA = rA.crossProduct(n), linB = -n, angB = -rB.crossProduct(n);
+        const tLoc vrel = linA.dotProduct(linear(_vel, a)) + angA.dotProduct(angular(_vel, a)) +
+                          linB.dotProduct(linear(_vel, b)) + angB.dotProduct(angular(_vel, b));
+        const tLoc target = vrel < -settings.bounceThreshold ? -contact.restitution * vrel : 0;
+        const tLoc bias = contact.baumgarte * std::max(c.depth - contact.slop, tLoc(0)) / dt;
+
+        pushRow(a, b, linA, angA, linB, angB, target, bias, 0, std::numeric_limits<tLoc>::infinity(), nullptr);
+    }
+
+    // Greedy coloring: each row takes the first color unused by its two bodies (the world never
+    // conflicts), and the rows of a color are packed Width at a time. Rows beyond the last color
+    // are solved one per batch.
+    void buildBatches()
+    {
+        const tIndex numColors = 64;
+        const tIndex world = static_cast<tIndex>(bodies.size());
+
+        _colorMask.assign(world + 1, 0);
+        _colorRows.resize(numColors + 1);
+        for (tIndex c = 0; c <= numColors; ++c)
+            _colorRows[c].clear();
+
+        for (tIndex r = 0; r < _rows.size(); ++r)
+        {
+            const tIndex a = _rows[r].a, b = _rows[r].b;
+            const uint64_t used = (a != world ? _colorMask[a] : 0) | (b != world ? _colorMask[b] : 0);
+            tIndex c = 0;
+            while (c < numColors && (used >> c) & 1)
+                ++c;
+            if (c < numColors)
+            {
+                if (a != world)
+                    _colorMask[a] |= uint64_t(1) << c;
+                if (b != world)
+                    _colorMask[b] |= uint64_t(1) << c;
+            }
+            _colorRows[c].push_back(r);
+        }
+
+        _batches.clear();
+        for (tIndex c = 0; c < numColors; ++c)
+            for (tIndex first = 0; first < _colorRows[c].size(); first += Width)
+            {
+                _batches.push_back(Batch());
+                fillBatch(_batches.back(), &_colorRows[c][first],
+                          std::min<tIndex>(Width, static_cast<tIndex>(_colorRows[c].size()) - first));
+            }
+        for (tIndex i = 0; i < _colorRows[numColors].size(); ++i)
+        {
+            _batches.push_back(Batch());
+            fillBatch(_batches.back(), &_colorRows[numColors][i], 1);
+        }
+    }
+
+    // Pack rows into the lanes of a batch, the remaining lanes are empty rows between world slots
+    void fillBatch(Batch &batch, const tIndex *rows, const tIndex count)
+    {
+        const tIndex world = static_cast<tIndex>(bodies.size());
+        for (unsigned l = 0; l < Width; ++l)
+        {
+            if (l >= count)
+            {
+                batch.bodyA[l] = batch.bodyB[l] = world;
+                for (int k = 0; k < 12; ++k)
+                    batch.J[k][l] = batch.MJ[k][l] = 0;
+                batch.invK[l] = batch.target[l] = batch.bias[l] = 0;
+                batch.lo[l] = batch.hi[l] = batch.lambda[l] = batch.lambdaPos[l] = 0;
+                batch.store[l] = nullptr;
+                continue;
+            }
+
+            const Row &r = _rows[rows[l]];
+            const Vec3l MJ[4] = {r.J[0] * _invMass[r.a], _Iinv[r.a] * r.J[1],
+                                 r.J[2] * _invMass[r.b], _Iinv[r.b] * r.J[3]};
+            tLoc K = 0;
+            for (int v = 0; v < 4; ++v)
+            {
+                K += r.J[v].dotProduct(MJ[v]);
+                for (int k = 0; k < 3; ++k)
+                {
+                    batch.J[3 * v + k][l] = r.J[v][k];
+                    batch.MJ[3 * v + k][l] = MJ[v][k];
+                }
+            }
+            batch.bodyA[l] = r.a;
+            batch.bodyB[l] = r.b;
+            batch.invK[l] = K > 0 ? 1 / K : 0;
+            batch.target[l] = r.target;
+            batch.bias[l] = r.bias;
+            batch.lo[l] = r.lo;
+            batch.hi[l] = r.hi;
+            batch.lambda[l] = r.lambda;
+            batch.lambdaPos[l] = 0;
+            batch.store[l] = r.store;
+        }
+    }
+
+    // Move the body with its velocity plus the pseudo velocity, the momenta follow the velocity only
+    void integrate(Body &body, const tIndex i, const tLoc dt)
+    {
+        body.V = linear(_vel, i);
+        body.omega = angular(_vel, i);
+        body.P = body.V * body.M;                                                         // p = m * v
+        body.L = body.R * (body.I0 * body.R.transposedMul(body.omega));                   // L = R * I0 * R^T * omega
+
+        body.X += static_cast<Vec3p>((body.V + linear(_pseudoVel, i)) * dt);                    // x = x + dt * (v + v_pseudo)
+        body.omega_q = Quatl(0, body.omega + angular(_pseudoVel, i));
+        body.q = body.q + body.omega_q * body.q * (0.5 * dt);                             // q = q + 0.5 * dt * omega_q * q
+        body.q.normalize();
+        body.R = body.q.toRotMat();
+        body.Iinv = body.R * body.I0inv * body.R.transposed();
+    }
+
+    Vec3l _g; // gravity
+
+    std::vector<Contact> _contacts; // contacts of the next step
+
+    // per step data
+    std::vector<tLoc> _vel, _pseudoVel;
+    std::vector<tLoc> _invMass;
+    std::vector<Mat3l> _Iinv;
+    std::vector<Row> _rows;
+    std::vector<uint64_t> _colorMask;
+    std::vector<std::vector<tIndex> > _colorRows;
+    std::vector<Batch> _batches;
+};
+
+template <typename Policy, unsigned Width>
+const tIndex ConstraintSolverT<Policy, Width>::WORLD;
+
+typedef JointT<tPrecision> Joint;
+typedef ConstraintSolverT<tPrecision> ConstraintSolver;
+
+#endif /* _CONSTRAINTSOLVER_HPP_ */
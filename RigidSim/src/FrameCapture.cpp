@@ -0,0 +1,275 @@
+#include "FrameCapture.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <iostream>
+
+CaptureEncoding captureEncoding(const std::string &filename)
+{
+    const size_t dot = filename.find_last_of('.');
+    std::string extension = dot == std::string::npos ? std::string() : filename.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    if (extension == ".ppm")
+        return CAPTURE_PPM;
+    if (extension == ".pgm")
+        return CAPTURE_PGM;
+    return CAPTURE_TGA;
+}
+
+FrameCapture::FrameCapture(unsigned int numBuffers, size_t maxQueuedImages)
+    : _slots(std::max(numBuffers, 1u)), _maxQueued(std::max<size_t>(maxQueuedImages, 1)), _written(0), _failed(0)
+{
+    for (Slot &slot : _slots)
+        glGenBuffers(1, &slot.pbo);
+    _thread = std::thread(&FrameCapture::run, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _queueChanged.notify_all();
+    _thread.join();
+
+    for (Slot &slot : _slots)
+        glDeleteBuffers(1, &slot.pbo);
+}
+
+void FrameCapture::captureColor(GLint x, GLint y, GLsizei width, GLsizei height, const std::string &filename)
+{
+    const CaptureEncoding encoding = captureEncoding(filename);
+    if (encoding == CAPTURE_PGM)
+        readback(x, y, width, height, GL_RED, 1, filename);
+    else
+        readback(x, y, width, height, encoding == CAPTURE_TGA ? GL_BGR : GL_RGB, 3, filename);
+}
+
+void FrameCapture::captureDepth(GLint x, GLint y, GLsizei width, GLsizei height, const std::string &filename)
+{
+    readback(x, y, width, height, GL_DEPTH_COMPONENT, 1, filename);
+}
+
+void FrameCapture::readback(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format,
+                            unsigned int channels, const std::string &filename)
+{
+    if (width <= 0 || height <= 0)
+        return;
+
+    // the oldest slot is reused: wait for its readback if the GPU is that far behind
+    Slot &slot = _slots[_next];
+    if (slot.fence)
+        collect(slot, true);
+    _next = (_next + 1) % _slots.size();
+
+    const GLsizeiptr size = static_cast<GLsizeiptr>(width) * height * channels;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    if (size > slot.capacity)
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+        slot.capacity = size;
+    }
+
+    GLint alignment;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1); // rows of 3 * width bytes
+    glReadPixels(x, y, width, height, format, GL_UNSIGNED_BYTE, nullptr);
+    glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.image.filename = filename;
+    slot.image.encoding = captureEncoding(filename);
+    slot.image.width = width;
+    slot.image.height = height;
+    slot.image.channels = channels;
+}
+
+bool FrameCapture::collect(Slot &slot, bool block)
+{
+    if (!slot.fence)
+        return true;
+
+    // flush the first time so that the fence is sure to be signaled eventually
+    GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    while (block && status == GL_TIMEOUT_EXPIRED)
+        status = glClientWaitSync(slot.fence, 0, 1000000000); // 1 s
+    if (status == GL_TIMEOUT_EXPIRED)
+        return false;
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+
+    Image image;
+    image.filename.swap(slot.image.filename);
+    image.encoding = slot.image.encoding;
+    image.width = slot.image.width;
+    image.height = slot.image.height;
+    image.channels = slot.image.channels;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_freePixels.empty())
+        {
+            image.pixels.swap(_freePixels.back());
+            _freePixels.pop_back();
+        }
+    }
+
+    const size_t size = static_cast<size_t>(image.width) * image.height * image.channels;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    const void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+    if (data)
+    {
+        image.pixels.resize(size);
+        std::memcpy(image.pixels.data(), data, size);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if (data)
+        enqueue(image);
+    else
+    {
+        std::cerr << "[FrameCapture][collect] cannot map the pixel buffer of " << image.filename << std::endl;
+        ++_failed;
+    }
+    return true;
+}
+
+void FrameCapture::enqueue(Image &image)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _queueChanged.wait(lock, [this] { return _queue.size() < _maxQueued; });
+    _queue.push_back(Image());
+    std::swap(_queue.back(), image);
+    lock.unlock();
+    _queueChanged.notify_all();
+}
+
+void FrameCapture::poll()
+{
+    // in submission order, stop at the first readback still in flight
+    for (size_t i = 0; i < _slots.size(); ++i)
+    {
+        Slot &slot = _slots[(_next + i) % _slots.size()];
+        if (slot.fence && !collect(slot, false))
+            break;
+    }
+}
+
+void FrameCapture::flush()
+{
+    for (size_t i = 0; i < _slots.size(); ++i)
+        collect(_slots[(_next + i) % _slots.size()], true);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _queueChanged.wait(lock, [this] { return _queue.empty() && _busy == 0; });
+}
+
+void FrameCapture::startRecording(const std::string &prefix, const std::string &extension)
+{
+    _recordPrefix = prefix;
+    _recordExtension = extension;
+    _recordedFrames = 0;
+    _recording = true;
+}
+
+void FrameCapture::stopRecording()
+{
+    _recording = false;
+}
+
+void FrameCapture::captureFrame(GLsizei width, GLsizei height)
+{
+    if (_recording)
+    {
+        char number[16];
+        std::snprintf(number, sizeof(number), "%06llu", static_cast<unsigned long long>(_recordedFrames++));
+        captureColor(0, 0, width, height, _recordPrefix + number + _recordExtension);
+    }
+    poll();
+}
+
+void FrameCapture::run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        _queueChanged.wait(lock, [this] { return _stop || !_queue.empty(); });
+        if (_queue.empty())
+            return;
+
+        Image image;
+        std::swap(image, _queue.front());
+        _queue.pop_front();
+        ++_busy;
+        lock.unlock();
+        _queueChanged.notify_all();
+
+        if (write(image))
+            ++_written;
+        else
+        {
+            std::cerr << "[FrameCapture][run] cannot write " << image.filename << std::endl;
+            ++_failed;
+        }
+
+        lock.lock();
+        if (_freePixels.size() < _maxQueued)
+            _freePixels.push_back(std::move(image.pixels));
+        --_busy;
+        _queueChanged.notify_all();
+    }
+}
+
+bool FrameCapture::write(const Image &image)
+{
+    std::FILE *out = std::fopen(image.filename.c_str(), "wb");
+    if (!out)
+        return false;
+
+    const size_t width = static_cast<size_t>(image.width);
+    const size_t height = static_cast<size_t>(image.height);
+    const unsigned char *pixels = image.pixels.data();
+    bool ok = true;
+
+    if (image.encoding == CAPTURE_TGA)
+    {
+        // bottom-up BGR, as read back: header then a single write
+        unsigned char header[18] = {0};
+        header[2] = image.channels == 1 ? 3 : 2; // uncompressed grey or true color
+        header[12] = static_cast<unsigned char>(width & 0xff);
+        header[13] = static_cast<unsigned char>(width >> 8);
+        header[14] = static_cast<unsigned char>(height & 0xff);
+        header[15] = static_cast<unsigned char>(height >> 8);
+        header[16] = static_cast<unsigned char>(8 * image.channels);
+        ok = std::fwrite(header, sizeof(header), 1, out) == 1 &&
+             std::fwrite(pixels, image.pixels.size(), 1, out) == 1;
+    }
+    else
+    {
+        // top-down rows; grey read back for a .ppm is expanded to RGB
+        const bool expand = image.encoding == CAPTURE_PPM && image.channels == 1;
+        const unsigned int channels = image.encoding == CAPTURE_PPM ? 3 : 1;
+        std::fprintf(out, "%s\n%zu %zu\n255\n", channels == 3 ? "P6" : "P5", width, height);
+
+        std::vector<unsigned char> row(expand ? 3 * width : 0);
+        const size_t rowBytes = width * image.channels;
+        for (size_t j = height; j-- > 0 && ok;)
+        {
+            const unsigned char *src = pixels + j * rowBytes;
+            if (expand)
+            {
+                for (size_t i = 0; i < width; ++i)
+                    row[3 * i] = row[3 * i + 1] = row[3 * i + 2] = src[i];
+                src = row.data();
+            }
+            ok = std::fwrite(src, width * channels, 1, out) == 1;
+        }
+    }
+
+    return std::fclose(out) == 0 && ok;
+}
@@ -0,0 +1,115 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <glad/gl.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// Image file written by the encoding thread, chosen from the extension of the file name
+enum CaptureEncoding
+{
+    CAPTURE_TGA = 0,  // ".tga": 24-bit BGR, uncompressed, bottom-up like the framebuffer
+    CAPTURE_PPM = 1,  // ".ppm": binary P6 RGB
+    CAPTURE_PGM = 2   // ".pgm": binary P5 grey, 8 bits
+};
+
+CaptureEncoding captureEncoding(const std::string &filename);
+
+// Asynchronous readback of the framebuffer to image files.
+//
+// glReadPixels writes into one of a ring of pixel pack buffers and returns at once; a fence tells
+// when the copy is done. The buffers are collected a few frames later by poll(), copied out and
+// handed over to a background thread which encodes and writes the files. The render thread only
+// waits when every buffer of the ring is still in flight, or when the encoding thread is
+// maxQueuedImages images behind: frames are never dropped, the rendering slows down instead.
+class FrameCapture
+{
+public:
+    // A valid OpenGL context must be active, and stay so until the object is destroyed
+    explicit FrameCapture(unsigned int numBuffers = 3, size_t maxQueuedImages = 8);
+
+    // Collect the pending readbacks, write all the files and stop the encoding thread
+    ~FrameCapture();
+
+    // Read back the color buffer of the read framebuffer, the file is written later
+    void captureColor(GLint x, GLint y, GLsizei width, GLsizei height, const std::string &filename);
+    // Read back the depth buffer of the read framebuffer, stored as 8-bit grey (replicated in a .ppm)
+    void captureDepth(GLint x, GLint y, GLsizei width, GLsizei height, const std::string &filename);
+
+    // Hand over the readbacks completed by the GPU, without waiting. Call once per frame.
+    void poll();
+    // Wait for all the readbacks and all the files to be written
+    void flush();
+
+    // Continuous recording: captureFrame() saves <prefix><frame number><extension> each time it is
+    // called until stopRecording()
+    void startRecording(const std::string &prefix, const std::string &extension = ".tga");
+    void stopRecording();
+    bool recording() const { return _recording; }
+    // Capture the frame if recording, then poll()
+    void captureFrame(GLsizei width, GLsizei height);
+
+    uint64_t numRecorded() const { return _recordedFrames; }
+    uint64_t numWritten() const { return _written.load(); }
+    uint64_t numFailed() const { return _failed.load(); }
+
+private:
+    FrameCapture(const FrameCapture &) = delete;
+    FrameCapture &operator=(const FrameCapture &) = delete;
+
+    struct Image
+    {
+        std::string filename;
+        CaptureEncoding encoding;
+        GLsizei width, height;
+        unsigned int channels;       // 3 for color, 1 for depth
+        std::vector<unsigned char> pixels; // rows bottom-up, tightly packed
+    };
+
+    struct Slot
+    {
+        GLuint pbo = 0;
+        GLsizeiptr capacity = 0;
+        GLsync fence = nullptr;  // not null while the readback is in flight
+        Image image;             // everything but the pixels
+    };
+
+    void readback(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, unsigned int channels,
+                  const std::string &filename);
+    // Copy a finished readback out of its buffer; wait for it if block, returns false if not done
+    bool collect(Slot &slot, bool block);
+    // Queue an image for the encoding thread, waits while the queue is full
+    void enqueue(Image &image);
+
+    void run();
+    static bool write(const Image &image);
+
+    std::vector<Slot> _slots;
+    unsigned int _next = 0; // next slot to be written, also the oldest one in flight
+
+    // encoding thread
+    std::deque<Image> _queue;
+    std::vector<std::vector<unsigned char>> _freePixels; // pixel storage given back by the thread
+    size_t _maxQueued;
+    size_t _busy = 0; // images taken from the queue, not written yet
+    bool _stop = false;
+    std::mutex _mutex;
+    std::condition_variable _queueChanged;
+    std::atomic<uint64_t> _written;
+    std::atomic<uint64_t> _failed;
+    std::thread _thread;
+
+    bool _recording = false;
+    std::string _recordPrefix;
+    std::string _recordExtension;
+    uint64_t _recordedFrames = 0;
+};
+
+#endif // FRAME_CAPTURE_H
@@ -9,6 +9,23 @@
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
+#include "VertexFormat.h"
+
+// Per-instance data of a draw, streamed to the GPU as instanced vertex attributes
+// (locations 3 to 11 of vertexShader.glsl) instead of being set as uniforms for every draw
+struct MeshInstance
+{
+    glm::mat4 modelMat;
+    glm::mat3 normMat;
+    glm::vec3 albedo;
+    glm::vec2 texLoaded; // albedo texture, normal texture: 1 if used, 0 otherwise
+
+    MeshInstance() : modelMat(1.f), normMat(1.f), albedo(1.f), texLoaded(0.f) {}
+    MeshInstance(const glm::mat4 &model, const glm::vec3 &color, bool albedoTex = false, bool normalTex = false)
+        : modelMat(model), normMat(glm::inverseTranspose(glm::mat3(model))), albedo(color),
+          texLoaded(albedoTex ? 1.f : 0.f, normalTex ? 1.f : 0.f) {}
+};
+
 class Mesh
 {
 public:
@@ -35,7 +52,13 @@ public:
     void recomputePerVertexTextureCoordinates();
 
     void init();
-    void render();
+    // Draw all the instances with a single call, the instance buffer is refilled every time
+    void render(const MeshInstance *instances, size_t count);
+    void render(const std::vector<MeshInstance> &instances);
+    void render(const MeshInstance &instance);
+    // As render(), with vertexArray() already bound, e.g. by a RenderState
+    void draw(const MeshInstance *instances, size_t count);
+    GLuint vertexArray() const { return _vao; }
     void clear();
 
     void addPlane(const float square_half_side = 1.0f);
@@ -47,11 +70,15 @@ private:
     std::vector<glm::vec2> _vertexTexCoords;
     std::vector<glm::uvec3> _triangleIndices;
 
+    void packBuffers(std::vector<PackedVertex> &vertices, std::vector<unsigned char> &indices);
+    void clearGPU();
+
     GLuint _vao = 0;
-    GLuint _posVbo = 0;
-    GLuint _normalVbo = 0;
-    GLuint _texCoordVbo = 0;
+    GLuint _vbo = 0; // interleaved PackedVertex
     GLuint _ibo = 0;
+    GLenum _indexType = GL_UNSIGNED_INT;
+    GLuint _instanceVbo = 0;
+    size_t _instanceCapacity = 0; // in instances
 };
 
 // utility: loader
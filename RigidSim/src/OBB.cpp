@@ -8,31 +8,39 @@
 #include <memory>
 #include <string>
 #include <iostream>
+#include <limits>
+#include <algorithm>
 
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 #include <Eigen/Dense> // Add the correct include path for Eigen library
 
-OBB OBB::ComputeOBBfromMesh(std::shared_ptr<Mesh> &mesh, const glm::mat4 &worldMat)
+template <typename Policy>
+OBBT<Policy> OBBT<Policy>::ComputeOBBfromMesh(const std::shared_ptr<Mesh> &mesh, const glm::mat<4, 4, tPos> &worldMat)
 {
+    typedef glm::vec<3, tLoc> vec3l;
+    typedef glm::mat<3, 3, tLoc> mat3l;
+    typedef Eigen::Matrix<tLoc, 3, 3> EigenMatrix3;
+    typedef Eigen::Matrix<tLoc, 3, 1> EigenVector3;
+
     // compute the center of the mesh
-    glm::vec3 MeshCenter = glm::vec3(0.0f, 0.0f, 0.0f);
+    vec3l MeshCenter = vec3l(0.0f, 0.0f, 0.0f);
     for (const auto &v : mesh->vertexPositions())
     {
-        MeshCenter += v;
+        MeshCenter += vec3l(v);
     }
-    MeshCenter /= mesh->vertexPositions().size();
+    MeshCenter /= tLoc(mesh->vertexPositions().size());
 
     // compute covariance matrix
-    glm::mat3 CovarianceMatrix = glm::mat3(0.0f);
+    mat3l CovarianceMatrix = mat3l(0.0f);
     for (const auto &v : mesh->vertexPositions())
     {
-        glm::vec3 v_ = v - MeshCenter;
+        vec3l v_ = vec3l(v) - MeshCenter;
         CovarianceMatrix += glm::outerProduct(v_, v_);
     }
-    CovarianceMatrix /= mesh->vertexPositions().size();
+    CovarianceMatrix /= tLoc(mesh->vertexPositions().size());
 
-    Eigen::Matrix3f eigenMatrix;
+    EigenMatrix3 eigenMatrix;
     for (int i = 0; i < 3; ++i) {
         for (int j = 0; j < 3; ++j) {
             if (CovarianceMatrix[i][j] < 0.0001f) 
@@ -47,12 +55,12 @@ OBB OBB::ComputeOBBfromMesh(std::shared_ptr<Mesh> &mesh, const glm::mat4 &worldM
     }
 
     // compute eigenvalues and eigenvectors
-    Eigen::EigenSolver<Eigen::Matrix3f> solver(eigenMatrix, true);
-    Eigen::Vector3f eigenvalues = solver.eigenvalues().real();
-    Eigen::Matrix3f eigenvectors = solver.eigenvectors().real();
+    Eigen::EigenSolver<EigenMatrix3> solver(eigenMatrix, true);
+    EigenVector3 eigenvalues = solver.eigenvalues().real();
+    EigenMatrix3 eigenvectors = solver.eigenvectors().real();
     
     // Create a list of (eigenvalue, index) pairs
-    std::vector<std::pair<float, int>> indexed_eigenvalues;
+    std::vector<std::pair<tLoc, int>> indexed_eigenvalues;
     for (int i = 0; i < 3; ++i) 
     {
         indexed_eigenvalues.push_back(std::make_pair(eigenvalues[i], i));
@@ -60,21 +68,21 @@ OBB OBB::ComputeOBBfromMesh(std::shared_ptr<Mesh> &mesh, const glm::mat4 &worldM
 
     // Sort the eigenvalues by their absolute value in descending order
     std::sort(indexed_eigenvalues.begin(), indexed_eigenvalues.end(),
-          [](const std::pair<float, int> &a, 
-          const std::pair<float, int> &b) 
+          [](const std::pair<tLoc, int> &a, 
+          const std::pair<tLoc, int> &b) 
           {
             return std::abs(a.first) > std::abs(b.first);
           });
 
     // Arrange the eigenvectors according to the sorted indices
-    Eigen::Matrix3f sortedEigenvectors;
+    EigenMatrix3 sortedEigenvectors;
     for (int i = 0; i < 3; ++i) 
     {
         int index = indexed_eigenvalues[i].second;
         sortedEigenvectors.col(i) = eigenvectors.col(index);
     }
 
-    glm::mat3 EigenVectors = glm::mat3(1.0f);
+    mat3l EigenVectors = mat3l(1.0f);
     for (int i = 0; i < 3; ++i) 
     {
         for (int j = 0; j < 3; ++j) 
@@ -84,25 +92,29 @@ OBB OBB::ComputeOBBfromMesh(std::shared_ptr<Mesh> &mesh, const glm::mat4 &worldM
     }
 
     // compute the half sizes
-    glm::vec3 minHalfSize(FLT_MAX);
-    glm::vec3 maxHalfSize(-FLT_MAX);
-    glm::mat3 invRotation = glm::transpose(EigenVectors); 
+    vec3l minHalfSize(std::numeric_limits<tLoc>::max());
+    vec3l maxHalfSize(-std::numeric_limits<tLoc>::max());
+    mat3l invRotation = glm::transpose(EigenVectors); 
 
     for (const auto &v : mesh->vertexPositions()) 
     {
-        glm::vec3 localVertex = invRotation * (v - MeshCenter); 
+        vec3l localVertex = invRotation * (vec3l(v) - MeshCenter); 
         minHalfSize = glm::min(minHalfSize, localVertex);
         maxHalfSize = glm::max(maxHalfSize, localVertex);
     }
 
-    glm::vec3 obbHalfSizes = (maxHalfSize - minHalfSize) * 0.5f;
+    vec3l obbHalfSizes = (maxHalfSize - minHalfSize) * tLoc(0.5);
 
     // update obb
-    OBB obb;
-    obb.center = glm::vec3(worldMat * glm::vec4(MeshCenter, 1.0f));
+    OBBT obb;
+    obb.center = glm::vec<3, tPos>(worldMat * glm::vec<4, tPos>(glm::vec<3, tPos>(MeshCenter), 1.0f));
     obb.halfSize = obbHalfSizes;
-    obb.Rotation = glm::mat3(worldMat);
+    obb.Rotation = mat3l(glm::mat<3, 3, tPos>(worldMat));
 
 
     return obb;
-};    
\ No newline at end of file
+};
+
+template class OBBT<FloatPrecision>;
+template class OBBT<DoublePrecision>;
+template class OBBT<MixedPrecision>;    
\ No newline at end of file
@@ -9,20 +9,28 @@
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
-class OBB
+// Oriented bounding box, templated on the precision policy (see typedefs.hpp):
+// the center is in world space with tPosition, the extents and orientation use tLocal.
+template <typename Policy>
+class OBBT
 {
 public:
-    glm::vec3 center;
-    glm::vec3 halfSize;
-    glm::mat3 Rotation;
+    typedef typename Policy::tPosition tPos;
+    typedef typename Policy::tLocal tLoc;
 
-    OBB() : center(0, 0, 0), halfSize(0, 0, 0), Rotation(glm::mat3(1.0f)) {}
-    OBB(const glm::vec3 &c, const glm::vec3 &hs, const  glm::mat3 &rot) : center(c), halfSize(hs), Rotation(rot) {}
+    glm::vec<3, tPos> center;
+    glm::vec<3, tLoc> halfSize;
+    glm::mat<3, 3, tLoc> Rotation;
 
-    static OBB ComputeOBBfromMesh(std::shared_ptr<Mesh> &mesh, const glm::mat4 &worldMat);
+    OBBT() : center(0, 0, 0), halfSize(0, 0, 0), Rotation(glm::mat<3, 3, tLoc>(1.0f)) {}
+    OBBT(const glm::vec<3, tPos> &c, const glm::vec<3, tLoc> &hs, const glm::mat<3, 3, tLoc> &rot) : center(c), halfSize(hs), Rotation(rot) {}
+
+    static OBBT ComputeOBBfromMesh(const std::shared_ptr<Mesh> &mesh, const glm::mat<4, 4, tPos> &worldMat);
 
 };   
 
+typedef OBBT<tPrecision> OBB;
+
 
 
 #endif  /* _OBB_HPP_ */
\ No newline at end of file
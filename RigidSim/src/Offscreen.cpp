@@ -0,0 +1,278 @@
+#include "Offscreen.h"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define OFFSCREEN_EGL
+#include <dlfcn.h>
+#endif
+
+namespace
+{
+// The few EGL types, values and entry points used here, resolved from libEGL at run time
+typedef void *EGLDisplay;
+typedef void *EGLConfig;
+typedef void *EGLContext;
+typedef void *EGLSurface;
+typedef unsigned int EGLBoolean;
+typedef unsigned int EGLenum;
+typedef khronos_int32_t EGLint;
+
+const EGLint EGL_NONE = 0x3038;
+const EGLint EGL_EXTENSIONS = 0x3055;
+const EGLint EGL_RENDERABLE_TYPE = 0x3040;
+const EGLint EGL_OPENGL_BIT = 0x0008;
+const EGLenum EGL_OPENGL_API = 0x30A2;
+const EGLint EGL_CONTEXT_MAJOR_VERSION = 0x3098;
+const EGLint EGL_CONTEXT_MINOR_VERSION = 0x30FB;
+const EGLint EGL_CONTEXT_OPENGL_PROFILE_MASK = 0x30FD;
+const EGLint EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT = 0x0001;
+const EGLenum EGL_PLATFORM_SURFACELESS_MESA = 0x31DD;
+
+typedef OffscreenContext::ProcAddress(KHRONOS_APIENTRY *PFN_eglGetProcAddress)(const char *);
+typedef EGLDisplay(KHRONOS_APIENTRY *PFN_eglGetDisplay)(void *);
+typedef EGLDisplay(KHRONOS_APIENTRY *PFN_eglGetPlatformDisplayEXT)(EGLenum, void *, const EGLint *);
+typedef EGLBoolean(KHRONOS_APIENTRY *PFN_eglInitialize)(EGLDisplay, EGLint *, EGLint *);
+typedef EGLBoolean(KHRONOS_APIENTRY *PFN_eglTerminate)(EGLDisplay);
+typedef const char *(KHRONOS_APIENTRY *PFN_eglQueryString)(EGLDisplay, EGLint);
+typedef EGLBoolean(KHRONOS_APIENTRY *PFN_eglBindAPI)(EGLenum);
+typedef EGLBoolean(KHRONOS_APIENTRY *PFN_eglChooseConfig)(EGLDisplay, const EGLint *, EGLConfig *, EGLint, EGLint *);
+typedef EGLContext(KHRONOS_APIENTRY *PFN_eglCreateContext)(EGLDisplay, EGLConfig, EGLContext, const EGLint *);
+typedef EGLBoolean(KHRONOS_APIENTRY *PFN_eglDestroyContext)(EGLDisplay, EGLContext);
+typedef EGLBoolean(KHRONOS_APIENTRY *PFN_eglMakeCurrent)(EGLDisplay, EGLSurface, EGLSurface, EGLContext);
+typedef EGLint(KHRONOS_APIENTRY *PFN_eglGetError)();
+
+struct Egl
+{
+    void *library = nullptr;
+    PFN_eglGetProcAddress GetProcAddress = nullptr;
+    PFN_eglGetDisplay GetDisplay = nullptr;
+    PFN_eglInitialize Initialize = nullptr;
+    PFN_eglTerminate Terminate = nullptr;
+    PFN_eglQueryString QueryString = nullptr;
+    PFN_eglBindAPI BindAPI = nullptr;
+    PFN_eglChooseConfig ChooseConfig = nullptr;
+    PFN_eglCreateContext CreateContext = nullptr;
+    PFN_eglDestroyContext DestroyContext = nullptr;
+    PFN_eglMakeCurrent MakeCurrent = nullptr;
+    PFN_eglGetError GetError = nullptr;
+} egl;
+
+#ifdef OFFSCREEN_EGL
+bool hasExtension(const char *extensions, const char *name)
+{
+    const size_t length = std::strlen(name);
+    for (const char *s = extensions; s && (s = std::strstr(s, name)); s += length)
+        if ((s == extensions || s[-1] == ' ') && (s[length] == ' ' || s[length] == '\0'))
+            return true;
+    return false;
+}
+
+std::string eglError(const std::string &what)
+{
+    char code[16];
+    std::snprintf(code, sizeof(code), "0x%04x", egl.GetError ? static_cast<unsigned int>(egl.GetError()) : 0u);
+    return "[Offscreen][OffscreenContext] " + what + " (EGL error " + code + ")";
+}
+
+template <typename T>
+void resolve(T &function, const char *name)
+{
+    function = reinterpret_cast<T>(dlsym(egl.library, name));
+    if (!function)
+        throw std::runtime_error(std::string("[Offscreen][OffscreenContext] Missing EGL entry point ") + name);
+}
+
+void loadEgl()
+{
+    if (egl.library)
+        return;
+    const char *names[] = {"libEGL.so.1", "libEGL.so", "libEGL.dylib"};
+    for (const char *name : names)
+        if ((egl.library = dlopen(name, RTLD_LAZY | RTLD_LOCAL)))
+            break;
+    if (!egl.library)
+        throw std::runtime_error("[Offscreen][OffscreenContext] Cannot load libEGL");
+
+    resolve(egl.GetProcAddress, "eglGetProcAddress");
+    resolve(egl.GetDisplay, "eglGetDisplay");
+    resolve(egl.Initialize, "eglInitialize");
+    resolve(egl.Terminate, "eglTerminate");
+    resolve(egl.QueryString, "eglQueryString");
+    resolve(egl.BindAPI, "eglBindAPI");
+    resolve(egl.ChooseConfig, "eglChooseConfig");
+    resolve(egl.CreateContext, "eglCreateContext");
+    resolve(egl.DestroyContext, "eglDestroyContext");
+    resolve(egl.MakeCurrent, "eglMakeCurrent");
+    resolve(egl.GetError, "eglGetError");
+}
+#endif
+
+uint64_t fnv1a(const unsigned char *data, const size_t size, uint64_t hash = 14695981039346656037ull)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+} // namespace
+
+OffscreenContext::OffscreenContext()
+{
+#ifndef OFFSCREEN_EGL
+    throw std::runtime_error("[Offscreen][OffscreenContext] EGL is not supported on this platform");
+#else
+    loadEgl();
+
+    // the surfaceless platform needs neither a display server nor a GPU; else the default
+    // display, which works on the headless drivers exposing a device
+    const char *clientExtensions = egl.QueryString(nullptr, EGL_EXTENSIONS);
+    PFN_eglGetPlatformDisplayEXT getPlatformDisplay =
+        reinterpret_cast<PFN_eglGetPlatformDisplayEXT>(egl.GetProcAddress("eglGetPlatformDisplayEXT"));
+    if (getPlatformDisplay && hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless"))
+        _display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, nullptr, nullptr);
+    if (!_display)
+        _display = egl.GetDisplay(nullptr);
+
+    EGLint major = 0, minor = 0;
+    if (!_display || !egl.Initialize(_display, &major, &minor))
+        throw std::runtime_error(eglError("Cannot initialize the EGL display"));
+    if (!egl.BindAPI(EGL_OPENGL_API))
+    {
+        egl.Terminate(_display);
+        throw std::runtime_error(eglError("Desktop OpenGL is not supported"));
+    }
+
+    // there is no surface, the configuration only matters if the driver requires one
+    const EGLint configAttributes[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    EGLConfig config = nullptr;
+    EGLint numConfigs = 0;
+    if (!egl.ChooseConfig(_display, configAttributes, &config, 1, &numConfigs) || numConfigs == 0)
+        config = nullptr; // EGL_NO_CONFIG_KHR
+
+    const EGLint contextAttributes[] = {EGL_CONTEXT_MAJOR_VERSION, 3,
+                                        EGL_CONTEXT_MINOR_VERSION, 3,
+                                        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                        EGL_NONE};
+    _context = egl.CreateContext(_display, config, nullptr, contextAttributes);
+    if (!_context)
+    {
+        const std::string message = eglError("Cannot create an OpenGL 3.3 core context");
+        egl.Terminate(_display);
+        throw std::runtime_error(message);
+    }
+    if (!egl.MakeCurrent(_display, nullptr, nullptr, _context))
+    {
+        const std::string message = eglError("Cannot make the context current without surface");
+        egl.DestroyContext(_display, _context);
+        egl.Terminate(_display);
+        throw std::runtime_error(message);
+    }
+#endif
+}
+
+OffscreenContext::~OffscreenContext()
+{
+    if (!_display)
+        return;
+    egl.MakeCurrent(_display, nullptr, nullptr, nullptr);
+    egl.DestroyContext(_display, _context);
+    egl.Terminate(_display);
+}
+
+OffscreenContext::ProcAddress OffscreenContext::getProcAddress(const char *name)
+{
+    return egl.GetProcAddress ? egl.GetProcAddress(name) : nullptr;
+}
+
+OffscreenTarget::OffscreenTarget(GLsizei width, GLsizei height) : _width(width), _height(height)
+{
+    GLint previous;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+
+    glGenRenderbuffers(1, &_color);
+    glBindRenderbuffer(GL_RENDERBUFFER, _color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &_depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, _depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, _depth);
+    const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, previous);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+    {
+        glDeleteFramebuffers(1, &_framebuffer);
+        glDeleteRenderbuffers(1, &_color);
+        glDeleteRenderbuffers(1, &_depth);
+        throw std::runtime_error("[Offscreen][OffscreenTarget] Incomplete framebuffer");
+    }
+}
+
+OffscreenTarget::~OffscreenTarget()
+{
+    glDeleteFramebuffers(1, &_framebuffer);
+    glDeleteRenderbuffers(1, &_color);
+    glDeleteRenderbuffers(1, &_depth);
+}
+
+void OffscreenTarget::read(std::vector<unsigned char> &pixels) const
+{
+    pixels.resize(static_cast<size_t>(_width) * _height * 4);
+
+    GLint previous, alignment;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previous);
+    glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, _framebuffer);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, _width, _height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, previous);
+}
+
+void RenderBenchmark::addFrame(double time, const std::vector<unsigned char> &pixels)
+{
+    const uint64_t hash = fnv1a(pixels.data(), pixels.size());
+    _times.push_back(time);
+    _hashes.push_back(hash);
+    _hash = fnv1a(reinterpret_cast<const unsigned char *>(&hash), sizeof(hash), _hash);
+}
+
+void RenderBenchmark::report(std::ostream &output) const
+{
+    char line[160];
+    for (size_t i = 0; i < _times.size(); ++i)
+    {
+        std::snprintf(line, sizeof(line), "frame %zu %.3f %016llx", i, _times[i],
+                      static_cast<unsigned long long>(_hashes[i]));
+        output << line << std::endl;
+    }
+    if (_times.empty())
+        return;
+
+    std::vector<double> sorted(_times);
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0;
+    for (double t : sorted)
+        total += t;
+    const double mean = total / sorted.size();
+    const size_t n = sorted.size();
+    const double median = n % 2 ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+    const double p95 = sorted[std::min(n - 1, static_cast<size_t>(0.95 * n))];
+    std::snprintf(line, sizeof(line), "frames %zu mean %.3f median %.3f p95 %.3f min %.3f max %.3f fps %.1f", n, mean,
+                  median, p95, sorted.front(), sorted.back(), mean > 0 ? 1000.0 / mean : 0.0);
+    output << line << std::endl;
+    std::snprintf(line, sizeof(line), "hash %016llx", static_cast<unsigned long long>(_hash));
+    output << line << std::endl;
+}
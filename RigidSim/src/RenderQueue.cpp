@@ -0,0 +1,183 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+const int meshShift = 16;
+const int materialShift = 32;
+const int programShift = 48;
+const int layerShift = 56;
+} // namespace
+
+void RenderState::invalidate()
+{
+    _program = unknown;
+    _vertexArray = unknown;
+    _activeUnit = unknown;
+    for (GLuint &texture : _textures)
+        texture = unknown;
+}
+
+void RenderState::useProgram(GLuint program)
+{
+    if (program == _program)
+    {
+        ++_skipped;
+        return;
+    }
+    glUseProgram(program);
+    _program = program;
+    ++_calls;
+}
+
+void RenderState::bindVertexArray(GLuint vertexArray)
+{
+    if (vertexArray == _vertexArray)
+    {
+        ++_skipped;
+        return;
+    }
+    glBindVertexArray(vertexArray);
+    _vertexArray = vertexArray;
+    ++_calls;
+}
+
+void RenderState::bindTexture(GLuint unit, GLuint texture)
+{
+    if (unit < maxUnits && texture == _textures[unit])
+    {
+        ++_skipped;
+        return;
+    }
+    if (unit != _activeUnit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        _activeUnit = unit;
+        ++_calls;
+    }
+    glBindTexture(GL_TEXTURE_2D, texture);
+    if (unit < maxUnits)
+        _textures[unit] = texture;
+    ++_calls;
+}
+
+RenderQueue::RenderQueue()
+{
+    _materials.push_back(RenderMaterial()); // noMaterial
+}
+
+unsigned int RenderQueue::addProgram(const std::shared_ptr<ShaderProgram> &program)
+{
+    if (_programs.size() >= (1u << (layerShift - programShift)))
+        throw std::runtime_error("[RenderQueue][addProgram] Too many programs");
+    _programs.push_back(program);
+    return static_cast<unsigned int>(_programs.size() - 1);
+}
+
+unsigned int RenderQueue::addMaterial(const RenderMaterial &material)
+{
+    if (_materials.size() >= (1u << (programShift - materialShift)))
+        throw std::runtime_error("[RenderQueue][addMaterial] Too many materials");
+    _materials.push_back(material);
+    return static_cast<unsigned int>(_materials.size() - 1);
+}
+
+unsigned int RenderQueue::addMesh(const std::shared_ptr<Mesh> &mesh)
+{
+    if (_meshes.size() >= (1u << (materialShift - meshShift)))
+        throw std::runtime_error("[RenderQueue][addMesh] Too many meshes");
+    _meshes.push_back(mesh);
+    return static_cast<unsigned int>(_meshes.size() - 1);
+}
+
+uint64_t RenderQueue::makeKey(unsigned int layer, unsigned int program, unsigned int material, unsigned int mesh,
+                              float depth)
+{
+    const uint64_t quantizedDepth = static_cast<uint64_t>(std::min(std::max(depth, 0.f), 1.f) * 65535.f);
+    return (static_cast<uint64_t>(layer & 0xff) << layerShift) | (static_cast<uint64_t>(program & 0xff) << programShift) |
+           (static_cast<uint64_t>(material & 0xffff) << materialShift) |
+           (static_cast<uint64_t>(mesh & 0xffff) << meshShift) | quantizedDepth;
+}
+
+void RenderQueue::submit(unsigned int program, unsigned int material, unsigned int mesh, const MeshInstance &instance,
+                         float depth, unsigned int layer)
+{
+    SortItem item;
+    item.key = makeKey(layer, program, material, mesh, depth);
+    item.command = static_cast<uint32_t>(_commands.size());
+    _items.push_back(item);
+    _commands.push_back(instance);
+}
+
+void RenderQueue::sort()
+{
+    const size_t n = _items.size();
+    _sorted.resize(n);
+
+    // the histograms of the 8 digits in a single read of the keys
+    static const int numDigits = 8;
+    size_t counts[numDigits][256] = {};
+    for (const SortItem &item : _items)
+        for (int d = 0; d < numDigits; ++d)
+            ++counts[d][(item.key >> (8 * d)) & 0xff];
+
+    for (int d = 0; d < numDigits; ++d)
+    {
+        // all the keys share this digit, e.g. a single layer or no depth: nothing to reorder
+        const size_t *count = counts[d];
+        if (count[(_items[0].key >> (8 * d)) & 0xff] == n)
+            continue;
+
+        size_t offsets[256];
+        size_t offset = 0;
+        for (int b = 0; b < 256; ++b)
+        {
+            offsets[b] = offset;
+            offset += count[b];
+        }
+        for (const SortItem &item : _items)
+            _sorted[offsets[(item.key >> (8 * d)) & 0xff]++] = item;
+        _items.swap(_sorted);
+    }
+}
+
+void RenderQueue::flush(RenderState &state)
+{
+    _numSubmitted = _items.size();
+    _numDrawCalls = 0;
+    if (_items.empty())
+        return;
+    sort();
+
+    // the draws whose keys differ in the depth only share all their state
+    const uint64_t stateMask = ~static_cast<uint64_t>(0) << meshShift;
+    for (size_t begin = 0; begin < _items.size();)
+    {
+        const uint64_t key = _items[begin].key;
+        size_t end = begin + 1;
+        while (end < _items.size() && (_items[end].key & stateMask) == (key & stateMask))
+            ++end;
+
+        const ShaderProgram &program = *_programs[(key >> programShift) & 0xff];
+        const RenderMaterial &material = _materials[(key >> materialShift) & 0xffff];
+        Mesh &mesh = *_meshes[(key >> meshShift) & 0xffff];
+
+        state.useProgram(program.id());
+        for (unsigned int i = 0; i < material.numTextures; ++i)
+            state.bindTexture(material.units[i], material.textures[i]);
+        state.bindVertexArray(mesh.vertexArray());
+
+        _batch.clear();
+        for (size_t i = begin; i < end; ++i)
+            _batch.push_back(_commands[_items[i].command]);
+        mesh.draw(_batch.data(), _batch.size());
+        ++_numDrawCalls;
+
+        begin = end;
+    }
+
+    _items.clear();
+    _commands.clear();
+}
@@ -0,0 +1,122 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/gl.h>
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+
+#include "ShaderProgram.h"
+#include "Mesh.h"
+
+// Textures of a material, each bound to its own texture unit. The sampler uniforms of the
+// programs point to these units once and for all.
+struct RenderMaterial
+{
+    static const unsigned int maxTextures = 4;
+
+    GLuint units[maxTextures];
+    GLuint textures[maxTextures];
+    unsigned int numTextures = 0;
+
+    RenderMaterial &texture(GLuint unit, GLuint texture)
+    {
+        if (numTextures < maxTextures)
+        {
+            units[numTextures] = unit;
+            textures[numTextures] = texture;
+            ++numTextures;
+        }
+        return *this;
+    }
+};
+
+// Last GL state set through it: the calls that would set the same state again are skipped.
+// The state is unknown after invalidate(), e.g. at the beginning of the frame, code outside the
+// render queue being free to change it.
+class RenderState
+{
+public:
+    RenderState() { invalidate(); }
+
+    void invalidate();
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vertexArray);
+    void bindTexture(GLuint unit, GLuint texture); // GL_TEXTURE_2D
+
+    // GL calls issued and skipped since the creation
+    uint64_t numCalls() const { return _calls; }
+    uint64_t numSkipped() const { return _skipped; }
+
+private:
+    static const unsigned int maxUnits = 16;
+    static const GLuint unknown = ~0u;
+
+    GLuint _program;
+    GLuint _vertexArray;
+    GLuint _activeUnit;
+    GLuint _textures[maxUnits];
+    uint64_t _calls = 0;
+    uint64_t _skipped = 0;
+};
+
+// Draws of a frame, submitted in any order as a sort key and the instance data.
+//
+// The key holds, from the most significant bits: the layer (8 bits, drawn in increasing order),
+// the program (8), the material (16), the mesh (16) and the depth (16). Once radix sorted, the
+// draws sharing a state follow each other: each state is set once, and the consecutive instances
+// of a mesh are drawn with a single call. Within a state, the draws go front to back.
+class RenderQueue
+{
+public:
+    // Material 0 has no texture, e.g. for the passes which sample none
+    static const unsigned int noMaterial = 0;
+
+    RenderQueue();
+
+    // Resources referred to by the keys, registered once: returns their index in the key.
+    // Throws std::runtime_error beyond 256 programs, 65536 materials or 65536 meshes.
+    unsigned int addProgram(const std::shared_ptr<ShaderProgram> &program);
+    unsigned int addMaterial(const RenderMaterial &material);
+    unsigned int addMesh(const std::shared_ptr<Mesh> &mesh);
+
+    // Queue a draw. depth orders the draws of the same state, from 0 (near) to 1 (far), e.g. the
+    // distance to the camera over the far plane distance.
+    void submit(unsigned int program, unsigned int material, unsigned int mesh, const MeshInstance &instance,
+                float depth = 0.f, unsigned int layer = 0);
+
+    // Sort and draw the queued draws, then empty the queue
+    void flush(RenderState &state);
+
+    size_t numQueued() const { return _commands.size(); }
+    // draws submitted and GL draw calls issued by the last flush
+    size_t numSubmitted() const { return _numSubmitted; }
+    size_t numDrawCalls() const { return _numDrawCalls; }
+
+    static uint64_t makeKey(unsigned int layer, unsigned int program, unsigned int material, unsigned int mesh,
+                            float depth);
+
+private:
+    struct SortItem
+    {
+        uint64_t key;
+        uint32_t command;
+    };
+
+    // LSD radix sort of the items on the key, 8 bits per pass; stable
+    void sort();
+
+    std::vector<std::shared_ptr<ShaderProgram>> _programs;
+    std::vector<RenderMaterial> _materials;
+    std::vector<std::shared_ptr<Mesh>> _meshes;
+
+    std::vector<MeshInstance> _commands; // instance data, in submission order
+    std::vector<SortItem> _items, _sorted;
+    std::vector<MeshInstance> _batch;
+    size_t _numSubmitted = 0;
+    size_t _numDrawCalls = 0;
+};
+
+#endif // RENDER_QUEUE_H
@@ -3,106 +3,172 @@
 
 #include <glm/ext/matrix_transform.hpp>
 
+#include <iostream>
+#include <vector>
+
+#include "typedefs.hpp"
 #include "Vector3.hpp"
 #include "Matrix3x3.hpp"
 #include "quaternion.hpp"
 #include "CollisionDetector.hpp"
 
-struct BodyAttributes
+// Rigid body state, templated on the precision policy (see typedefs.hpp):
+// the position is stored with tPosition, everything relative to the body with tLocal.
+template <typename Policy>
+struct BodyAttributesT
 {
-    BodyAttributes() : X(0, 0, 0), R(Mat3f::I()), P(0, 0, 0), L(0, 0, 0),
-                       V(0, 0, 0), omega(0, 0, 0), F(0, 0, 0), tau(0, 0, 0) {}
+    typedef typename Policy::tPosition tPos;
+    typedef typename Policy::tLocal tLoc;
+    typedef Vector3<tPos> Vec3p;
+    typedef Vector3<tLoc> Vec3l;
+    typedef Matrix3x3<tLoc> Mat3l;
+    typedef Quaternion<tLoc> Quatl;
+
+    BodyAttributesT() : X(0, 0, 0), R(Mat3l::I()), P(0, 0, 0), L(0, 0, 0),
+                        V(0, 0, 0), omega(0, 0, 0), F(0, 0, 0), tau(0, 0, 0) {}
 
     glm::mat4 worldMat() const
     {
+        return worldMat(Vec3p(0, 0, 0));
+    }
+
+    // world matrix relative to a given origin, e.g. the camera, to keep float precision for rendering far from 0
+    glm::mat4 worldMat(const Vec3p &origin) const
+    {
+        const Vec3p x = X - origin;
         return glm::mat4( // column-major
+            R(0, 0), R(1, 0), R(2, 0), 0,
+            R(0, 1), R(1, 1), R(2, 1), 0,
+            R(0, 2), R(1, 2), R(2, 2), 0,
+            x[0], x[1], x[2], 1);
+    }
+
+    // world matrix with the position at full precision, for the collision detection
+    glm::mat<4, 4, tPos> worldMatP() const
+    {
+        return glm::mat<4, 4, tPos>( // column-major
             R(0, 0), R(1, 0), R(2, 0), 0,
             R(0, 1), R(1, 1), R(2, 1), 0,
             R(0, 2), R(1, 2), R(2, 2), 0,
             X[0], X[1], X[2], 1);
     }
 
-    tReal M;         // mass
-    Mat3f I0, I0inv; // inertia tensor and its inverse in body space
-    Mat3f Iinv;      // inverse of inertia tensor
+    tLoc M;          // mass
+    Mat3l I0, I0inv; // inertia tensor and its inverse in body space
+    Mat3l Iinv;      // inverse of inertia tensor
 
     // rigid body state
-    Vec3f X; // position
-    Mat3f R; // rotation
-    Vec3f P; // linear momentum
-    Vec3f L; // angular momentum
-    Quaternionf q; // quaternion
+    Vec3p X; // position
+    Mat3l R; // rotation
+    Vec3l P; // linear momentum
+    Vec3l L; // angular momentum
+    Quatl q; // quaternion
 
     // auxiliary quantities
-    Vec3f V;     // linear velocity
-    Vec3f omega; // angular velocity
-    Quaternionf omega_q; // angular velocity in quaternion
+    Vec3l V;       // linear velocity
+    Vec3l omega;   // angular velocity
+    Quatl omega_q; // angular velocity in quaternion
 
     // force and torque
-    Vec3f F;   // force
-    Vec3f tau; // torque
+    Vec3l F;   // force
+    Vec3l tau; // torque
 
     // mesh's vertices in body space
-    std::vector<Vec3f> vdata0;
+    std::vector<Vec3l> vdata0;
 };
 
-class Box : public BodyAttributes
+template <typename Policy>
+class BoxT : public BodyAttributesT<Policy>
 {
 public:
-    explicit Box(
-        const tReal w = 1.0, const tReal h = 1.0, const tReal d = 1.0, const tReal dens = 10.0,
-        const Vec3f v0 = Vec3f(0, 0, 0), const Vec3f omega0 = Vec3f(0, 0, 0)) : width(w), height(h), depth(d)
+    typedef typename BodyAttributesT<Policy>::tLoc tLoc;
+    typedef typename BodyAttributesT<Policy>::Vec3l Vec3l;
+    typedef typename BodyAttributesT<Policy>::Mat3l Mat3l;
+
+    explicit BoxT(
+        const tLoc w = 1.0, const tLoc h = 1.0, const tLoc d = 1.0, const tLoc dens = 10.0,
+        const Vec3l v0 = Vec3l(0, 0, 0), const Vec3l omega0 = Vec3l(0, 0, 0)) : width(w), height(h), depth(d)
     {
-        V = v0;         // initial velocity
-        omega = omega0; // initial angular velocity
+        this->V = v0;         // initial velocity
+        this->omega = omega0; // initial angular velocity
 
         // TODO: calculate physical attributes
-        M = dens * w * h * d;                                             // mass = density * volume(widht * height * depth)
-        I0 = Mat3f(Vec3f(
+        const tLoc M = dens * w * h * d;                                  // mass = density * volume(widht * height * depth)
+        this->M = M;
+        this->I0 = Mat3l(Vec3l(
             M / 12.0 * (h * h + d * d),
             M / 12.0 * (w * w + d * d),
             M / 12.0 * (w * w + h * h)));                                 // inertia tensor in body space using matrix3x3(vec3 &diag) constructor
-        I0inv = I0.inverse();                                                 
-        Iinv = R * I0inv * R.transpose();                                 // inertia tensor inverse in world space            
+        this->I0inv = this->I0.inverse();
+        this->Iinv = this->R * this->I0inv * this->R.transposed();        // inertia tensor inverse in world space
 
         // vertices data (8 vertices)
-        vdata0.push_back(Vec3f(-0.5 * w, -0.5 * h, -0.5 * d));
-        vdata0.push_back(Vec3f(0.5 * w, -0.5 * h, -0.5 * d));
-        vdata0.push_back(Vec3f(0.5 * w, 0.5 * h, -0.5 * d));
-        vdata0.push_back(Vec3f(-0.5 * w, 0.5 * h, -0.5 * d));
-
-        vdata0.push_back(Vec3f(-0.5 * w, -0.5 * h, 0.5 * d));
-        vdata0.push_back(Vec3f(0.5 * w, -0.5 * h, 0.5 * d));
-        vdata0.push_back(Vec3f(0.5 * w, 0.5 * h, 0.5 * d));
-        vdata0.push_back(Vec3f(-0.5 * w, 0.5 * h, 0.5 * d));
+        this->vdata0.push_back(Vec3l(-0.5 * w, -0.5 * h, -0.5 * d));
+        this->vdata0.push_back(Vec3l(0.5 * w, -0.5 * h, -0.5 * d));
+        this->vdata0.push_back(Vec3l(0.5 * w, 0.5 * h, -0.5 * d));
+        this->vdata0.push_back(Vec3l(-0.5 * w, 0.5 * h, -0.5 * d));
+
+        this->vdata0.push_back(Vec3l(-0.5 * w, -0.5 * h, 0.5 * d));
+        this->vdata0.push_back(Vec3l(0.5 * w, -0.5 * h, 0.5 * d));
+        this->vdata0.push_back(Vec3l(0.5 * w, 0.5 * h, 0.5 * d));
+        this->vdata0.push_back(Vec3l(-0.5 * w, 0.5 * h, 0.5 * d));
     }
 
     // rigid body property
-    tReal width, height, depth;
+    tLoc width, height, depth;
 };
 
-class RigidSolver
+// Parameters of the contact resolution, in the precision of the local computations they enter
+template <typename Policy>
+struct ContactSettingsT
 {
-public:
-    explicit RigidSolver(
-        BodyAttributes *body0 = nullptr, const Vec3f g = Vec3f(0, 0, 0)) : body(body0), _g(g), _step(0), _sim_t(0) {}
+    typedef typename Policy::tLocal tLoc;
 
-    void init(BodyAttributes *body0)
+    ContactSettingsT() : restitution(tLoc(0.65)), slop(tLoc(0.002)), baumgarte(tLoc(0.4)), positionIterations(4) {}
+
+    tLoc restitution;          // coefficient of restitution used by the velocity impulse
+    tLoc slop;                 // penetration depth that is tolerated without correction
+    tLoc baumgarte;            // fraction of the penetration beyond the slop removed per iteration
+    tIndex positionIterations; // iterations of the position correction pass
+};
+
+template <typename Policy>
+class RigidSolverT
+{
+public:
+    typedef BodyAttributesT<Policy> Body;
+    typedef typename Body::tPos tPos;
+    typedef typename Body::tLoc tLoc;
+    typedef typename Body::Vec3p Vec3p;
+    typedef typename Body::Vec3l Vec3l;
+    typedef typename Body::Quatl Quatl;
+    typedef CollisionInfoT<Policy> Info;
+
+    explicit RigidSolverT(
+        Body *body0 = nullptr, const Vec3l g = Vec3l(0, 0, 0)) : body(body0), verbose(true), _g(g), _step(0), _sim_t(0) {}
+
+    void init(Body *body0)
     {
         body = body0;
         _step = 0;
         _sim_t = 0;
     }
 
-    void step(const tReal dt, const CollisionInfo &info)
+    void step(const tLoc dt, const Info &info)
     {
-        std::cout << "t=" << _sim_t << " (dt=" << dt << ")" << std::endl;
+        if (verbose)
+            std::cout << "t=" << _sim_t << " (dt=" << dt << ")" << std::endl;
 
         computeForceAndTorque();
 
         if (info.hasCollision)
         {
-            computeCollisionResponse(info.point, info.normal, dt);
+            // the contact point is attached to the body: remember it in body space before the update
+            const Vec3p p = Vec3p(info.point.x, info.point.y, info.point.z);
+            const Vec3l r0 = body->R.transposedMul(static_cast<Vec3l>(p - body->X));
+
+            computeCollisionResponse(p, info.normal, dt);
+            correctPenetration(r0, p, info.normal, info.depth);
         }
         else
         {
@@ -113,136 +179,180 @@ public:
         _sim_t += dt;
     }
 
-    BodyAttributes *body;
+    Body *body;
+    ContactSettingsT<Policy> contact;
+    bool verbose; // print the state of the contacts at each step
 
 private:
     void computeForceAndTorque()
     {
         // TODO: force and torque calculation
         body->F = _g * body->M;
-        body->tau = Vec3f(0, 0, 0);
+        body->tau = Vec3l(0, 0, 0);
 
         // TODO: instance force at the very first step
         if (_step == 1)
         {
-            body->F = Vec3f(0.0, 0.0, 0.0);
-            body->tau = (body->R * body->vdata0[0] - body->X).crossProduct(body->F);   // torque = (r - x) x F
+            body->F = Vec3l(0.0, 0.0, 0.0);
+            body->tau = (body->R * body->vdata0[0]).crossProduct(body->F);          // torque = (r - x) x F
         }
     }
 
-    void normalUpdate(const tReal dt)
+    // x = x + dt * v, accumulated in the precision of the positions
+    void integratePosition(const tLoc dt)
     {
-        body->P += dt * body->F;                                                      // p = p + dt * F
-        body->L += dt * body->tau;                                                    // L = L + dt * tau
-        body->X += dt * body->P / body->M;                                            // x = x + dt * p / m
+        body->X += static_cast<Vec3p>(body->V * dt);
+    }
+
+    // q = q + 0.5 * dt * omega_q * q
+    void integrateOrientation(const tLoc dt)
+    {
+        body->omega_q = Quatl(0, body->omega);
+        body->q = body->q + body->omega_q * body->q * (0.5 * dt);
+        body->q.normalize();                                                          // q = q / |q|
+        body->R = body->q.toRotMat();
+    }
+
+    void normalUpdate(const tLoc dt)
+    {
+        body->P += body->F * dt;                                                      // p = p + dt * F
+        body->L += body->tau * dt;                                                    // L = L + dt * tau
 
         body->V = body->P / body->M;                                                  // v = p / m
-        body->Iinv = body->R * body->I0inv * body->R.transpose();                     // Iinv = R * I0inv * R^T
+        integratePosition(dt);                                                        // x = x + dt * p / m
+        body->Iinv = body->R * body->I0inv * body->R.transposed();                    // Iinv = R * I0inv * R^T
         body->omega = body->Iinv * body->L;                                           // omega = Iinv * L
         //body->R = body->R + dt * (body->omega).crossProductMatrix() * body->R;        // R = R + dt * [omega] x R
 
-        body->omega_q = Quaternionf(0, body->omega);
-        body->q = body->q + 0.5 * dt * body->omega_q * body->q;                       // q = q + 0.5 * dt * omega_q * q
-        body->q.normalize();                                                          // q = q / |q|
-        body->R = body->q.toRotMat();  
-         
+        integrateOrientation(dt);
     }
 
-    void computeCollisionResponse(const glm::vec3 &cp, const glm::vec3 &cn, const tReal dt)
+    void computeCollisionResponse(const Vec3p &p, const glm::vec<3, tLoc> &cn, const tLoc dt)
     {
-        Vec3f n = Vec3f(cn.x, cn.y, cn.z).normalize();                                  // collision normal, the direction is from floor to body
-        Vec3f p = Vec3f(cp.x, cp.y, cp.z);                                              // collision point
+        Vec3l n = Vec3l(cn.x, cn.y, cn.z).normalize();                                  // collision normal, the direction is from floor to body
+        Vec3l r = static_cast<Vec3l>(p - body->X);                                      // collision point relative to the body
 
         // calculate the relative velocity
-        Vec3f v1 = body->V + body->omega.crossProduct(p - body->X);                     // v1 = v + omega x (p - x)
-        Vec3f v2 = Vec3f(0, 0, 0);                                                      // We know here that the floor is static
-        tReal vrel = n.dotProduct(v1 - v2);                                             // vrel = n (v1 - v2)                  
+        Vec3l v1 = body->V + body->omega.crossProduct(r);                               // v1 = v + omega x (p - x)
+        Vec3l v2 = Vec3l(0, 0, 0);                                                      // We know here that the floor is static
+        tLoc vrel = n.dotProduct(v1 - v2);                                              // vrel = n (v1 - v2)
 
         // handle the colliding contacts
 
-        if (vrel > -0.01f)                                                    
+        if (vrel > -0.01f)
         {
-            std::cout <<"------------------------------------------" << std::endl;
-            std::cout << "Vrel > 0 : Separating." << std::endl;
-            std::cout << "the collision point is:" << p << std::endl;
-            std::cout << "the force is:" << body->F << std::endl; 
-            std::cout << "the speed is:" << body->V << std::endl;
-            std::cout << "the velocity is:" << v1 << std::endl;
-            std::cout << "normal = " << n << std::endl;
-            std::cout << "Vrel = " << vrel  << std::endl;
-            std::cout << "Vrel > 0 : Nothing to do." << std::endl;
+            if (verbose)
+            {
+                std::cout <<"------------------------------------------" << std::endl;
+                std::cout << "Vrel > 0 : Separating." << std::endl;
+                std::cout << "the collision point is:" << p << std::endl;
+                std::cout << "the force is:" << body->F << std::endl;
+                std::cout << "the speed is:" << body->V << std::endl;
+                std::cout << "the velocity is:" << v1 << std::endl;
+                std::cout << "normal = " << n << std::endl;
+                std::cout << "Vrel = " << vrel  << std::endl;
+                std::cout << "Vrel > 0 : Nothing to do." << std::endl;
+            }
             normalUpdate(dt);
-        } 
+        }
 
-        else                                                 
+        else
         {
             // calculate the impulse
-            std::cout <<"------------------------------------------" << std::endl;
-            std::cout << "Vrel < 0 : Collision detected." << std::endl;
-            std::cout << "the velocity is of cp:" << v1 << std::endl;
-            std::cout << "Vrel = " << vrel  << std::endl;
-            std::cout << "the collision point is:" << p << std::endl;
-            std::cout << "normal is:" << n << std::endl;
-
-            tReal e = 0.65;                                                              // coefficient of restitution
-            tReal j = -(1 + e) * vrel /
-                     ((1 / body->M) + (body->Iinv * (p - body->X).crossProduct(n)).crossProduct(p - body->X).dotProduct(n));
-
-            
+            if (verbose)
+            {
+                std::cout <<"------------------------------------------" << std::endl;
+                std::cout << "Vrel < 0 : Collision detected." << std::endl;
+                std::cout << "the velocity is of cp:" << v1 << std::endl;
+                std::cout << "Vrel = " << vrel  << std::endl;
+                std::cout << "the collision point is:" << p << std::endl;
+                std::cout << "normal is:" << n << std::endl;
+            }
+
+            tLoc e = contact.restitution;                                                // coefficient of restitution
+            tLoc j = -(1 + e) * vrel /
+                     ((1 / body->M) + (body->Iinv * r.crossProduct(n)).crossProduct(r).dotProduct(n));
+
+
             // calculate the force and torque
-            Vec3f J = j * n;                                                             // J = j * n
-            std::cout << "the impulse is:" << J << std::endl;
-            body->tau = (p - body->X).crossProduct(J);                                   // tau = (p - x) x J
+            Vec3l J = n * j;                                                             // J = j * n
+            if (verbose)
+                std::cout << "the impulse is:" << J << std::endl;
+            body->tau = r.crossProduct(J);                                               // tau = (p - x) x J
             body->P += J;                                                                // p = p + J
             body->L += body->tau;                                                        // L = L + tau
-            body->omega = body->Iinv * body->L;                                          // omega = Iinv * L                  
+            body->omega = body->Iinv * body->L;                                          // omega = Iinv * L
 
             // calculate the separating velocity and acceleration
-            Vec3f a_rel = (body->F / body->M);                                           // a_rel = F / m
-            Vec3f omega_delta = body->Iinv * (body->L.crossProduct(body->omega)) + body->Iinv*body->tau; // omega_delta = Iinv * (L x omega) + Iinv * tau
-            Vec3f a_acc = a_rel + omega_delta.crossProduct(p - body->X) + body->omega.crossProduct(body->omega.crossProduct(p - body->X)); // a_acc = a_rel + omega_delta x (p - x) + omega x (omega x (p - x))
-            tReal a_sep = a_acc.dotProduct(n);                                           // a_sep = a_rel * n
+            Vec3l a_rel = (body->F / body->M);                                           // a_rel = F / m
+            Vec3l omega_delta = body->Iinv * (body->L.crossProduct(body->omega)) + body->Iinv*body->tau; // omega_delta = Iinv * (L x omega) + Iinv * tau
+            Vec3l a_acc = a_rel + omega_delta.crossProduct(r) + body->omega.crossProduct(body->omega.crossProduct(r)); // a_acc = a_rel + omega_delta x (p - x) + omega x (omega x (p - x))
+            tLoc a_sep = a_acc.dotProduct(n);                                            // a_sep = a_rel * n
 
             if (a_sep < 0.0f)                                                            // if a_sep < 0
             {
-                Vec3f pointOnPlane = Vec3f(0.0, -1.0, 0.0);
-                tReal penetration = (p - pointOnPlane).dotProduct(n);                         // penetration = (p - x) * n
-                if (penetration > 0.0f)
-                {
-                    std::cout << "nothing to do" << std::endl;
-                }
-                else
-                {
-                    std::cout << "penetration is:" << penetration << std::endl;
-                    tReal requiredJ = -penetration / dt * body->M / 22.5;                                  // requiredJ = -penetration / dt
-                    Vec3f J_sep1 = requiredJ * n;                                          // J_sep = requiredJ * n
-                    body->P += J_sep1;                                                     // p = p + J_sep
-                }
-                tReal j_sep = -a_sep * dt * body->M * 1; 
-                Vec3f J_sep = j_sep * n;                                                 // J_sep = j_sep * n
+                tLoc j_sep = -a_sep * dt * body->M * 1;
+                Vec3l J_sep = n * j_sep;                                                 // J_sep = j_sep * n
                 body->P += J_sep;                                                        // p = p + J_sep
-                body->L += (p - body->X).crossProduct(J_sep);                            // L = L + (p - x) x J_sep
+                body->L += r.crossProduct(J_sep);                                        // L = L + (p - x) x J_sep
             }
-            
-            body->P += dt * body->F;                                                     // p = p + dt * F
-            body->L += dt * body->tau;                                                   // L = L + dt * tau
-
-            std::cout << "p is:" << body->P << std::endl;
-            body->V = body->P / body->M;                                                 // v = p / m 
-            std::cout << "v is:" << body->V << std::endl;                                
-            body->X += dt * body->V;                                                     // x = x + dt * p / m
+
+            body->P += body->F * dt;                                                     // p = p + dt * F
+            body->L += body->tau * dt;                                                   // L = L + dt * tau
+
+            body->V = body->P / body->M;                                                 // v = p / m
+            if (verbose)
+            {
+                std::cout << "p is:" << body->P << std::endl;
+                std::cout << "v is:" << body->V << std::endl;
+            }
+            integratePosition(dt);                                                       // x = x + dt * p / m
             body->omega = body->Iinv * body->L;                                          // omega = Iinv * L
-            body->omega_q = Quaternionf(0, body->omega);
-            body->q = body->q + 0.5 * dt * body->omega_q * body->q;                      // q = q + 0.5 * dt * omega_q * q
-            body->q.normalize();                                                         // q = q / |q|
-            body->R = body->q.toRotMat();                                    
+            integrateOrientation(dt);
+        }
+    }
+
+    // Split impulse: push the body out of the contact by moving its position and orientation only,
+    // so that the penetration is resolved without adding momentum to the body.
+    // Nonlinear Gauss-Seidel: the penetration is re-evaluated at the corrected pose at each iteration.
+    void correctPenetration(const Vec3l &r0, const Vec3p &p0, const glm::vec<3, tLoc> &cn, const tLoc depth)
+    {
+        Vec3l n = Vec3l(cn.x, cn.y, cn.z).normalize();                                  // collision normal, from floor to body
+
+        for (tIndex it = 0; it < contact.positionIterations; ++it)
+        {
+            Vec3l r = body->R * r0;                                                      // lever arm at the current pose
+            Vec3l dp = static_cast<Vec3l>(body->X - p0) + r;                             // displacement of the contact point
+            tLoc penetration = depth - dp.dotProduct(n);                                 // remaining penetration along n
+            tLoc C = penetration - contact.slop;
+            if (C <= 0)
+                break;
+
+            // pseudo impulse along n removing a fraction of the penetration beyond the slop
+            tLoc k = (1 / body->M) + (body->Iinv * r.crossProduct(n)).crossProduct(r).dotProduct(n);
+            tLoc lambda = contact.baumgarte * C / k;
+
+            body->X += static_cast<Vec3p>(n * (lambda / body->M));                       // x = x + lambda * n / m
+            Vec3l dtheta = body->Iinv * r.crossProduct(n * lambda);                      // dtheta = Iinv * (r x lambda n)
+            body->q = body->q + Quatl(0, dtheta) * body->q * 0.5;                        // q = q + 0.5 * dtheta_q * q
+            body->q.normalize();
+            body->R = body->q.toRotMat();
+            body->Iinv = body->R * body->I0inv * body->R.transposed();
         }
+
+        // momenta are untouched, only the derived angular velocity follows the new orientation
+        body->omega = body->Iinv * body->L;
     }
 
     // simulation parameters
-    Vec3f _g;     // gravity
+    Vec3l _g;     // gravity
     tIndex _step; // step count
-    tReal _sim_t; // simulation time
+    tLoc _sim_t;  // simulation time
 };
 
+typedef BodyAttributesT<tPrecision> BodyAttributes;
+typedef BoxT<tPrecision> Box;
+typedef ContactSettingsT<tPrecision> ContactSettings;
+typedef RigidSolverT<tPrecision> RigidSolver;
+
 #endif /* _RIGIDSOLVER_HPP_ */
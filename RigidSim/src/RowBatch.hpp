@@ -0,0 +1,189 @@
+#ifndef _ROWBATCH_HPP_
+#define _ROWBATCH_HPP_
+
+#include <algorithm>
+
+#include "typedefs.hpp"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define ROWBATCH_SSE
+#include <xmmintrin.h>
+#endif
+
+// 'Width' scalar constraint rows stored as a structure of arrays. The lanes of a batch never share
+// a body, so a batch is solved with lane-wise arithmetic only: Width = 8 floats or 4 doubles fill a
+// 256-bit register.
+template <typename T, unsigned Width>
+struct RowBatchT
+{
+    tIndex bodyA[Width], bodyB[Width];
+    T J[12][Width];                    // Jacobian: linear A, angular A, linear B, angular B
+    T MJ[12][Width];                   // M^-1 J^T: velocity change per unit impulse
+    T invK[Width];                     // 1 / (J M^-1 J^T)
+    T target[Width];                   // velocity target of the velocity pass
+    T bias[Width];                     // velocity target of the position pass
+    T lo[Width], hi[Width];            // bounds of the accumulated impulse
+    T lambda[Width], lambdaPos[Width]; // accumulated impulses of both passes
+    T *store[Width];                   // where lambda is kept for warm starting, or nullptr
+};
+
+// Kernels on the batches. The velocities of the bodies are stored 8 values per body:
+// linear velocity, 0, angular velocity, 0.
+template <typename T, unsigned Width>
+struct RowBatchScalarKernel
+{
+    static void gather(const tIndex *body, const T *v, T out[6][Width])
+    {
+        for (int k = 0; k < 3; ++k)
+            for (unsigned l = 0; l < Width; ++l)
+            {
+                out[k][l] = v[8 * body[l] + k];
+                out[3 + k][l] = v[8 * body[l] + 4 + k];
+            }
+    }
+
+    static void scatter(const tIndex *body, T *v, const T in[6][Width])
+    {
+        for (int k = 0; k < 3; ++k)
+            for (unsigned l = 0; l < Width; ++l)
+            {
+                v[8 * body[l] + k] = in[k][l];
+                v[8 * body[l] + 4 + k] = in[3 + k][l];
+            }
+    }
+
+    // v = v + M^-1 J^T lambda
+    static void applyImpulse(const RowBatchT<T, Width> &batch, T *v, const T *lambda)
+    {
+        T va[6][Width], vb[6][Width];
+        gather(batch.bodyA, v, va);
+        gather(batch.bodyB, v, vb);
+        for (int k = 0; k < 6; ++k)
+            for (unsigned l = 0; l < Width; ++l)
+            {
+                va[k][l] += batch.MJ[k][l] * lambda[l];
+                vb[k][l] += batch.MJ[6 + k][l] * lambda[l];
+            }
+        // the world slot is written back unchanged since its M^-1 is 0
+        scatter(batch.bodyA, v, va);
+        scatter(batch.bodyB, v, vb);
+    }
+
+    // One projected Gauss-Seidel update of all the lanes towards J v = rhs
+    static void solve(const RowBatchT<T, Width> &batch, T *v, const T *rhs, T *lambda)
+    {
+        T va[6][Width], vb[6][Width], delta[Width], acc[Width];
+        gather(batch.bodyA, v, va);
+        gather(batch.bodyB, v, vb);
+
+        // local copies: rhs and lambda point into the batch, which would prevent the vectorization
+        for (unsigned l = 0; l < Width; ++l)
+        {
+            delta[l] = rhs[l];
+            acc[l] = lambda[l];
+        }
+        for (int k = 0; k < 6; ++k)
+            for (unsigned l = 0; l < Width; ++l)
+                delta[l] -= batch.J[k][l] * va[k][l] + batch.J[6 + k][l] * vb[k][l];   // rhs - J v
+
+        for (unsigned l = 0; l < Width; ++l)
+        {
+            const T old = acc[l];
+            acc[l] = std::min(std::max(old + delta[l] * batch.invK[l], batch.lo[l]), batch.hi[l]);
+            delta[l] = acc[l] - old;
+        }
+        for (unsigned l = 0; l < Width; ++l)
+            lambda[l] = acc[l];
+
+        for (int k = 0; k < 6; ++k)
+            for (unsigned l = 0; l < Width; ++l)
+            {
+                va[k][l] += batch.MJ[k][l] * delta[l];
+                vb[k][l] += batch.MJ[6 + k][l] * delta[l];
+            }
+        scatter(batch.bodyA, v, va);
+        scatter(batch.bodyB, v, vb);
+    }
+};
+
+// Portable kernel: the compiler vectorizes the lane loops when it can
+template <typename T, unsigned Width>
+struct RowBatchKernel : public RowBatchScalarKernel<T, Width>
+{
+};
+
+#ifdef ROWBATCH_SSE
+// Float kernel on 4 lanes at a time with SSE: the velocities of 4 bodies are gathered into
+// registers with a 4x4 transpose instead of going through memory lane by lane
+template <unsigned Width>
+struct RowBatchKernel<float, Width> : public RowBatchScalarKernel<float, Width>
+{
+    static void gather4(const float *v, const tIndex *body, __m128 out[6])
+    {
+        for (int h = 0; h < 2; ++h)
+        {
+            __m128 r0 = _mm_loadu_ps(v + 8 * body[0] + 4 * h);
+            __m128 r1 = _mm_loadu_ps(v + 8 * body[1] + 4 * h);
+            __m128 r2 = _mm_loadu_ps(v + 8 * body[2] + 4 * h);
+            __m128 r3 = _mm_loadu_ps(v + 8 * body[3] + 4 * h);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            out[3 * h] = r0;
+            out[3 * h + 1] = r1;
+            out[3 * h + 2] = r2;
+        }
+    }
+
+    static void scatter4(float *v, const tIndex *body, const __m128 in[6])
+    {
+        for (int h = 0; h < 2; ++h)
+        {
+            __m128 r0 = in[3 * h], r1 = in[3 * h + 1], r2 = in[3 * h + 2], r3 = _mm_setzero_ps();
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(v + 8 * body[0] + 4 * h, r0);
+            _mm_storeu_ps(v + 8 * body[1] + 4 * h, r1);
+            _mm_storeu_ps(v + 8 * body[2] + 4 * h, r2);
+            _mm_storeu_ps(v + 8 * body[3] + 4 * h, r3);
+        }
+    }
+
+    static void solve(const RowBatchT<float, Width> &batch, float *v, const float *rhs, float *lambda)
+    {
+        if (Width % 4 != 0)
+        {
+            RowBatchScalarKernel<float, Width>::solve(batch, v, rhs, lambda);
+            return;
+        }
+
+        for (unsigned l = 0; l + 4 <= Width; l += 4)
+        {
+            __m128 va[6], vb[6];
+            gather4(v, batch.bodyA + l, va);
+            gather4(v, batch.bodyB + l, vb);
+
+            // rhs - J v, with one sum per body to shorten the dependency chain
+            __m128 dA = _mm_loadu_ps(rhs + l), dB = _mm_setzero_ps();
+            for (int k = 0; k < 6; ++k)
+            {
+                dA = _mm_sub_ps(dA, _mm_mul_ps(_mm_loadu_ps(&batch.J[k][l]), va[k]));
+                dB = _mm_sub_ps(dB, _mm_mul_ps(_mm_loadu_ps(&batch.J[6 + k][l]), vb[k]));
+            }
+
+            const __m128 old = _mm_loadu_ps(lambda + l);
+            __m128 acc = _mm_add_ps(old, _mm_mul_ps(_mm_add_ps(dA, dB), _mm_loadu_ps(&batch.invK[l])));
+            acc = _mm_min_ps(_mm_max_ps(acc, _mm_loadu_ps(&batch.lo[l])), _mm_loadu_ps(&batch.hi[l]));
+            const __m128 delta = _mm_sub_ps(acc, old);
+            _mm_storeu_ps(lambda + l, acc);
+
+            for (int k = 0; k < 6; ++k)
+            {
+                va[k] = _mm_add_ps(va[k], _mm_mul_ps(_mm_loadu_ps(&batch.MJ[k][l]), delta));
+                vb[k] = _mm_add_ps(vb[k], _mm_mul_ps(_mm_loadu_ps(&batch.MJ[6 + k][l]), delta));
+            }
+            scatter4(v, batch.bodyA + l, va);
+            scatter4(v, batch.bodyB + l, vb);
+        }
+    }
+};
+#endif
+
+#endif /* _ROWBATCH_HPP_ */
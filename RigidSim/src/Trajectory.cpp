@@ -0,0 +1,413 @@
+#include "Trajectory.h"
+
+#include <cstring>
+#include <chrono>
+#include <ios>
+#include <algorithm>
+#include <stdexcept>
+
+#include <glm/gtc/packing.hpp>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TRAJECTORY_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+const char trajectoryMagic[8] = {'R', 'I', 'G', 'I', 'D', 'T', 'R', 'J'};
+const uint32_t chunkMagic = 0x4b4e4843; // "CHNK"
+const uint32_t trajectoryVersion = 1;
+
+uint64_t pageSize()
+{
+#ifdef TRAJECTORY_MMAP
+    return static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#else
+    return 4096;
+#endif
+}
+
+uint64_t roundUp(const uint64_t n, const uint64_t alignment)
+{
+    return (n + alignment - 1) / alignment * alignment;
+}
+
+template <typename T>
+void put(unsigned char *&p, const T value)
+{
+    std::memcpy(p, &value, sizeof(T));
+    p += sizeof(T);
+}
+
+template <typename T>
+T get(const unsigned char *&p)
+{
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return value;
+}
+
+void unmapFile(const unsigned char *data, const size_t size)
+{
+#ifdef TRAJECTORY_MMAP
+    if (data)
+        munmap(const_cast<unsigned char *>(data), size);
+#endif
+}
+
+// bytes per body in a record
+uint32_t bodyBytes(const TrajectoryEncoding encoding)
+{
+    return encoding == TRAJECTORY_HALF ? 7 * sizeof(uint16_t) : 3 * sizeof(double) + 4 * sizeof(float);
+}
+} // namespace
+
+TrajectoryWriter::TrajectoryWriter(const std::string &filename, tIndex numBodies,
+                                   TrajectoryEncoding encoding, const glm::dvec3 &origin,
+                                   tIndex framesPerChunk, tIndex queueFrames)
+    : _filename(filename), _numBodies(numBodies), _ringFrames(std::max(queueFrames, 1u)),
+      _head(0), _tail(0), _reserved(false), _dropped(0), _written(0), _failed(false), _stop(false),
+      _fd(-1), _file(nullptr), _chunk(nullptr), _chunkIndex(0)
+{
+    const uint64_t page = pageSize();
+
+    std::memset(&_header, 0, sizeof(_header));
+    std::memcpy(_header.magic, trajectoryMagic, sizeof(trajectoryMagic));
+    _header.version = trajectoryVersion;
+    _header.numBodies = numBodies;
+    _header.encoding = encoding;
+    _header.recordBytes = sizeof(uint64_t) + sizeof(double) + numBodies * bodyBytes(encoding);
+    _header.chunkBytes = static_cast<uint32_t>(
+        roundUp(sizeof(TrajectoryChunkHeader) + uint64_t(std::max(framesPerChunk, 1u)) * _header.recordBytes, page));
+    _header.framesPerChunk = (_header.chunkBytes - sizeof(TrajectoryChunkHeader)) / _header.recordBytes;
+    _header.headerBytes = roundUp(sizeof(TrajectoryFileHeader), page);
+    _header.numFrames = 0;
+    _header.origin[0] = origin.x;
+    _header.origin[1] = origin.y;
+    _header.origin[2] = origin.z;
+
+#ifdef TRAJECTORY_MMAP
+    _fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (_fd < 0)
+        throw std::ios_base::failure("[Trajectory][TrajectoryWriter] Cannot create " + filename);
+#else
+    _file = std::fopen(filename.c_str(), "w+b");
+    if (!_file)
+        throw std::ios_base::failure("[Trajectory][TrajectoryWriter] Cannot create " + filename);
+    _chunkBuffer.resize(_header.chunkBytes);
+#endif
+    writeHeader();
+
+    // all the memory of the simulation side is allocated here
+    _ring.resize(_ringFrames * slotDoubles());
+    _thread = std::thread(&TrajectoryWriter::run, this);
+}
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+    _stop = true;
+    _thread.join();
+
+    _header.numFrames = _written;
+    writeHeader();
+#ifdef TRAJECTORY_MMAP
+    close(_fd);
+#else
+    std::fclose(_file);
+#endif
+}
+
+bool TrajectoryWriter::beginFrame(uint64_t step, double time)
+{
+    const uint64_t head = _head.load(std::memory_order_relaxed);
+    if (_failed.load(std::memory_order_relaxed) || head - _tail.load(std::memory_order_acquire) >= _ringFrames)
+    {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        _reserved = false;
+        return false;
+    }
+
+    double *slot = &_ring[(head % _ringFrames) * slotDoubles()];
+    slot[0] = static_cast<double>(step);
+    slot[1] = time;
+    _reserved = true;
+    return true;
+}
+
+void TrajectoryWriter::setBody(tIndex body, const glm::dvec3 &position, const glm::quat &orientation)
+{
+    if (!_reserved || body >= _numBodies)
+        return;
+    const uint64_t head = _head.load(std::memory_order_relaxed);
+    double *slot = &_ring[(head % _ringFrames) * slotDoubles() + 2 + 7 * body];
+    slot[0] = position.x;
+    slot[1] = position.y;
+    slot[2] = position.z;
+    slot[3] = orientation.w;
+    slot[4] = orientation.x;
+    slot[5] = orientation.y;
+    slot[6] = orientation.z;
+}
+
+void TrajectoryWriter::endFrame()
+{
+    if (!_reserved)
+        return;
+    _reserved = false;
+    _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// Writer thread: encode the frames of the ring into the mapped chunks until the writer is destroyed
+void TrajectoryWriter::run()
+{
+    while (true)
+    {
+        const uint64_t head = _head.load(std::memory_order_acquire);
+        uint64_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == head)
+        {
+            if (_stop)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        for (; tail != head && !_failed; ++tail)
+        {
+            const uint64_t frame = _written.load(std::memory_order_relaxed);
+            const uint64_t chunk = frame / _header.framesPerChunk;
+            const uint32_t inChunk = static_cast<uint32_t>(frame % _header.framesPerChunk);
+            if (!_chunk || chunk != _chunkIndex)
+            {
+                unmapChunk();
+                if (!mapChunk(chunk))
+                {
+                    _failed = true;
+                    break;
+                }
+            }
+
+            encode(&_ring[(tail % _ringFrames) * slotDoubles()],
+                   _chunk + sizeof(TrajectoryChunkHeader) + uint64_t(inChunk) * _header.recordBytes);
+            TrajectoryChunkHeader *chunkHeader = reinterpret_cast<TrajectoryChunkHeader *>(_chunk);
+            chunkHeader->numFrames = inChunk + 1;
+            _written.store(frame + 1, std::memory_order_relaxed);
+        }
+
+        // frames lost to an error are released too
+        _tail.store(_failed ? head : tail, std::memory_order_release);
+    }
+    unmapChunk();
+}
+
+void TrajectoryWriter::encode(const double *slot, unsigned char *record) const
+{
+    unsigned char *p = record;
+    put<uint64_t>(p, static_cast<uint64_t>(slot[0]));
+    put<double>(p, slot[1]);
+    for (tIndex b = 0; b < _numBodies; ++b)
+    {
+        const double *s = slot + 2 + 7 * b;
+        if (_header.encoding == TRAJECTORY_HALF)
+        {
+            for (int k = 0; k < 3; ++k)
+                put<uint16_t>(p, glm::packHalf1x16(static_cast<float>(s[k] - _header.origin[k])));
+            for (int k = 3; k < 7; ++k)
+                put<uint16_t>(p, glm::packHalf1x16(static_cast<float>(s[k])));
+        }
+        else
+        {
+            for (int k = 0; k < 3; ++k)
+                put<double>(p, s[k]);
+            for (int k = 3; k < 7; ++k)
+                put<float>(p, static_cast<float>(s[k]));
+        }
+    }
+}
+
+bool TrajectoryWriter::mapChunk(uint64_t chunk)
+{
+    const uint64_t offset = _header.headerBytes + chunk * _header.chunkBytes;
+#ifdef TRAJECTORY_MMAP
+    if (ftruncate(_fd, static_cast<off_t>(offset + _header.chunkBytes)) != 0)
+        return false;
+    void *data = mmap(nullptr, _header.chunkBytes, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, static_cast<off_t>(offset));
+    if (data == MAP_FAILED)
+        return false;
+    _chunk = static_cast<unsigned char *>(data);
+#else
+    std::fill(_chunkBuffer.begin(), _chunkBuffer.end(), 0);
+    _chunk = &_chunkBuffer[0];
+#endif
+    _chunkIndex = chunk;
+
+    TrajectoryChunkHeader chunkHeader;
+    chunkHeader.magic = chunkMagic;
+    chunkHeader.numFrames = 0;
+    chunkHeader.firstFrame = chunk * _header.framesPerChunk;
+    std::memcpy(_chunk, &chunkHeader, sizeof(chunkHeader));
+    return true;
+}
+
+// The pages of the chunk are written back by the system, unmapping does not wait for the disk
+void TrajectoryWriter::unmapChunk()
+{
+    if (!_chunk)
+        return;
+#ifdef TRAJECTORY_MMAP
+    munmap(_chunk, _header.chunkBytes);
+#else
+    std::fseek(_file, static_cast<long>(_header.headerBytes + _chunkIndex * _header.chunkBytes), SEEK_SET);
+    if (std::fwrite(_chunk, _header.chunkBytes, 1, _file) != 1)
+        _failed = true;
+#endif
+    _chunk = nullptr;
+}
+
+void TrajectoryWriter::writeHeader()
+{
+    std::vector<unsigned char> bytes(_header.headerBytes, 0);
+    std::memcpy(&bytes[0], &_header, sizeof(_header));
+#ifdef TRAJECTORY_MMAP
+    if (pwrite(_fd, &bytes[0], bytes.size(), 0) != static_cast<ssize_t>(bytes.size()))
+        _failed = true;
+#else
+    std::fseek(_file, 0, SEEK_SET);
+    if (std::fwrite(&bytes[0], bytes.size(), 1, _file) != 1)
+        _failed = true;
+#endif
+}
+
+TrajectoryReader::TrajectoryReader(const std::string &filename) : _numFrames(0), _data(nullptr), _size(0)
+{
+#ifdef TRAJECTORY_MMAP
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::ios_base::failure("[Trajectory][TrajectoryReader] Cannot open " + filename);
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        _size = static_cast<size_t>(st.st_size);
+        void *data = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+        _data = data == MAP_FAILED ? nullptr : static_cast<const unsigned char *>(data);
+    }
+    close(fd);
+#else
+    std::FILE *file = std::fopen(filename.c_str(), "rb");
+    if (!file)
+        throw std::ios_base::failure("[Trajectory][TrajectoryReader] Cannot open " + filename);
+    std::fseek(file, 0, SEEK_END);
+    _buffer.resize(static_cast<size_t>(std::ftell(file)));
+    std::fseek(file, 0, SEEK_SET);
+    if (!_buffer.empty() && std::fread(&_buffer[0], _buffer.size(), 1, file) == 1)
+    {
+        _data = &_buffer[0];
+        _size = _buffer.size();
+    }
+    std::fclose(file);
+#endif
+
+    if (!_data || _size < sizeof(TrajectoryFileHeader))
+    {
+        unmapFile(_data, _size);
+        throw std::ios_base::failure("[Trajectory][TrajectoryReader] Cannot read " + filename);
+    }
+    std::memcpy(&_header, _data, sizeof(_header));
+    // the layout must fit in the file: the chunks after the header, the frames of a chunk in it
+    if (std::memcmp(_header.magic, trajectoryMagic, sizeof(trajectoryMagic)) != 0 ||
+        _header.version != trajectoryVersion || _header.framesPerChunk == 0 ||
+        _header.recordBytes != sizeof(uint64_t) + sizeof(double) + uint64_t(_header.numBodies) * bodyBytes(encoding()) ||
+        _header.headerBytes < sizeof(TrajectoryFileHeader) || _header.headerBytes > _size ||
+        _header.chunkBytes < sizeof(TrajectoryChunkHeader) + uint64_t(_header.framesPerChunk) * _header.recordBytes)
+    {
+        unmapFile(_data, _size);
+        throw std::ios_base::failure("[Trajectory][TrajectoryReader] Not a trajectory log: " + filename);
+    }
+
+    // count the frames from the chunk headers, the last chunk may be partially filled. The chunks hold the frames
+    // in order: one out of place ends the log, every frame found is then within the file.
+    uint64_t chunk = 0;
+    for (uint64_t offset = _header.headerBytes; _size - offset >= _header.chunkBytes;
+         offset += _header.chunkBytes, ++chunk)
+    {
+        TrajectoryChunkHeader chunkHeader;
+        std::memcpy(&chunkHeader, _data + offset, sizeof(chunkHeader));
+        if (chunkHeader.magic != chunkMagic || chunkHeader.firstFrame != chunk * _header.framesPerChunk)
+            break;
+        _numFrames = chunk * _header.framesPerChunk + std::min(chunkHeader.numFrames, _header.framesPerChunk);
+        if (chunkHeader.numFrames < _header.framesPerChunk)
+            break;
+    }
+}
+
+TrajectoryReader::~TrajectoryReader()
+{
+    unmapFile(_data, _size);
+}
+
+const unsigned char *TrajectoryReader::record(uint64_t frame) const
+{
+    if (frame >= _numFrames)
+        throw std::out_of_range("[Trajectory][record] Frame " + std::to_string(frame) + " of a log of " +
+                                std::to_string(_numFrames) + " frames");
+    const uint64_t chunk = frame / _header.framesPerChunk;
+    const uint64_t inChunk = frame % _header.framesPerChunk;
+    return _data + _header.headerBytes + chunk * _header.chunkBytes + sizeof(TrajectoryChunkHeader) +
+           inChunk * _header.recordBytes;
+}
+
+uint64_t TrajectoryReader::step(uint64_t frame) const
+{
+    const unsigned char *p = record(frame);
+    return get<uint64_t>(p);
+}
+
+double TrajectoryReader::time(uint64_t frame) const
+{
+    const unsigned char *p = record(frame) + sizeof(uint64_t);
+    return get<double>(p);
+}
+
+void TrajectoryReader::body(uint64_t frame, tIndex body, glm::dvec3 &position, glm::quat &orientation) const
+{
+    if (body >= numBodies())
+        throw std::out_of_range("[Trajectory][body] Body " + std::to_string(body) + " of " +
+                                std::to_string(numBodies()) + " bodies");
+    const unsigned char *p = record(frame) + sizeof(uint64_t) + sizeof(double) +
+                             body * bodyBytes(encoding());
+    if (encoding() == TRAJECTORY_HALF)
+    {
+        for (int k = 0; k < 3; ++k)
+            position[k] = _header.origin[k] + glm::unpackHalf1x16(get<uint16_t>(p));
+        orientation.w = glm::unpackHalf1x16(get<uint16_t>(p));
+        orientation.x = glm::unpackHalf1x16(get<uint16_t>(p));
+        orientation.y = glm::unpackHalf1x16(get<uint16_t>(p));
+        orientation.z = glm::unpackHalf1x16(get<uint16_t>(p));
+    }
+    else
+    {
+        for (int k = 0; k < 3; ++k)
+            position[k] = get<double>(p);
+        orientation.w = get<float>(p);
+        orientation.x = get<float>(p);
+        orientation.y = get<float>(p);
+        orientation.z = get<float>(p);
+    }
+}
+
+TrajectoryFrame TrajectoryReader::frame(uint64_t i) const
+{
+    TrajectoryFrame f;
+    f.step = step(i);
+    f.time = time(i);
+    f.positions.resize(numBodies());
+    f.orientations.resize(numBodies());
+    for (tIndex b = 0; b < numBodies(); ++b)
+        body(i, b, f.positions[b], f.orientations[b]);
+    return f;
+}
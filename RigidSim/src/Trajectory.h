@@ -0,0 +1,171 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "typedefs.hpp"
+
+// Binary trajectory log: the position and orientation of every body at every step.
+//
+// File layout (little endian):
+//  - TrajectoryFileHeader, padded to headerBytes
+//  - chunks of chunkBytes, each one a TrajectoryChunkHeader followed by framesPerChunk records
+// A record is { uint64 step, double time } followed by, for each body:
+//  - TRAJECTORY_FULL: double position[3], float orientation[4] (w, x, y, z)
+//  - TRAJECTORY_HALF: half position[3] relative to the origin of the header, half orientation[4]
+// Header and chunks are aligned on the page size so that each chunk can be mapped on its own.
+
+enum TrajectoryEncoding
+{
+    TRAJECTORY_FULL = 0,
+    TRAJECTORY_HALF = 1
+};
+
+struct TrajectoryFileHeader
+{
+    char magic[8];           // "RIGIDTRJ"
+    uint32_t version;
+    uint32_t numBodies;
+    uint32_t encoding;       // TrajectoryEncoding
+    uint32_t recordBytes;    // size of one frame
+    uint32_t framesPerChunk;
+    uint32_t chunkBytes;
+    uint64_t headerBytes;    // offset of the first chunk
+    uint64_t numFrames;      // written when the log is closed, the chunk headers are authoritative
+    double origin[3];        // subtracted from the positions in TRAJECTORY_HALF
+};
+
+struct TrajectoryChunkHeader
+{
+    uint32_t magic;          // "CHNK"
+    uint32_t numFrames;      // frames written in this chunk so far
+    uint64_t firstFrame;     // index of the first frame of the chunk in the log
+};
+
+// One frame of the log, decoded
+struct TrajectoryFrame
+{
+    uint64_t step;
+    double time;
+    std::vector<glm::dvec3> positions;
+    std::vector<glm::quat> orientations;
+};
+
+// Writes the log from a background thread.
+// The simulation thread copies each frame into a preallocated ring buffer and returns at once:
+// it never waits on the disk nor on a lock. When the ring is full the frame is dropped and counted.
+// The background thread encodes the frames into the chunk currently mapped in memory.
+class TrajectoryWriter
+{
+public:
+    // Create the file, throws std::ios_base::failure if it cannot be created.
+    // framesPerChunk is a minimum, chunks are filled up to the next page boundary.
+    TrajectoryWriter(const std::string &filename, tIndex numBodies,
+                     TrajectoryEncoding encoding = TRAJECTORY_FULL,
+                     const glm::dvec3 &origin = glm::dvec3(0.0),
+                     tIndex framesPerChunk = 256, tIndex queueFrames = 1024);
+
+    // Write the pending frames and close the file
+    ~TrajectoryWriter();
+
+    // Reserve the next frame, false if the ring is full (the frame is dropped)
+    bool beginFrame(uint64_t step, double time);
+    // Fill a body of the reserved frame
+    void setBody(tIndex body, const glm::dvec3 &position, const glm::quat &orientation);
+    // Hand the reserved frame over to the writer thread
+    void endFrame();
+
+    // Record the state of all the bodies of a solver, e.g. BodyAttributesT<Policy> *
+    template <typename BodyPtr>
+    bool writeFrame(uint64_t step, double time, const std::vector<BodyPtr> &bodies)
+    {
+        if (!beginFrame(step, time))
+            return false;
+        for (tIndex i = 0; i < bodies.size() && i < _numBodies; ++i)
+            setBody(i,
+                    glm::dvec3(bodies[i]->X.x, bodies[i]->X.y, bodies[i]->X.z),
+                    glm::quat(bodies[i]->q.w, bodies[i]->q.x, bodies[i]->q.y, bodies[i]->q.z));
+        endFrame();
+        return true;
+    }
+
+    uint64_t numDropped() const { return _dropped.load(); }
+    uint64_t numWritten() const { return _written.load(); }
+    bool failed() const { return _failed.load(); }
+    const std::string &filename() const { return _filename; }
+
+private:
+    // frame as stored in the ring: step, time, then position[3] (double) and orientation[4] (double) per body
+    tIndex slotDoubles() const { return 2 + 7 * _numBodies; }
+
+    void run();
+    void encode(const double *slot, unsigned char *record) const;
+    bool mapChunk(uint64_t chunk);
+    void unmapChunk();
+    void writeHeader();
+
+    std::string _filename;
+    TrajectoryFileHeader _header;
+    tIndex _numBodies;
+
+    // single producer / single consumer ring
+    std::vector<double> _ring;
+    uint64_t _ringFrames;
+    std::atomic<uint64_t> _head; // next frame to be written by the simulation
+    std::atomic<uint64_t> _tail; // next frame to be encoded by the writer thread
+    bool _reserved;              // a frame is between beginFrame and endFrame
+
+    std::atomic<uint64_t> _dropped;
+    std::atomic<uint64_t> _written;
+    std::atomic<bool> _failed;
+    std::atomic<bool> _stop;
+
+    // writer thread state
+    int _fd;
+    std::FILE *_file;      // used instead of _fd where mmap is not available
+    unsigned char *_chunk; // mapped chunk
+    uint64_t _chunkIndex;
+    std::vector<unsigned char> _chunkBuffer; // used instead of the mapping where mmap is not available
+
+    std::thread _thread;
+};
+
+// Reads a log written by TrajectoryWriter, mapped in memory
+class TrajectoryReader
+{
+public:
+    // Open the file, throws std::ios_base::failure if it is not a trajectory log
+    explicit TrajectoryReader(const std::string &filename);
+    ~TrajectoryReader();
+
+    tIndex numBodies() const { return _header.numBodies; }
+    uint64_t numFrames() const { return _numFrames; }
+    TrajectoryEncoding encoding() const { return static_cast<TrajectoryEncoding>(_header.encoding); }
+
+    // Decode a whole frame. The accessors below throw std::out_of_range for a frame past numFrames(), or a body
+    // past numBodies()
+    TrajectoryFrame frame(uint64_t i) const;
+    // Decode one body of a frame
+    void body(uint64_t frame, tIndex body, glm::dvec3 &position, glm::quat &orientation) const;
+    uint64_t step(uint64_t frame) const;
+    double time(uint64_t frame) const;
+
+private:
+    const unsigned char *record(uint64_t frame) const;
+
+    TrajectoryFileHeader _header;
+    uint64_t _numFrames;
+    const unsigned char *_data;
+    size_t _size;
+    std::vector<unsigned char> _buffer; // used instead of the mapping where mmap is not available
+};
+
+#endif // TRAJECTORY_H
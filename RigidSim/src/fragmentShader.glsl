@@ -5,39 +5,42 @@ struct LightSource {
     vec3 color;
     float intensity;
 };
-uniform LightSource lightSrc;
 
+// written once per frame (CPU side: FrameBlock in main.cpp), must be the same in every shader
+layout(std140) uniform FrameBlock {
+    mat4 viewMat;
+    mat4 projMat;
+    vec3 camPos;
+    LightSource lightSrc;
+};
+
+// the albedo and which textures are used come with each instance
 struct Material {
-    vec3 albedo;
     sampler2D albedoTex;
-    int albedoTexLoaded;
-
     sampler2D normalTex;
-    int normalTexLoaded;
 };
 uniform Material material;
 
-uniform vec3 camPos;
-
 in vec3 fPositionModel;
 in vec3 fPosition;
 in vec3 fNormal;
 in vec2 fTexCoord;
 
-out vec4 colorOut; // shader output: the color response attached to this fragment
+flat in mat3 fNormMat;
+flat in vec3 fAlbedo;
+flat in vec2 fTexLoaded;
 
-uniform mat4 modelMat;
-uniform mat3 normMat;
+out vec4 colorOut; // shader output: the color response attached to this fragment
 
 void main() {
-    vec3 n = (material.normalTexLoaded == 1) ?
-        normalize(normMat*((texture(material.normalTex, fTexCoord).rgb - 0.5)*2.0)) : // colors are in [0,1]^3, and normals are in [-1,1]^3
+    vec3 n = (fTexLoaded.y > 0.5) ?
+        normalize(fNormMat*((texture(material.normalTex, fTexCoord).rgb - 0.5)*2.0)) : // colors are in [0,1]^3, and normals are in [-1,1]^3
         normalize(fNormal);
 
     vec3 radiance = vec3(0, 0, 0);
     vec3 wi = normalize(lightSrc.position - fPosition); // unit vector pointing to the light source
     vec3 Li = lightSrc.color*lightSrc.intensity;
-    vec3 albedo = material.albedoTexLoaded==1 ? texture(material.albedoTex, fTexCoord).rgb : material.albedo;
+    vec3 albedo = fTexLoaded.x > 0.5 ? texture(material.albedoTex, fTexCoord).rgb : fAlbedo;
 
     radiance += Li*albedo*max(dot(n, wi), 0);
 
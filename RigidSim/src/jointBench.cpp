@@ -0,0 +1,130 @@
+// Benchmark of the constraint solver on articulated chains falling on a floor.
+// Each chain hangs from a slider on a rail and its links are connected by ball, hinge and fixed
+// joints; the contacts of the links with the floor are solved in the same iterations as the joints.
+// Reports the steps per second of the solver for several batch widths and the largest joint error,
+// and fails if a slider leaves its rail by more than maxSliderError.
+
+#define _USE_MATH_DEFINES
+
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <memory>
+
+#include "ConstraintSolver.hpp"
+#include "CollisionDetector.hpp"
+#include "Mesh.h"
+
+// the sliders slide about 10 links along their rail over the default steps
+const double maxSliderError = 1e-2;
+
+template <typename Policy, unsigned Width>
+bool runScenario(const std::string &name, const tIndex numChains, const tIndex numLinks, const tIndex numSteps,
+                 const std::shared_ptr<Mesh> &linkMesh, const std::shared_ptr<Mesh> &floorMesh)
+{
+    typedef typename Policy::tPosition tPos;
+    typedef typename Policy::tLocal tLoc;
+    typedef ConstraintSolverT<Policy, Width> Solver;
+    typedef typename Solver::Vec3p Vec3p;
+    typedef typename Solver::Vec3l Vec3l;
+    typedef glm::mat<4, 4, tPos> mat4p;
+    typedef glm::vec<3, tPos> vec3p;
+
+    const tLoc length = 0.1f, width = 0.04f;
+    const tLoc dt = 0.016f;
+    const tPos floorY = -0.6;
+
+    // links along x, chains side by side along z
+    std::vector<BoxT<Policy> > links(numChains * numLinks, BoxT<Policy>(length, width, width));
+    Solver solver(Vec3l(0, -0.98, 0));
+    for (tIndex c = 0; c < numChains; ++c)
+    {
+        const tPos z = 0.1 * c;
+        for (tIndex i = 0; i < numLinks; ++i)
+        {
+            BoxT<Policy> &link = links[c * numLinks + i];
+            link.X = Vec3p((i + 0.5) * length, 0, z);
+            const tIndex body = solver.addBody(&link);
+
+            const Vec3p anchor(i * length, 0, z);
+            if (i == 0)
+                solver.addJoint(SLIDER_JOINT, body, Solver::WORLD, anchor, Vec3l(1, 0, 0));
+            else
+            {
+                const JointType types[] = {BALL_JOINT, HINGE_JOINT, BALL_JOINT, FIXED_JOINT};
+                solver.addJoint(types[i % 4], body, body - 1, anchor, Vec3l(0, 0, 1));
+            }
+        }
+    }
+
+    CollisionDetectorT<Policy> detector;
+    detector.verbose = false;
+    const mat4p floorMat = glm::translate(mat4p(1.0), vec3p(0.0, floorY, 0.0)) *
+                           glm::rotate(mat4p(1.0), tPos(-0.5 * M_PI), vec3p(1.0, 0.0, 0.0)) *
+                           glm::scale(mat4p(1.0), vec3p(10.0, 10.0, 1.0));
+
+    double seconds = 0;
+    for (tIndex s = 0; s < numSteps; ++s)
+    {
+        // contacts of the links close to the floor
+        for (tIndex b = 0; b < links.size(); ++b)
+            if (links[b].X.y - floorY < length)
+                solver.addContact(b, Solver::WORLD, detector.SATcheckCollision(linkMesh, floorMesh, links[b].worldMatP(), floorMat));
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        solver.step(dt);
+        const auto end = std::chrono::high_resolution_clock::now();
+        seconds += std::chrono::duration<double>(end - start).count();
+    }
+
+    tLoc error = 0, sliderError = 0;
+    for (tIndex j = 0; j < solver.joints.size(); ++j)
+    {
+        error = std::max(error, solver.jointError(j));
+        if (solver.joints[j].type == SLIDER_JOINT)
+            sliderError = std::max(sliderError, solver.jointError(j));
+    }
+
+    std::cout << std::setw(8) << name
+              << std::setw(8) << Width
+              << std::setw(16) << std::fixed << std::setprecision(0) << numSteps / seconds
+              << std::setw(16) << std::scientific << std::setprecision(3) << error
+              << std::defaultfloat << std::endl;
+    if (sliderError > maxSliderError)
+    {
+        std::cerr << "[jointBench] " << name << " x" << Width << ": slider error " << sliderError
+                  << " over " << maxSliderError << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const tIndex numChains = argc > 1 ? static_cast<tIndex>(std::atoi(argv[1])) : 16;
+    const tIndex numLinks = argc > 2 ? static_cast<tIndex>(std::atoi(argv[2])) : 16;
+    const tIndex numSteps = argc > 3 ? static_cast<tIndex>(std::atoi(argv[3])) : 200;
+
+    std::shared_ptr<Mesh> linkMesh = std::make_shared<Mesh>();
+    linkMesh->addBox(0.1f, 0.04f, 0.04f);
+    std::shared_ptr<Mesh> floorMesh = std::make_shared<Mesh>();
+    floorMesh->addPlane();
+
+    std::cout << "> " << numChains << " chains of " << numLinks << " links, "
+              << numChains * numLinks << " joints, " << numSteps << " steps" << std::endl;
+    std::cout << std::setw(8) << "policy"
+              << std::setw(8) << "width"
+              << std::setw(16) << "steps/s"
+              << std::setw(16) << "joint error" << std::endl;
+
+    bool ok = runScenario<FloatPrecision, 1>("float", numChains, numLinks, numSteps, linkMesh, floorMesh);
+    ok &= runScenario<FloatPrecision, 4>("float", numChains, numLinks, numSteps, linkMesh, floorMesh);
+    ok &= runScenario<FloatPrecision, 8>("float", numChains, numLinks, numSteps, linkMesh, floorMesh);
+    ok &= runScenario<DoublePrecision, 1>("double", numChains, numLinks, numSteps, linkMesh, floorMesh);
+    ok &= runScenario<DoublePrecision, 4>("double", numChains, numLinks, numSteps, linkMesh, floorMesh);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -21,24 +21,39 @@
 #include <memory>
 #include <algorithm>
 #include <exception>
-
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
+#include <chrono>
 
 // #include "Error.h" // OpenGL 4.3 or later
 #include "ShaderProgram.h"
+#include "UniformBuffer.h"
+#include "TextureLoader.h"
 #include "Camera.h"
 #include "Mesh.h"
 
 #include "RigidSolver.hpp"
 #include "OBB.hpp"
 #include "CollisionDetector.hpp"
+#include "Trajectory.h"
+#include "FrameCapture.h"
+#include "Profiler.h"
+#include "Offscreen.h"
+#include "RenderQueue.h"
 
 // window parameters
 GLFWwindow *g_window = nullptr;
 int g_windowWidth = 1024;
 int g_windowHeight = 768;
 
+// offscreen rendering (--offscreen): no window, the frames are rendered into g_offscreenTarget
+unsigned int g_offscreenFrames = 0;
+std::unique_ptr<OffscreenContext> g_offscreenContext;
+std::unique_ptr<OffscreenTarget> g_offscreenTarget;
+
+// framebuffer of the main pass: the window's, or the offscreen target
+GLuint g_framebuffer = 0;
+// OpenGL entry points of the current context
+ShaderProgram::ProcAddressLoader g_procAddressLoader = glfwGetProcAddress;
+
 // pointer to the current camera model
 std::shared_ptr<Camera> g_cam;
 
@@ -65,47 +80,11 @@ unsigned int g_albedoTexOnGPU;
 GLuint g_normalTex;
 unsigned int g_normalTexOnGPU;
 
-GLuint loadTextureFromFileToGPU(const std::string &filename)
-{
-    int width, height, numComponents;
-    // Loading the image in CPU memory using stbd_image
-    unsigned char *data = stbi_load(
-        filename.c_str(),
-        &width,
-        &height,
-        &numComponents, // 1 for a 8 bit greyscale image, 3 for 24bits RGB image, 4 for 32bits RGBA image
-        0);
-
-    // Create a texture in GPU memory
-    GLuint texID;
-    glGenTextures(1, &texID);
-    glBindTexture(GL_TEXTURE_2D, texID);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    // Uploading the image data to GPU memory
-    glTexImage2D(
-        GL_TEXTURE_2D,
-        0,
-        (numComponents == 1 ? GL_RED : numComponents == 3 ? GL_RGB
-                                                          : GL_RGBA), // For greyscale images, we store them in the RED channel
-        width,
-        height,
-        0,
-        (numComponents == 1 ? GL_RED : numComponents == 3 ? GL_RGB
-                                                          : GL_RGBA), // For greyscale images, we store them in the RED channel
-        GL_UNSIGNED_BYTE,
-        data);
-
-    // Generating mipmaps for filtered texture fetch
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    // Freeing the now useless CPU memory
-    stbi_image_free(data);
-    glBindTexture(GL_TEXTURE_2D, 0); // unbind the texture
-    return texID;
-}
+// decodes the textures in the background, keeps the results in a disk cache
+std::unique_ptr<TextureLoader> g_textureLoader;
+
+// CPU and GPU timings of the frame, overlay and traces
+std::unique_ptr<Profiler> g_profiler;
 
 struct Light
 {
@@ -114,6 +93,20 @@ struct Light
     float intensity;
 };
 
+// std140 layout of the FrameBlock uniform block of the shaders
+struct FrameBlock
+{
+    glm::mat4 viewMat;
+    glm::mat4 projMat;
+    glm::vec3 camPos;
+    float pad0;
+    glm::vec3 lightPosition;
+    float pad1;
+    glm::vec3 lightColor;
+    float lightIntensity;
+};
+static_assert(sizeof(FrameBlock) == 176, "FrameBlock does not match the std140 layout");
+
 struct Scene
 {
     Light light;
@@ -123,6 +116,8 @@ struct Scene
 
     CollisionInfo info;
     CollisionDetector detector;
+    std::vector<CollisionPair> collisionPairs; // candidate pairs for the narrow phase
+    ThreadPool pool;                           // workers for the narrow phase
 
     // meshes
     std::shared_ptr<Mesh> rigid = nullptr;
@@ -141,6 +136,40 @@ struct Scene
     // shaders to render the meshes
     std::shared_ptr<ShaderProgram> mainShader;
 
+    // draws of the frame, sorted by state, and their resources registered once
+    std::unique_ptr<RenderQueue> queue;
+    RenderState renderState;
+    unsigned int mainProgram = 0;
+    unsigned int diceMaterial = 0;
+    unsigned int rigidMesh = 0, planeMesh = 0, OBBMesh = 0, collisionPointMesh = 0;
+    MeshInstance planeInstance, floorInstance; // static, with their normal matrix
+
+    // uniforms of mainShader, resolved once after linking
+    struct MainShaderUniforms
+    {
+        ShaderProgram::Uniform<int> albedoTex, normalTex;
+
+        void resolve(const ShaderProgram &program)
+        {
+            albedoTex = program.uniform<int>("material.albedoTex");
+            normalTex = program.uniform<int>("material.normalTex");
+        }
+    } mainUniforms;
+
+    // camera and light, shared by all the programs
+    std::unique_ptr<UniformBuffer> frameBuffer;
+
+    // trajectory log, recording while not null
+    std::unique_ptr<TrajectoryWriter> trajectory;
+    std::vector<BodyAttributes *> trajectoryBodies;
+    uint64_t trajectoryStep = 0;
+    int trajectoryCnt = 0;
+
+    // screenshots and frame sequences, read back and written asynchronously
+    std::unique_ptr<FrameCapture> capture;
+    int videoCnt = 0;
+    int traceCnt = 0;
+
     // useful for debug
     bool saveScreenShot = false;
     bool checkOBB = false;
@@ -154,83 +183,112 @@ struct Scene
         rigidMat = glm::mat4(1.0);
     }
 
+    void toggleTrajectory()
+    {
+        if (trajectory)
+        {
+            std::cout << "Closing trajectory file " << trajectory->filename() << " ("
+                      << trajectory->numDropped() << " frames dropped)" << std::endl;
+            trajectory.reset();
+            return;
+        }
+
+        std::stringstream fpath;
+        fpath << "t" << std::setw(4) << std::setfill('0') << trajectoryCnt++ << ".rtrj";
+        try
+        {
+            trajectoryBodies.assign(1, rigidAtt.get());
+            trajectory.reset(new TrajectoryWriter(fpath.str(), static_cast<tIndex>(trajectoryBodies.size())));
+            trajectoryStep = 0;
+            std::cout << "Recording trajectory file " << fpath.str() << std::endl;
+        }
+        catch (std::exception &e)
+        {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+
+    void toggleVideo()
+    {
+        if (capture->recording())
+        {
+            capture->stopRecording();
+            std::cout << "Stopped recording, " << capture->numRecorded() << " frames" << std::endl;
+            return;
+        }
+
+        std::stringstream fpath;
+        fpath << "v" << std::setw(4) << std::setfill('0') << videoCnt++ << "_";
+        capture->startRecording(fpath.str());
+        std::cout << "Recording frames " << fpath.str() << "*.tga" << std::endl;
+    }
+
+    void traceFrames(unsigned int numFrames)
+    {
+        if (g_profiler->tracing())
+            return;
+        std::stringstream fpath;
+        fpath << "trace" << std::setw(4) << std::setfill('0') << traceCnt++ << ".json";
+        g_profiler->traceFrames(fpath.str(), numFrames);
+        std::cout << "Tracing " << numFrames << " frames to " << fpath.str() << std::endl;
+    }
+
+    // Distance to the camera over the far plane distance, to draw front to back
+    float viewDepth(const glm::mat4 &modelMat) const
+    {
+        return glm::length(glm::vec3(modelMat[3]) - g_cam->getPosition()) / g_cam->getFar();
+    }
+
     void render()
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        renderState.invalidate(); // changed by any code since the last frame
+        glBindFramebuffer(GL_FRAMEBUFFER, g_framebuffer);
         glViewport(0, 0, g_windowWidth, g_windowHeight);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // clear the color and z buffers.
 
         // glDisable(GL_CULL_FACE);    // or
         glCullFace(GL_BACK);
 
-        mainShader->use();
-
-        // camera
-        mainShader->set("camPos", g_cam->getPosition());
-        mainShader->set("viewMat", g_cam->computeViewMatrix());
-        mainShader->set("projMat", g_cam->computeProjectionMatrix());
-
-        // light
-        mainShader->set(std::string("lightSrc.position"), light.position);
-        mainShader->set(std::string("lightSrc.color"), light.color);
-        mainShader->set(std::string("lightSrc.intensity"), light.intensity);
-
-        // back-wall
-        mainShader->set("material.albedo", glm::vec3(0.29, 0.51, 0.82)); // default value if the texture was not loaded
-        mainShader->set("material.albedoTexLoaded", 0);
-        mainShader->set("material.normalTex", (int)g_normalTexOnGPU);
-        mainShader->set("material.normalTexLoaded", 1);
-        mainShader->set("modelMat", planeMat);
-        mainShader->set("normMat", glm::mat3(glm::inverseTranspose(planeMat)));
-        plane->render();
+        ProfileScope mainPass(*g_profiler, "main pass", Profiler::CPU_GPU);
 
-        // floor
-        mainShader->set("material.albedo", glm::vec3(0.8, 0.8, 0.9));
-        mainShader->set("material.albedoTexLoaded", 0);
-        mainShader->set("material.normalTexLoaded", 0);
-        mainShader->set("modelMat", floorMat);
-        mainShader->set("normMat", glm::mat3(glm::inverseTranspose(floorMat)));
-        plane->render();
+        // camera and light
+        FrameBlock frame;
+        frame.viewMat = g_cam->computeViewMatrix();
+        frame.projMat = g_cam->computeProjectionMatrix();
+        frame.camPos = g_cam->getPosition();
+        frame.lightPosition = light.position;
+        frame.lightColor = light.color;
+        frame.lightIntensity = light.intensity;
+        frameBuffer->update(frame);
 
+        // back-wall and floor, drawn together: same program, material and mesh. Which textures an
+        // instance uses is part of the instance data.
+        queue->submit(mainProgram, diceMaterial, planeMesh, planeInstance, viewDepth(planeMat));
+        queue->submit(mainProgram, diceMaterial, planeMesh, floorInstance, viewDepth(floorMat));
 
         // rigid or OBB
         if (checkOBB)
         {
-            OBB obb = OBB::ComputeOBBfromMesh(rigid, rigidMat);
-            glm::mat4 OBBMat = glm::translate(glm::mat4(1.0), obb.center) *
-                               glm::mat4(obb.Rotation) *
+            OBB obb = OBB::ComputeOBBfromMesh(rigid, rigidAtt->worldMatP());
+            glm::mat4 OBBMat = glm::translate(glm::mat4(1.0), glm::vec3(obb.center)) *
+                               glm::mat4(glm::mat3(obb.Rotation)) *
                                glm::scale(glm::mat4(1.0), glm::vec3(obb.halfSize.x * 2, 
                                                                     obb.halfSize.y * 2, 
                                                                     obb.halfSize.z * 2));
-            mainShader->set("material.albedo", glm::vec3(1, 0, 0));
-            mainShader->set("material.albedoTexLoaded", 0);
-            mainShader->set("material.normalTexLoaded", 0);
-            mainShader->set("modelMat", OBBMat);
-            mainShader->set("normMat", glm::mat3(glm::inverseTranspose(OBBMat)));
-            OBBBoundingBox->render();
+            queue->submit(mainProgram, diceMaterial, OBBMesh, MeshInstance(OBBMat, glm::vec3(1, 0, 0)), viewDepth(OBBMat));
         }
         else
         {
-            mainShader->set("material.albedo", glm::vec3(1, 0.71, 0.29));
-            mainShader->set("material.albedoTex", (int)g_albedoTexOnGPU);
-            mainShader->set("material.albedoTexLoaded", 1);
-            mainShader->set("material.normalTexLoaded", 0);
-            mainShader->set("modelMat", rigidMat);
-            mainShader->set("normMat", glm::mat3(glm::inverseTranspose(rigidMat)));
-            rigid->render();
-
+            queue->submit(mainProgram, diceMaterial, rigidMesh, MeshInstance(rigidMat, glm::vec3(1, 0.71, 0.29), true),
+                          viewDepth(rigidMat));
         }
 
         
         if (checkCollisionPoint && info.hasCollision)
         {
-            mainShader->set("material.albedo", glm::vec3(1, 0, 0));
-            mainShader->set("material.albedoTexLoaded", 0);
-            mainShader->set("material.normalTexLoaded", 0);
-            glm::mat4 collisionPointMat = glm::translate(glm::mat4(1.0), info.point) * glm::scale(glm::mat4(1.0), glm::vec3(0.3, 0.3, 0.3));
-            mainShader->set("modelMat", collisionPointMat);
-            mainShader->set("normMat", glm::mat3(glm::inverseTranspose(collisionPointMat)));
-            collisionPoint->render();
+            glm::mat4 collisionPointMat = glm::translate(glm::mat4(1.0), glm::vec3(info.point)) * glm::scale(glm::mat4(1.0), glm::vec3(0.3, 0.3, 0.3));
+            queue->submit(mainProgram, diceMaterial, collisionPointMesh, MeshInstance(collisionPointMat, glm::vec3(1, 0, 0)),
+                          viewDepth(collisionPointMat));
 
             std::cout << "Collision detected!" << std::endl;
             std::cout << "Collision normal: " << info.normal.x << " " << info.normal.y << " " << info.normal.z << std::endl;
@@ -240,28 +298,20 @@ struct Scene
             std::cout << std::endl;
         }
 
-        mainShader->stop();
+        queue->flush(renderState);
+        renderState.useProgram(0);
 
+        ProfileScope captureScope(*g_profiler, "capture");
         if (saveScreenShot)
         {
             std::stringstream fpath;
             fpath << "s" << std::setw(4) << std::setfill('0') << savedCnt++ << ".tga";
-
-            std::cout << "Saving file " << fpath.str() << " ... " << std::flush;
-            const short int w = g_windowWidth;
-            const short int h = g_windowHeight;
-            std::vector<int> buf(w * h * 3, 0);
-            glReadPixels(0, 0, w, h, GL_BGR, GL_UNSIGNED_BYTE, &(buf[0]));
-
-            FILE *out = fopen(fpath.str().c_str(), "wb");
-            short TGAhead[] = {0, 2, 0, 0, 0, 0, w, h, 24};
-            fwrite(&TGAhead, sizeof(TGAhead), 1, out);
-            fwrite(&(buf[0]), 3 * w * h, 1, out);
-            fclose(out);
+            std::cout << "Saving file " << fpath.str() << std::endl;
+            capture->captureColor(0, 0, g_windowWidth, g_windowHeight, fpath.str());
             saveScreenShot = false;
-
-            std::cout << "Done" << std::endl;
         }
+        // the frame of the video if recording, and the files of the previous frames
+        capture->captureFrame(g_windowWidth, g_windowHeight);
     }
 };
 
@@ -281,6 +331,10 @@ void printHelp()
               << "    * P: toggle simulation" << std::endl
               << "    * R: reset simulation" << std::endl
               << "    * S: save a screenshot" << std::endl
+              << "    * T: start/stop recording the trajectory" << std::endl
+              << "    * V: start/stop recording every frame as an image" << std::endl
+              << "    * F2: show/hide the profiler overlay" << std::endl
+              << "    * F3: trace the next 120 frames (chrome://tracing)" << std::endl
               << "    * W: wireframe rendering" << std::endl
               << "    * F: surface rendering" << std::endl
               << "    * ESC: quit the program" << std::endl;
@@ -318,6 +372,22 @@ void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods
     {
         g_scene.saveScreenShot = true;
     }
+    else if (action == GLFW_PRESS && key == GLFW_KEY_T)
+    {
+        g_scene.toggleTrajectory();
+    }
+    else if (action == GLFW_PRESS && key == GLFW_KEY_V)
+    {
+        g_scene.toggleVideo();
+    }
+    else if (action == GLFW_PRESS && key == GLFW_KEY_F2)
+    {
+        g_profiler->toggleOverlay();
+    }
+    else if (action == GLFW_PRESS && key == GLFW_KEY_F3)
+    {
+        g_scene.traceFrames(120);
+    }
     else if (action == GLFW_PRESS && key == GLFW_KEY_P)
     {
         g_appTimerStoppedP = !g_appTimerStoppedP;
@@ -405,7 +475,7 @@ void mouseButtonCallback(GLFWwindow *window, int button, int action, int mods)
     }
 }
 
-void initGLFW()
+void initGLFW(bool visible = true)
 {
     // Initialize GLFW, the library responsible for window management
     if (!glfwInit())
@@ -420,6 +490,7 @@ void initGLFW()
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_RESIZABLE, GL_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, visible ? GL_TRUE : GL_FALSE);
 
     // Create the window
     g_window = glfwCreateWindow(g_windowWidth, g_windowHeight, "A Simple Rigid Body Simulator", nullptr, nullptr);
@@ -453,10 +524,25 @@ void exitOnCriticalError(const std::string &message)
     std::exit(EXIT_FAILURE);
 }
 
+void initOffscreen()
+{
+    try
+    {
+        g_offscreenContext.reset(new OffscreenContext());
+        g_procAddressLoader = OffscreenContext::getProcAddress;
+    }
+    catch (std::exception &e)
+    {
+        // offscreen as well if GLFW is built with GLFW_USE_OSMESA, else needs a display
+        std::cerr << e.what() << ", using a hidden window" << std::endl;
+        initGLFW(false);
+    }
+}
+
 void initOpenGL()
 {
     // Load extensions for modern OpenGL
-    if (!gladLoadGL(glfwGetProcAddress))
+    if (!gladLoadGL(g_procAddressLoader))
         exitOnCriticalError("[Failed to initialize OpenGL context]");
 
     // supported from OpenGL 4.3
@@ -470,25 +556,33 @@ void initOpenGL()
     glEnable(GL_DEPTH_TEST);              // Enable the z-buffer test in the rasterization
     glClearColor(1.0f, 1.0f, 1.0f, 1.0f); // specify the background color, used any time the framebuffer is cleared
 
+    // linked programs of the previous runs, when the driver can give them back
+    ShaderProgram::enableBinaryCache("shadercache", g_procAddressLoader);
+
     // Loads and compile the programmable shader pipeline
     try
     {
         g_scene.mainShader = ShaderProgram::genBasicShaderProgram("../src/vertexShader.glsl", "../src/fragmentShader.glsl");
+        g_scene.mainUniforms.resolve(*g_scene.mainShader);
         g_scene.mainShader->stop();
+        g_scene.frameBuffer.reset(new UniformBuffer(sizeof(FrameBlock), FRAME_BLOCK_BINDING));
+        g_profiler.reset(new Profiler());
+        g_profiler->setOverlayProgram(
+            ShaderProgram::genBasicShaderProgram("../src/profilerVertexShader.glsl", "../src/profilerFragmentShader.glsl"));
     }
     catch (std::exception &e)
     {
         exitOnCriticalError(std::string("[Error loading shader program]") + e.what());
     }
+
+    g_scene.capture.reset(new FrameCapture());
 }
 
 void initScene()
 {
     // Init camera
-    int width, height;
-    glfwGetWindowSize(g_window, &width, &height);
     g_cam = std::make_shared<Camera>();
-    g_cam->setAspectRatio(static_cast<float>(width) / static_cast<float>(height));
+    g_cam->setAspectRatio(static_cast<float>(g_windowWidth) / static_cast<float>(g_windowHeight));
 
     // Load meshes in the scene
     {
@@ -518,22 +612,35 @@ void initScene()
 
     // Load textures
     {
-        g_albedoTex = loadTextureFromFileToGPU("../data/dice.png");
-        g_normalTex = loadTextureFromFileToGPU("../data/normal.png");
+        g_textureLoader.reset(new TextureLoader());
+        g_albedoTex = g_textureLoader->load("../data/dice.png");
+        g_normalTex = g_textureLoader->load("../data/normal.png", glm::u8vec4(128, 128, 255, 255));
     }
 
-    // Setup textures on the GPU
+    // Texture units of the material, bound by the render queue: the samplers are set once
     {
         g_albedoTexOnGPU = g_availableTextureSlot;
         ++g_availableTextureSlot;
-        glActiveTexture(GL_TEXTURE0 + g_albedoTexOnGPU);
-        glBindTexture(GL_TEXTURE_2D, g_albedoTex);
-    }
-    {
         g_normalTexOnGPU = g_availableTextureSlot;
         ++g_availableTextureSlot;
-        glActiveTexture(GL_TEXTURE0 + g_normalTexOnGPU);
-        glBindTexture(GL_TEXTURE_2D, g_normalTex);
+        g_scene.mainShader->use();
+        g_scene.mainUniforms.albedoTex.set((int)g_albedoTexOnGPU);
+        g_scene.mainUniforms.normalTex.set((int)g_normalTexOnGPU);
+        g_scene.mainShader->stop();
+    }
+
+    // Resources of the draws
+    {
+        g_scene.queue.reset(new RenderQueue());
+        g_scene.mainProgram = g_scene.queue->addProgram(g_scene.mainShader);
+        g_scene.diceMaterial = g_scene.queue->addMaterial(
+            RenderMaterial().texture(g_albedoTexOnGPU, g_albedoTex).texture(g_normalTexOnGPU, g_normalTex));
+        g_scene.rigidMesh = g_scene.queue->addMesh(g_scene.rigid);
+        g_scene.planeMesh = g_scene.queue->addMesh(g_scene.plane);
+        g_scene.OBBMesh = g_scene.queue->addMesh(g_scene.OBBBoundingBox);
+        g_scene.collisionPointMesh = g_scene.queue->addMesh(g_scene.collisionPoint);
+        g_scene.planeInstance = MeshInstance(g_scene.planeMat, glm::vec3(0.29, 0.51, 0.82), false, true);
+        g_scene.floorInstance = MeshInstance(g_scene.floorMat, glm::vec3(0.8, 0.8, 0.9));
     }
 
     // Setup light
@@ -550,7 +657,10 @@ void initScene()
 
 void init()
 {
-    initGLFW();   // Windowing system
+    if (g_offscreenFrames > 0)
+        initOffscreen(); // No window
+    else
+        initGLFW();   // Windowing system
     initOpenGL(); // OpenGL Context and shader pipeline
     initScene();  // Actual scene to render
 }
@@ -563,31 +673,56 @@ void clear()
     g_scene.OBBBoundingBox.reset();
     g_scene.collisionPoint.reset();
     g_scene.mainShader.reset();
+    g_scene.queue.reset();
+    g_scene.frameBuffer.reset();
+    g_scene.trajectory.reset();
+    g_scene.capture.reset(); // writes the pending files
+    g_textureLoader.reset();
+    g_profiler.reset();
+    g_offscreenTarget.reset();
+    g_offscreenContext.reset();
     glfwDestroyWindow(g_window);
     glfwTerminate();
 }
 
 void checkCollision()
 {
-    g_scene.info = g_scene.detector.SATcheckCollision(g_scene.rigid, g_scene.plane, g_scene.rigidMat, g_scene.floorMat);
+    ProfileScope scope(*g_profiler, "collision");
+    // candidate pairs: the rigid against the floor
+    g_scene.collisionPairs.clear();
+    CollisionPair pair;
+    pair.meshPtr1 = g_scene.rigid;
+    pair.meshPtr2 = g_scene.plane;
+    pair.worldMat1 = g_scene.rigidAtt->worldMatP();
+    pair.worldMat2 = glm::mat<4, 4, tPrecision::tPosition>(g_scene.floorMat);
+    g_scene.collisionPairs.push_back(pair);
+
+    std::vector<CollisionInfo> contacts = g_scene.detector.narrowPhase(g_scene.collisionPairs, g_scene.pool);
+    if (contacts.empty())
+    {
+        g_scene.info.hasCollision = false;
+    }
+    else
+    {
+        g_scene.info = contacts[0];
+    }
 }
 
 // The main rendering call
 void render()
 {
+    ProfileScope scope(*g_profiler, "render");
+    {
+        ProfileScope textures(*g_profiler, "textures");
+        g_textureLoader->update(); // textures decoded since the last frame
+    }
     g_scene.render();
 }
 
 // Update any accessible variable based on the current time
 void update(const float currentTime)
 {
-    if (g_scene.info.hasCollision)
-    {
-        // TODO: This BUG need to be fixed, can ONLY work without a chosen ratio with a specific scene
-        //g_scene.detector.applyPenetrationCorrection(g_scene.info, 1.f, g_scene.rigidMat);
-        //g_appTimerStoppedP = true;
-    }
-
+    ProfileScope scope(*g_profiler, "update");
     if (!g_appTimerStoppedP)
     {
         // Animate any entity of the program here
@@ -596,21 +731,99 @@ void update(const float currentTime)
         g_appTimer += dt;
         // <---- Update here what needs to be animated over time ---->
 
-        g_scene.solver.step(std::min(dt, 0.018f), g_scene.info);       // solve for the next step; avoid any chances of too large time step
+        {
+            ProfileScope solver(*g_profiler, "solver");
+            g_scene.solver.step(std::min(dt, 0.018f), g_scene.info);       // solve for the next step; avoid any chances of too large time step
+        }
         g_scene.rigidMat = g_scene.rigidAtt->worldMat(); // update position/orientation for rendering
+        if (g_scene.trajectory)
+            g_scene.trajectory->writeFrame(g_scene.trajectoryStep++, g_appTimer, g_scene.trajectoryBodies);
+    }
+}
+
+// Render numFrames frames along a fixed camera path, with a fixed time step, into the offscreen
+// target. Prints the time and the image hash of each frame, then the statistics.
+void runOffscreen(unsigned int numFrames)
+{
+    try
+    {
+        g_offscreenTarget.reset(new OffscreenTarget(g_windowWidth, g_windowHeight));
+    }
+    catch (std::exception &e)
+    {
+        exitOnCriticalError(e.what());
+    }
+    g_framebuffer = g_offscreenTarget->framebuffer();
+
+    // the final textures from the first frame on, for the hashes to be reproducible
+    g_textureLoader->finish();
+
+    g_appTimerStoppedP = false;
+    g_appTimerLastClockTime = 0.0f;
+    RenderBenchmark benchmark;
+    std::vector<unsigned char> pixels;
+    for (unsigned int i = 0; i < numFrames; ++i)
+    {
+        // the camera swings around the scene and up, one period over the sequence
+        const float phase = static_cast<float>(2.0 * M_PI * i / numFrames);
+        g_cam->setRotation(glm::vec3(-0.2f * (1.0f - std::cos(phase)), 0.5f * std::sin(phase), 0.0f));
+
+        const auto start = std::chrono::steady_clock::now();
+        g_profiler->beginFrame();
+        checkCollision();
+        update((i + 1) / 60.0f);
+        render();
+        glFinish();
+        g_profiler->endFrame();
+        const double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        g_offscreenTarget->read(pixels);
+        benchmark.addFrame(time, pixels);
     }
+    benchmark.report(std::cout);
+}
+
+void usage(const char *command)
+{
+    std::cerr << "Usage : " << command << " [--offscreen <frames>] [--size <width>x<height>]" << std::endl;
+    std::exit(EXIT_FAILURE);
 }
 
 int main(int argc, char **argv)
 {
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        if (arg == "--offscreen" && i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+            g_offscreenFrames = static_cast<unsigned int>(std::atoi(argv[++i]));
+        else if (arg == "--size" && i + 1 < argc &&
+                 std::sscanf(argv[++i], "%dx%d", &g_windowWidth, &g_windowHeight) == 2 &&
+                 g_windowWidth > 0 && g_windowHeight > 0)
+            continue;
+        else
+            usage(argv[0]);
+    }
+
     init();
+    if (g_offscreenFrames > 0)
+    {
+        runOffscreen(g_offscreenFrames);
+        clear();
+        return EXIT_SUCCESS;
+    }
     while (!glfwWindowShouldClose(g_window))
     {
+        g_profiler->beginFrame();
         checkCollision();
         update(static_cast<float>(glfwGetTime()));
         render();
-        glfwSwapBuffers(g_window);
+        g_profiler->drawOverlay(g_windowWidth, g_windowHeight);
+        {
+            ProfileScope swap(*g_profiler, "swap");
+            glfwSwapBuffers(g_window);
+        }
         glfwPollEvents();
+        g_profiler->endFrame();
     }
     clear();
     std::cout << " > Quit" << std::endl;
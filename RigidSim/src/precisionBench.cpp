@@ -0,0 +1,87 @@
+// Benchmark of the precision policies of the solver and collision code (see typedefs.hpp).
+// A box is dropped on a floor placed further and further away from the origin: the number of
+// steps per second gives the cost of each policy, the error of the resting height above the
+// floor gives its accuracy.
+
+#define _USE_MATH_DEFINES
+
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <memory>
+
+#include "RigidSolver.hpp"
+#include "CollisionDetector.hpp"
+#include "Mesh.h"
+
+template <typename Policy>
+void runScenario(const std::string &name, const double offset, const tIndex numSteps,
+                 const std::shared_ptr<Mesh> &boxMesh, const std::shared_ptr<Mesh> &floorMesh)
+{
+    typedef typename Policy::tPosition tPos;
+    typedef typename Policy::tLocal tLoc;
+    typedef glm::mat<4, 4, tPos> mat4p;
+    typedef glm::vec<3, tPos> vec3p;
+
+    const tLoc size = 0.1f;
+    const tLoc dt = 0.016f;
+
+    BoxT<Policy> box(size, size, size);
+    box.X = Vector3<tPos>(offset, offset, offset);
+    RigidSolverT<Policy> solver(&box, Vector3<tLoc>(0, -0.98, 0));
+    solver.verbose = false;
+    CollisionDetectorT<Policy> detector;
+    detector.verbose = false;
+
+    // the floor lies 1 below the initial position of the box
+    const mat4p floorMat = glm::translate(mat4p(1.0), vec3p(offset, offset - 1.0, offset)) *
+                           glm::rotate(mat4p(1.0), tPos(-0.5 * M_PI), vec3p(1.0, 0.0, 0.0));
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    for (tIndex i = 0; i < numSteps; ++i)
+    {
+        const CollisionInfoT<Policy> info = detector.SATcheckCollision(boxMesh, floorMesh, box.worldMatP(), floorMat);
+        solver.step(dt, info);
+    }
+    const auto end = std::chrono::high_resolution_clock::now();
+    const double seconds = std::chrono::duration<double>(end - start).count();
+
+    // at rest, the center of the box is half its size above the floor, up to the contact slop
+    const double height = static_cast<double>(box.X.y) - (offset - 1.0);
+    const double error = std::abs(height - 0.5 * size);
+
+    std::cout << std::setw(8) << name
+              << std::setw(12) << offset
+              << std::setw(16) << std::fixed << std::setprecision(0) << numSteps / seconds
+              << std::setw(16) << std::scientific << std::setprecision(3) << error
+              << std::defaultfloat << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    const tIndex numSteps = argc > 1 ? static_cast<tIndex>(std::atoi(argv[1])) : 5000;
+
+    std::shared_ptr<Mesh> boxMesh = std::make_shared<Mesh>();
+    boxMesh->addBox(.1f, .1f, .1f);
+    std::shared_ptr<Mesh> floorMesh = std::make_shared<Mesh>();
+    floorMesh->addPlane();
+
+    std::cout << "> " << numSteps << " steps per scenario" << std::endl;
+    std::cout << std::setw(8) << "policy"
+              << std::setw(12) << "offset"
+              << std::setw(16) << "steps/s"
+              << std::setw(16) << "rest error" << std::endl;
+
+    const double offsets[] = {0.0, 1e2, 1e4, 1e5, 1e6};
+    for (double offset : offsets)
+    {
+        runScenario<FloatPrecision>("float", offset, numSteps, boxMesh, floorMesh);
+        runScenario<MixedPrecision>("mixed", offset, numSteps, boxMesh, floorMesh);
+        runScenario<DoublePrecision>("double", offset, numSteps, boxMesh, floorMesh);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,12 @@
+#version 330 core            // minimal GL version support expected from the GPU
+
+uniform sampler2D font;      // glyph coverage in the red channel
+
+in vec2 fTexCoord;
+in vec4 fColor;
+
+out vec4 colorOut; // shader output: the color response attached to this fragment
+
+void main() {
+    colorOut = vec4(fColor.rgb, fColor.a * texture(font, fTexCoord).r);
+}
@@ -52,10 +52,11 @@ public:
 
     Quaternion &operator*=(const Quaternion &q)
     {
-        w = w * q.w - x * q.x - y * q.y - z * q.z;
-        x = w * q.x + x * q.w + y * q.z - z * q.y;
-        y = w * q.y - x * q.z + y * q.w + z * q.x;
-        z = w * q.z + x * q.y - y * q.x + z * q.w;
+        const Quaternion p(*this); // the components are all needed until the end
+        w = p.w * q.w - p.x * q.x - p.y * q.y - p.z * q.z;
+        x = p.w * q.x + p.x * q.w + p.y * q.z - p.z * q.y;
+        y = p.w * q.y - p.x * q.z + p.y * q.w + p.z * q.x;
+        z = p.w * q.z + p.x * q.y - p.y * q.x + p.z * q.w;
         return *this;
     }
 
@@ -69,9 +70,9 @@ public:
         return Quaternion(*this) += q;
     }
 
-    Mat3f toRotMat() const
+    Matrix3x3<T> toRotMat() const
     {
-        return Mat3f(
+        return Matrix3x3<T>(
             1 - 2 * (y * y + z * z),  2 * (x * y - w * z),      2 * (x * z + w * y),
             2 * (x * y + w * z),      1 - 2 * (x * x + z * z),  2 * (y * z - w * x),
             2 * (x * z - w * y),      2 * (y * z + w * x),      1 - 2 * (x * x + y * y));
@@ -0,0 +1,48 @@
+// Print a trajectory log written by tpRigid (see Trajectory.h) as text, one line per body and frame:
+// frame step time body px py pz qw qx qy qz
+
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <exception>
+
+#include "Trajectory.h"
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <trajectory file> [first frame] [frame count]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        TrajectoryReader reader(argv[1]);
+        const uint64_t first = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 0;
+        const uint64_t count = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : reader.numFrames();
+
+        std::cout << "# " << reader.numFrames() << " frames, " << reader.numBodies() << " bodies, "
+                  << (reader.encoding() == TRAJECTORY_HALF ? "half" : "full") << " precision" << std::endl;
+        std::cout << std::setprecision(9);
+        for (uint64_t f = first; f < reader.numFrames() && f - first < count; ++f)
+        {
+            const TrajectoryFrame frame = reader.frame(f);
+            for (tIndex b = 0; b < reader.numBodies(); ++b)
+            {
+                const glm::dvec3 &p = frame.positions[b];
+                const glm::quat &q = frame.orientations[b];
+                std::cout << f << " " << frame.step << " " << frame.time << " " << b << " "
+                          << p.x << " " << p.y << " " << p.z << " "
+                          << q.w << " " << q.x << " " << q.y << " " << q.z << std::endl;
+            }
+        }
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
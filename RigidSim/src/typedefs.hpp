@@ -4,4 +4,34 @@
 typedef float tReal;
 typedef unsigned int tIndex;
 
+// Precision policies of the solver and collision code:
+// tPosition is used for the world positions, tLocal for the computations relative to a body.
+struct FloatPrecision
+{
+    typedef float tPosition;
+    typedef float tLocal;
+};
+
+struct DoublePrecision
+{
+    typedef double tPosition;
+    typedef double tLocal;
+};
+
+// double positions to stay accurate far from the origin, float for everything else
+struct MixedPrecision
+{
+    typedef double tPosition;
+    typedef float tLocal;
+};
+
+// policy of the application, chosen at build time (see RIGID_PRECISION in CMakeLists.txt)
+#if defined(RIGID_PRECISION_DOUBLE)
+typedef DoublePrecision tPrecision;
+#elif defined(RIGID_PRECISION_MIXED)
+typedef MixedPrecision tPrecision;
+#else
+typedef FloatPrecision tPrecision;
+#endif
+
 #endif  /* _TYPEDEFS_H_ */
@@ -1,22 +1,55 @@
 #version 330 core            // minimal GL version support expected from the GPU
 
 layout(location=0) in vec3 vPosition; // the 1st input attribute is the position (CPU side: glVertexAttrib 0)
-layout(location=1) in vec3 vNormal;
+layout(location=1) in vec2 vNormal; // octahedral encoding (CPU side: PackedVertex)
 layout(location=2) in vec2 vTexCoord;
 
-uniform mat4 modelMat, viewMat, projMat;
-uniform mat3 normMat;
+// per-instance attributes (CPU side: MeshInstance, glVertexAttribDivisor 1)
+layout(location=3) in mat4 iModelMat;  // locations 3 to 6
+layout(location=7) in mat3 iNormMat;   // locations 7 to 9
+layout(location=10) in vec3 iAlbedo;
+layout(location=11) in vec2 iTexLoaded; // albedo texture, normal texture
+
+struct LightSource {
+    vec3 position;
+    vec3 color;
+    float intensity;
+};
+
+// written once per frame (CPU side: FrameBlock in main.cpp), must be the same in every shader
+layout(std140) uniform FrameBlock {
+    mat4 viewMat;
+    mat4 projMat;
+    vec3 camPos;
+    LightSource lightSrc;
+};
 
 out vec3 fPositionModel;
 out vec3 fPosition;
 out vec3 fNormal;
 out vec2 fTexCoord;
 
+flat out mat3 fNormMat;
+flat out vec3 fAlbedo;
+flat out vec2 fTexLoaded;
+
+// inverse of octEncode in VertexFormat.h
+vec3 octDecode(vec2 e) {
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  float t = max(-n.z, 0.0);
+  n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+  return normalize(n);
+}
+
 void main() {
   fPositionModel = vPosition;
-  fPosition = (modelMat*vec4(vPosition, 1.0)).xyz;
-  fNormal = normMat*vNormal;
+  fPosition = (iModelMat*vec4(vPosition, 1.0)).xyz;
+  fNormal = iNormMat*octDecode(vNormal);
   fTexCoord = vTexCoord;
 
-  gl_Position =  projMat*viewMat*modelMat*vec4(vPosition, 1.0); // mandatory
+  fNormMat = iNormMat;
+  fAlbedo = iAlbedo;
+  fTexLoaded = iTexLoaded;
+
+  gl_Position =  projMat*viewMat*vec4(fPosition, 1.0); // mandatory
 }
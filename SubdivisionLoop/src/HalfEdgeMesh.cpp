@@ -0,0 +1,125 @@
+#include "HalfEdgeMesh.h"
+
+const unsigned int HalfEdgeMesh::invalid;
+
+namespace
+{
+const size_t grainSize = 4096;
+} // namespace
+
+void HalfEdgeMesh::build(size_t numVertices, const std::vector<glm::uvec3> &triangles, ThreadPool *pool)
+{
+    const size_t numHalfEdges = 3 * triangles.size();
+    _next.resize(numHalfEdges);
+    _twin.resize(numHalfEdges);
+    _vertex.resize(numHalfEdges);
+    _face.resize(numHalfEdges);
+    _edge.resize(numHalfEdges);
+    _vertexHalfEdge.resize(numVertices);
+
+    parallelForRange(pool, triangles.size(), grainSize, [&](size_t begin, size_t end)
+    {
+        for (unsigned int t = begin; t < end; ++t)
+            for (unsigned int k = 0; k < 3; ++k)
+            {
+                const unsigned int h = 3 * t + k;
+                _next[h] = 3 * t + (k + 1) % 3;
+                _vertex[h] = triangles[t][k];
+                _face[h] = t;
+            }
+    });
+
+    // Half-edges grouped by origin vertex, in increasing order, with a counting sort, and their
+    // targets next to them for the lookups below
+    std::vector<unsigned int> offsets(numVertices + 1, 0);
+    for (unsigned int h = 0; h < numHalfEdges; ++h)
+        ++offsets[_vertex[h] + 1];
+    for (size_t v = 0; v < numVertices; ++v)
+        offsets[v + 1] += offsets[v];
+    std::vector<unsigned int> outgoing(numHalfEdges), outgoingTarget(numHalfEdges);
+    {
+        std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (unsigned int h = 0; h < numHalfEdges; ++h)
+        {
+            const unsigned int i = fill[_vertex[h]]++;
+            outgoing[i] = h;
+            outgoingTarget[i] = target(h);
+        }
+    }
+
+    // The twin of the i-th half-edge a->b is the i-th half-edge b->a, if any: a single pair on a
+    // manifold edge, and the same pairs whatever the order the half-edges are visited in. The
+    // edges are counted in each range of half-edges along the way, see below.
+    const size_t numRanges = (numHalfEdges + grainSize - 1) / grainSize;
+    std::vector<unsigned int> firstEdge(numRanges + 1, 0);
+    parallelForRange(pool, numHalfEdges, grainSize, [&](size_t begin, size_t end)
+    {
+        unsigned int numEdges = 0;
+        for (unsigned int h = begin; h < end; ++h)
+        {
+            const unsigned int a = _vertex[h];
+            const unsigned int b = target(h);
+            unsigned int rank = 0;
+            for (unsigned int i = offsets[a]; outgoing[i] != h; ++i)
+                if (outgoingTarget[i] == b)
+                    ++rank;
+
+            _twin[h] = invalid;
+            for (unsigned int i = offsets[b]; i < offsets[b + 1]; ++i)
+            {
+                if (outgoingTarget[i] == a && outgoing[i] != h && rank-- == 0)
+                {
+                    _twin[h] = outgoing[i];
+                    break;
+                }
+            }
+            if (isFirstOfEdge(h))
+                ++numEdges;
+        }
+        firstEdge[begin / grainSize + 1] = numEdges;
+    });
+
+    // The edges, numbered when their first half-edge is met: the first edge of each range is
+    // known once the edges of the previous ranges are counted
+    for (size_t r = 0; r < numRanges; ++r)
+        firstEdge[r + 1] += firstEdge[r];
+    _numEdges = firstEdge[numRanges];
+    parallelForRange(pool, numRanges, 1, [&](size_t begin, size_t end)
+    {
+        for (size_t r = begin; r < end; ++r)
+        {
+            unsigned int e = firstEdge[r];
+            for (unsigned int h = r * grainSize; h < std::min(numHalfEdges, (r + 1) * grainSize); ++h)
+                if (isFirstOfEdge(h))
+                    _edge[h] = e++;
+        }
+    });
+    // the second half-edges, once all the first ones are numbered
+    parallelForRange(pool, numHalfEdges, grainSize, [&](size_t begin, size_t end)
+    {
+        for (unsigned int h = begin; h < end; ++h)
+            if (!isFirstOfEdge(h))
+                _edge[h] = _edge[_twin[h]];
+    });
+
+    // A half-edge leaving each vertex, the first boundary one if any
+    parallelForRange(pool, numVertices, grainSize, [&](size_t begin, size_t end)
+    {
+        for (unsigned int v = begin; v < end; ++v)
+        {
+            unsigned int start = invalid;
+            for (unsigned int i = offsets[v]; i < offsets[v + 1]; ++i)
+            {
+                const unsigned int h = outgoing[i];
+                if (start == invalid)
+                    start = h;
+                if (_twin[h] == invalid)
+                {
+                    start = h;
+                    break;
+                }
+            }
+            _vertexHalfEdge[v] = start;
+        }
+    });
+}
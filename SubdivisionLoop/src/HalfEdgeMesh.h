@@ -0,0 +1,104 @@
+#ifndef HALF_EDGE_MESH_H
+#define HALF_EDGE_MESH_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "ThreadPool.h"
+
+// Connectivity of a triangle mesh as half-edges, stored as contiguous index arrays.
+//
+// Half-edge 3t+k goes from corner k to corner k+1 of triangle t: the half-edges of a face are
+// consecutive, next() and prev() stay in the face. vertex() is the origin of a half-edge, twin()
+// the opposite half-edge of the adjacent face, or invalid on a boundary. Edges shared by more
+// than two faces are not manifold: the half-edges beyond the first pair are left as boundaries.
+//
+// Built in linear time from the triangles (the twins are looked up among the half-edges leaving
+// the target vertex, a bounded number for meshes of bounded valence), on a thread pool if any,
+// the one-ring of a vertex is then walked in O(1) per neighbor.
+class HalfEdgeMesh
+{
+public:
+    static const unsigned int invalid = ~0u;
+
+    HalfEdgeMesh() = default;
+    HalfEdgeMesh(size_t numVertices, const std::vector<glm::uvec3> &triangles, ThreadPool *pool = nullptr)
+    {
+        build(numVertices, triangles, pool);
+    }
+
+    // The same arrays with or without a pool
+    void build(size_t numVertices, const std::vector<glm::uvec3> &triangles, ThreadPool *pool = nullptr);
+
+    size_t numVertices() const { return _vertexHalfEdge.size(); }
+    size_t numFaces() const { return _vertex.size() / 3; }
+    size_t numHalfEdges() const { return _vertex.size(); }
+    size_t numEdges() const { return _numEdges; }
+
+    unsigned int next(unsigned int h) const { return _next[h]; }
+    unsigned int prev(unsigned int h) const { return _next[_next[h]]; }
+    unsigned int twin(unsigned int h) const { return _twin[h]; }
+    unsigned int vertex(unsigned int h) const { return _vertex[h]; }
+    unsigned int target(unsigned int h) const { return _vertex[_next[h]]; }
+    unsigned int face(unsigned int h) const { return _face[h]; }
+    // Index of the undirected edge, numbered in the order of their first half-edge
+    unsigned int edge(unsigned int h) const { return _edge[h]; }
+
+    bool isBoundary(unsigned int h) const { return _twin[h] == invalid; }
+    // The half-edge of its edge the edge is numbered from: the boundary one, or the lower of the pair
+    bool isFirstOfEdge(unsigned int h) const { return _twin[h] == invalid || _twin[h] > h; }
+
+    // A half-edge leaving the vertex, the boundary one if the vertex is on a boundary, so that
+    // the one-ring starts there. invalid for a vertex of no face.
+    unsigned int vertexHalfEdge(unsigned int v) const { return _vertexHalfEdge[v]; }
+    bool isBoundaryVertex(unsigned int v) const
+    {
+        return _vertexHalfEdge[v] != invalid && _twin[_vertexHalfEdge[v]] == invalid;
+    }
+
+    // Half-edge leaving the origin of h after h, turning around it, or invalid past a boundary
+    unsigned int nextAroundVertex(unsigned int h) const { return _twin[prev(h)]; }
+
+    // Call f(neighbor) for the vertices of the one-ring of v, in order around it. On a boundary,
+    // from the target of the boundary half-edge leaving v to the origin of the one arriving at v.
+    template <typename F>
+    void forEachNeighbor(unsigned int v, F f) const
+    {
+        const unsigned int start = _vertexHalfEdge[v];
+        if (start == invalid)
+            return;
+        unsigned int h = start;
+        for (;;)
+        {
+            f(target(h));
+            const unsigned int n = nextAroundVertex(h);
+            if (n == invalid)
+            {
+                f(vertex(prev(h)));
+                return;
+            }
+            if (n == start)
+                return;
+            h = n;
+        }
+    }
+
+    unsigned int valence(unsigned int v) const
+    {
+        unsigned int count = 0;
+        forEachNeighbor(v, [&count](unsigned int) { ++count; });
+        return count;
+    }
+
+private:
+    std::vector<unsigned int> _next;
+    std::vector<unsigned int> _twin;
+    std::vector<unsigned int> _vertex;
+    std::vector<unsigned int> _face;
+    std::vector<unsigned int> _edge;
+    std::vector<unsigned int> _vertexHalfEdge;
+    size_t _numEdges = 0;
+};
+
+#endif // HALF_EDGE_MESH_H
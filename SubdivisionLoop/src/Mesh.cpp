@@ -10,6 +10,9 @@
 #include <ios>
 #include <string>
 #include <memory>
+#include <stdexcept>
+
+#include "MeshSimplifier.h"
 
 Mesh::~Mesh()
 {
@@ -45,7 +48,8 @@ void Mesh::recomputePerVertexNormals(bool angleBased)
     }
     for (unsigned int nIt = 0; nIt < _vertexNormals.size(); ++nIt)
     {
-        glm::normalize(_vertexNormals[nIt]);
+        if (glm::dot(_vertexNormals[nIt], _vertexNormals[nIt]) > 0.f)
+            _vertexNormals[nIt] = glm::normalize(_vertexNormals[nIt]);
     }
 }
 
@@ -95,97 +99,757 @@ void Mesh::addPlan(float square_half_side)
         glm::uvec3(_vertexPositions.size() - 4, _vertexPositions.size() - 2, _vertexPositions.size() - 1));
 }
 
-#ifdef SUPPORT_OPENGL_45
-void Mesh::init()
+// Interleave and quantize the vertices (see VertexFormat.h) into the CPU-side staging buffers
+void Mesh::packBuffers(std::vector<PackedVertex> &vertices, std::vector<unsigned char> &indices,
+                       std::vector<MorphVertex> &morphVertices)
 {
-    glCreateBuffers(1, &_posVbo);                                                                     // Generate a GPU buffer to store the positions of the vertices
-    size_t vertexBufferSize = sizeof(glm::vec3) * _vertexPositions.size();                            // Gather the size of the buffer from the CPU-side vector
-    glNamedBufferStorage(_posVbo, vertexBufferSize, _vertexPositions.data(), GL_DYNAMIC_STORAGE_BIT); // Create a data store on the GPU
-
-    glCreateBuffers(1, &_normalVbo); // Same for normal
-    glNamedBufferStorage(_normalVbo, vertexBufferSize, _vertexNormals.data(), GL_DYNAMIC_STORAGE_BIT);
+    if (_drawTriangles.size() != _triangleIndices.size())
+    {
+        _drawTriangles = optimizeVertexCache(_triangleIndices, drawnPositions(), _vertexPositions.size());
+        _drawVertexIndices = optimizeVertexFetch(_drawTriangles, _vertexPositions.size());
+    }
+    _indexType = packIndices(_drawTriangles, _vertexPositions.size(), indices);
+    packVertices(vertices, morphVertices);
+}
 
-    glCreateBuffers(1, &_texCoordVbo); // Same for texture coordinates
-    size_t texCoordBufferSize = sizeof(glm::vec2) * _vertexTexCoords.size();
-    glNamedBufferStorage(_texCoordVbo, texCoordBufferSize, _vertexTexCoords.data(), GL_DYNAMIC_STORAGE_BIT);
+void Mesh::packVertices(std::vector<PackedVertex> &vertices, std::vector<MorphVertex> &morphVertices)
+{
+    vertices.resize(_vertexPositions.size());
+    for (size_t v = 0; v < _vertexPositions.size(); ++v)
+        vertices[_drawVertexIndices[v]] = packVertex(
+            v < _limitPositions.size() ? _limitPositions[v] : _vertexPositions[v],
+            v < _vertexNormals.size() ? _vertexNormals[v] : glm::vec3(0.f, 0.f, 1.f),
+            v < _vertexTexCoords.size() ? _vertexTexCoords[v] : glm::vec2(0.f));
+    morphVertices.resize(_morphPositions.size());
+    for (size_t v = 0; v < _morphPositions.size(); ++v)
+        morphVertices[_drawVertexIndices[v]] = packMorphVertex(_morphPositions[v], _morphNormals[v]);
+
+    // The bounds of the meshlets follow the positions, in the numbering of the vertex buffer
+    const std::vector<glm::vec3> &positions = drawnPositions();
+    std::vector<glm::vec3> drawPositions(positions.size()), drawMorphPositions(_morphPositions.size());
+    for (size_t v = 0; v < positions.size(); ++v)
+        drawPositions[_drawVertexIndices[v]] = positions[v];
+    for (size_t v = 0; v < _morphPositions.size(); ++v)
+        drawMorphPositions[_drawVertexIndices[v]] = _morphPositions[v];
+    buildMeshlets(_drawTriangles, drawPositions, drawMorphPositions, _meshlets);
+}
 
-    glCreateBuffers(1, &_ibo); // Same for the index buffer, that stores the list of indices of the triangles forming the mesh
-    size_t indexBufferSize = sizeof(glm::uvec3) * _triangleIndices.size();
-    glNamedBufferStorage(_ibo, indexBufferSize, _triangleIndices.data(), GL_DYNAMIC_STORAGE_BIT);
+#ifdef SUPPORT_OPENGL_45
+void Mesh::init()
+{
+    clearGPU(); // init() is called again after each subdivision
+    std::vector<PackedVertex> vertices;
+    std::vector<unsigned char> indices;
+    std::vector<MorphVertex> morphVertices;
+    packBuffers(vertices, indices, morphVertices);
+
+    // Immutable stores. The indices are written once, at creation, the vertices again by updatePositions().
+    glCreateBuffers(1, &_vbo);
+    glNamedBufferStorage(_vbo, vertices.size() * sizeof(PackedVertex), vertices.data(), GL_DYNAMIC_STORAGE_BIT);
+    glCreateBuffers(1, &_ibo);
+    glNamedBufferStorage(_ibo, indices.size(), indices.data(), 0);
 
     glCreateVertexArrays(1, &_vao); // Create a single handle that joins together attributes (vertex positions, normals) and connectivity (triangles indices)
-    glBindVertexArray(_vao);
-
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, _posVbo);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
-
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, _normalVbo);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
-
-    glEnableVertexAttribArray(2);
-    glBindBuffer(GL_ARRAY_BUFFER, _texCoordVbo);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), 0);
+    glVertexArrayVertexBuffer(_vao, 0, _vbo, 0, sizeof(PackedVertex));
+    glEnableVertexArrayAttrib(_vao, 0);
+    glVertexArrayAttribFormat(_vao, 0, 3, GL_FLOAT, GL_FALSE, offsetof(PackedVertex, position));
+    glVertexArrayAttribBinding(_vao, 0, 0);
+    glEnableVertexArrayAttrib(_vao, 1);
+    glVertexArrayAttribFormat(_vao, 1, 2, GL_SHORT, GL_TRUE, offsetof(PackedVertex, normal));
+    glVertexArrayAttribBinding(_vao, 1, 0);
+    glEnableVertexArrayAttrib(_vao, 2);
+    glVertexArrayAttribFormat(_vao, 2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, texCoord));
+    glVertexArrayAttribBinding(_vao, 2, 0);
+    if (!morphVertices.empty())
+    {
+        glCreateBuffers(1, &_morphVbo);
+        glNamedBufferStorage(_morphVbo, morphVertices.size() * sizeof(MorphVertex), morphVertices.data(),
+                             GL_DYNAMIC_STORAGE_BIT);
+        glVertexArrayVertexBuffer(_vao, 1, _morphVbo, 0, sizeof(MorphVertex));
+        glEnableVertexArrayAttrib(_vao, 3);
+        glVertexArrayAttribFormat(_vao, 3, 3, GL_FLOAT, GL_FALSE, offsetof(MorphVertex, position));
+        glVertexArrayAttribBinding(_vao, 3, 1);
+        glEnableVertexArrayAttrib(_vao, 4);
+        glVertexArrayAttribFormat(_vao, 4, 2, GL_SHORT, GL_TRUE, offsetof(MorphVertex, normal));
+        glVertexArrayAttribBinding(_vao, 4, 1);
+    }
+    glVertexArrayElementBuffer(_vao, _ibo);
+}
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ibo);
-    glBindVertexArray(0); // Desactive the VAO just created. Will be activated at rendering time.
+void Mesh::uploadVertices(const std::vector<PackedVertex> &vertices, const std::vector<MorphVertex> &morphVertices)
+{
+    glNamedBufferSubData(_vbo, 0, vertices.size() * sizeof(PackedVertex), vertices.data());
+    if (!morphVertices.empty())
+        glNamedBufferSubData(_morphVbo, 0, morphVertices.size() * sizeof(MorphVertex), morphVertices.data());
 }
 #else
 void Mesh::init()
 {
-    // Generate a GPU buffer to store the positions of the vertices
-    size_t vertexBufferSize = sizeof(glm::vec3) * _vertexPositions.size();
-    glGenBuffers(1, &_posVbo);
-    glBindBuffer(GL_ARRAY_BUFFER, _posVbo);
-    glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, _vertexPositions.data(), GL_DYNAMIC_READ);
-
-    // Same for normal
-    glGenBuffers(1, &_normalVbo);
-    glBindBuffer(GL_ARRAY_BUFFER, _normalVbo);
-    glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, _vertexNormals.data(), GL_DYNAMIC_READ);
-
-    // Same for texture coordinates
-    size_t texCoordBufferSize = sizeof(glm::vec2) * _vertexTexCoords.size();
-    glGenBuffers(1, &_texCoordVbo);
-    glBindBuffer(GL_ARRAY_BUFFER, _texCoordVbo);
-    glBufferData(GL_ARRAY_BUFFER, texCoordBufferSize, _vertexTexCoords.data(), GL_DYNAMIC_READ);
-
-    // Same for the index buffer that stores the list of indices of the triangles forming the mesh
-    size_t indexBufferSize = sizeof(glm::uvec3) * _triangleIndices.size();
+    clearGPU(); // init() is called again after each subdivision
+    std::vector<PackedVertex> vertices;
+    std::vector<unsigned char> indices;
+    std::vector<MorphVertex> morphVertices;
+    packBuffers(vertices, indices, morphVertices);
+
+    // No vertex array bound while the index buffer is: it would become the one of the vertex array drawn last
+    glBindVertexArray(0);
+
+    // Generate a GPU buffer to store the interleaved vertices, written again by updatePositions() when the mesh moves
+    glGenBuffers(1, &_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(PackedVertex), vertices.data(), GL_DYNAMIC_DRAW);
+
+    // The index buffer that stores the list of indices of the triangles forming the mesh, written once
     glGenBuffers(1, &_ibo);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ibo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, _triangleIndices.data(), GL_DYNAMIC_READ);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size(), indices.data(), GL_STATIC_DRAW);
 
     // Create a single handle that joins together attributes (vertex positions, normals) and connectivity (triangles indices)
     glGenVertexArrays(1, &_vao);
     glBindVertexArray(_vao);
 
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, _posVbo);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    setPackedVertexAttributes();
 
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, _normalVbo);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
-
-    glEnableVertexAttribArray(2);
-    glBindBuffer(GL_ARRAY_BUFFER, _texCoordVbo);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), 0);
+    // The morph targets, if any, in their own buffer: the meshes without them keep 20 bytes per vertex
+    if (!morphVertices.empty())
+    {
+        glGenBuffers(1, &_morphVbo);
+        glBindBuffer(GL_ARRAY_BUFFER, _morphVbo);
+        glBufferData(GL_ARRAY_BUFFER, morphVertices.size() * sizeof(MorphVertex), morphVertices.data(),
+                     GL_DYNAMIC_DRAW);
+        setMorphVertexAttributes();
+    }
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ibo);
 
     glBindVertexArray(0); // Desactive the VAO just created. Will be activated at rendering time.
 }
+
+void Mesh::uploadVertices(const std::vector<PackedVertex> &vertices, const std::vector<MorphVertex> &morphVertices)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(PackedVertex), vertices.data());
+    if (!morphVertices.empty())
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, _morphVbo);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, morphVertices.size() * sizeof(MorphVertex), morphVertices.data());
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 #endif
 
+void Mesh::updatePositions()
+{
+    // Same vertices and triangles as uploaded, and the same morph buffer: written in place
+    if (!_vbo || _drawTriangles.size() != _triangleIndices.size() ||
+        _drawVertexIndices.size() != _vertexPositions.size() || hasMorphTargets() != (_morphVbo != 0))
+    {
+        init();
+        return;
+    }
+    std::vector<PackedVertex> vertices;
+    std::vector<MorphVertex> morphVertices;
+    packVertices(vertices, morphVertices);
+    uploadVertices(vertices, morphVertices);
+}
+
 void Mesh::render()
 {
     glBindVertexArray(_vao); // Activate the VAO storing geometry data
-    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_triangleIndices.size() * 3), GL_UNSIGNED_INT, 0);
+    draw();
+}
+
+void Mesh::draw() const
+{
+    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_triangleIndices.size() * 3), _indexType, 0);
     // Call for rendering: stream the current GPU geometry through the current GPU program
 }
 
+void Mesh::draw(const DrawRanges &ranges) const
+{
+    if (!ranges.counts.empty())
+        glMultiDrawElements(GL_TRIANGLES, ranges.counts.data(), _indexType, ranges.offsets.data(),
+                            static_cast<GLsizei>(ranges.counts.size()));
+}
+
+
+void Mesh::setControlPositions(const std::vector<glm::vec3> &positions, ThreadPool *pool)
+{
+    if (positions.size() != controlPositions().size())
+        throw std::runtime_error("[Mesh][setControlPositions] " + std::to_string(positions.size()) +
+                                 " positions given for " + std::to_string(controlPositions().size()) + " vertices");
+    if (_subdivisionStencils.empty())
+    {
+        _vertexPositions = positions;
+    }
+    else
+    {
+        // One product per level. The operator composed from the control mesh to the current level has more
+        // entries per row than the ones of the levels together, and is long to compute.
+        _controlPositions = positions;
+        std::vector<glm::vec3> levelPositions = _controlPositions, nextPositions;
+        for (size_t level = 0; level + 1 < _subdivisionStencils.size(); ++level)
+        {
+            _subdivisionStencils[level].apply(levelPositions, nextPositions, pool);
+            levelPositions.swap(nextPositions);
+        }
+        _subdivisionStencils.back().apply(levelPositions, _vertexPositions, pool);
+    }
+    if (_limitPositions.empty())
+        recomputePerVertexNormals();
+    else
+        evaluateLimitSurface(pool);
+}
+
+const HalfEdgeMesh &Mesh::currentHalfEdges(ThreadPool *pool)
+{
+    if (!_hasHalfEdges)
+    {
+        _halfEdges.build(_vertexPositions.size(), _triangleIndices, pool);
+        _hasHalfEdges = true;
+    }
+    return _halfEdges;
+}
+
+void Mesh::topologyChanged()
+{
+    _halfEdges = HalfEdgeMesh();
+    _hasHalfEdges = false;
+    _limitPosition.clear();
+    _limitTangents[0].clear();
+    _limitTangents[1].clear();
+    _limitPositions.clear();
+    _greenTriangles.clear();
+    _morphPositions.clear();
+    _morphNormals.clear();
+    _drawTriangles.clear();
+    _drawVertexIndices.clear();
+    _meshlets.clear();
+}
+
+void Mesh::setMorphTargets(const std::vector<glm::vec3> &positions, const std::vector<glm::vec3> &normals)
+{
+    if (positions.size() != _vertexPositions.size() || normals.size() != _vertexPositions.size())
+        throw std::runtime_error("[Mesh][setMorphTargets] " + std::to_string(positions.size()) + " positions and " +
+                                 std::to_string(normals.size()) + " normals given for " +
+                                 std::to_string(_vertexPositions.size()) + " vertices");
+    _morphPositions = positions;
+    _morphNormals = normals;
+}
+
+unsigned int Mesh::evenStencilSize(const HalfEdgeMesh &halfEdges, unsigned int v)
+{
+    const unsigned int valence = halfEdges.valence(v);
+    return valence == 0 ? 1 : halfEdges.isBoundaryVertex(v) ? 3 : valence + 1;
+}
+
+void Mesh::setEvenStencil(const HalfEdgeMesh &halfEdges, unsigned int v, size_t row, SubdivisionStencil &stencil,
+                          std::vector<unsigned int> &neighbors)
+{
+    neighbors.clear();
+    halfEdges.forEachNeighbor(v, [&neighbors](unsigned int n) { neighbors.push_back(n); });
+    if (neighbors.empty())
+    {
+        stencil.setEntry(row, 0, v, 1.f); // isolated vertex
+        return;
+    }
+
+    if (halfEdges.isBoundaryVertex(v))
+    {
+        // the boundary neighbors are the first and the last of the one-ring
+        stencil.setEntry(row, 0, neighbors.front(), 0.125f);
+        stencil.setEntry(row, 1, neighbors.back(), 0.125f);
+        stencil.setEntry(row, 2, v, 0.75f);
+    }
+    else
+    {
+        unsigned int valence = neighbors.size();
+        float alpha = (40.f - pow(3.f + 2.f*cos(2.f*M_PI/valence), 2)) / 64.f;
+
+        for (unsigned int i = 0; i < valence; ++i)
+            stencil.setEntry(row, i, neighbors[i], alpha/valence);
+        stencil.setEntry(row, valence, v, 1 - alpha);
+    }
+    stencil.sortRow(row);
+}
+
+unsigned int Mesh::oddStencilSize(const HalfEdgeMesh &halfEdges, unsigned int h)
+{
+    const unsigned int twin = halfEdges.twin(h);
+    if (twin == HalfEdgeMesh::invalid)
+        return 2;
+    return halfEdges.vertex(halfEdges.prev(h)) == halfEdges.vertex(halfEdges.prev(twin)) ? 3 : 4;
+}
+
+void Mesh::setOddStencil(const HalfEdgeMesh &halfEdges, unsigned int h, size_t row, SubdivisionStencil &stencil)
+{
+    const unsigned int twin = halfEdges.twin(h);
+    const unsigned int a = halfEdges.vertex(h);
+    const unsigned int b = halfEdges.target(h);
+    if (twin == HalfEdgeMesh::invalid)
+    {
+        stencil.setEntry(row, 0, a, 0.5f);
+        stencil.setEntry(row, 1, b, 0.5f);
+        stencil.sortRow(row);
+        return;
+    }
+
+    // the vertices opposite to the edge in its two faces
+    const unsigned int c = halfEdges.vertex(halfEdges.prev(h));
+    const unsigned int d = halfEdges.vertex(halfEdges.prev(twin));
+    unsigned int k = 0;
+    stencil.setEntry(row, k++, c, 0.125f);
+    if (d != c)
+        stencil.setEntry(row, k++, d, 0.125f);
+    stencil.setEntry(row, k++, a, 0.375f);
+    stencil.setEntry(row, k++, b, 0.375f);
+    stencil.sortRow(row);
+}
+
+namespace
+{
+// Tangent across the boundary at a boundary vertex of numFaces faces: the left eigenvector of the subdivision
+// matrix of the vertex and its one-ring for the largest eigenvalue below 1 among the masks symmetric about the
+// vertex, the mask along the boundary being antisymmetric. Weights of the vertex, then of the one-ring from the
+// first boundary neighbor, the tangent pointing toward the faces.
+std::vector<double> boundaryTangentMask(unsigned int numFaces)
+{
+    const unsigned int k = numFaces, size = k + 2;
+    // row: new vertex, column: old vertex, 0 being the center and i + 1 the neighbor i
+    std::vector<std::vector<double>> subdivision(size, std::vector<double>(size, 0.0));
+    subdivision[0][0] = 0.75;
+    subdivision[0][1] = subdivision[0][k + 1] = 0.125;
+    for (unsigned int i = 0; i <= k; ++i)
+    {
+        std::vector<double> &odd = subdivision[i + 1];
+        if (i == 0 || i == k)
+        {
+            odd[0] = odd[i + 1] = 0.5; // boundary edge
+            continue;
+        }
+        odd[0] = odd[i + 1] = 0.375;
+        odd[i] = odd[i + 2] = 0.125;
+    }
+
+    // power iteration on the symmetric masks, without the limit position (eigenvalue 1): the position is a
+    // left eigenvector, the affine invariance makes the constants a right one
+    std::vector<double> limit(size, 0.0);
+    limit[0] = 2.0 / 3.0;
+    limit[1] = limit[k + 1] = 1.0 / 6.0;
+    std::vector<double> mask(size, 1.0), next(size);
+    mask[0] = -static_cast<double>(k + 1);
+    for (int iteration = 0; iteration < 200; ++iteration)
+    {
+        for (unsigned int j = 0; j < size; ++j)
+        {
+            next[j] = 0.0;
+            for (unsigned int r = 0; r < size; ++r)
+                next[j] += mask[r] * subdivision[r][j];
+        }
+        double sum = 0.0, norm = 0.0;
+        for (unsigned int j = 1; j < size; ++j)
+            next[j] = next[size - j] = 0.5 * (next[j] + next[size - j]); // no rounding drift to the other masks
+        for (double w : next)
+            sum += w;
+        for (unsigned int j = 0; j < size; ++j)
+        {
+            next[j] -= sum * limit[j];
+            norm = std::max(norm, std::abs(next[j]));
+        }
+        for (unsigned int j = 0; j < size; ++j)
+            mask[j] = next[j] / norm;
+    }
+
+    // toward the faces of a flat one-ring, the faces being above the boundary
+    double across = 0.0;
+    for (unsigned int i = 0; i <= k; ++i)
+        across += mask[i + 1] * std::sin((i + 0.5) * M_PI / (k + 1));
+    if (across < 0.0)
+        for (double &w : mask)
+            w = -w;
+    return mask;
+}
+} // namespace
+
+void Mesh::buildLimitStencils(const HalfEdgeMesh &halfEdges, ThreadPool *pool)
+{
+    const size_t numVertices = _vertexPositions.size();
+    _limitPosition.reset(numVertices, numVertices);
+    _limitTangents[0].reset(numVertices, numVertices);
+    _limitTangents[1].reset(numVertices, numVertices);
+
+    // The number of vertices of the one-ring, and whether it is open on a boundary
+    std::vector<unsigned int> valences(numVertices);
+    parallelForRange(pool, numVertices, subdivisionGrainSize, [&](size_t begin, size_t end)
+    {
+        for (unsigned int v = begin; v < end; ++v)
+        {
+            const unsigned int valence = halfEdges.valence(v);
+            valences[v] = valence;
+            if (valence == 0)
+            {
+                _limitPosition.setRowSize(v, 1); // isolated vertex, without tangents
+            }
+            else if (halfEdges.isBoundaryVertex(v))
+            {
+                _limitPosition.setRowSize(v, 3);
+                _limitTangents[0].setRowSize(v, 2);
+                _limitTangents[1].setRowSize(v, valence + 1);
+            }
+            else
+            {
+                _limitPosition.setRowSize(v, valence + 1);
+                _limitTangents[0].setRowSize(v, valence);
+                _limitTangents[1].setRowSize(v, valence);
+            }
+        }
+    });
+    _limitPosition.allocate();
+    _limitTangents[0].allocate();
+    _limitTangents[1].allocate();
+
+    // The masks across the boundary, by number of faces
+    std::vector<std::vector<double>> boundaryTangentMasks;
+    for (unsigned int v = 0; v < numVertices; ++v)
+        if (halfEdges.isBoundaryVertex(v))
+            while (boundaryTangentMasks.size() < valences[v])
+                boundaryTangentMasks.push_back(boundaryTangentMask(boundaryTangentMasks.size()));
+
+    // The one-ring comes counterclockwise around the normal, from the boundary on a boundary
+    parallelForRange(pool, numVertices, subdivisionGrainSize, [&](size_t begin, size_t end)
+    {
+        std::vector<unsigned int> ring;
+        for (unsigned int v = begin; v < end; ++v)
+        {
+            const unsigned int n = valences[v];
+            if (n == 0)
+            {
+                _limitPosition.setEntry(v, 0, v, 1.f);
+                continue;
+            }
+            ring.clear();
+            halfEdges.forEachNeighbor(v, [&ring](unsigned int neighbor) { ring.push_back(neighbor); });
+
+            if (halfEdges.isBoundaryVertex(v))
+            {
+                // the boundary is a cubic B-spline of the boundary vertices
+                _limitPosition.setEntry(v, 0, ring.front(), 1.f / 6.f);
+                _limitPosition.setEntry(v, 1, v, 2.f / 3.f);
+                _limitPosition.setEntry(v, 2, ring.back(), 1.f / 6.f);
+                _limitTangents[0].setEntry(v, 0, ring.front(), 1.f);
+                _limitTangents[0].setEntry(v, 1, ring.back(), -1.f);
+
+                // across the boundary, for the n - 1 faces of the vertex
+                const std::vector<double> &mask = boundaryTangentMasks[n - 1];
+                _limitTangents[1].setEntry(v, 0, v, static_cast<float>(mask[0]));
+                for (unsigned int i = 0; i < n; ++i)
+                    _limitTangents[1].setEntry(v, i + 1, ring[i], static_cast<float>(mask[i + 1]));
+            }
+            else
+            {
+                // Loop: the limit position weights the center with 3 / (8 beta), beta being the weight of the
+                // neighbors in the subdivision mask; the tangents are the first harmonics of the one-ring
+                const double alpha = 0.625 - std::pow(0.375 + 0.25 * std::cos(2.0 * M_PI / n), 2.0);
+                const double chi = 1.0 / (3.0 * n / (8.0 * alpha) + n);
+                for (unsigned int i = 0; i < n; ++i)
+                {
+                    _limitPosition.setEntry(v, i, ring[i], static_cast<float>(chi));
+                    _limitTangents[0].setEntry(v, i, ring[i], static_cast<float>(std::cos(2.0 * M_PI * i / n)));
+                    _limitTangents[1].setEntry(v, i, ring[i], static_cast<float>(std::sin(2.0 * M_PI * i / n)));
+                }
+                _limitPosition.setEntry(v, n, v, static_cast<float>(1.0 - n * chi));
+            }
+        }
+    });
+}
+
+void Mesh::evaluateLimitSurface(ThreadPool *pool)
+{
+    if (_limitPosition.numRows() != _vertexPositions.size())
+        buildLimitStencils(currentHalfEdges(pool), pool);
+
+    std::vector<glm::vec3> tangents[2];
+    _limitPosition.apply(_vertexPositions, _limitPositions, pool);
+    _limitTangents[0].apply(_vertexPositions, tangents[0], pool);
+    _limitTangents[1].apply(_vertexPositions, tangents[1], pool);
+
+    _vertexNormals.resize(_vertexPositions.size(), glm::vec3(0.f, 0.f, 1.f));
+    parallelForRange(pool, _vertexPositions.size(), subdivisionGrainSize, [&](size_t begin, size_t end)
+    {
+        for (size_t v = begin; v < end; ++v)
+        {
+            const glm::vec3 normal = glm::cross(tangents[0][v], tangents[1][v]);
+            if (glm::dot(normal, normal) > 0.f)
+                _vertexNormals[v] = glm::normalize(normal); // else degenerate, keeps the previous normal
+        }
+    });
+}
+
+std::vector<unsigned char> Mesh::markFacesForRefinement(const AdaptiveSubdivisionCriteria &criteria, ThreadPool *pool)
+{
+    const std::vector<glm::vec3> &positions = drawnPositions();
+    const HalfEdgeMesh &halfEdges = currentHalfEdges(pool);
+    const bool inView = criteria.viewportSize.x > 0.f && criteria.viewportSize.y > 0.f;
+    const bool withNormals = criteria.maxNormalAngle > 0.f && _vertexNormals.size() == positions.size();
+    const float minNormalDot = std::cos(criteria.maxNormalAngle);
+
+    std::vector<unsigned char> refine(_triangleIndices.size(), 0);
+    parallelForRange(pool, _triangleIndices.size(), subdivisionGrainSize, [&](size_t begin, size_t end)
+    {
+        for (size_t t = begin; t < end; ++t)
+        {
+            const glm::uvec3 &triangle = _triangleIndices[t];
+            if (inView)
+            {
+                glm::vec4 clip[3];
+                for (int k = 0; k < 3; ++k)
+                    clip[k] = criteria.modelViewProjection * glm::vec4(positions[triangle[k]], 1.f);
+                // out of the frustum: the 3 corners beyond one of its planes
+                bool outside = false;
+                for (int axis = 0; axis < 3 && !outside; ++axis)
+                {
+                    outside = (clip[0][axis] > clip[0].w && clip[1][axis] > clip[1].w && clip[2][axis] > clip[2].w) ||
+                              (clip[0][axis] < -clip[0].w && clip[1][axis] < -clip[1].w && clip[2][axis] < -clip[2].w);
+                }
+                if (outside)
+                    continue;
+
+                // the size is only known in front of the camera
+                if (criteria.maxScreenEdge > 0.f && clip[0].w > 0.f && clip[1].w > 0.f && clip[2].w > 0.f)
+                {
+                    glm::vec2 screen[3];
+                    for (int k = 0; k < 3; ++k)
+                        screen[k] = 0.5f * criteria.viewportSize * glm::vec2(clip[k]) / clip[k].w;
+                    const float longestEdge = std::max(glm::distance(screen[0], screen[1]),
+                                                       std::max(glm::distance(screen[1], screen[2]),
+                                                                glm::distance(screen[2], screen[0])));
+                    if (longestEdge > criteria.maxScreenEdge)
+                    {
+                        refine[t] = 1;
+                        continue;
+                    }
+                }
+            }
+
+            if (withNormals)
+            {
+                for (int k = 0; k < 3 && !refine[t]; ++k)
+                {
+                    if (glm::dot(_vertexNormals[triangle[k]], _vertexNormals[triangle[(k + 1) % 3]]) < minNormalDot)
+                        refine[t] = 1;
+                }
+                if (refine[t])
+                    continue;
+            }
+
+            if (criteria.maxLimitDistance > 0.f)
+            {
+                // 3/8 (a + b) + 1/8 (c + d) - 1/2 (a + b), the edge ab between the faces abc and bad; the
+                // middle of a boundary edge stays on it
+                for (unsigned int k = 0; k < 3 && !refine[t]; ++k)
+                {
+                    const unsigned int h = 3 * t + k;
+                    const unsigned int twin = halfEdges.twin(h);
+                    if (twin == HalfEdgeMesh::invalid)
+                        continue;
+                    const glm::vec3 displacement = 0.125f * (positions[halfEdges.vertex(halfEdges.prev(h))] +
+                                                             positions[halfEdges.vertex(halfEdges.prev(twin))] -
+                                                             positions[halfEdges.vertex(h)] -
+                                                             positions[halfEdges.target(h)]);
+                    if (glm::length(displacement) > criteria.maxLimitDistance)
+                        refine[t] = 1;
+                }
+            }
+        }
+    });
+    return refine;
+}
+
+size_t Mesh::subdivideLoopAdaptive(const std::vector<unsigned char> &refine, ThreadPool *pool)
+{
+    if (refine.size() != _triangleIndices.size())
+        throw std::runtime_error("[Mesh][subdivideLoopAdaptive] " + std::to_string(refine.size()) +
+                                 " marks given for " + std::to_string(_triangleIndices.size()) + " faces");
+
+    // I) First, the closure: the edges of the red faces are split, and a face becomes red with its second split
+    // edge, or its first one if green, until no face changes. Each face is split at most once.
+    const HalfEdgeMesh &halfEdges = currentHalfEdges(pool);
+    const size_t numFaces = _triangleIndices.size();
+    std::vector<unsigned char> red(refine), splitEdge(halfEdges.numEdges(), 0);
+    std::vector<unsigned int> pending;
+    for (unsigned int t = 0; t < numFaces; ++t)
+    {
+        if (red[t])
+            pending.push_back(t);
+    }
+    size_t numRed = pending.size();
+    if (numRed == 0)
+        return 0;
+    while (!pending.empty())
+    {
+        const unsigned int t = pending.back();
+        pending.pop_back();
+        for (unsigned int k = 0; k < 3; ++k)
+        {
+            const unsigned int h = 3 * t + k;
+            if (splitEdge[halfEdges.edge(h)])
+                continue;
+            splitEdge[halfEdges.edge(h)] = 1;
+            const unsigned int twin = halfEdges.twin(h);
+            if (twin == HalfEdgeMesh::invalid || red[halfEdges.face(twin)])
+                continue;
+            const unsigned int neighbor = halfEdges.face(twin);
+            unsigned int numSplitEdges = 0;
+            for (unsigned int j = 0; j < 3; ++j)
+                numSplitEdges += splitEdge[halfEdges.edge(3 * neighbor + j)];
+            if (numSplitEdges >= 2 || (!_greenTriangles.empty() && _greenTriangles[neighbor]))
+            {
+                red[neighbor] = 1;
+                pending.push_back(neighbor);
+                ++numRed;
+            }
+        }
+    }
+
+    // II) Then, the new vertices: the old ones, the vertices of the red faces being smoothed, then one per split
+    // edge, in the order of the edges
+    const unsigned int firstOddVertex = _vertexPositions.size();
+    std::vector<unsigned char> smoothed(firstOddVertex, 0);
+    for (unsigned int t = 0; t < numFaces; ++t)
+    {
+        if (red[t])
+            smoothed[_triangleIndices[t][0]] = smoothed[_triangleIndices[t][1]] = smoothed[_triangleIndices[t][2]] = 1;
+    }
+    std::vector<unsigned int> oddVertex(halfEdges.numEdges(), HalfEdgeMesh::invalid), oddHalfEdges;
+    for (unsigned int h = 0; h < halfEdges.numHalfEdges(); ++h)
+    {
+        if (halfEdges.isFirstOfEdge(h) && splitEdge[halfEdges.edge(h)])
+        {
+            oddVertex[halfEdges.edge(h)] = firstOddVertex + oddHalfEdges.size();
+            oddHalfEdges.push_back(h);
+        }
+    }
+
+    // III) Then, their stencils, as in subdivideLoopNew()
+    SubdivisionStencil stencil;
+    stencil.reset(firstOddVertex + oddHalfEdges.size(), firstOddVertex);
+    parallelForRange(pool, firstOddVertex, subdivisionGrainSize, [&](size_t begin, size_t end)
+    {
+        for (unsigned int v = begin; v < end; ++v)
+            stencil.setRowSize(v, smoothed[v] ? evenStencilSize(halfEdges, v) : 1);
+    });
+    parallelForRange(pool, oddHalfEdges.size(), subdivisionGrainSize, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+            stencil.setRowSize(firstOddVertex + i, oddStencilSize(halfEdges, oddHalfEdges[i]));
+    });
+    stencil.allocate();
+    parallelForRange(pool, firstOddVertex, subdivisionGrainSize, [&](size_t begin, size_t end)
+    {
+        std::vector<unsigned int> neighbors;
+        for (unsigned int v = begin; v < end; ++v)
+        {
+            if (smoothed[v])
+                setEvenStencil(halfEdges, v, v, stencil, neighbors);
+            else
+                stencil.setEntry(v, 0, v, 1.f);
+        }
+    });
+    parallelForRange(pool, oddHalfEdges.size(), subdivisionGrainSize, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+            setOddStencil(halfEdges, oddHalfEdges[i], firstOddVertex + i, stencil);
+    });
+
+    // IV) Then, the new triangles, in the order of the faces: 4 per red face, 2 per face with a split edge, the
+    // face itself otherwise
+    std::vector<unsigned int> firstTriangle(numFaces + 1, 0);
+    for (unsigned int t = 0; t < numFaces; ++t)
+    {
+        unsigned int count = 1;
+        if (red[t])
+            count = 4;
+        else if (splitEdge[halfEdges.edge(3 * t)] || splitEdge[halfEdges.edge(3 * t + 1)] ||
+                 splitEdge[halfEdges.edge(3 * t + 2)])
+            count = 2;
+        firstTriangle[t + 1] = firstTriangle[t] + count;
+    }
+    std::vector<glm::uvec3> newTriangles(firstTriangle.back());
+    std::vector<unsigned char> newGreenTriangles(newTriangles.size(), 0);
+    parallelForRange(pool, numFaces, subdivisionGrainSize, [&](size_t begin, size_t end)
+    {
+        for (unsigned int tIt = begin; tIt < end; ++tIt)
+        {
+            const unsigned int first = firstTriangle[tIt];
+            const glm::uvec3 &triangle = _triangleIndices[tIt];
+            if (red[tIt])
+            {
+                unsigned int a = triangle[0];
+                unsigned int b = triangle[1];
+                unsigned int c = triangle[2];
+                unsigned int oddVertexOnEdgeEab = oddVertex[halfEdges.edge(3 * tIt)];
+                unsigned int oddVertexOnEdgeEbc = oddVertex[halfEdges.edge(3 * tIt + 1)];
+                unsigned int oddVertexOnEdgeEca = oddVertex[halfEdges.edge(3 * tIt + 2)];
+
+                newTriangles[first] = glm::uvec3(a, oddVertexOnEdgeEab, oddVertexOnEdgeEca);
+                newTriangles[first + 1] = glm::uvec3(oddVertexOnEdgeEab, b, oddVertexOnEdgeEbc);
+                newTriangles[first + 2] = glm::uvec3(oddVertexOnEdgeEca, oddVertexOnEdgeEbc, c);
+                newTriangles[first + 3] = glm::uvec3(oddVertexOnEdgeEab, oddVertexOnEdgeEbc, oddVertexOnEdgeEca);
+            }
+            else if (firstTriangle[tIt + 1] - first == 2)
+            {
+                // bisected from the middle of its split edge to the opposite corner
+                unsigned int k = 0;
+                while (!splitEdge[halfEdges.edge(3 * tIt + k)])
+                    ++k;
+                const unsigned int middle = oddVertex[halfEdges.edge(3 * tIt + k)];
+                newTriangles[first] = glm::uvec3(triangle[k], middle, triangle[(k + 2) % 3]);
+                newTriangles[first + 1] = glm::uvec3(middle, triangle[(k + 1) % 3], triangle[(k + 2) % 3]);
+                newGreenTriangles[first] = newGreenTriangles[first + 1] = 1;
+            }
+            else
+            {
+                newTriangles[first] = triangle;
+                newGreenTriangles[first] = _greenTriangles.empty() ? 0 : _greenTriangles[tIt];
+            }
+        }
+    });
+
+    // after that:
+    if (_subdivisionStencils.empty())
+        _controlPositions = _vertexPositions;
+    std::vector<glm::vec3> newVertices;
+    stencil.apply(_vertexPositions, newVertices, pool);
+    _subdivisionStencils.push_back(std::move(stencil));
+    _triangleIndices.swap(newTriangles);
+    _vertexPositions.swap(newVertices);
+    topologyChanged();
+    _greenTriangles.swap(newGreenTriangles);
+    evaluateLimitSurface(pool);
+    recomputePerVertexTextureCoordinates();
+    return numRed;
+}
+
+float Mesh::simplify(size_t targetTriangles, float maxError)
+{
+    MeshSimplifier simplifier(_vertexPositions, _triangleIndices, _vertexTexCoords);
+    MeshSimplifier::Options options;
+    options.targetTriangles = targetTriangles;
+    options.maxError = maxError;
+    const MeshSimplifier::Statistics statistics = simplifier.simplify(options);
+
+    _vertexPositions = simplifier.positions();
+    _triangleIndices = simplifier.triangles();
+    _vertexTexCoords = simplifier.texCoords();
+    _subdivisionStencils.clear();
+    _controlPositions.clear();
+    topologyChanged();
+    recomputePerVertexNormals();
+    if (_vertexTexCoords.size() != _vertexPositions.size())
+        recomputePerVertexTextureCoordinates();
+    return statistics.error;
+}
 
 void Mesh::clear()
 {
@@ -193,31 +857,34 @@ void Mesh::clear()
     _vertexNormals.clear();
     _vertexTexCoords.clear();
     _triangleIndices.clear();
+    _controlPositions.clear();
+    _subdivisionStencils.clear();
+    topologyChanged();
+    clearGPU();
+}
+
+void Mesh::clearGPU()
+{
     if (_vao)
     {
         glDeleteVertexArrays(1, &_vao);
         _vao = 0;
     }
-    if (_posVbo)
-    {
-        glDeleteBuffers(1, &_posVbo);
-        _posVbo = 0;
-    }
-    if (_normalVbo)
+    if (_vbo)
     {
-        glDeleteBuffers(1, &_normalVbo);
-        _normalVbo = 0;
-    }
-    if (_texCoordVbo)
-    {
-        glDeleteBuffers(1, &_texCoordVbo);
-        _texCoordVbo = 0;
+        glDeleteBuffers(1, &_vbo);
+        _vbo = 0;
     }
     if (_ibo)
     {
         glDeleteBuffers(1, &_ibo);
         _ibo = 0;
     }
+    if (_morphVbo)
+    {
+        glDeleteBuffers(1, &_morphVbo);
+        _morphVbo = 0;
+    }
 }
 
 // Loads an OFF mesh file. See https://en.wikipedia.org/wiki/OFF_(file_format)
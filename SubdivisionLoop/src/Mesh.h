@@ -11,11 +11,37 @@
 #include <glm/ext.hpp>
 
 #include <map>
-#include <set>
+#include <algorithm>
+#include <limits>
+
+#include "VertexFormat.h"
+#include "HalfEdgeMesh.h"
+#include "ThreadPool.h"
+#include "SubdivisionStencil.h"
+#include "VertexCache.h"
+#include "Meshlets.h"
+
+// Thresholds of the adaptive Loop subdivision: a face is refined when one of them is exceeded, 0 disabling it
+struct AdaptiveSubdivisionCriteria
+{
+    // Curvature: angle between the normals of the corners of the face, in radians
+    float maxNormalAngle = 0.f;
+    // Distance from the edges of the face to the limit surface, estimated as the displacement the Loop rule of
+    // the new vertex on an edge gives to its middle, in object units
+    float maxLimitDistance = 0.f;
+    // Screen-space size: longest edge of the face once projected, in pixels. The faces out of the view frustum
+    // are never refined when the viewport size is set.
+    float maxScreenEdge = 0.f;
+    glm::mat4 modelViewProjection = glm::mat4(1.f);
+    glm::vec2 viewportSize = glm::vec2(0.f);
+};
 
 class Mesh
 {
 public:
+    // Elements per task of the parallel loops of the subdivision
+    static const size_t subdivisionGrainSize = 4096;
+
     virtual ~Mesh();
 
     const std::vector<glm::vec3> &vertexPositions() const { return _vertexPositions; }
@@ -37,10 +63,29 @@ public:
     void recomputePerVertexTextureCoordinates();
 
     void init();
+    // Upload the positions, normals and morph targets again after the vertices moved, the triangles being the same:
+    // the vertex buffers are rewritten in place and the bounds of the meshlets refreshed, without ordering the
+    // triangles again. As init() if the mesh was not uploaded with this topology.
+    void updatePositions();
     void initOldGL();
     void render();
+    // As render(), with vertexArray() already bound, e.g. by a RenderState
+    void draw() const;
+    // As draw(), only these ranges of the index buffer, e.g. from cull()
+    void draw(const DrawRanges &ranges) const;
+    GLuint vertexArray() const { return _vao; }
     void clear();
 
+    // Meshlets of the index buffer as of the last init(), see Meshlets.h
+    const std::vector<Meshlet> &meshlets() const { return _meshlets; }
+    // Index ranges of the meshlets that may be seen with this model-view-projection, see cullMeshlets(). Without
+    // the cones when drawn with a morph factor under 1.
+    void cull(const glm::mat4 &modelViewProjection, bool cullFront, float morph, DrawRanges &ranges) const
+    {
+        cullMeshlets(_meshlets, modelViewProjection, cullFront, morph >= 1.f,
+                     _indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t), ranges);
+    }
+
     void addPlan(float square_half_side = 2.0f);
 
     void subdivideLinear()
@@ -111,226 +156,94 @@ public:
         // after that:
         _triangleIndices = newTriangles;
         _vertexPositions = newVertices;
+        _subdivisionStencils.clear(); // the new positions are the control mesh of the next Loop levels
+        topologyChanged();
         recomputePerVertexNormals();
         recomputePerVertexTextureCoordinates();
     }
 
-    void subdivideLoopNew()
+    // Loop subdivision, each new vertex being a fixed stencil of the old positions: the stencils, the new
+    // positions and the new triangles are computed in independent loops, on the pool if any. The result is the
+    // same with or without a pool, whatever its number of threads. The operator of the level is kept, see
+    // setControlPositions(), and the vertices are moved to the limit surface, see evaluateLimitSurface().
+    void subdivideLoopNew(ThreadPool *pool = nullptr)
     {
-        // Declare new vertices and new triangles. Initialize the new positions for the even vertices with (0,0,0):
-        std::vector<glm::vec3> newVertices(_vertexPositions.size(), glm::vec3(0, 0, 0));
-        std::vector<glm::uvec3> newTriangles;
-
-        struct Edge
-        {
-            unsigned int a, b;
-            Edge(unsigned int c, unsigned int d) : a(std::min<unsigned int>(c, d)), b(std::max<unsigned int>(c, d)) {}
-            bool operator<(Edge const &o) const { return a < o.a || (a == o.a && b < o.b); }
-            bool operator==(Edge const &o) const { return a == o.a && b == o.b; }
-        };
-
-        std::map<Edge, unsigned int> newVertexOnEdge;                                     // this will be useful to find out whether we already inserted an odd vertex or not
-        std::map<Edge, std::set<unsigned int>> trianglesOnEdge;                           // this will be useful to find out if an edge is boundary or not
-        std::map<Edge, unsigned int> edgeTriangleCount;
-        std::vector<std::set<unsigned int>> neighboringVertices(_vertexPositions.size()); // this will be used to store the adjacent vertices, i.e., neighboringVertices[i] will be the list of vertices that are adjacent to vertex i.
-        std::vector<bool> evenVertexIsBoundary(_vertexPositions.size(), false);
-        
-
-        // I) First, compute the valences of the even vertices, the neighboring vertices required to update the position of the even vertices, and the boundaries:
-        for (unsigned int tIt = 0; tIt < _triangleIndices.size(); ++tIt)
+        // I) First, the adjacency: the neighbors of the even vertices, the boundaries and the faces shared by the
+        // edges. The odd vertices are numbered by edge, so that all the new vertices and triangles have their index.
+        const HalfEdgeMesh &halfEdges = currentHalfEdges(pool);
+        const unsigned int firstOddVertex = _vertexPositions.size();
+        SubdivisionStencil stencil;
+        stencil.reset(firstOddVertex + halfEdges.numEdges(), _vertexPositions.size());
+        std::vector<glm::uvec3> newTriangles(4 * _triangleIndices.size());
+
+        // II) Then, the number of old vertices each new vertex depends on: the even vertices and their neighbors,
+        // the odd vertices, from the first half-edge of their edge, and their edge and opposite vertices.
+        parallelForRange(pool, firstOddVertex, subdivisionGrainSize, [&](size_t begin, size_t end)
         {
-            unsigned int a = _triangleIndices[tIt][0];
-            unsigned int b = _triangleIndices[tIt][1];
-            unsigned int c = _triangleIndices[tIt][2];
-
-            // TODO: Remember the faces shared by the edge
-            Edge Eab(a, b), Ebc(b, c), Eca(c, a);
-            edgeTriangleCount[Eab]++;
-            edgeTriangleCount[Ebc]++;
-            edgeTriangleCount[Eca]++;
-
-            if (trianglesOnEdge[Eab].find(c) == trianglesOnEdge[Eab].end()) 
-            {
-                trianglesOnEdge[Eab].insert(c);
-            }
-
-            if (trianglesOnEdge[Ebc].find(a) == trianglesOnEdge[Ebc].end()) 
-            {
-                trianglesOnEdge[Ebc].insert(a);
-            }
-
-            if (trianglesOnEdge[Eca].find(b) == trianglesOnEdge[Eca].end()) 
-            {
-                trianglesOnEdge[Eca].insert(b);
-            }
-
-            neighboringVertices[a].insert(b);
-            neighboringVertices[a].insert(c);
-            neighboringVertices[b].insert(a);
-            neighboringVertices[b].insert(c);
-            neighboringVertices[c].insert(a);
-            neighboringVertices[c].insert(b);
-        }
-
-        for (const auto& edgeCountPair : edgeTriangleCount) {
-            if (edgeCountPair.second == 1) 
-            { 
-                evenVertexIsBoundary[edgeCountPair.first.a] = true;
-                evenVertexIsBoundary[edgeCountPair.first.b] = true;
-            }
-        }
-
-        // The valence of a vertex is the number of adjacent vertices:
-        std::vector<unsigned int> evenVertexValence(_vertexPositions.size(), 0);
-        for (unsigned int v = 0; v < _vertexPositions.size(); ++v)
+            for (unsigned int v = begin; v < end; ++v)
+                stencil.setRowSize(v, evenStencilSize(halfEdges, v));
+        });
+        parallelForRange(pool, halfEdges.numHalfEdges(), subdivisionGrainSize, [&](size_t begin, size_t end)
         {
-            evenVertexValence[v] = neighboringVertices[v].size();
-        }
-        // TODO: Identify even vertices (clue: check the number of triangles) and remember immediate neighbors for further calculation
-        //  II) Then, compute the positions for the even vertices: (make sure that you handle the boundaries correctly)
-        float alpha = 0.0f;
-        
-        for (unsigned int v = 0; v < _vertexPositions.size(); ++v)
+            for (unsigned int h = begin; h < end; ++h)
+                if (halfEdges.isFirstOfEdge(h))
+                    stencil.setRowSize(firstOddVertex + halfEdges.edge(h), oddStencilSize(halfEdges, h));
+        });
+        stencil.allocate();
+
+        // III) Then, the weights of the even vertices. The entries of each row, the vertex and its neighbors, come
+        // in increasing index order, so that the result does not depend on the order of the triangles.
+        parallelForRange(pool, firstOddVertex, subdivisionGrainSize, [&](size_t begin, size_t end)
         {
-            // TODO: Compute the coordinates for even vertices - check both the cases - ordinary and extraordinary
-            if (evenVertexIsBoundary[v]) 
-            {
-                for (auto &neighbor : neighboringVertices[v])
-                {
-                    if (evenVertexIsBoundary[neighbor]) 
-                    {
-                        newVertices[v] += _vertexPositions[neighbor] * (0.125f);
-                    }
-                }
-                newVertices[v] += _vertexPositions[v] * (0.75f);
-            }
-            else
-            {
-                unsigned int valence = evenVertexValence[v];
-                //if (valence > 3) alpha = (0.375f / (float)valence);
-                //else if (valence == 3) alpha = 0.1875f;
-                //else std::cout<<("Error: valence is less than 3\n")<<std::endl;
+            std::vector<unsigned int> neighbors;
+            for (unsigned int v = begin; v < end; ++v)
+                setEvenStencil(halfEdges, v, v, stencil, neighbors);
+        });
 
-                alpha = (40.f - pow(3.f + 2.f*cos(2.f*M_PI/valence), 2)) / 64.f;
-
-                for (unsigned int neighbor : neighboringVertices[v])
-                {
-                    newVertices[v] += _vertexPositions[neighbor] * (alpha/valence);
-                }
-
-                newVertices[v] += _vertexPositions[v] * (1 - alpha);
-
-            }
-        }
-
-        // III) Then, compute the odd vertices:
-        for (unsigned int tIt = 0; tIt < _triangleIndices.size(); ++tIt)
+        // IV) Then, the weights of the odd vertices:
+        parallelForRange(pool, halfEdges.numHalfEdges(), subdivisionGrainSize, [&](size_t begin, size_t end)
         {
-            unsigned int a = _triangleIndices[tIt][0];
-            unsigned int b = _triangleIndices[tIt][1];
-            unsigned int c = _triangleIndices[tIt][2];
-
-            Edge Eab(a, b);
-            unsigned int oddVertexOnEdgeEab = 0;
-            if (newVertexOnEdge.find(Eab) == newVertexOnEdge.end())
-            {
-                newVertices.push_back(glm::vec3(0, 0, 0));
-                oddVertexOnEdgeEab = newVertices.size() - 1;
-                newVertexOnEdge[Eab] = oddVertexOnEdgeEab;
-                if (edgeTriangleCount[Eab] == 1) 
-                {
-                    newVertices[oddVertexOnEdgeEab] = (_vertexPositions[a] + _vertexPositions[b]) / 2.0f;
-                }
-                else
-                {
-                    for (auto vertex : trianglesOnEdge[Eab])
-                    {
-                        newVertices[oddVertexOnEdgeEab] += 0.125f * _vertexPositions[vertex];
-                    }
-                    newVertices[oddVertexOnEdgeEab] += ((_vertexPositions[a] + _vertexPositions[b]) * 0.375f);
-                }
-            }
-            else
-            {
-                oddVertexOnEdgeEab = newVertexOnEdge[Eab];
-            }
-
-            // TODO: Update odd vertices
-
-            Edge Ebc(b, c);
-            unsigned int oddVertexOnEdgeEbc = 0;
-            if (newVertexOnEdge.find(Ebc) == newVertexOnEdge.end())
-            {
-                newVertices.push_back(glm::vec3(0, 0, 0));
-                oddVertexOnEdgeEbc = newVertices.size() - 1;
-                newVertexOnEdge[Ebc] = oddVertexOnEdgeEbc;
-                if (edgeTriangleCount[Ebc] == 1) 
-                {
-                    newVertices[oddVertexOnEdgeEbc] = (_vertexPositions[b] + _vertexPositions[c]) / 2.0f;
-                }
-                else
-                {
-                    for (auto vertex : trianglesOnEdge[Ebc])
-                    {
-                        newVertices[oddVertexOnEdgeEbc] += 0.125f * _vertexPositions[vertex];
-                    }
-                    newVertices[oddVertexOnEdgeEbc] += ((_vertexPositions[b] + _vertexPositions[c]) * 0.375f);
-                }
-            }                
-            else
-            {
-                oddVertexOnEdgeEbc = newVertexOnEdge[Ebc];
-            }
-            
-
-            // TODO: Update odd vertices
+            for (unsigned int h = begin; h < end; ++h)
+                if (halfEdges.isFirstOfEdge(h))
+                    setOddStencil(halfEdges, h, firstOddVertex + halfEdges.edge(h), stencil);
+        });
 
-            Edge Eca(c, a);
-            unsigned int oddVertexOnEdgeEca = 0;
-            if (newVertexOnEdge.find(Eca) == newVertexOnEdge.end())
-            {
-                newVertices.push_back(glm::vec3(0, 0, 0));
-                oddVertexOnEdgeEca = newVertices.size() - 1;
-                newVertexOnEdge[Eca] = oddVertexOnEdgeEca;
-                if (edgeTriangleCount[Eca] == 1) 
-                {
-                    newVertices[oddVertexOnEdgeEca] = (_vertexPositions[c] + _vertexPositions[a]) / 2.0f;
-                }
-                else
-                {
-                    for (auto vertex : trianglesOnEdge[Eca])
-                    {
-                        newVertices[oddVertexOnEdgeEca] += 0.125f * _vertexPositions[vertex];
-                    }
-                    newVertices[oddVertexOnEdgeEca] += ((_vertexPositions[c] + _vertexPositions[a]) * 0.375f);
-                }
-            }
-            
-            else
+        // V) set new triangles, 4 per old triangle:
+        parallelForRange(pool, _triangleIndices.size(), subdivisionGrainSize, [&](size_t begin, size_t end)
+        {
+            for (unsigned int tIt = begin; tIt < end; ++tIt)
             {
-                oddVertexOnEdgeEca = newVertexOnEdge[Eca];
+                unsigned int a = _triangleIndices[tIt][0];
+                unsigned int b = _triangleIndices[tIt][1];
+                unsigned int c = _triangleIndices[tIt][2];
+                unsigned int oddVertexOnEdgeEab = firstOddVertex + halfEdges.edge(3 * tIt);
+                unsigned int oddVertexOnEdgeEbc = firstOddVertex + halfEdges.edge(3 * tIt + 1);
+                unsigned int oddVertexOnEdgeEca = firstOddVertex + halfEdges.edge(3 * tIt + 2);
+
+                newTriangles[4 * tIt] = glm::uvec3(a, oddVertexOnEdgeEab, oddVertexOnEdgeEca);
+                newTriangles[4 * tIt + 1] = glm::uvec3(oddVertexOnEdgeEab, b, oddVertexOnEdgeEbc);
+                newTriangles[4 * tIt + 2] = glm::uvec3(oddVertexOnEdgeEca, oddVertexOnEdgeEbc, c);
+                newTriangles[4 * tIt + 3] = glm::uvec3(oddVertexOnEdgeEab, oddVertexOnEdgeEbc, oddVertexOnEdgeEca);
             }
-
-            // TODO: Update odd vertices
-
-            // set new triangles :
-            newTriangles.push_back(glm::uvec3(a, oddVertexOnEdgeEab, oddVertexOnEdgeEca));
-            newTriangles.push_back(glm::uvec3(oddVertexOnEdgeEab, b, oddVertexOnEdgeEbc));
-            newTriangles.push_back(glm::uvec3(oddVertexOnEdgeEca, oddVertexOnEdgeEbc, c));
-            newTriangles.push_back(glm::uvec3(oddVertexOnEdgeEab, oddVertexOnEdgeEbc, oddVertexOnEdgeEca));
-        }
+        });
 
         // after that:
-        _triangleIndices = newTriangles;
-        _vertexPositions = newVertices;
-        recomputePerVertexNormals();
+        if (_subdivisionStencils.empty())
+            _controlPositions = _vertexPositions;
+        std::vector<glm::vec3> newVertices;
+        stencil.apply(_vertexPositions, newVertices, pool);
+        _subdivisionStencils.push_back(std::move(stencil));
+        _triangleIndices.swap(newTriangles);
+        _vertexPositions.swap(newVertices);
+        topologyChanged();
+        evaluateLimitSurface(pool);
         recomputePerVertexTextureCoordinates();
     }
 
-    void subdivideLoop()
+    void subdivideLoop(ThreadPool *pool = nullptr)
     {
         //subdivideLinear();
-        subdivideLoopNew();
+        subdivideLoopNew(pool);
 
         // TODO: Implement here the Loop subdivision instead of the straightforward Linear Subdivision.
         // You can have a look at the Linear Subdivision function to take some inspiration from it.
@@ -351,17 +264,122 @@ public:
         // Good luck! Do not hesitate asking questions, we are here to help you.
     }
 
+    // Faces over one of the thresholds, as of the drawn positions and normals: the limit ones if evaluated
+    std::vector<unsigned char> markFacesForRefinement(const AdaptiveSubdivisionCriteria &criteria,
+                                                      ThreadPool *pool = nullptr);
+
+    // One step of adaptive Loop subdivision: the marked faces are split in 4 (red), and the closure keeps the mesh
+    // conforming: a face with 2 or 3 split edges is split in 4 as well, a face with a single one is bisected
+    // (green). A green face is not bisected again, a split edge makes it red, so that the angles stay bounded. The
+    // new vertices on the split edges and the vertices of the red faces follow the Loop rules, the other vertices
+    // stay: the triangle count grows with the refined area instead of 4 times per level. As subdivideLoopNew(), the
+    // operator of the step is kept and the vertices are moved to the limit surface. Returns the number of faces
+    // split in 4.
+    size_t subdivideLoopAdaptive(const std::vector<unsigned char> &refine, ThreadPool *pool = nullptr);
+    size_t subdivideLoopAdaptive(const AdaptiveSubdivisionCriteria &criteria, ThreadPool *pool = nullptr)
+    {
+        return subdivideLoopAdaptive(markFacesForRefinement(criteria, pool), pool);
+    }
+
+    // Faces bisected by the closure of the last adaptive steps, empty if none
+    const std::vector<unsigned char> &greenTriangles() const { return _greenTriangles; }
+
+    // Edge-collapse decimation with quadric error metrics, see MeshSimplifier: down to targetTriangles, or until the
+    // next collapse is over maxError, in object units. For lighter levels of detail of a heavy mesh: the boundaries
+    // and the seams stay, the texture coordinates follow the collapses, the normals are recomputed. The subdivision
+    // operators are dropped, the result being the new control mesh. Returns the largest error of the collapses.
+    float simplify(size_t targetTriangles, float maxError = std::numeric_limits<float>::max());
+
+    // Loop levels done since the positions were set, uniform or adaptive, each with its operator: the positions of
+    // a level are the operator times the positions of the previous level.
+    unsigned int subdivisionLevel() const { return static_cast<unsigned int>(_subdivisionStencils.size()); }
+    const std::vector<SubdivisionStencil> &subdivisionStencils() const { return _subdivisionStencils; }
+
+    // Positions of the mesh before the Loop levels
+    const std::vector<glm::vec3> &controlPositions() const
+    {
+        return _subdivisionStencils.empty() ? _vertexPositions : _controlPositions;
+    }
+
+    // Move the vertices of the control mesh, e.g. to animate it, the topology being the same: the positions of the
+    // current level are recomputed with the cached operators, without any adjacency, then the normals. The
+    // texture coordinates stay. Throws std::runtime_error if the number of positions differs.
+    void setControlPositions(const std::vector<glm::vec3> &positions, ThreadPool *pool = nullptr);
+
+    // Limit surface of the Loop subdivision of the current level, from the masks of each vertex: the limit
+    // position and tangents of Loop (1987) inside, the cubic B-spline of the boundary curves on the boundaries,
+    // the tangent across them being an eigenvector of the subdivision matrix of the vertex. The vertices are
+    // drawn at their limit position, with the normal of the limit surface there: no other level is needed for
+    // smooth shading. The masks are kept until the topology changes, setControlPositions() evaluates the limit
+    // again.
+    void evaluateLimitSurface(ThreadPool *pool = nullptr);
+    // Positions on the limit surface, empty until evaluateLimitSurface()
+    const std::vector<glm::vec3> &limitPositions() const { return _limitPositions; }
+    // Positions the vertices are drawn at: the limit ones if evaluated
+    const std::vector<glm::vec3> &drawnPositions() const
+    {
+        return _limitPositions.empty() ? _vertexPositions : _limitPositions;
+    }
+
+    // Position and normal each vertex morphs from, one per vertex, uploaded by init() in a second vertex buffer:
+    // the vertex shaders blend them into the drawn ones by the morph factor of the object, see SubdivisionLod.
+    // Dropped when the topology changes. Throws std::runtime_error if the sizes differ from the vertices.
+    void setMorphTargets(const std::vector<glm::vec3> &positions, const std::vector<glm::vec3> &normals);
+    bool hasMorphTargets() const { return !_morphPositions.empty(); }
+
 private:
     std::vector<glm::vec3> _vertexPositions;
     std::vector<glm::vec3> _vertexNormals;
     std::vector<glm::vec2> _vertexTexCoords;
     std::vector<glm::uvec3> _triangleIndices;
 
+    std::vector<glm::vec3> _controlPositions;
+    std::vector<SubdivisionStencil> _subdivisionStencils;
+
+    // Adjacency of the current level, built when first needed for the subdivision or the limit surface
+    const HalfEdgeMesh &currentHalfEdges(ThreadPool *pool);
+    HalfEdgeMesh _halfEdges;
+    bool _hasHalfEdges = false;
+
+    // Masks of the limit position and of two tangents of each vertex, whose cross product is the normal
+    void buildLimitStencils(const HalfEdgeMesh &halfEdges, ThreadPool *pool);
+    SubdivisionStencil _limitPosition, _limitTangents[2];
+    std::vector<glm::vec3> _limitPositions;
+
+    // Loop rules of a new vertex, shared by the uniform and the adaptive subdivisions: the number of old vertices it
+    // depends on, then their weights in the given row, sorted by old vertex index on the boundaries too. Even
+    // vertex v, odd vertex of the edge of h, the first half-edge of its edge.
+    static unsigned int evenStencilSize(const HalfEdgeMesh &halfEdges, unsigned int v);
+    static void setEvenStencil(const HalfEdgeMesh &halfEdges, unsigned int v, size_t row, SubdivisionStencil &stencil,
+                               std::vector<unsigned int> &neighbors);
+    static unsigned int oddStencilSize(const HalfEdgeMesh &halfEdges, unsigned int h);
+    static void setOddStencil(const HalfEdgeMesh &halfEdges, unsigned int h, size_t row, SubdivisionStencil &stencil);
+
+    // Faces bisected by the closure of the adaptive subdivision
+    std::vector<unsigned char> _greenTriangles;
+
+    std::vector<glm::vec3> _morphPositions;
+    std::vector<glm::vec3> _morphNormals;
+
+    // Drop what depends on the triangles
+    void topologyChanged();
+
+    // The GPU buffers are in the order of the post-transform cache and of the vertex fetches, see VertexCache.h,
+    // kept until the topology changes: the positions can move without ordering again.
+    void packBuffers(std::vector<PackedVertex> &vertices, std::vector<unsigned char> &indices,
+                     std::vector<MorphVertex> &morphVertices);
+    void packVertices(std::vector<PackedVertex> &vertices, std::vector<MorphVertex> &morphVertices);
+    void uploadVertices(const std::vector<PackedVertex> &vertices, const std::vector<MorphVertex> &morphVertices);
+    std::vector<glm::uvec3> _drawTriangles;
+    std::vector<unsigned int> _drawVertexIndices; // index of each vertex in the vertex buffer
+    std::vector<Meshlet> _meshlets;
+    void clearGPU();
+
     GLuint _vao = 0;
-    GLuint _posVbo = 0;
-    GLuint _normalVbo = 0;
-    GLuint _texCoordVbo = 0;
+    GLuint _vbo = 0; // interleaved PackedVertex
     GLuint _ibo = 0;
+    GLuint _morphVbo = 0; // MorphVertex, if morph targets
+    GLenum _indexType = GL_UNSIGNED_INT;
     GLuint _texId = 0;
 };
 
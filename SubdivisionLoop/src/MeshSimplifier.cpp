@@ -0,0 +1,394 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iterator>
+#include <numeric>
+
+#include "HalfEdgeMesh.h"
+
+namespace
+{
+// Weight of the planes along the boundaries, against the planes of the faces
+const double boundaryWeight = 100.0;
+// Smallest cosine between the normals of a face before and after a collapse
+const double minNormalCosine = 0.2;
+} // namespace
+
+void MeshSimplifier::Quadric::addPlane(const glm::dvec3 &normal, double offset, double weight)
+{
+    const double plane[4] = {normal.x, normal.y, normal.z, offset};
+    unsigned int k = 0;
+    for (unsigned int i = 0; i < 4; ++i)
+        for (unsigned int j = i; j < 4; ++j)
+            q[k++] += weight * plane[i] * plane[j];
+}
+
+MeshSimplifier::Quadric &MeshSimplifier::Quadric::operator+=(const Quadric &other)
+{
+    for (unsigned int k = 0; k < 10; ++k)
+        q[k] += other.q[k];
+    return *this;
+}
+
+double MeshSimplifier::Quadric::error(const glm::dvec3 &p) const
+{
+    // p^T A p + 2 b.p + c, A the upper 3x3 block, b the last column
+    const double e = q[0] * p.x * p.x + 2.0 * q[1] * p.x * p.y + 2.0 * q[2] * p.x * p.z + q[4] * p.y * p.y +
+                     2.0 * q[5] * p.y * p.z + q[7] * p.z * p.z + 2.0 * (q[3] * p.x + q[6] * p.y + q[8] * p.z) + q[9];
+    return std::max(e, 0.0);
+}
+
+bool MeshSimplifier::Quadric::minimum(glm::dvec3 &p) const
+{
+    // A p = -b
+    const glm::dmat3 a(q[0], q[1], q[2], q[1], q[4], q[5], q[2], q[5], q[7]);
+    const double det = glm::determinant(a);
+    const double trace = (q[0] + q[4] + q[7]) / 3.0;
+    if (std::abs(det) <= 1e-9 * trace * trace * trace)
+        return false;
+    p = glm::inverse(a) * -glm::dvec3(q[3], q[6], q[8]);
+    return true;
+}
+
+MeshSimplifier::MeshSimplifier(const std::vector<glm::vec3> &positions, const std::vector<glm::uvec3> &triangles,
+                               const std::vector<glm::vec2> &texCoords)
+    : _positions(positions), _triangles(triangles), _texCoords(texCoords)
+{
+    if (_texCoords.size() != _positions.size())
+        _texCoords.clear();
+    const size_t numVertices = _positions.size();
+    _quadrics.resize(numVertices);
+    _vertexFaces.resize(numVertices);
+    _faceAlive.assign(_triangles.size(), 1);
+    _vertexAlive.assign(numVertices, 1);
+    _boundary.assign(numVertices, 0);
+    _locked.assign(numVertices, 0);
+    _stamps.assign(numVertices, 0);
+    _numTriangles = _triangles.size();
+
+    // The planes of the faces
+    std::vector<glm::dvec3> faceNormals(_triangles.size(), glm::dvec3(0.0));
+    for (unsigned int t = 0; t < _triangles.size(); ++t)
+    {
+        const glm::uvec3 &triangle = _triangles[t];
+        const glm::dvec3 p0(_positions[triangle[0]]), p1(_positions[triangle[1]]), p2(_positions[triangle[2]]);
+        const glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+        if (glm::dot(normal, normal) > 0.0)
+            faceNormals[t] = glm::normalize(normal);
+        for (unsigned int k = 0; k < 3; ++k)
+        {
+            _quadrics[triangle[k]].addPlane(faceNormals[t], -glm::dot(faceNormals[t], p0), 1.0);
+            _vertexFaces[triangle[k]].push_back(t);
+        }
+    }
+
+    // The planes along the boundaries, perpendicular to their faces
+    const HalfEdgeMesh halfEdges(numVertices, _triangles);
+    for (unsigned int h = 0; h < halfEdges.numHalfEdges(); ++h)
+    {
+        if (!halfEdges.isBoundary(h))
+            continue;
+        const unsigned int a = halfEdges.vertex(h), b = halfEdges.target(h);
+        const glm::dvec3 pa(_positions[a]), pb(_positions[b]);
+        glm::dvec3 normal = glm::cross(pb - pa, faceNormals[halfEdges.face(h)]);
+        if (glm::dot(normal, normal) > 0.0)
+            normal = glm::normalize(normal);
+        _quadrics[a].addPlane(normal, -glm::dot(normal, pa), boundaryWeight);
+        _quadrics[b].addPlane(normal, -glm::dot(normal, pa), boundaryWeight);
+        _boundary[a] = _boundary[b] = 1;
+    }
+
+    // The seams: the vertices sharing their position with another one
+    std::vector<unsigned int> order(numVertices);
+    std::iota(order.begin(), order.end(), 0);
+    auto less = [this](unsigned int a, unsigned int b)
+    {
+        const glm::vec3 &p = _positions[a], &q = _positions[b];
+        return p.x < q.x || (p.x == q.x && (p.y < q.y || (p.y == q.y && p.z < q.z)));
+    };
+    std::sort(order.begin(), order.end(), less);
+    for (size_t i = 1; i < order.size(); ++i)
+    {
+        if (_positions[order[i]] == _positions[order[i - 1]])
+            _locked[order[i]] = _locked[order[i - 1]] = 1;
+    }
+}
+
+bool MeshSimplifier::evaluate(unsigned int a, unsigned int b, Collapse &collapse) const
+{
+    if (_locked[a] && _locked[b])
+        return false;
+    if (_boundary[a] && _boundary[b])
+    {
+        // along the boundary only: a single face on the edge
+        unsigned int numFaces = 0;
+        for (unsigned int f : _vertexFaces[a])
+        {
+            const glm::uvec3 &triangle = _triangles[f];
+            if (_faceAlive[f] && (triangle[0] == b || triangle[1] == b || triangle[2] == b))
+                ++numFaces;
+        }
+        if (numFaces != 1)
+            return false;
+    }
+
+    Quadric quadric = _quadrics[a];
+    quadric += _quadrics[b];
+    glm::dvec3 position;
+    if (_locked[a] || (_boundary[a] && !_boundary[b] && !_locked[b]))
+    {
+        collapse.kept = a;
+        collapse.removed = b;
+        position = glm::dvec3(_positions[a]);
+    }
+    else if (_locked[b] || (_boundary[b] && !_boundary[a]))
+    {
+        collapse.kept = b;
+        collapse.removed = a;
+        position = glm::dvec3(_positions[b]);
+    }
+    else
+    {
+        collapse.kept = a;
+        collapse.removed = b;
+        if (!quadric.minimum(position))
+        {
+            // the best of the ends and the middle
+            const glm::dvec3 pa(_positions[a]), pb(_positions[b]);
+            const glm::dvec3 candidates[3] = {pa, pb, 0.5 * (pa + pb)};
+            position = candidates[0];
+            for (const glm::dvec3 &candidate : candidates)
+            {
+                if (quadric.error(candidate) < quadric.error(position))
+                    position = candidate;
+            }
+        }
+    }
+    collapse.cost = quadric.error(position);
+    collapse.position = glm::vec3(position);
+    collapse.keptStamp = _stamps[collapse.kept];
+    collapse.removedStamp = _stamps[collapse.removed];
+    return true;
+}
+
+bool MeshSimplifier::isValid(const Collapse &collapse) const
+{
+    const unsigned int kept = collapse.kept, removed = collapse.removed;
+
+    // The vertices linked to both ends are the ones of the faces of the edge, else the collapse pinches the mesh
+    std::vector<unsigned int> keptNeighbors, removedNeighbors;
+    unsigned int numEdgeFaces = 0;
+    for (unsigned int f : _vertexFaces[kept])
+    {
+        if (!_faceAlive[f])
+            continue;
+        for (unsigned int k = 0; k < 3; ++k)
+        {
+            if (_triangles[f][k] != kept)
+                keptNeighbors.push_back(_triangles[f][k]);
+        }
+    }
+    for (unsigned int f : _vertexFaces[removed])
+    {
+        if (!_faceAlive[f])
+            continue;
+        const glm::uvec3 &triangle = _triangles[f];
+        if (triangle[0] == kept || triangle[1] == kept || triangle[2] == kept)
+            ++numEdgeFaces;
+        for (unsigned int k = 0; k < 3; ++k)
+        {
+            if (triangle[k] != removed && triangle[k] != kept)
+                removedNeighbors.push_back(triangle[k]);
+        }
+    }
+    std::sort(keptNeighbors.begin(), keptNeighbors.end());
+    keptNeighbors.erase(std::unique(keptNeighbors.begin(), keptNeighbors.end()), keptNeighbors.end());
+    std::sort(removedNeighbors.begin(), removedNeighbors.end());
+    removedNeighbors.erase(std::unique(removedNeighbors.begin(), removedNeighbors.end()), removedNeighbors.end());
+    std::vector<unsigned int> common;
+    std::set_intersection(keptNeighbors.begin(), keptNeighbors.end(), removedNeighbors.begin(),
+                          removedNeighbors.end(), std::back_inserter(common));
+    if (numEdgeFaces == 0 || common.size() != numEdgeFaces)
+        return false;
+
+    // The faces that stay keep their orientation and some area
+    for (unsigned int v : {kept, removed})
+    {
+        for (unsigned int f : _vertexFaces[v])
+        {
+            if (!_faceAlive[f])
+                continue;
+            const glm::uvec3 &triangle = _triangles[f];
+            glm::vec3 before[3], after[3];
+            bool onEdge = false;
+            for (unsigned int k = 0; k < 3; ++k)
+            {
+                before[k] = _positions[triangle[k]];
+                after[k] = triangle[k] == kept || triangle[k] == removed ? collapse.position : before[k];
+                onEdge |= triangle[k] == (v == kept ? removed : kept);
+            }
+            if (onEdge)
+                continue;
+            const glm::dvec3 normalBefore =
+                glm::cross(glm::dvec3(before[1] - before[0]), glm::dvec3(before[2] - before[0]));
+            const glm::dvec3 normalAfter = glm::cross(glm::dvec3(after[1] - after[0]), glm::dvec3(after[2] - after[0]));
+            const double lengths = glm::length(normalBefore) * glm::length(normalAfter);
+            if (lengths <= 0.0 || glm::dot(normalBefore, normalAfter) < minNormalCosine * lengths)
+                return false;
+        }
+    }
+    return true;
+}
+
+void MeshSimplifier::apply(const Collapse &collapse)
+{
+    const unsigned int kept = collapse.kept, removed = collapse.removed;
+    if (!_texCoords.empty())
+    {
+        const glm::vec3 edge = _positions[removed] - _positions[kept];
+        const float length2 = glm::dot(edge, edge);
+        const float t =
+            length2 > 0.f ? glm::clamp(glm::dot(collapse.position - _positions[kept], edge) / length2, 0.f, 1.f) : 0.f;
+        _texCoords[kept] = glm::mix(_texCoords[kept], _texCoords[removed], t);
+    }
+    _positions[kept] = collapse.position;
+    _quadrics[kept] += _quadrics[removed];
+    _boundary[kept] |= _boundary[removed];
+
+    for (unsigned int f : _vertexFaces[removed])
+    {
+        if (!_faceAlive[f])
+            continue;
+        glm::uvec3 &triangle = _triangles[f];
+        if (triangle[0] == kept || triangle[1] == kept || triangle[2] == kept)
+        {
+            _faceAlive[f] = 0;
+            --_numTriangles;
+            continue;
+        }
+        for (unsigned int k = 0; k < 3; ++k)
+        {
+            if (triangle[k] == removed)
+                triangle[k] = kept;
+        }
+        _vertexFaces[kept].push_back(f);
+    }
+    _vertexAlive[removed] = 0;
+    std::vector<unsigned int>().swap(_vertexFaces[removed]);
+    ++_stamps[kept];
+    compactFaces(kept);
+    pushEdges(kept);
+}
+
+void MeshSimplifier::compactFaces(unsigned int v)
+{
+    std::vector<unsigned int> &faces = _vertexFaces[v];
+    faces.erase(std::remove_if(faces.begin(), faces.end(), [this](unsigned int f) { return !_faceAlive[f]; }),
+                faces.end());
+}
+
+void MeshSimplifier::pushEdges(unsigned int v)
+{
+    std::vector<unsigned int> neighbors;
+    for (unsigned int f : _vertexFaces[v])
+    {
+        for (unsigned int k = 0; k < 3; ++k)
+        {
+            if (_triangles[f][k] != v)
+                neighbors.push_back(_triangles[f][k]);
+        }
+    }
+    std::sort(neighbors.begin(), neighbors.end());
+    neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+    Collapse collapse;
+    for (unsigned int n : neighbors)
+    {
+        if (evaluate(v, n, collapse))
+        {
+            _heap.push_back(collapse);
+            std::push_heap(_heap.begin(), _heap.end(), std::greater<Collapse>());
+        }
+    }
+}
+
+MeshSimplifier::Statistics MeshSimplifier::simplify(const Options &options)
+{
+    Statistics statistics;
+
+    // The edges, once each
+    std::vector<std::pair<unsigned int, unsigned int>> edges;
+    for (unsigned int t = 0; t < _triangles.size(); ++t)
+    {
+        if (!_faceAlive[t])
+            continue;
+        for (unsigned int k = 0; k < 3; ++k)
+        {
+            const unsigned int a = _triangles[t][k], b = _triangles[t][(k + 1) % 3];
+            edges.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    _heap.clear();
+    Collapse collapse;
+    for (const auto &edge : edges)
+    {
+        if (evaluate(edge.first, edge.second, collapse))
+            _heap.push_back(collapse);
+    }
+    std::make_heap(_heap.begin(), _heap.end(), std::greater<Collapse>());
+
+    const double maxCost = static_cast<double>(options.maxError) * options.maxError;
+    double maxCollapsedCost = 0.0;
+    while (_numTriangles > options.targetTriangles && !_heap.empty())
+    {
+        std::pop_heap(_heap.begin(), _heap.end(), std::greater<Collapse>());
+        collapse = _heap.back();
+        _heap.pop_back();
+        // stale: an end moved or went since
+        if (!_vertexAlive[collapse.kept] || !_vertexAlive[collapse.removed] ||
+            _stamps[collapse.kept] != collapse.keptStamp || _stamps[collapse.removed] != collapse.removedStamp)
+            continue;
+        if (collapse.cost > maxCost)
+            break;
+        if (!isValid(collapse))
+            continue;
+        apply(collapse);
+        maxCollapsedCost = std::max(maxCollapsedCost, collapse.cost);
+        ++statistics.numCollapses;
+    }
+    _heap.clear();
+    statistics.error = static_cast<float>(std::sqrt(maxCollapsedCost));
+
+    // The vertices left, in their order
+    std::vector<unsigned int> remap(_positions.size(), HalfEdgeMesh::invalid);
+    _outPositions.clear();
+    _outTriangles.clear();
+    _outTexCoords.clear();
+    for (unsigned int t = 0; t < _triangles.size(); ++t)
+    {
+        if (_faceAlive[t])
+            for (unsigned int k = 0; k < 3; ++k)
+                remap[_triangles[t][k]] = 0;
+    }
+    for (unsigned int v = 0; v < _positions.size(); ++v)
+    {
+        if (remap[v] == HalfEdgeMesh::invalid)
+            continue;
+        remap[v] = static_cast<unsigned int>(_outPositions.size());
+        _outPositions.push_back(_positions[v]);
+        if (!_texCoords.empty())
+            _outTexCoords.push_back(_texCoords[v]);
+    }
+    for (unsigned int t = 0; t < _triangles.size(); ++t)
+    {
+        if (_faceAlive[t])
+        {
+            const glm::uvec3 &triangle = _triangles[t];
+            _outTriangles.push_back(glm::uvec3(remap[triangle[0]], remap[triangle[1]], remap[triangle[2]]));
+        }
+    }
+    return statistics;
+}
@@ -0,0 +1,94 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Edge-collapse simplification of a triangle mesh with quadric error metrics (Garland and Heckbert 1997).
+//
+// Each vertex accumulates the quadric of the planes of its faces, and each edge costs the error of the quadrics
+// of its vertices at the position that minimizes it. The edges are collapsed in increasing cost order from a
+// priority queue, the entries made stale by a collapse being skipped when they come out. The adjacency is a list
+// of faces per vertex, merged on each collapse.
+//
+// The boundaries stay: a boundary vertex only moves along its boundary edges, weighted by planes perpendicular
+// to the faces, and a boundary is never pinched. The vertices of a UV seam, several vertices at the same position,
+// never move, so that the copies stay together. A collapse that would flip or degenerate a face is skipped.
+class MeshSimplifier
+{
+public:
+    struct Options
+    {
+        // Stop at this number of triangles...
+        size_t targetTriangles = 0;
+        // ...or before an edge whose error, the distance to the planes of the faces merged into its vertices,
+        // is over this one
+        float maxError = std::numeric_limits<float>::max();
+    };
+
+    struct Statistics
+    {
+        size_t numCollapses = 0;
+        // Largest error of the edges collapsed
+        float error = 0.f;
+    };
+
+    // texCoords may be empty, else one per vertex, interpolated along the edges collapsed
+    MeshSimplifier(const std::vector<glm::vec3> &positions, const std::vector<glm::uvec3> &triangles,
+                   const std::vector<glm::vec2> &texCoords = std::vector<glm::vec2>());
+
+    Statistics simplify(const Options &options);
+
+    // The simplified mesh, without the vertices removed, in the order of the input
+    const std::vector<glm::vec3> &positions() const { return _outPositions; }
+    const std::vector<glm::uvec3> &triangles() const { return _outTriangles; }
+    const std::vector<glm::vec2> &texCoords() const { return _outTexCoords; }
+
+private:
+    // Symmetric 4x4 matrix of a sum of squared distances to planes: a00 a01 a02 a03 a11 a12 a13 a22 a23 a33
+    struct Quadric
+    {
+        double q[10] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+        void addPlane(const glm::dvec3 &normal, double offset, double weight);
+        Quadric &operator+=(const Quadric &other);
+        double error(const glm::dvec3 &p) const;
+        // Position of least error, false if the quadric is singular there
+        bool minimum(glm::dvec3 &p) const;
+    };
+
+    struct Collapse
+    {
+        double cost;
+        unsigned int kept, removed;
+        unsigned int keptStamp, removedStamp;
+        glm::vec3 position;
+        bool operator>(const Collapse &other) const { return cost > other.cost; }
+    };
+
+    // The best collapse of the edge ab, false if none keeps the boundaries and the seams
+    bool evaluate(unsigned int a, unsigned int b, Collapse &collapse) const;
+    // Topology and flips, as of the current mesh
+    bool isValid(const Collapse &collapse) const;
+    void apply(const Collapse &collapse);
+    void pushEdges(unsigned int v);
+    void compactFaces(unsigned int v);
+
+    std::vector<glm::vec3> _positions;
+    std::vector<glm::uvec3> _triangles;
+    std::vector<glm::vec2> _texCoords;
+    std::vector<Quadric> _quadrics;
+    std::vector<std::vector<unsigned int>> _vertexFaces;
+    std::vector<unsigned char> _faceAlive, _vertexAlive, _boundary, _locked;
+    std::vector<unsigned int> _stamps;
+    std::vector<Collapse> _heap;
+    size_t _numTriangles = 0;
+
+    std::vector<glm::vec3> _outPositions;
+    std::vector<glm::uvec3> _outTriangles;
+    std::vector<glm::vec2> _outTexCoords;
+};
+
+#endif // MESH_SIMPLIFIER_H
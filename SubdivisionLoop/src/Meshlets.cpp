@@ -0,0 +1,153 @@
+#include "Meshlets.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void buildMeshlets(const std::vector<glm::uvec3> &triangles, const std::vector<glm::vec3> &positions,
+                   const std::vector<glm::vec3> &morphPositions, std::vector<Meshlet> &meshlets,
+                   unsigned int maxTriangles)
+{
+    meshlets.clear();
+    const bool hasMorph = morphPositions.size() == positions.size();
+    for (size_t first = 0; first < triangles.size(); first += maxTriangles)
+    {
+        Meshlet meshlet;
+        meshlet.firstTriangle = static_cast<unsigned int>(first);
+        meshlet.numTriangles = static_cast<unsigned int>(std::min<size_t>(maxTriangles, triangles.size() - first));
+        const size_t end = first + meshlet.numTriangles;
+
+        // Sphere around the box of the vertices
+        glm::vec3 low(std::numeric_limits<float>::max()), high(-std::numeric_limits<float>::max());
+        for (size_t t = first; t < end; ++t)
+            for (int k = 0; k < 3; ++k)
+            {
+                low = glm::min(low, positions[triangles[t][k]]);
+                high = glm::max(high, positions[triangles[t][k]]);
+                if (hasMorph)
+                {
+                    low = glm::min(low, morphPositions[triangles[t][k]]);
+                    high = glm::max(high, morphPositions[triangles[t][k]]);
+                }
+            }
+        meshlet.center = 0.5f * (low + high);
+        float radius2 = 0.f;
+        for (size_t t = first; t < end; ++t)
+            for (int k = 0; k < 3; ++k)
+            {
+                radius2 = std::max(radius2, glm::dot(positions[triangles[t][k]] - meshlet.center,
+                                                     positions[triangles[t][k]] - meshlet.center));
+                if (hasMorph)
+                    radius2 = std::max(radius2, glm::dot(morphPositions[triangles[t][k]] - meshlet.center,
+                                                         morphPositions[triangles[t][k]] - meshlet.center));
+            }
+        meshlet.radius = std::sqrt(radius2);
+
+        // Cone around the mean of the unit normals, the degenerate faces facing nowhere
+        glm::vec3 axis(0.f);
+        for (size_t t = first; t < end; ++t)
+        {
+            const glm::vec3 &a = positions[triangles[t][0]], &b = positions[triangles[t][1]],
+                            &c = positions[triangles[t][2]];
+            const glm::vec3 normal = glm::cross(b - a, c - a);
+            const float length = glm::length(normal);
+            if (length > 0.f)
+                axis += normal / length;
+        }
+        const float axisLength = glm::length(axis);
+        if (axisLength > 0.f)
+        {
+            meshlet.coneAxis = axis / axisLength;
+            meshlet.coneCos = 1.f;
+            for (size_t t = first; t < end; ++t)
+            {
+                const glm::vec3 &a = positions[triangles[t][0]], &b = positions[triangles[t][1]],
+                                &c = positions[triangles[t][2]];
+                const glm::vec3 normal = glm::cross(b - a, c - a);
+                const float length = glm::length(normal);
+                if (length > 0.f)
+                    meshlet.coneCos = std::min(meshlet.coneCos, glm::dot(meshlet.coneAxis, normal / length));
+            }
+        }
+        meshlets.push_back(meshlet);
+    }
+}
+
+void cullMeshlets(const std::vector<Meshlet> &meshlets, const glm::mat4 &modelViewProjection, bool cullFront,
+                  bool useCones, size_t indexSize, DrawRanges &ranges)
+{
+    ranges.clear();
+
+    // Planes of the frustum in object space, pointing inside (Gribb and Hartmann)
+    glm::vec4 planes[6];
+    const glm::mat4 &m = modelViewProjection;
+    const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+    for (int i = 0; i < 3; ++i)
+    {
+        const glm::vec4 row(m[0][i], m[1][i], m[2][i], m[3][i]);
+        planes[2 * i] = row3 + row;
+        planes[2 * i + 1] = row3 - row;
+    }
+    for (glm::vec4 &plane : planes)
+        plane /= glm::length(glm::vec3(plane));
+
+    // The viewer: the point the projection sends to infinity along the depth, else the direction of the depth for
+    // an orthographic projection
+    const glm::vec4 viewer = glm::inverse(m) * glm::vec4(0.f, 0.f, 1.f, 0.f);
+    const bool perspective = std::fabs(viewer.w) > 1e-6f * glm::length(glm::vec3(viewer));
+    const glm::vec3 eye = perspective ? glm::vec3(viewer) / viewer.w : glm::vec3(0.f);
+    const glm::vec3 direction = perspective ? glm::vec3(0.f) : glm::normalize(glm::vec3(viewer));
+
+    for (const Meshlet &meshlet : meshlets)
+    {
+        bool visible = true;
+        for (const glm::vec4 &plane : planes)
+            if (glm::dot(glm::vec3(plane), meshlet.center) + plane.w < -meshlet.radius)
+            {
+                visible = false;
+                break;
+            }
+
+        // All the faces away from the viewer: the view directions to the sphere are within beta of the one to its
+        // center, the normals within alpha of the axis, and alpha + beta + the angle between the axis and the
+        // direction to the center stays under 90 degrees
+        if (visible && useCones && meshlet.coneCos > 0.f)
+        {
+            const glm::vec3 axis = cullFront ? -meshlet.coneAxis : meshlet.coneAxis;
+            const float coneSin = std::sqrt(std::max(1.f - meshlet.coneCos * meshlet.coneCos, 0.f));
+            if (perspective)
+            {
+                const glm::vec3 toCenter = meshlet.center - eye;
+                const float distance = glm::length(toCenter);
+                if (distance > meshlet.radius)
+                {
+                    const float sinBeta = meshlet.radius / distance;
+                    const float cosBeta = std::sqrt(1.f - sinBeta * sinBeta);
+                    if (meshlet.coneCos * cosBeta - coneSin * sinBeta > 0.f &&
+                        glm::dot(axis, toCenter) > distance * (coneSin * cosBeta + meshlet.coneCos * sinBeta))
+                        visible = false;
+                }
+            }
+            else if (glm::dot(axis, direction) > coneSin)
+            {
+                visible = false;
+            }
+        }
+        if (!visible)
+            continue;
+
+        const GLsizei count = static_cast<GLsizei>(3 * meshlet.numTriangles);
+        const size_t offset = 3 * static_cast<size_t>(meshlet.firstTriangle) * indexSize;
+        if (!ranges.counts.empty() &&
+            reinterpret_cast<size_t>(ranges.offsets.back()) + ranges.counts.back() * indexSize == offset)
+        {
+            ranges.counts.back() += count;
+        }
+        else
+        {
+            ranges.counts.push_back(count);
+            ranges.offsets.push_back(reinterpret_cast<const void *>(offset));
+        }
+        ranges.numTriangles += meshlet.numTriangles;
+    }
+}
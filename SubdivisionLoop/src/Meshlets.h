@@ -0,0 +1,55 @@
+#ifndef MESHLETS_H
+#define MESHLETS_H
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Triangles of a meshlet: a few vertices shared by its fans, small enough for its bounds to be tight
+const unsigned int MESHLET_MAX_TRIANGLES = 128;
+
+// Cluster of consecutive triangles of the draw order of a mesh, with the bounds to skip it in a view: a sphere
+// around its triangles and a cone around their normals
+struct Meshlet
+{
+    unsigned int firstTriangle = 0;
+    unsigned int numTriangles = 0;
+    glm::vec3 center = glm::vec3(0.f);
+    float radius = 0.f;
+    // The normals are at most acos(coneCos) from the axis, no cone if coneCos <= 0
+    glm::vec3 coneAxis = glm::vec3(0.f, 0.f, 1.f);
+    float coneCos = 0.f;
+};
+
+// Parts of an index buffer to draw, the adjacent ones merged: the arguments of glMultiDrawElements()
+struct DrawRanges
+{
+    std::vector<GLsizei> counts;
+    std::vector<const void *> offsets; // in bytes
+    size_t numTriangles = 0;
+
+    void clear()
+    {
+        counts.clear();
+        offsets.clear();
+        numTriangles = 0;
+    }
+};
+
+// The triangles cut into runs of maxTriangles in their order, the order of the vertex cache keeping the runs compact,
+// see VertexCache.h. The spheres hold the morph targets too if given, one per vertex, for the geometry anywhere
+// between them and the positions; the cones are the ones of the positions.
+void buildMeshlets(const std::vector<glm::uvec3> &triangles, const std::vector<glm::vec3> &positions,
+                   const std::vector<glm::vec3> &morphPositions, std::vector<Meshlet> &meshlets,
+                   unsigned int maxTriangles = MESHLET_MAX_TRIANGLES);
+
+// Ranges of the index buffer of the meshlets that may be seen with this model-view-projection, perspective or
+// orthographic, the model being rigid: the ones whose sphere is out of the frustum, and with the cones, the ones
+// whose triangles all face away from the viewer, or towards it if cullFront, as the culling of the faces would drop
+// them anyway. Without the cones for geometry between the morph targets and the positions. indexSize in bytes.
+void cullMeshlets(const std::vector<Meshlet> &meshlets, const glm::mat4 &modelViewProjection, bool cullFront,
+                  bool useCones, size_t indexSize, DrawRanges &ranges);
+
+#endif // MESHLETS_H
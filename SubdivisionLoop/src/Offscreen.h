@@ -0,0 +1,84 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+
+// OpenGL 3.3 core context without any window nor display, e.g. Mesa llvmpipe on a machine
+// without GPU. It is a surfaceless EGL context (EGL_MESA_platform_surfaceless), libEGL being
+// loaded at run time: nothing is needed to build, and the applications start as usual where
+// it is missing. There is no default framebuffer, render into an OffscreenTarget.
+class OffscreenContext
+{
+public:
+    typedef void (*ProcAddress)();
+
+    // Create the context and make it current, throws std::runtime_error on failure
+    OffscreenContext();
+    ~OffscreenContext();
+
+    // OpenGL entry points of the context, for gladLoadGL() and ShaderProgram::enableBinaryCache()
+    static ProcAddress getProcAddress(const char *name);
+
+private:
+    OffscreenContext(const OffscreenContext &) = delete;
+    OffscreenContext &operator=(const OffscreenContext &) = delete;
+
+    void *_display = nullptr;
+    void *_context = nullptr;
+};
+
+// Framebuffer object with an RGBA8 color and a 24-bit depth attachment
+class OffscreenTarget
+{
+public:
+    // A valid OpenGL context must be active, throws std::runtime_error if the framebuffer is incomplete
+    OffscreenTarget(GLsizei width, GLsizei height);
+    ~OffscreenTarget();
+
+    GLuint framebuffer() const { return _framebuffer; }
+    GLsizei width() const { return _width; }
+    GLsizei height() const { return _height; }
+
+    // Wait for the rendering and read back the color buffer, RGBA rows bottom-up
+    void read(std::vector<unsigned char> &pixels) const;
+
+private:
+    OffscreenTarget(const OffscreenTarget &) = delete;
+    OffscreenTarget &operator=(const OffscreenTarget &) = delete;
+
+    GLsizei _width, _height;
+    GLuint _framebuffer = 0;
+    GLuint _color = 0;
+    GLuint _depth = 0;
+};
+
+// Frame times and image hashes of a fixed sequence of frames. The hashes are FNV-1a of the
+// pixels: the same build on the same driver gives the same values, to compare the images of
+// two runs without storing them.
+class RenderBenchmark
+{
+public:
+    // time of the frame in ms, pixels as read by OffscreenTarget::read()
+    void addFrame(double time, const std::vector<unsigned char> &pixels);
+
+    // One line per frame then the statistics:
+    //   frame <index> <time ms> <image hash>
+    //   frames <count> mean <ms> median <ms> p95 <ms> min <ms> max <ms> fps <mean rate>
+    //   hash <hash of all the images>
+    void report(std::ostream &output) const;
+
+    size_t numFrames() const { return _times.size(); }
+    uint64_t hash() const { return _hash; }
+
+private:
+    std::vector<double> _times;
+    std::vector<uint64_t> _hashes;
+    uint64_t _hash = 14695981039346656037ull;
+};
+
+#endif // OFFSCREEN_H
@@ -0,0 +1,176 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+const int meshShift = 16;
+const int materialShift = 32;
+const int programShift = 48;
+const int layerShift = 56;
+} // namespace
+
+void RenderState::invalidate()
+{
+    _program = unknown;
+    _vertexArray = unknown;
+    _activeUnit = unknown;
+    for (GLuint &texture : _textures)
+        texture = unknown;
+}
+
+void RenderState::useProgram(GLuint program)
+{
+    if (program == _program)
+    {
+        ++_skipped;
+        return;
+    }
+    glUseProgram(program);
+    _program = program;
+    ++_calls;
+}
+
+void RenderState::bindVertexArray(GLuint vertexArray)
+{
+    if (vertexArray == _vertexArray)
+    {
+        ++_skipped;
+        return;
+    }
+    glBindVertexArray(vertexArray);
+    _vertexArray = vertexArray;
+    ++_calls;
+}
+
+void RenderState::bindTexture(GLuint unit, GLuint texture)
+{
+    if (unit < maxUnits && texture == _textures[unit])
+    {
+        ++_skipped;
+        return;
+    }
+    if (unit != _activeUnit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        _activeUnit = unit;
+        ++_calls;
+    }
+    glBindTexture(GL_TEXTURE_2D, texture);
+    if (unit < maxUnits)
+        _textures[unit] = texture;
+    ++_calls;
+}
+
+RenderQueue::RenderQueue()
+{
+    _materials.push_back(RenderMaterial()); // noMaterial
+}
+
+unsigned int RenderQueue::addProgram(const std::shared_ptr<ShaderProgram> &program)
+{
+    if (_programs.size() >= (1u << (layerShift - programShift)))
+        throw std::runtime_error("[RenderQueue][addProgram] Too many programs");
+    _programs.push_back(program);
+    return static_cast<unsigned int>(_programs.size() - 1);
+}
+
+unsigned int RenderQueue::addMaterial(const RenderMaterial &material)
+{
+    if (_materials.size() >= (1u << (programShift - materialShift)))
+        throw std::runtime_error("[RenderQueue][addMaterial] Too many materials");
+    _materials.push_back(material);
+    return static_cast<unsigned int>(_materials.size() - 1);
+}
+
+unsigned int RenderQueue::addMesh(const std::shared_ptr<Mesh> &mesh)
+{
+    if (_meshes.size() >= (1u << (materialShift - meshShift)))
+        throw std::runtime_error("[RenderQueue][addMesh] Too many meshes");
+    _meshes.push_back(mesh);
+    return static_cast<unsigned int>(_meshes.size() - 1);
+}
+
+uint64_t RenderQueue::makeKey(unsigned int layer, unsigned int program, unsigned int material, unsigned int mesh,
+                              float depth)
+{
+    const uint64_t quantizedDepth = static_cast<uint64_t>(std::min(std::max(depth, 0.f), 1.f) * 65535.f);
+    return (static_cast<uint64_t>(layer & 0xff) << layerShift) | (static_cast<uint64_t>(program & 0xff) << programShift) |
+           (static_cast<uint64_t>(material & 0xffff) << materialShift) |
+           (static_cast<uint64_t>(mesh & 0xffff) << meshShift) | quantizedDepth;
+}
+
+void RenderQueue::submit(unsigned int program, unsigned int material, unsigned int mesh, GLintptr objectBlock,
+                         float depth, unsigned int layer, const DrawRanges *ranges)
+{
+    SortItem item;
+    item.key = makeKey(layer, program, material, mesh, depth);
+    item.objectBlock = objectBlock;
+    item.ranges = ranges;
+    _items.push_back(item);
+}
+
+void RenderQueue::sort()
+{
+    const size_t n = _items.size();
+    _sorted.resize(n);
+
+    // the histograms of the 8 digits in a single read of the keys
+    static const int numDigits = 8;
+    size_t counts[numDigits][256] = {};
+    for (const SortItem &item : _items)
+        for (int d = 0; d < numDigits; ++d)
+            ++counts[d][(item.key >> (8 * d)) & 0xff];
+
+    for (int d = 0; d < numDigits; ++d)
+    {
+        // all the keys share this digit, e.g. a single layer or no depth: nothing to reorder
+        const size_t *count = counts[d];
+        if (count[(_items[0].key >> (8 * d)) & 0xff] == n)
+            continue;
+
+        size_t offsets[256];
+        size_t offset = 0;
+        for (int b = 0; b < 256; ++b)
+        {
+            offsets[b] = offset;
+            offset += count[b];
+        }
+        for (const SortItem &item : _items)
+            _sorted[offsets[(item.key >> (8 * d)) & 0xff]++] = item;
+        _items.swap(_sorted);
+    }
+}
+
+void RenderQueue::flush(RenderState &state, const UniformRingBuffer &objects)
+{
+    if (_items.empty())
+        return;
+    sort();
+
+    // the block bound by the last push is not known here
+    GLintptr boundBlock = -1;
+    for (const SortItem &item : _items)
+    {
+        const ShaderProgram &program = *_programs[(item.key >> programShift) & 0xff];
+        const RenderMaterial &material = _materials[(item.key >> materialShift) & 0xffff];
+        const Mesh &mesh = *_meshes[(item.key >> meshShift) & 0xffff];
+
+        state.useProgram(program.id());
+        for (unsigned int i = 0; i < material.numTextures; ++i)
+            state.bindTexture(material.units[i], material.textures[i]);
+        state.bindVertexArray(mesh.vertexArray());
+        if (item.objectBlock != boundBlock)
+        {
+            objects.bind(item.objectBlock);
+            boundBlock = item.objectBlock;
+        }
+        if (item.ranges)
+            mesh.draw(*item.ranges);
+        else
+            mesh.draw();
+    }
+
+    _items.clear();
+}
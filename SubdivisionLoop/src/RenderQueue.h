@@ -0,0 +1,120 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+
+#include "ShaderProgram.h"
+#include "Mesh.h"
+#include "UniformBuffer.h"
+
+// Textures of a material, each bound to its own texture unit. The sampler uniforms of the
+// programs point to these units once and for all.
+struct RenderMaterial
+{
+    static const unsigned int maxTextures = 4;
+
+    GLuint units[maxTextures];
+    GLuint textures[maxTextures];
+    unsigned int numTextures = 0;
+
+    RenderMaterial &texture(GLuint unit, GLuint texture)
+    {
+        if (numTextures < maxTextures)
+        {
+            units[numTextures] = unit;
+            textures[numTextures] = texture;
+            ++numTextures;
+        }
+        return *this;
+    }
+};
+
+// Last GL state set through it: the calls that would set the same state again are skipped.
+// The state is unknown after invalidate(), e.g. at the beginning of the frame, code outside the
+// render queue being free to change it.
+class RenderState
+{
+public:
+    RenderState() { invalidate(); }
+
+    void invalidate();
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vertexArray);
+    void bindTexture(GLuint unit, GLuint texture); // GL_TEXTURE_2D
+
+    // GL calls issued and skipped since the creation
+    uint64_t numCalls() const { return _calls; }
+    uint64_t numSkipped() const { return _skipped; }
+
+private:
+    static const unsigned int maxUnits = 16;
+    static const GLuint unknown = ~0u;
+
+    GLuint _program;
+    GLuint _vertexArray;
+    GLuint _activeUnit;
+    GLuint _textures[maxUnits];
+    uint64_t _calls = 0;
+    uint64_t _skipped = 0;
+};
+
+// Draws of a pass, submitted in any order as a sort key and the offset of their ObjectBlock in a
+// UniformRingBuffer.
+//
+// The key holds, from the most significant bits: the layer (8 bits, drawn in increasing order),
+// the program (8), the material (16), the mesh (16) and the depth (16). Once radix sorted, the
+// draws sharing a state follow each other and each state is set once. Within a state, the draws
+// go front to back.
+class RenderQueue
+{
+public:
+    // Material 0 has no texture, e.g. for the passes which sample none
+    static const unsigned int noMaterial = 0;
+
+    RenderQueue();
+
+    // Resources referred to by the keys, registered once: returns their index in the key.
+    // Throws std::runtime_error beyond 256 programs, 65536 materials or 65536 meshes.
+    unsigned int addProgram(const std::shared_ptr<ShaderProgram> &program);
+    unsigned int addMaterial(const RenderMaterial &material);
+    unsigned int addMesh(const std::shared_ptr<Mesh> &mesh);
+
+    // Queue a draw of the object block pushed at objectBlock. depth orders the draws of the same
+    // state, from 0 (near) to 1 (far), e.g. the distance to the camera over the far plane distance.
+    // Only the ranges of the index buffer given are drawn if any, e.g. the visible meshlets, which
+    // must stay until the flush.
+    void submit(unsigned int program, unsigned int material, unsigned int mesh, GLintptr objectBlock,
+                float depth = 0.f, unsigned int layer = 0, const DrawRanges *ranges = nullptr);
+
+    // Sort and draw the queued draws, binding their blocks of objects, then empty the queue
+    void flush(RenderState &state, const UniformRingBuffer &objects);
+
+    size_t numQueued() const { return _items.size(); }
+
+    static uint64_t makeKey(unsigned int layer, unsigned int program, unsigned int material, unsigned int mesh,
+                            float depth);
+
+private:
+    struct SortItem
+    {
+        uint64_t key;
+        GLintptr objectBlock;
+        const DrawRanges *ranges;
+    };
+
+    // LSD radix sort of the items on the key, 8 bits per pass; stable
+    void sort();
+
+    std::vector<std::shared_ptr<ShaderProgram>> _programs;
+    std::vector<RenderMaterial> _materials;
+    std::vector<std::shared_ptr<Mesh>> _meshes;
+
+    std::vector<SortItem> _items, _sorted;
+};
+
+#endif // RENDER_QUEUE_H
@@ -4,28 +4,64 @@
 #include <glad/glad.h>
 #include <string>
 #include <memory>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
 class ShaderProgram
 {
 public:
+    // Location of a uniform resolved once, with the type it is set with. Setting it costs a single
+    // glUniform* call: no string and no lookup. A handle on a uniform the program does not use is
+    // valid but has no effect, as with glGetUniformLocation returning -1.
+    template <typename T>
+    class Uniform
+    {
+    public:
+        Uniform() : _location(-1) {}
+        explicit Uniform(GLint location) : _location(location) {}
+
+        GLint location() const { return _location; }
+        bool active() const { return _location >= 0; }
+
+        // Set the value in the program currently in use
+        void set(const T &value) const { ShaderProgram::upload(_location, value); }
+
+    private:
+        GLint _location;
+    };
+
     // Create the program. A valid OpenGL context must be active.
     ShaderProgram();
     virtual ~ShaderProgram();
 
-    // Generate a minimal shader program, made of one vertex shader and one fragment shader
+    // Generate a minimal shader program, made of one vertex shader and one fragment shader.
+    // With the binary cache enabled, the program linked by a previous run is loaded instead.
     static std::shared_ptr<ShaderProgram> genBasicShaderProgram(
         const std::string &vertexShaderFilename, const std::string &fragmentShaderFilename);
 
+    // Entry point loader, e.g. glfwGetProcAddress
+    typedef void (*ProcAddress)();
+    typedef ProcAddress (*ProcAddressLoader)(const char *name);
+
+    // Keep the programs linked by genBasicShaderProgram in cacheDir, keyed by the hash of their
+    // sources and of the driver strings. A binary the driver rejects is compiled again.
+    // Needs OpenGL 4.1 or GL_ARB_get_program_binary, whose entry points are resolved with load:
+    // returns false, and the programs are always compiled, if the driver has none.
+    static bool enableBinaryCache(const std::string &cacheDir, ProcAddressLoader load);
+
     // OpenGL identifier of the program
     GLuint id() const { return _id; }
 
     // Loads and compile a shader from a text file, before attaching it to a program
     void loadShader(GLenum type, const std::string &shaderFilename);
 
-    // The main GPU program is ready to be handle streams of polygons
-    void link() { glLinkProgram(_id); }
+    // The main GPU program is ready to be handle streams of polygons.
+    // The active uniforms are listed into the location table at this point, and the uniform
+    // blocks named in UniformBuffer.h are bound to their binding points.
+    void link();
 
     // Activate the program
     void use() { glUseProgram(_id); }
@@ -33,51 +69,94 @@ public:
     // Desactivate the current program
     static void stop() { glUseProgram(0); }
 
-    GLuint getLocation(const std::string &name) const
-    {
-        return glGetUniformLocation(_id, name.c_str());
-    }
+    // Location of an active uniform from the table, -1 if the program does not use it.
+    // Array elements are found both as "name[i]" and, for the first one, "name".
+    GLint getLocation(const char *name) const;
+    GLint getLocation(const std::string &name) const { return getLocation(name.c_str()); }
 
-    void set(const std::string &name, int value)
+    // Resolve a typed handle, reports on std::cerr if the uniform is declared with another type
+    template <typename T>
+    Uniform<T> uniform(const std::string &name) const
     {
-        glUniform1i(getLocation(name.c_str()), value);
+        const UniformInfo *info = find(name.c_str());
+        if (!info)
+            return Uniform<T>();
+        if (!accepts(info->type, static_cast<const T *>(nullptr)))
+        {
+            reportTypeMismatch(name);
+            return Uniform<T>();
+        }
+        return Uniform<T>(info->location);
     }
 
-    void set(const std::string &name, float value)
-    {
-        glUniform1f(getLocation(name.c_str()), value);
-    }
-
-    void set(const std::string &name, const glm::vec2 &value)
-    {
-        glUniform2fv(getLocation(name.c_str()), 1, glm::value_ptr(value));
-    }
+    template <typename T>
+    void set(const Uniform<T> &uniform, const T &value) { uniform.set(value); }
+
+    // Set by name, through the table
+    void set(const char *name, int value) { upload(getLocation(name), value); }
+    void set(const char *name, float value) { upload(getLocation(name), value); }
+    void set(const char *name, const glm::vec2 &value) { upload(getLocation(name), value); }
+    void set(const char *name, const glm::vec3 &value) { upload(getLocation(name), value); }
+    void set(const char *name, const glm::vec4 &value) { upload(getLocation(name), value); }
+    void set(const char *name, const glm::mat4 &value) { upload(getLocation(name), value); }
+    void set(const char *name, const glm::mat3 &value) { upload(getLocation(name), value); }
+
+    template <typename T>
+    void set(const std::string &name, const T &value) { set(name.c_str(), value); }
+
+    // glUniform* on a location of the program currently in use
+    static void upload(GLint location, int value) { glUniform1i(location, value); }
+    static void upload(GLint location, float value) { glUniform1f(location, value); }
+    static void upload(GLint location, const glm::vec2 &value) { glUniform2fv(location, 1, glm::value_ptr(value)); }
+    static void upload(GLint location, const glm::vec3 &value) { glUniform3fv(location, 1, glm::value_ptr(value)); }
+    static void upload(GLint location, const glm::vec4 &value) { glUniform4fv(location, 1, glm::value_ptr(value)); }
+    static void upload(GLint location, const glm::mat4 &value) { glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value)); }
+    static void upload(GLint location, const glm::mat3 &value) { glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value)); }
 
-    void set(const std::string &name, const glm::vec3 &value)
-    {
-        glUniform3fv(getLocation(name.c_str()), 1, glm::value_ptr(value));
-    }
-
-    void set(const std::string &name, const glm::vec4 &value)
-    {
-        glUniform4fv(getLocation(name.c_str()), 1, glm::value_ptr(value));
-    }
-
-    void set(const std::string &name, const glm::mat4 &value)
-    {
-        glUniformMatrix4fv(getLocation(name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
-    }
-
-    void set(const std::string &name, const glm::mat3 &value)
+private:
+    struct UniformInfo
     {
-        glUniformMatrix3fv(getLocation(name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
-    }
+        std::string name;
+        GLint location;
+        GLenum type;
+    };
 
-private:
     // Loads the content of an ASCII file in a standard C++ string
     std::string file2String(const std::string &filename);
 
+    // Compile a shader from its source and attach it, name is used in the error messages
+    void compileShader(GLenum type, const std::string &source, const std::string &name);
+    // Fill the uniform table and bind the uniform blocks, once linked or loaded from a binary
+    void setupLinkedProgram();
+
+    // Binary cache file of a program, empty if the cache is disabled
+    static std::string binaryCacheFile(const std::string &vertexSource, const std::string &fragmentSource);
+    // Load a binary written by saveBinary, false if missing or rejected by the driver
+    bool loadBinary(const std::string &filename);
+    void saveBinary(const std::string &filename) const;
+
+    // List the active uniforms of the linked program into the table
+    void reflectUniforms();
+    void addUniform(const std::string &name, GLint location, GLenum type);
+    const UniformInfo *find(const char *name) const;
+    void reportTypeMismatch(const std::string &name) const;
+
+    // FNV-1a, computed on the C string so that lookups do not allocate
+    static uint64_t hashName(const char *name);
+
+    // GL types a C++ type can be uploaded to
+    static bool accepts(GLenum type, const int *);
+    static bool accepts(GLenum type, const float *) { return type == GL_FLOAT; }
+    static bool accepts(GLenum type, const glm::vec2 *) { return type == GL_FLOAT_VEC2; }
+    static bool accepts(GLenum type, const glm::vec3 *) { return type == GL_FLOAT_VEC3; }
+    static bool accepts(GLenum type, const glm::vec4 *) { return type == GL_FLOAT_VEC4; }
+    static bool accepts(GLenum type, const glm::mat3 *) { return type == GL_FLOAT_MAT3; }
+    static bool accepts(GLenum type, const glm::mat4 *) { return type == GL_FLOAT_MAT4; }
+
     GLuint _id = 0;
+    // hash of the name -> index in _uniformInfos, names are compared on lookup to rule out collisions
+    std::unordered_multimap<uint64_t, size_t> _uniformTable;
+    std::vector<UniformInfo> _uniformInfos;
 };
 
 #endif // SHADER_PROGRAM_H
@@ -2,7 +2,6 @@
 #define SHADOWMAP_H
 
 #include <glad/glad.h>
-#include <fstream>
 #include <iostream>
 #include <ostream>
 #include <string>
@@ -10,6 +9,8 @@
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
+#include "FrameCapture.h"
+
 class FboShadowMap
 {
 public:
@@ -34,6 +35,7 @@ public:
         glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, _depthMapTexture, 0);
 
         glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
 
         if (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE)
         {
@@ -57,32 +59,12 @@ public:
 
     void free() { glDeleteFramebuffers(1, &_depthMapFbo); }
 
-    void savePpmFile(std::string const &filename)
+    // Queue the depth map for writing as a binary grey image, e.g. a .ppm; the file is written by
+    // the encoding thread of the capture
+    void savePpmFile(FrameCapture &capture, std::string const &filename)
     {
-        std::ofstream output_image(filename.c_str());
-
-        int i, j, k;
-        float *pixels = new float[_depthMapTextureWidth * _depthMapTextureHeight];
-
-        glReadBuffer(GL_COLOR_ATTACHMENT0);
-        glReadPixels(0, 0, _depthMapTextureWidth, _depthMapTextureHeight, GL_DEPTH_COMPONENT, GL_FLOAT, pixels);
-
-        output_image << "P3" << std::endl;
-        output_image << _depthMapTextureWidth << " " << _depthMapTextureHeight << std::endl;
-        output_image << "255" << std::endl;
-
-        k = 0;
-        for (i = 0; i < _depthMapTextureWidth; ++i)
-        {
-            for (j = 0; j < _depthMapTextureHeight; ++j)
-            {
-                output_image << static_cast<unsigned int>(255 * pixels[k]) << " " << static_cast<unsigned int>(255 * pixels[k]) << " " << static_cast<unsigned int>(255 * pixels[k]) << " ";
-                k = k + 1;
-            }
-            output_image << std::endl;
-        }
-        delete[] pixels;
-        output_image.close();
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, _depthMapFbo);
+        capture.captureDepth(0, 0, _depthMapTextureWidth, _depthMapTextureHeight, filename);
     }
 
 private:
@@ -0,0 +1,323 @@
+#include "StreamingSubdivision.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include "Mesh.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define STREAMING_SUBDIVISION_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+const char streamingSubdivisionMagic[8] = {'L', 'O', 'O', 'P', 'S', 'U', 'B', 'D'};
+const uint32_t streamingSubdivisionVersion = 1;
+const unsigned int maxLevels = 15; // 4^levels triangles per control face in 32 bits
+
+// Output file of a known size written at any offset: mapped in memory where possible, the pages being written back
+// by the system as they go, else written through the C library
+class OutputFile
+{
+public:
+    OutputFile(const std::string &filename, uint64_t size) : _size(size)
+    {
+#ifdef STREAMING_SUBDIVISION_MMAP
+        _fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (_fd < 0)
+            throw std::runtime_error("[StreamingSubdivision][OutputFile] Cannot open " + filename);
+        // The blocks are reserved before the mapping: a full disk would raise SIGBUS on a write to a sparse file
+#ifdef __APPLE__
+        fstore_t store = {F_ALLOCATEALL, F_PEOFPOSMODE, 0, static_cast<off_t>(size), 0};
+        const int error = fcntl(_fd, F_PREALLOCATE, &store) == -1 || ftruncate(_fd, static_cast<off_t>(size)) != 0
+                              ? errno
+                              : 0;
+#else
+        const int error = posix_fallocate(_fd, 0, static_cast<off_t>(size));
+#endif
+        if (error != 0)
+        {
+            close(_fd);
+            throw std::runtime_error("[StreamingSubdivision][OutputFile] Cannot reserve " + std::to_string(size) +
+                                     " bytes for " + filename + ": " + std::strerror(error));
+        }
+        void *data = mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+        if (data == MAP_FAILED)
+        {
+            close(_fd);
+            throw std::runtime_error("[StreamingSubdivision][OutputFile] Cannot map " + filename);
+        }
+        _data = static_cast<unsigned char *>(data);
+#else
+        _file = std::fopen(filename.c_str(), "wb");
+        if (!_file)
+            throw std::runtime_error("[StreamingSubdivision][OutputFile] Cannot open " + filename);
+#endif
+    }
+
+    ~OutputFile()
+    {
+#ifdef STREAMING_SUBDIVISION_MMAP
+        munmap(_data, static_cast<size_t>(_size));
+        close(_fd);
+#else
+        std::fclose(_file);
+#endif
+    }
+
+    OutputFile(const OutputFile &) = delete;
+    OutputFile &operator=(const OutputFile &) = delete;
+
+    void write(uint64_t offset, const void *data, size_t size)
+    {
+#ifdef STREAMING_SUBDIVISION_MMAP
+        std::memcpy(_data + offset, data, size);
+#else
+#ifdef _WIN32
+        _fseeki64(_file, static_cast<__int64>(offset), SEEK_SET);
+#else
+        std::fseek(_file, static_cast<long>(offset), SEEK_SET);
+#endif
+        std::fwrite(data, 1, size, _file);
+#endif
+    }
+
+private:
+    uint64_t _size;
+#ifdef STREAMING_SUBDIVISION_MMAP
+    int _fd = -1;
+    unsigned char *_data = nullptr;
+#else
+    std::FILE *_file = nullptr;
+#endif
+};
+} // namespace
+
+StreamingSubdivision::StreamingSubdivision(const std::vector<glm::vec3> &controlPositions,
+                                           const std::vector<glm::uvec3> &controlTriangles)
+    : _positions(controlPositions), _triangles(controlTriangles),
+      _halfEdges(controlPositions.size(), controlTriangles)
+{
+    _vertexFaceOffsets.assign(_positions.size() + 1, 0);
+    for (const glm::uvec3 &triangle : _triangles)
+        for (unsigned int k = 0; k < 3; ++k)
+            ++_vertexFaceOffsets[triangle[k] + 1];
+    for (size_t v = 0; v < _positions.size(); ++v)
+        _vertexFaceOffsets[v + 1] += _vertexFaceOffsets[v];
+    _vertexFaces.resize(_vertexFaceOffsets.back());
+    std::vector<unsigned int> fill(_vertexFaceOffsets.begin(), _vertexFaceOffsets.end() - 1);
+    for (unsigned int t = 0; t < _triangles.size(); ++t)
+        for (unsigned int k = 0; k < 3; ++k)
+            _vertexFaces[fill[_triangles[t][k]]++] = t;
+}
+
+StreamingSubdivision::Statistics StreamingSubdivision::run(unsigned int levels, const std::string &filename,
+                                                           size_t maxPatchTriangles, ThreadPool *pool) const
+{
+    if (levels > maxLevels)
+        throw std::runtime_error("[StreamingSubdivision][run] " + std::to_string(levels) + " levels, at most " +
+                                 std::to_string(maxLevels));
+
+    // Numbering of the vertices, n + 1 of them along each control edge
+    const uint64_t n = uint64_t(1) << levels;
+    const uint64_t numControlFaces = _triangles.size();
+    const uint64_t firstEdgeVertex = _positions.size();
+    const uint64_t firstFaceVertex = firstEdgeVertex + _halfEdges.numEdges() * (n - 1);
+    const uint64_t faceVertices = (n - 1) * (n - 2) / 2;
+    Statistics statistics;
+    statistics.numVertices = firstFaceVertex + numControlFaces * faceVertices;
+    statistics.numTriangles = numControlFaces * n * n;
+    if (statistics.numVertices > HalfEdgeMesh::invalid)
+        throw std::runtime_error("[StreamingSubdivision][run] " + std::to_string(statistics.numVertices) +
+                                 " vertices do not fit in 32-bit indices");
+
+    // The vertex of barycentric coordinates (b0, b1, b2) in control face f, b0 + b1 + b2 = n
+    auto globalVertex = [&](unsigned int f, const glm::uvec3 &b) -> unsigned int
+    {
+        for (unsigned int k = 0; k < 3; ++k)
+        {
+            if (b[k] == n)
+                return _triangles[f][k];
+        }
+        for (unsigned int k = 0; k < 3; ++k)
+        {
+            if (b[k] != 0)
+                continue;
+            // on the edge from corner k + 1 to corner k + 2, counted from its lower vertex
+            const unsigned int k1 = (k + 1) % 3, k2 = (k + 2) % 3;
+            const uint64_t i = _triangles[f][k1] < _triangles[f][k2] ? b[k2] : b[k1];
+            return static_cast<unsigned int>(firstEdgeVertex + _halfEdges.edge(3 * f + k1) * (n - 1) + i - 1);
+        }
+        // inside, row b2 from 1 to n - 2, b1 from 1 to n - 1 - b2 in the row
+        const uint64_t row = b[2] - 1;
+        return static_cast<unsigned int>(firstFaceVertex + f * faceVertices + row * (n - 1) - row * (row + 1) / 2 +
+                                         b[1] - 1);
+    };
+
+    const uint64_t positionsOffset = sizeof(FileHeader);
+    const uint64_t normalsOffset = positionsOffset + statistics.numVertices * sizeof(glm::vec3);
+    const uint64_t trianglesOffset = normalsOffset + statistics.numVertices * sizeof(glm::vec3);
+    OutputFile file(filename, trianglesOffset + statistics.numTriangles * sizeof(glm::uvec3));
+    FileHeader header;
+    std::memcpy(header.magic, streamingSubdivisionMagic, sizeof(header.magic));
+    header.version = streamingSubdivisionVersion;
+    header.levels = levels;
+    header.numVertices = statistics.numVertices;
+    header.numTriangles = statistics.numTriangles;
+    file.write(0, &header, sizeof(header));
+
+    // Patches grown breadth-first over the edges from the first free face, while the patch and its halo fit
+    const size_t maxLocalFaces = std::max<size_t>(1, maxPatchTriangles / (n * n));
+    const unsigned int none = HalfEdgeMesh::invalid;
+    std::vector<unsigned int> facePatch(numControlFaces, none), faceQueued(numControlFaces, none);
+    std::vector<unsigned int> faceInPatch(numControlFaces, none), vertexInPatch(_positions.size(), none);
+    std::vector<unsigned int> localVertex(_positions.size());
+    std::vector<unsigned int> frontier, localFaces, localVertices;
+    for (unsigned int seed = 0; seed < numControlFaces; ++seed)
+    {
+        if (facePatch[seed] != none)
+            continue;
+        const unsigned int patch = static_cast<unsigned int>(statistics.numPatches++);
+        frontier.assign(1, seed);
+        faceQueued[seed] = patch;
+        localFaces.clear();
+        size_t numOwned = 0;
+        for (size_t head = 0; head < frontier.size(); ++head)
+        {
+            const unsigned int f = frontier[head];
+            // the faces around its new corners join the halo, counted once per corner at most
+            size_t numNewFaces = 0;
+            for (unsigned int k = 0; k < 3; ++k)
+            {
+                const unsigned int v = _triangles[f][k];
+                if (vertexInPatch[v] == patch)
+                    continue;
+                for (unsigned int i = _vertexFaceOffsets[v]; i < _vertexFaceOffsets[v + 1]; ++i)
+                    numNewFaces += faceInPatch[_vertexFaces[i]] != patch;
+            }
+            if (numOwned > 0 && localFaces.size() + numNewFaces > maxLocalFaces)
+                break;
+
+            facePatch[f] = patch;
+            ++numOwned;
+            for (unsigned int k = 0; k < 3; ++k)
+            {
+                const unsigned int v = _triangles[f][k];
+                if (vertexInPatch[v] == patch)
+                    continue;
+                vertexInPatch[v] = patch;
+                for (unsigned int i = _vertexFaceOffsets[v]; i < _vertexFaceOffsets[v + 1]; ++i)
+                {
+                    const unsigned int g = _vertexFaces[i];
+                    if (faceInPatch[g] != patch)
+                    {
+                        faceInPatch[g] = patch;
+                        localFaces.push_back(g);
+                    }
+                }
+            }
+            for (unsigned int k = 0; k < 3; ++k)
+            {
+                const unsigned int twin = _halfEdges.twin(3 * f + k);
+                if (twin == HalfEdgeMesh::invalid)
+                    continue;
+                const unsigned int g = _halfEdges.face(twin);
+                if (facePatch[g] == none && faceQueued[g] != patch)
+                {
+                    faceQueued[g] = patch;
+                    frontier.push_back(g);
+                }
+            }
+        }
+
+        // The local mesh, in the order of the control mesh: the stencils sum the same neighbors in the same order
+        std::sort(localFaces.begin(), localFaces.end());
+        localVertices.clear();
+        for (unsigned int f : localFaces)
+            for (unsigned int k = 0; k < 3; ++k)
+                localVertices.push_back(_triangles[f][k]);
+        std::sort(localVertices.begin(), localVertices.end());
+        localVertices.erase(std::unique(localVertices.begin(), localVertices.end()), localVertices.end());
+        Mesh mesh;
+        mesh.vertexPositions().resize(localVertices.size());
+        for (unsigned int i = 0; i < localVertices.size(); ++i)
+        {
+            localVertex[localVertices[i]] = i;
+            mesh.vertexPositions()[i] = _positions[localVertices[i]];
+        }
+        mesh.triangleIndices().resize(localFaces.size());
+        for (unsigned int i = 0; i < localFaces.size(); ++i)
+        {
+            const glm::uvec3 &triangle = _triangles[localFaces[i]];
+            mesh.triangleIndices()[i] = glm::uvec3(localVertex[triangle[0]], localVertex[triangle[1]],
+                                                   localVertex[triangle[2]]);
+        }
+
+        // Each local face keeps its control face, its index among the faces of the control face, and the
+        // barycentric coordinates of its corners in it, the children being numbered as in subdivideLoopNew()
+        std::vector<unsigned int> faceControl(localFaces), faceIndex(localFaces.size(), 0), nextControl, nextIndex;
+        std::vector<glm::uvec3> corners(3 * localFaces.size()), nextCorners;
+        for (size_t i = 0; i < localFaces.size(); ++i)
+        {
+            corners[3 * i] = glm::uvec3(n, 0, 0);
+            corners[3 * i + 1] = glm::uvec3(0, n, 0);
+            corners[3 * i + 2] = glm::uvec3(0, 0, n);
+        }
+        if (levels == 0)
+            mesh.evaluateLimitSurface(pool);
+        for (unsigned int level = 0; level < levels; ++level)
+        {
+            mesh.subdivideLoopNew(pool);
+            const size_t numFaces = faceControl.size();
+            nextControl.resize(4 * numFaces);
+            nextIndex.resize(4 * numFaces);
+            nextCorners.resize(12 * numFaces);
+            parallelForRange(pool, numFaces, Mesh::subdivisionGrainSize, [&](size_t begin, size_t end)
+            {
+                for (size_t t = begin; t < end; ++t)
+                {
+                    const glm::uvec3 a = corners[3 * t], b = corners[3 * t + 1], c = corners[3 * t + 2];
+                    const glm::uvec3 ab = (a + b) / 2u, bc = (b + c) / 2u, ca = (c + a) / 2u;
+                    const glm::uvec3 children[4][3] = {{a, ab, ca}, {ab, b, bc}, {ca, bc, c}, {ab, bc, ca}};
+                    for (unsigned int child = 0; child < 4; ++child)
+                    {
+                        nextControl[4 * t + child] = faceControl[t];
+                        nextIndex[4 * t + child] = 4 * faceIndex[t] + child;
+                        for (unsigned int k = 0; k < 3; ++k)
+                            nextCorners[3 * (4 * t + child) + k] = children[child][k];
+                    }
+                }
+            });
+            faceControl.swap(nextControl);
+            faceIndex.swap(nextIndex);
+            corners.swap(nextCorners);
+        }
+        statistics.maxPatchTriangles = std::max(statistics.maxPatchTriangles, mesh.triangleIndices().size());
+
+        // Then, the faces of the patch and their vertices, the shared ones being the same in the other patches
+        for (size_t t = 0; t < faceControl.size(); ++t)
+        {
+            if (facePatch[faceControl[t]] != patch)
+                continue;
+            glm::uvec3 triangle;
+            for (unsigned int k = 0; k < 3; ++k)
+            {
+                triangle[k] = globalVertex(faceControl[t], corners[3 * t + k]);
+                const unsigned int v = mesh.triangleIndices()[t][k];
+                file.write(positionsOffset + uint64_t(triangle[k]) * sizeof(glm::vec3), &mesh.vertexPositions()[v],
+                           sizeof(glm::vec3));
+                file.write(normalsOffset + uint64_t(triangle[k]) * sizeof(glm::vec3), &mesh.vertexNormals()[v],
+                           sizeof(glm::vec3));
+            }
+            file.write(trianglesOffset + (faceControl[t] * n * n + faceIndex[t]) * sizeof(glm::uvec3), &triangle,
+                       sizeof(glm::uvec3));
+        }
+    }
+    return statistics;
+}
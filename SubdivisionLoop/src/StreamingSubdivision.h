@@ -0,0 +1,65 @@
+#ifndef STREAMING_SUBDIVISION_H
+#define STREAMING_SUBDIVISION_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "HalfEdgeMesh.h"
+#include "ThreadPool.h"
+
+// Loop subdivision of a control mesh into a file, for levels whose mesh does not fit in memory.
+//
+// The control faces are cut into patches grown over their adjacency. Each patch is subdivided on its own with
+// the faces sharing a vertex with it, its one-ring halo: the subdivided faces of a patch only depend on the control
+// vertices of these faces, whatever the level. Only the faces of the patch are written, to a memory-mapped file,
+// so that the memory held is bounded by the size of a patch instead of the size of the result.
+//
+// The vertices are numbered from the control mesh so that the patches agree on the shared ones without talking to
+// each other: the control vertices first, then the vertices inside each control edge, then the vertices inside each
+// control face. The triangles are in the order of Mesh::subdivideLoopNew(), the 4^levels triangles of each control
+// face following each other.
+class StreamingSubdivision
+{
+public:
+    // Layout of the file: the header, then the positions and the normals of the vertices, 3 floats each, then the
+    // triangles, 3 uint32_t each. The normals are the ones of the limit surface, see Mesh::evaluateLimitSurface().
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t levels;
+        uint64_t numVertices;
+        uint64_t numTriangles;
+    };
+
+    struct Statistics
+    {
+        size_t numPatches = 0;
+        // Most triangles held at once, in the subdivided patch and its halo
+        size_t maxPatchTriangles = 0;
+        uint64_t numVertices = 0;
+        uint64_t numTriangles = 0;
+    };
+
+    StreamingSubdivision(const std::vector<glm::vec3> &controlPositions,
+                         const std::vector<glm::uvec3> &controlTriangles);
+
+    // levels Loop levels of the control mesh to filename, with patches of at most maxPatchTriangles triangles once
+    // subdivided, halo included, unless a single face is larger. Each patch is subdivided on the pool if any.
+    // Throws std::runtime_error if the file cannot be written or the vertices overflow 32-bit indices.
+    Statistics run(unsigned int levels, const std::string &filename, size_t maxPatchTriangles,
+                   ThreadPool *pool = nullptr) const;
+
+private:
+    std::vector<glm::vec3> _positions;
+    std::vector<glm::uvec3> _triangles;
+    HalfEdgeMesh _halfEdges;
+    // Faces around each vertex, all its fans included
+    std::vector<unsigned int> _vertexFaceOffsets;
+    std::vector<unsigned int> _vertexFaces;
+};
+
+#endif // STREAMING_SUBDIVISION_H
@@ -0,0 +1,132 @@
+#include "SubdivisionLod.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+SubdivisionLod::SubdivisionLod(unsigned int maxLevels)
+{
+    for (unsigned int level = 0; level <= maxLevels; ++level)
+        _meshes.push_back(std::make_shared<Mesh>());
+}
+
+void SubdivisionLod::build(const std::vector<glm::vec3> &positions, const std::vector<glm::uvec3> &triangles,
+                           const std::vector<glm::vec2> &texCoords, size_t maxTriangles, ThreadPool *pool)
+{
+    clear();
+    if (triangles.empty())
+        return;
+
+    Mesh &base = *_meshes[0];
+    base.vertexPositions() = positions;
+    base.triangleIndices() = triangles;
+    if (texCoords.size() == positions.size())
+        base.vertexTexCoords() = texCoords;
+    else
+        base.recomputePerVertexTextureCoordinates();
+    base.recomputePerVertexNormals();
+    _numLevels = 1;
+
+    // Each level is the Loop level of the positions of the previous one before the limit, its only operator: moving
+    // the base mesh goes down the levels one product each
+    while (_numLevels < _meshes.size() && 4 * _meshes[_numLevels - 1]->triangleIndices().size() <= maxTriangles)
+    {
+        const Mesh &parent = *_meshes[_numLevels - 1];
+        Mesh &level = *_meshes[_numLevels];
+        level.vertexPositions() = parent.vertexPositions();
+        level.triangleIndices() = parent.triangleIndices();
+        level.vertexTexCoords() = parent.vertexTexCoords();
+        level.subdivideLoop(pool);
+        updateMorphTargets(_numLevels++);
+    }
+    for (unsigned int level = 0; level < _numLevels; ++level)
+        _meshes[level]->init();
+
+    float radius;
+    base.computeBoundingSphere(_center, radius);
+    double length = 0.0;
+    for (const glm::uvec3 &t : triangles)
+        for (int k = 0; k < 3; ++k)
+            length += glm::distance(positions[t[k]], positions[t[(k + 1) % 3]]);
+    _edgeLength = static_cast<float>(length / (3.0 * triangles.size()));
+}
+
+void SubdivisionLod::clear()
+{
+    for (const std::shared_ptr<Mesh> &mesh : _meshes)
+        mesh->clear();
+    _numLevels = 0;
+    _center = glm::vec3(0.f);
+    _edgeLength = 0.f;
+}
+
+SubdivisionLod::Selection SubdivisionLod::select(const glm::mat4 &modelView, const glm::mat4 &projection,
+                                                 float viewportHeight, float targetEdgePixels) const
+{
+    Selection selection;
+    if (_numLevels < 2 || targetEdgePixels <= 0.f)
+        return selection;
+
+    // Pixels per object unit at the center of the mesh, the model-view being a rotation and a uniform scale
+    const glm::vec3 center = glm::vec3(modelView * glm::vec4(_center, 1.f));
+    const float distance = std::max(glm::length(center), 1e-6f);
+    const float pixelsPerUnit = glm::length(glm::vec3(modelView[0])) * projection[1][1] * 0.5f * viewportHeight /
+                                distance;
+
+    // Each level halves the edges: level k is fine enough from lod = k on
+    const float lod = std::log2(std::max(_edgeLength * pixelsPerUnit / targetEdgePixels, 1e-6f));
+    if (lod <= 0.f)
+        return selection;
+    const float maxLevel = static_cast<float>(_numLevels - 1);
+    const float level = std::min(std::ceil(lod), maxLevel);
+    selection.level = static_cast<unsigned int>(level);
+    selection.morph = glm::clamp(lod - (level - 1.f), 0.f, 1.f);
+    return selection;
+}
+
+void SubdivisionLod::setControlPositions(const std::vector<glm::vec3> &positions, ThreadPool *pool)
+{
+    if (_numLevels == 0)
+        throw std::runtime_error("[SubdivisionLod][setControlPositions] " + std::to_string(positions.size()) +
+                                 " positions given for no level");
+    _meshes[0]->setControlPositions(positions, pool);
+    for (unsigned int level = 1; level < _numLevels; ++level)
+    {
+        _meshes[level]->setControlPositions(_meshes[level - 1]->vertexPositions(), pool);
+        updateMorphTargets(level);
+    }
+    for (unsigned int level = 0; level < _numLevels; ++level)
+        _meshes[level]->updatePositions();
+}
+
+void SubdivisionLod::updateMorphTargets(unsigned int level)
+{
+    const Mesh &parent = *_meshes[level - 1];
+    Mesh &mesh = *_meshes[level];
+    const std::vector<glm::vec3> &parentPositions = parent.drawnPositions();
+    const std::vector<glm::vec3> &parentNormals = parent.vertexNormals();
+    const std::vector<glm::uvec3> &parentTriangles = parent.triangleIndices();
+    const std::vector<glm::uvec3> &triangles = mesh.triangleIndices();
+
+    // The even vertices keep their index, the odd ones are found from the 4 children of each face, in the order
+    // of Mesh::subdivideLoopNew(): (a, ab, ca), (ab, b, bc), ...
+    std::vector<glm::vec3> positions(mesh.vertexPositions().size());
+    std::vector<glm::vec3> normals(positions.size());
+    std::copy(parentPositions.begin(), parentPositions.end(), positions.begin());
+    std::copy(parentNormals.begin(), parentNormals.end(), normals.begin());
+    for (size_t t = 0; t < parentTriangles.size(); ++t)
+    {
+        const glm::uvec3 &corners = parentTriangles[t];
+        const unsigned int odd[3] = {triangles[4 * t][1], triangles[4 * t + 1][2], triangles[4 * t][2]};
+        for (int k = 0; k < 3; ++k)
+        {
+            const unsigned int a = corners[k], b = corners[(k + 1) % 3];
+            positions[odd[k]] = 0.5f * (parentPositions[a] + parentPositions[b]);
+            const glm::vec3 normal = parentNormals[a] + parentNormals[b];
+            const float length = glm::length(normal);
+            normals[odd[k]] = length > 0.f ? normal / length : parentNormals[a];
+        }
+    }
+    mesh.setMorphTargets(positions, normals);
+}
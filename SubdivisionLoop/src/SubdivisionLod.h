@@ -0,0 +1,65 @@
+#ifndef SUBDIVISION_LOD_H
+#define SUBDIVISION_LOD_H
+
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+#include "ThreadPool.h"
+
+// Levels of detail of a mesh from its uniform Loop levels, all kept on the GPU, one drawn per frame depending on
+// the size of the mesh on screen.
+//
+// Each level morphs from the surface of the previous one (geomorphs, Hoppe 1996): its even vertices start at their
+// position in the previous level, its odd vertices at the middle of their edge there, with the normals likewise.
+// A level appears with the exact shape of the previous one and grows into its own as the mesh gets closer, so that
+// the switches do not pop. The vertices of each level being on the limit surface, the even ones do not move at all.
+class SubdivisionLod
+{
+public:
+    struct Selection
+    {
+        unsigned int level = 0;
+        // Of the level from its morph targets, see Mesh::setMorphTargets(): 0 draws the previous level, 1 its own
+        float morph = 1.f;
+    };
+
+    // Up to maxLevels Loop levels over the base mesh
+    explicit SubdivisionLod(unsigned int maxLevels);
+
+    // The base mesh and its Loop levels, on the pool if any, until maxLevels or until the next one would have more
+    // than maxTriangles triangles. The meshes are uploaded with init(), the current OpenGL context needed.
+    void build(const std::vector<glm::vec3> &positions, const std::vector<glm::uvec3> &triangles,
+               const std::vector<glm::vec2> &texCoords, size_t maxTriangles, ThreadPool *pool = nullptr);
+    void clear();
+
+    // The base mesh and the levels built, its first ones
+    unsigned int numLevels() const { return _numLevels; }
+    // The meshes of all the possible levels, to register them once
+    const std::vector<std::shared_ptr<Mesh>> &meshes() const { return _meshes; }
+
+    // Level and morph to draw the mesh with this model-view and projection, in a viewport of viewportHeight pixels:
+    // the coarsest level whose mean edge is at most targetEdgePixels pixels long on screen, morphing linearly in the
+    // log of the distance between the points where it and the previous one reach that size. Level 0 if none built.
+    Selection select(const glm::mat4 &modelView, const glm::mat4 &projection, float viewportHeight,
+                     float targetEdgePixels) const;
+
+    // Move the vertices of the base mesh, the topology being the same: the levels and their morph targets follow
+    // through the operators of the levels, and their vertex buffers are written again in place. Throws std::runtime_error if the number of
+    // positions differs.
+    void setControlPositions(const std::vector<glm::vec3> &positions, ThreadPool *pool = nullptr);
+
+private:
+    // Morph targets of a level from the drawn positions and the normals of the previous one
+    void updateMorphTargets(unsigned int level);
+
+    std::vector<std::shared_ptr<Mesh>> _meshes;
+    unsigned int _numLevels = 0;
+    // Of the base mesh: center of its bounding sphere and mean edge length, in object units
+    glm::vec3 _center = glm::vec3(0.f);
+    float _edgeLength = 0.f;
+};
+
+#endif // SUBDIVISION_LOD_H
@@ -0,0 +1,64 @@
+#include "SubdivisionStencil.h"
+
+#include <stdexcept>
+#include <string>
+
+const size_t SubdivisionStencil::grainSize;
+
+void SubdivisionStencil::reset(size_t numRows, size_t numColumns)
+{
+    _offsets.assign(numRows + 1, 0);
+    _columns.clear();
+    _weights.clear();
+    _numColumns = numColumns;
+}
+
+void SubdivisionStencil::allocate()
+{
+    for (size_t row = 0; row < numRows(); ++row)
+        _offsets[row + 1] += _offsets[row];
+    _columns.resize(_offsets.back());
+    _weights.resize(_offsets.back());
+}
+
+void SubdivisionStencil::sortRow(size_t row)
+{
+    // insertion sort: the rows are a few entries long
+    for (unsigned int k = _offsets[row] + 1; k < _offsets[row + 1]; ++k)
+    {
+        const unsigned int column = _columns[k];
+        const float weight = _weights[k];
+        unsigned int j = k;
+        for (; j > _offsets[row] && _columns[j - 1] > column; --j)
+        {
+            _columns[j] = _columns[j - 1];
+            _weights[j] = _weights[j - 1];
+        }
+        _columns[j] = column;
+        _weights[j] = weight;
+    }
+}
+
+void SubdivisionStencil::clear()
+{
+    reset(0, 0);
+}
+
+void SubdivisionStencil::apply(const std::vector<glm::vec3> &controlPositions, std::vector<glm::vec3> &positions,
+                               ThreadPool *pool) const
+{
+    if (controlPositions.size() != _numColumns)
+        throw std::runtime_error("[SubdivisionStencil][apply] " + std::to_string(controlPositions.size()) +
+                                 " positions given for " + std::to_string(_numColumns) + " columns");
+    positions.resize(numRows());
+    parallelForRange(pool, numRows(), grainSize, [&](size_t begin, size_t end)
+    {
+        for (size_t row = begin; row < end; ++row)
+        {
+            glm::vec3 position(0.f);
+            for (unsigned int k = _offsets[row]; k < _offsets[row + 1]; ++k)
+                position += _weights[k] * controlPositions[_columns[k]];
+            positions[row] = position;
+        }
+    });
+}
@@ -0,0 +1,54 @@
+#ifndef SUBDIVISION_STENCIL_H
+#define SUBDIVISION_STENCIL_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "ThreadPool.h"
+
+// Sparse linear operator of a subdivision, in CSR form: new position i is the sum of
+// weight(k) * old position column(k) over the entries k of row i, accumulated in this order.
+// It only depends on the topology, so the new positions of a deformed mesh are a single
+// sparse matrix-vector product away.
+class SubdivisionStencil
+{
+public:
+    // Elements per task of the parallel loops
+    static const size_t grainSize = 4096;
+
+    size_t numRows() const { return _offsets.size() - 1; }
+    size_t numColumns() const { return _numColumns; }
+    size_t numEntries() const { return _columns.size(); }
+    bool empty() const { return _columns.empty(); }
+
+    size_t rowBegin(size_t row) const { return _offsets[row]; }
+    size_t rowEnd(size_t row) const { return _offsets[row + 1]; }
+    unsigned int column(size_t k) const { return _columns[k]; }
+    float weight(size_t k) const { return _weights[k]; }
+
+    // Build in two steps: set the size of each row, then allocate() and set the entries
+    void reset(size_t numRows, size_t numColumns);
+    void setRowSize(size_t row, unsigned int size) { _offsets[row + 1] = size; }
+    void allocate();
+    void setEntry(size_t row, unsigned int k, unsigned int column, float weight)
+    {
+        _columns[_offsets[row] + k] = column;
+        _weights[_offsets[row] + k] = weight;
+    }
+    // Order the entries of a row by increasing column, once they are all set
+    void sortRow(size_t row);
+    void clear();
+
+    // positions = this * controlPositions, on the pool if any, with the same result without
+    void apply(const std::vector<glm::vec3> &controlPositions, std::vector<glm::vec3> &positions,
+               ThreadPool *pool = nullptr) const;
+
+private:
+    std::vector<unsigned int> _offsets = std::vector<unsigned int>(1, 0);
+    std::vector<unsigned int> _columns;
+    std::vector<float> _weights;
+    size_t _numColumns = 0;
+};
+
+#endif // SUBDIVISION_STENCIL_H
@@ -0,0 +1,107 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <glm/glm.hpp>
+
+// Decoded texture cache file, one per source image, named after the hash of the source bytes:
+//  - TextureCacheHeader
+//  - the mip levels, from the full size image down to 1x1, rows in file order and tightly packed
+// The file is mapped in memory and copied as is into the pixel unpack buffer.
+static const unsigned int maxTextureLevels = 16;
+
+struct TextureCacheHeader
+{
+    char magic[8];         // "TEXCACHE"
+    uint32_t version;
+    uint32_t channels;     // 1, 2, 3 or 4 bytes per texel
+    uint32_t width;
+    uint32_t height;
+    uint32_t numLevels;
+    uint32_t reserved;
+    uint64_t sourceHash;   // FNV-1a of the source file
+    uint64_t sourceSize;
+    uint64_t fileSize;
+    uint64_t levelOffset[maxTextureLevels]; // from the start of the file
+};
+
+// Loads image files into textures without blocking the render thread.
+//
+// load() creates the texture at once with a single texel of a placeholder color, and queues the
+// file for the worker threads. They decode it with stb_image and build the mip levels, or map the
+// cached result of a previous run. update(), called once per frame, uploads the images that are
+// ready through a pixel unpack buffer.
+class TextureLoader
+{
+public:
+    // A valid OpenGL context must be active. An empty cacheDir disables the disk cache.
+    explicit TextureLoader(const std::string &cacheDir = "texcache", unsigned int numThreads = 2);
+
+    // Stop the workers, the textures not uploaded yet keep their placeholder
+    ~TextureLoader();
+
+    // Texture with GL_REPEAT wrapping and trilinear filtering, filled in by a later update()
+    GLuint load(const std::string &filename, const glm::u8vec4 &placeholder = glm::u8vec4(128, 128, 128, 255));
+
+    // Upload the images decoded since the last call, at least one and up to about maxBytes
+    void update(size_t maxBytes = 16 << 20);
+    // Wait for all the textures requested so far and upload them
+    void finish();
+
+    size_t numPending() const { return _pending; }
+    unsigned int numFromCache() const { return _fromCache; }
+    unsigned int numDecoded() const { return _decoded; }
+
+private:
+    TextureLoader(const TextureLoader &) = delete;
+    TextureLoader &operator=(const TextureLoader &) = delete;
+
+    struct Request
+    {
+        GLuint texture;
+        std::string filename;
+    };
+
+    struct Image
+    {
+        GLuint texture = 0;
+        std::string filename;
+        const unsigned char *data = nullptr; // cache file layout, mapped or in owned
+        size_t size = 0;
+        bool mapped = false;
+        bool fromCache = false;
+        std::vector<unsigned char> owned;
+    };
+
+    void run();
+    void process(const Request &request, Image &image) const;
+    bool readCache(const std::string &path, uint64_t hash, uint64_t sourceSize, Image &image) const;
+    void writeCache(const std::string &path, const Image &image) const;
+    void upload(Image &image);
+    static void release(Image &image);
+
+    std::string _cacheDir;
+    GLuint _pbo = 0;
+    size_t _pending = 0; // requested and not uploaded yet
+    unsigned int _fromCache = 0;
+    unsigned int _decoded = 0;
+
+    std::deque<Request> _requests;
+    std::deque<Image> _ready;
+    bool _stop = false;
+    std::mutex _mutex;
+    std::condition_variable _requested;
+    std::condition_variable _decodedImage;
+    std::vector<std::thread> _threads;
+};
+
+#endif // TEXTURE_LOADER_H
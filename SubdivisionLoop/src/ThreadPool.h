@@ -0,0 +1,149 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cstddef>
+
+// Fixed-size pool of worker threads. Work is submitted as a list of independent
+// tasks with parallelFor(); the calling thread takes part in the work and only
+// returns once every task is done.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned int numThreads = std::thread::hardware_concurrency())
+        : _stop(false), _generation(0), _numTasks(0), _nextTask(0), _pending(0)
+    {
+        // the calling thread is a worker too
+        unsigned int numWorkers = std::max(1u, numThreads) - 1;
+        for (unsigned int i = 0; i < numWorkers; ++i)
+            _workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _wakeUp.notify_all();
+        for (auto &w : _workers)
+            w.join();
+    }
+
+    unsigned int size() const { return static_cast<unsigned int>(_workers.size()) + 1; }
+
+    // Run task(i) for every i in [0, numTasks) and wait for all of them.
+    // Tasks may run in any order and on any thread.
+    void parallelFor(unsigned int numTasks, const std::function<void(unsigned int)> &task)
+    {
+        if (numTasks == 0)
+            return;
+        if (_workers.empty() || numTasks == 1)
+        {
+            for (unsigned int i = 0; i < numTasks; ++i)
+                task(i);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _task = task;
+            _numTasks = numTasks;
+            _nextTask = 0;
+            _pending = numTasks;
+            ++_generation;
+        }
+        _wakeUp.notify_all();
+
+        runTasks();
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done.wait(lock, [this]() { return _pending == 0; });
+        _task = nullptr;
+    }
+
+    // Run task(begin, end) over [0, size) cut in ranges of grainSize items, e.g. the
+    // elements of an array, and wait for all of them.
+    void parallelForRange(size_t size, size_t grainSize, const std::function<void(size_t, size_t)> &task)
+    {
+        grainSize = std::max<size_t>(1, grainSize);
+        const unsigned int numTasks = static_cast<unsigned int>((size + grainSize - 1) / grainSize);
+        parallelFor(numTasks, [&](unsigned int i)
+        {
+            const size_t begin = static_cast<size_t>(i) * grainSize;
+            task(begin, std::min(size, begin + grainSize));
+        });
+    }
+
+private:
+    void workerLoop()
+    {
+        unsigned int seenGeneration = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _wakeUp.wait(lock, [&]() { return _stop || _generation != seenGeneration; });
+                if (_stop)
+                    return;
+                seenGeneration = _generation;
+            }
+            runTasks();
+        }
+    }
+
+    // Grab tasks until none are left
+    void runTasks()
+    {
+        while (true)
+        {
+            unsigned int i;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (_nextTask >= _numTasks)
+                    return;
+                i = _nextTask++;
+            }
+            _task(i);
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (--_pending == 0)
+                    _done.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _wakeUp;
+    std::condition_variable _done;
+
+    std::function<void(unsigned int)> _task;
+    bool _stop;
+    unsigned int _generation;
+    unsigned int _numTasks;
+    unsigned int _nextTask;
+    unsigned int _pending;
+};
+
+// As ThreadPool::parallelForRange() on the pool if any, else the same ranges one after the other
+// on the calling thread
+inline void parallelForRange(ThreadPool *pool, size_t size, size_t grainSize,
+                             const std::function<void(size_t, size_t)> &task)
+{
+    if (pool)
+    {
+        pool->parallelForRange(size, grainSize, task);
+        return;
+    }
+    grainSize = std::max<size_t>(1, grainSize);
+    for (size_t begin = 0; begin < size; begin += grainSize)
+        task(begin, std::min(size, begin + grainSize));
+}
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,102 @@
+#include "UniformBuffer.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+const char *uniformBlockName(UniformBlockBinding binding)
+{
+    switch (binding)
+    {
+    case FRAME_BLOCK_BINDING:
+        return "FrameBlock";
+    case OBJECT_BLOCK_BINDING:
+        return "ObjectBlock";
+    default:
+        return "";
+    }
+}
+
+UniformBuffer::UniformBuffer(GLsizeiptr size, GLuint binding) : _size(size), _binding(binding)
+{
+    glGenBuffers(1, &_id);
+    glBindBuffer(GL_UNIFORM_BUFFER, _id);
+    glBufferData(GL_UNIFORM_BUFFER, _size, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    bind();
+}
+
+UniformBuffer::~UniformBuffer()
+{
+    glDeleteBuffers(1, &_id);
+}
+
+void UniformBuffer::update(const void *data, GLsizeiptr size)
+{
+    glBindBuffer(GL_UNIFORM_BUFFER, _id);
+    glBufferData(GL_UNIFORM_BUFFER, _size, nullptr, GL_DYNAMIC_DRAW); // orphan the store read by the last frame
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, size < _size ? size : _size, data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::bind() const
+{
+    glBindBufferBase(GL_UNIFORM_BUFFER, _binding, _id);
+}
+
+UniformRingBuffer::UniformRingBuffer(GLsizeiptr blockSize, GLuint binding, GLsizeiptr numBlocks)
+    : _blockSize(blockSize), _binding(binding)
+{
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    _stride = (_blockSize + alignment - 1) / alignment * alignment;
+    _capacity = _stride * numBlocks;
+
+    glGenBuffers(1, &_id);
+    glBindBuffer(GL_UNIFORM_BUFFER, _id);
+    glBufferData(GL_UNIFORM_BUFFER, _capacity, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+UniformRingBuffer::~UniformRingBuffer()
+{
+    glDeleteBuffers(1, &_id);
+}
+
+void UniformRingBuffer::beginFrame()
+{
+    if (_head == 0)
+        return;
+    glBindBuffer(GL_UNIFORM_BUFFER, _id);
+    glBufferData(GL_UNIFORM_BUFFER, _capacity, nullptr, GL_STREAM_DRAW); // orphan the store read by the last frames
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    _head = 0;
+}
+
+GLintptr UniformRingBuffer::push(const void *data)
+{
+    // wrapping would write over the blocks of this frame, or orphan them
+    if (_head + _stride > _capacity)
+        throw std::runtime_error("[UniformRingBuffer][push] More than " + std::to_string(_capacity / _stride) +
+                                 " blocks in a frame");
+
+    const GLintptr offset = _head;
+    glBindBuffer(GL_UNIFORM_BUFFER, _id);
+    void *slot = glMapBufferRange(GL_UNIFORM_BUFFER, offset, _blockSize,
+                                  GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    if (slot)
+    {
+        std::memcpy(slot, data, _blockSize);
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    _head += _stride;
+
+    bind(offset);
+    return offset;
+}
+
+void UniformRingBuffer::bind(GLintptr offset) const
+{
+    glBindBufferRange(GL_UNIFORM_BUFFER, _binding, _id, offset, _blockSize);
+}
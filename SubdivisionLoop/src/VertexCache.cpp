@@ -0,0 +1,193 @@
+#include "VertexCache.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+VertexCacheStatistics analyzeVertexCache(const std::vector<glm::uvec3> &triangles, size_t numVertices,
+                                         unsigned int cacheSize)
+{
+    // Time each vertex entered the cache: it is still there while fewer than cacheSize vertices entered since
+    VertexCacheStatistics statistics;
+    std::vector<size_t> entries(numVertices, std::numeric_limits<size_t>::max());
+    size_t numUsed = 0;
+    for (const glm::uvec3 &t : triangles)
+        for (int k = 0; k < 3; ++k)
+        {
+            size_t &entry = entries[t[k]];
+            if (entry == std::numeric_limits<size_t>::max())
+                ++numUsed;
+            else if (statistics.numMisses - entry < cacheSize)
+                continue;
+            entry = statistics.numMisses++;
+        }
+    if (!triangles.empty())
+        statistics.acmr = static_cast<float>(statistics.numMisses) / triangles.size();
+    if (numUsed > 0)
+        statistics.atvr = static_cast<float>(statistics.numMisses) / numUsed;
+    return statistics;
+}
+
+std::vector<glm::uvec3> optimizeVertexCache(const std::vector<glm::uvec3> &triangles,
+                                            const std::vector<glm::vec3> &positions, size_t numVertices,
+                                            unsigned int cacheSize)
+{
+    const unsigned int none = std::numeric_limits<unsigned int>::max();
+
+    // Triangles around each vertex, and the number of them not emitted yet
+    std::vector<unsigned int> offsets(numVertices + 1, 0);
+    for (const glm::uvec3 &t : triangles)
+        for (int k = 0; k < 3; ++k)
+            ++offsets[t[k] + 1];
+    std::vector<unsigned int> live(numVertices);
+    for (size_t v = 0; v < numVertices; ++v)
+    {
+        live[v] = offsets[v + 1];
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<unsigned int> vertexFaces(offsets.back());
+    {
+        std::vector<unsigned int> cursors(offsets.begin(), offsets.end() - 1);
+        for (unsigned int t = 0; t < triangles.size(); ++t)
+            for (int k = 0; k < 3; ++k)
+                vertexFaces[cursors[triangles[t][k]]++] = t;
+    }
+
+    // Time each vertex entered the cache, the clock ticking on each miss: in the cache while time - entry <= size
+    std::vector<unsigned int> entries(numVertices, 0);
+    unsigned int time = cacheSize + 1;
+    std::vector<unsigned char> emitted(triangles.size(), 0);
+    std::vector<unsigned int> deadEnds, candidates;
+    std::vector<glm::uvec3> ordered;
+    ordered.reserve(triangles.size());
+    // First triangle of each piece between two cache flushes
+    std::vector<size_t> clusters;
+    unsigned int cursor = 0;
+
+    unsigned int fanning = none;
+    while (cursor < numVertices && live[cursor] == 0)
+        ++cursor;
+    if (cursor < numVertices)
+        fanning = cursor;
+    while (fanning != none)
+    {
+        // Emit the fan of the vertex
+        candidates.clear();
+        for (unsigned int i = offsets[fanning]; i < offsets[fanning + 1]; ++i)
+        {
+            const unsigned int t = vertexFaces[i];
+            if (emitted[t])
+                continue;
+            emitted[t] = 1;
+            ordered.push_back(triangles[t]);
+            for (int k = 0; k < 3; ++k)
+            {
+                const unsigned int v = triangles[t][k];
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time - entries[v] > cacheSize)
+                    entries[v] = time++;
+            }
+        }
+
+        // The oldest vertex of the fan that stays in the cache while its own fan is emitted, 2 new vertices per
+        // triangle at most
+        fanning = none;
+        unsigned int best = 0;
+        for (unsigned int v : candidates)
+        {
+            if (live[v] == 0)
+                continue;
+            const unsigned int age = time - entries[v];
+            if (age + 2 * live[v] <= cacheSize && age > best)
+            {
+                best = age;
+                fanning = v;
+            }
+        }
+        if (fanning != none)
+            continue;
+
+        // Dead end: the last vertex with triangles left, else the next one in index order
+        while (!deadEnds.empty() && fanning == none)
+        {
+            if (live[deadEnds.back()] > 0)
+                fanning = deadEnds.back();
+            deadEnds.pop_back();
+        }
+        if (fanning == none)
+        {
+            while (cursor < numVertices && live[cursor] == 0)
+                ++cursor;
+            if (cursor < numVertices)
+                fanning = cursor;
+        }
+        if (fanning != none && time - entries[fanning] > cacheSize)
+            clusters.push_back(ordered.size());
+    }
+
+    if (positions.size() < numVertices || clusters.empty())
+        return ordered;
+
+    // Overdraw: the pieces in decreasing order of the distance of their plane from the center of the mesh, the
+    // outer ones first (Sander et al.). A piece starts and ends on a cache flush: the reuse inside stays.
+    clusters.insert(clusters.begin(), 0);
+    clusters.push_back(ordered.size());
+    const size_t numClusters = clusters.size() - 1;
+    std::vector<glm::vec3> centers(numClusters, glm::vec3(0.f)), normals(numClusters, glm::vec3(0.f));
+    glm::vec3 meshCenter(0.f);
+    float meshArea = 0.f;
+    for (size_t c = 0; c < numClusters; ++c)
+    {
+        float area = 0.f;
+        for (size_t i = clusters[c]; i < clusters[c + 1]; ++i)
+        {
+            const glm::vec3 &a = positions[ordered[i][0]], &b = positions[ordered[i][1]], &d = positions[ordered[i][2]];
+            const glm::vec3 normal = glm::cross(b - a, d - a); // twice the area
+            const float faceArea = glm::length(normal);
+            normals[c] += normal;
+            centers[c] += faceArea * (a + b + d) / 3.f;
+            area += faceArea;
+        }
+        meshCenter += centers[c];
+        meshArea += area;
+        centers[c] = area > 0.f ? centers[c] / area : positions[ordered[clusters[c]][0]];
+    }
+    if (meshArea > 0.f)
+        meshCenter /= meshArea;
+    std::vector<float> keys(numClusters);
+    for (size_t c = 0; c < numClusters; ++c)
+    {
+        const float length = glm::length(normals[c]);
+        keys[c] = length > 0.f ? glm::dot(centers[c] - meshCenter, normals[c] / length) : 0.f;
+    }
+    std::vector<unsigned int> order(numClusters);
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&keys](unsigned int a, unsigned int b) { return keys[a] > keys[b]; });
+
+    std::vector<glm::uvec3> sorted;
+    sorted.reserve(ordered.size());
+    for (unsigned int c : order)
+        sorted.insert(sorted.end(), ordered.begin() + clusters[c], ordered.begin() + clusters[c + 1]);
+    return sorted;
+}
+
+std::vector<unsigned int> optimizeVertexFetch(std::vector<glm::uvec3> &triangles, size_t numVertices)
+{
+    const unsigned int none = std::numeric_limits<unsigned int>::max();
+    std::vector<unsigned int> remap(numVertices, none);
+    unsigned int next = 0;
+    for (glm::uvec3 &t : triangles)
+        for (int k = 0; k < 3; ++k)
+        {
+            unsigned int &index = remap[t[k]];
+            if (index == none)
+                index = next++;
+            t[k] = index;
+        }
+    for (unsigned int &index : remap)
+        if (index == none)
+            index = next++;
+    return remap;
+}
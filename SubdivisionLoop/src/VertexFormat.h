@@ -0,0 +1,131 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+// Vertex as stored on the GPU by Mesh::init, interleaved: 20 bytes instead of 32 in separate
+// float buffers. Attribute locations are those of the vertex shaders:
+//  - 0: position, 3 floats
+//  - 1: normal, octahedral encoding on 2 snorm16, decoded by octDecode in the vertex shader
+//  - 2: texture coordinates, 2 half floats
+struct PackedVertex
+{
+    float position[3];
+    int16_t normal[2];
+    uint16_t texCoord[2];
+};
+static_assert(sizeof(PackedVertex) == 20, "PackedVertex must be tightly packed");
+
+// Morph target of a vertex, in a second buffer of the meshes of a level of detail, see SubdivisionLod: the
+// position and the normal the vertex starts from when the level appears. Attribute locations:
+//  - 3: position, 3 floats
+//  - 4: normal, octahedral encoding on 2 snorm16
+struct MorphVertex
+{
+    float position[3];
+    int16_t normal[2];
+};
+static_assert(sizeof(MorphVertex) == 16, "MorphVertex must be tightly packed");
+
+// Map a direction onto the octahedron |x| + |y| + |z| = 1 unfolded on [-1,1]^2
+inline glm::vec2 octEncode(const glm::vec3 &n)
+{
+    const float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (l1 == 0.f)
+        return glm::vec2(0.f); // decodes to +z
+    glm::vec2 e(n.x / l1, n.y / l1);
+    if (n.z < 0.f)
+        e = glm::vec2((1.f - std::fabs(e.y)) * (e.x >= 0.f ? 1.f : -1.f),
+                      (1.f - std::fabs(e.x)) * (e.y >= 0.f ? 1.f : -1.f));
+    return e;
+}
+
+// Inverse of octEncode, the same as in the vertex shaders
+inline glm::vec3 octDecode(const glm::vec2 &e)
+{
+    glm::vec3 n(e.x, e.y, 1.f - std::fabs(e.x) - std::fabs(e.y));
+    const float t = std::max(-n.z, 0.f);
+    n.x += n.x >= 0.f ? -t : t;
+    n.y += n.y >= 0.f ? -t : t;
+    return glm::normalize(n);
+}
+
+inline void packNormal(const glm::vec3 &normal, int16_t out[2])
+{
+    const glm::vec2 e = octEncode(normal);
+    out[0] = static_cast<int16_t>(std::round(glm::clamp(e.x, -1.f, 1.f) * 32767.f));
+    out[1] = static_cast<int16_t>(std::round(glm::clamp(e.y, -1.f, 1.f) * 32767.f));
+}
+
+inline PackedVertex packVertex(const glm::vec3 &position, const glm::vec3 &normal, const glm::vec2 &texCoord)
+{
+    PackedVertex v;
+    v.position[0] = position.x;
+    v.position[1] = position.y;
+    v.position[2] = position.z;
+    packNormal(normal, v.normal);
+    v.texCoord[0] = glm::packHalf1x16(texCoord.x);
+    v.texCoord[1] = glm::packHalf1x16(texCoord.y);
+    return v;
+}
+
+// Set the attributes of the vertex buffer bound to GL_ARRAY_BUFFER in the bound VAO
+inline void setPackedVertexAttributes()
+{
+    const GLsizei stride = sizeof(PackedVertex);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (const void *)offsetof(PackedVertex, position));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, (const void *)offsetof(PackedVertex, normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (const void *)offsetof(PackedVertex, texCoord));
+}
+
+inline MorphVertex packMorphVertex(const glm::vec3 &position, const glm::vec3 &normal)
+{
+    MorphVertex v;
+    v.position[0] = position.x;
+    v.position[1] = position.y;
+    v.position[2] = position.z;
+    packNormal(normal, v.normal);
+    return v;
+}
+
+// Set the attributes of the morph target buffer bound to GL_ARRAY_BUFFER in the bound VAO
+inline void setMorphVertexAttributes()
+{
+    const GLsizei stride = sizeof(MorphVertex);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (const void *)offsetof(MorphVertex, position));
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 2, GL_SHORT, GL_TRUE, stride, (const void *)offsetof(MorphVertex, normal));
+}
+
+// Index buffer content: 16-bit indices when the vertices allow it, 32-bit otherwise
+inline GLenum packIndices(const std::vector<glm::uvec3> &triangles, size_t numVertices, std::vector<unsigned char> &bytes)
+{
+    if (numVertices <= 65536)
+    {
+        bytes.resize(triangles.size() * 3 * sizeof(uint16_t));
+        uint16_t *out = reinterpret_cast<uint16_t *>(bytes.data());
+        for (size_t t = 0; t < triangles.size(); ++t)
+            for (int k = 0; k < 3; ++k)
+                out[3 * t + k] = static_cast<uint16_t>(triangles[t][k]);
+        return GL_UNSIGNED_SHORT;
+    }
+    bytes.resize(triangles.size() * sizeof(glm::uvec3));
+    if (!triangles.empty())
+        std::memcpy(bytes.data(), triangles.data(), bytes.size());
+    return GL_UNSIGNED_INT;
+}
+
+#endif // VERTEX_FORMAT_H
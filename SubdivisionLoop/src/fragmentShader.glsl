@@ -7,18 +7,33 @@ struct LightSource {
   int isActive;
 };
 
-struct Material {
+// written once per frame (CPU side: FrameBlock in main.cpp), must be the same in every shader
+layout(std140) uniform FrameBlock {
+  mat4 viewMat;
+  mat4 projMat;
+  vec3 camPos;
+  LightSource lightSources[3];
+  mat4 depthMVP[3]; // depth matrix of each light in the scene
+};
+
+// written for each object (CPU side: ObjectBlock in main.cpp), must be the same in every shader
+layout(std140) uniform ObjectBlock {
+  mat4 modelMat;
+  mat3 normMat;
   vec3 albedo;
-  sampler2D uvTex;
   int uvTexLoaded;
+  float morph; // 1 unless the mesh morphs from its morph targets, see SubdivisionLod
+};
+
+// the texture, the rest of the material is in ObjectBlock
+struct Material {
+  sampler2D uvTex;
 };
 
 int numberOfLights = 3;
 float pi = 3.1415927;
 
 uniform Material material;
-uniform LightSource lightSources[3];
-uniform vec3 camPos;
 uniform sampler2D depthTex[3];
 
 in vec3 fPositionModel;
@@ -59,7 +74,7 @@ void main() {
     vec3 radiance = vec3(0, 0, 0);
     vec3 texColor = vec3(1, 1, 1);
 
-    if (material.uvTexLoaded==1) 
+    if (uvTexLoaded==1) 
     {
             texColor = texture(material.uvTex, fTexCoord).rgb;
     }
@@ -71,8 +86,7 @@ void main() {
         { 
             vec3 wi = normalize(a_light.position - fPosition); 
             vec3 Li = a_light.color * a_light.intensity;
-            vec3 albedo = material.albedo;
-            float shadow = shadowMapCalculation(fPosShadow[i], i);
+                        float shadow = shadowMapCalculation(fPosShadow[i], i);
             radiance += Li*albedo*max(dot(n, wi), 0)*texColor*(1.0 - shadow);
         }
     }
@@ -17,15 +17,21 @@
 #include <memory>
 #include <algorithm>
 #include <exception>
+#include <chrono>
 
 #include "Error.h"
 #include "ShaderProgram.h"
+#include "UniformBuffer.h"
+#include "TextureLoader.h"
 #include "Camera.h"
 #include "Mesh.h"
 #include "ShadowMap.h"
-
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
+#include "Profiler.h"
+#include "Offscreen.h"
+#include "RenderQueue.h"
+#include "ThreadPool.h"
+#include "StreamingSubdivision.h"
+#include "SubdivisionLod.h"
 
 const std::string DEFAULT_MESH_FILENAME("../data/monkey.off");
 
@@ -34,6 +40,30 @@ GLFWwindow *g_window = nullptr;
 int g_windowWidth = 1024;
 int g_windowHeight = 768;
 
+// offscreen rendering (--offscreen): no window, the frames are rendered into g_offscreenTarget
+unsigned int g_offscreenFrames = 0;
+std::unique_ptr<OffscreenContext> g_offscreenContext;
+std::unique_ptr<OffscreenTarget> g_offscreenTarget;
+
+// streaming subdivision (--stream): the levels are written to g_streamFilename patch by patch, without a window
+int g_streamLevels = -1;
+std::string g_streamFilename;
+const size_t STREAM_PATCH_TRIANGLES = 1 << 20;
+
+// vertex cache statistics (--cache-stats): the orders of the triangles of each level, without a window
+int g_cacheStatsLevels = -1;
+
+// levels of detail of the rhino (G): Loop levels over the current mesh, up to a number of triangles, drawn so that
+// their edges are about this long on screen
+const unsigned int RHINO_LOD_LEVELS = 4;
+const size_t RHINO_LOD_MAX_TRIANGLES = 1 << 21;
+const float RHINO_LOD_EDGE_PIXELS = 6.f;
+
+// framebuffer of the main pass: the window's, or the offscreen target
+GLuint g_framebuffer = 0;
+// OpenGL entry points of the current context
+ShaderProgram::ProcAddressLoader g_procAddressLoader = glfwGetProcAddress;
+
 // pointer to the current camera model
 std::shared_ptr<Camera> g_cam;
 
@@ -65,50 +95,18 @@ unsigned int g_normalTexOnGPU;
 int g_uvTexLoaded = 0;
 
 GLuint g_uvTexWall;
-unsigned int g_uvTexWallOnGPU;
-
 GLuint g_uvTexFloor;
-unsigned int g_uvTexFloorOnGPU;
+unsigned int g_uvTexOnGPU; // unit of the texture of the material, bound by the render queue
 
 
-GLuint loadTextureFromFileToGPU(const std::string &filename)
-{
-    int width, height, numComponents;
-    // Loading the image in CPU memory using stbd_image
-    unsigned char *data = stbi_load(
-        filename.c_str(),
-        &width,
-        &height,
-        &numComponents, // 1 for a 8 bit greyscale image, 3 for 24bits RGB image, 4 for 32bits RGBA image
-        0);
-    // Create a texture in GPU memory
-    GLuint texID;
-    glGenTextures(1, &texID);
-    glBindTexture(GL_TEXTURE_2D, texID);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    // Uploading the image data to GPU memory
-    glTexImage2D(
-        GL_TEXTURE_2D,
-        0,
-        (numComponents == 1 ? GL_RED : numComponents == 3 ? GL_RGB
-                                                          : GL_RGBA), // For greyscale images, we store them in the RED channel
-        width,
-        height,
-        0,
-        (numComponents == 1 ? GL_RED : numComponents == 3 ? GL_RGB
-                                                          : GL_RGBA), // For greyscale images, we store them in the RED channel
-        GL_UNSIGNED_BYTE,
-        data);
-    // Generating mipmaps for filtered texture fetch
-    glGenerateMipmap(GL_TEXTURE_2D);
-    // Freeing the now useless CPU memory
-    stbi_image_free(data);
-    glBindTexture(GL_TEXTURE_2D, 0); // unbind the texture
-    return texID;
-}
+// decodes the textures in the background, keeps the results in a disk cache
+std::unique_ptr<TextureLoader> g_textureLoader;
+
+// CPU and GPU timings of the frame, overlay and traces
+std::unique_ptr<Profiler> g_profiler;
+
+// worker threads of the subdivision, one per core
+std::unique_ptr<ThreadPool> g_threadPool;
 
 struct Light
 {
@@ -141,6 +139,48 @@ struct Light
     }
 };
 
+// size of the light arrays of the shaders
+static const int MAX_LIGHTS = 3;
+
+// std140 layout of the LightSource struct of the shaders
+struct LightBlock
+{
+    glm::vec3 position;
+    float pad0;
+    glm::vec3 color;
+    float intensity;
+    int isActive;
+    int pad1[3];
+};
+
+// std140 layout of the FrameBlock uniform block of the shaders
+struct FrameBlock
+{
+    glm::mat4 viewMat;
+    glm::mat4 projMat;
+    glm::vec3 camPos;
+    float pad0;
+    LightBlock lightSources[MAX_LIGHTS];
+    glm::mat4 depthMVP[MAX_LIGHTS];
+};
+static_assert(sizeof(FrameBlock) == 480, "FrameBlock does not match the std140 layout");
+
+// std140 layout of the ObjectBlock uniform block of the shaders
+struct ObjectBlock
+{
+    glm::mat4 modelMat;
+    glm::mat3x4 normMat; // std140 stores each column of a mat3 as a vec4
+    glm::vec3 albedo;
+    int uvTexLoaded;
+    float morph; // from the morph targets of the mesh, see SubdivisionLod
+    float padding[3];
+
+    ObjectBlock(const glm::mat4 &model, const glm::vec3 &color, bool uvTex, float morphFactor = 1.f)
+        : modelMat(model), normMat(glm::mat3(glm::inverseTranspose(model))), albedo(color),
+          uvTexLoaded(uvTex ? 1 : 0), morph(morphFactor), padding{0.f, 0.f, 0.f} {}
+};
+static_assert(sizeof(ObjectBlock) == 144, "ObjectBlock does not match the std140 layout");
+
 struct Scene
 {   // lights
     std::vector<Light> lights;
@@ -150,105 +190,259 @@ struct Scene
     std::shared_ptr<Mesh> floor = nullptr;
     // transformation matrices
     glm::mat4 rhinoMat = glm::mat4(1.0);
+
+    // control mesh of the rhino at rest, waved when the deformation is on
+    std::vector<glm::vec3> rhinoRestPositions;
+    bool deformRhino = false;
+    // levels of detail drawn instead of the rhino when on, built from it
+    std::unique_ptr<SubdivisionLod> rhinoLod;
+    bool lodRhino = false;
+    // meshlets of the rhino drawn in each view: the lights, then the camera
+    bool cullRhino = true;
+    DrawRanges rhinoRanges[MAX_LIGHTS + 1];
     glm::mat4 planeMat = glm::mat4(1.0);
     glm::mat4 floorMat = glm::mat4(1.0);
     glm::vec3 scene_center = glm::vec3(0);
     float scene_radius = 1.f;
     // shaders to render the meshes
     std::shared_ptr<ShaderProgram> mainShader, shadowMapShader;
-    // save shadow maps to ppm files
+
+    // draws of the passes, sorted by state, and their resources registered once
+    std::unique_ptr<RenderQueue> queue;
+    RenderState renderState;
+    unsigned int mainProgram = 0, shadowMapProgram = 0;
+    unsigned int wallMaterial = 0, floorMaterial = 0;
+    unsigned int rhinoMesh = 0, planeMesh = 0, floorMesh = 0;
+    std::vector<unsigned int> rhinoLodMeshes;
+    // blocks of the static objects, with their normal matrix
+    ObjectBlock wallObject = ObjectBlock(glm::mat4(1.0), glm::vec3(1.0), true);
+    ObjectBlock floorObject = ObjectBlock(glm::mat4(1.0), glm::vec3(1.0), true);
+
+    // uniforms of the shaders, resolved once after linking
+    struct MainShaderUniforms
+    {
+        ShaderProgram::Uniform<int> uvTex;
+        ShaderProgram::Uniform<int> depthTex[MAX_LIGHTS];
+
+        void resolve(const ShaderProgram &program)
+        {
+            uvTex = program.uniform<int>("material.uvTex");
+            for (int i = 0; i < MAX_LIGHTS; ++i)
+                depthTex[i] = program.uniform<int>(std::string("depthTex[") + std::to_string(i) + std::string("]"));
+        }
+    } mainUniforms;
+    ShaderProgram::Uniform<int> shadowLightIndex;
+
+    // camera and lights, shared by all the programs and passes, and per-object data
+    std::unique_ptr<UniformBuffer> frameBuffer;
+    std::unique_ptr<UniformRingBuffer> objectBuffer;
+    // save shadow maps to ppm files, read back and written asynchronously
+    std::unique_ptr<FrameCapture> capture;
     bool saveShadowMapsPpm = false;
+    int traceCnt = 0;
+
+    // Distance to the camera over the far plane distance, to draw front to back
+    float viewDepth(const glm::mat4 &modelMat) const
+    {
+        return glm::length(glm::vec3(modelMat[3]) - g_cam->getPosition()) / g_cam->getFar();
+    }
 
     void render()
     {
+        renderState.invalidate(); // changed by any code since the last frame
+        //>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
+        // per-frame data, uploaded once for both passes
+        FrameBlock frame;
+        frame.viewMat = g_cam->computeViewMatrix();
+        frame.projMat = g_cam->computeProjectionMatrix();
+        frame.camPos = g_cam->getPosition();
+        for (int i = 0; i < MAX_LIGHTS; ++i)
+        {
+            LightBlock &block = frame.lightSources[i];
+            block.isActive = 0;
+            frame.depthMVP[i] = glm::mat4(1.0);
+            if (i >= static_cast<int>(lights.size()))
+                continue;
+            Light &light = lights[i];
+            light.setupCameraForShadowMapping(shadowMapShader, scene_center, scene_radius*1.5f);
+            block.position = light.position;
+            block.color = light.color;
+            block.intensity = light.intensity;
+            block.isActive = 1;
+            frame.depthMVP[i] = light.depthMVP;
+        }
+        frameBuffer->update(frame);
+
+        // per-object data, pushed once and bound again in each pass: valid for the whole frame
+        objectBuffer->beginFrame();
+        const GLintptr wallBlock = objectBuffer->push(wallObject);
+        const GLintptr floorBlock = objectBuffer->push(floorObject);
+        unsigned int rhinoDrawn = rhinoMesh;
+        const Mesh *rhinoDrawnMesh = rhino.get();
+        float rhinoMorph = 1.f;
+        if (lodRhino)
+        {
+            const SubdivisionLod::Selection lod = rhinoLod->select(frame.viewMat * rhinoMat, frame.projMat,
+                                                                   static_cast<float>(g_windowHeight),
+                                                                   RHINO_LOD_EDGE_PIXELS);
+            rhinoDrawn = rhinoLodMeshes[lod.level];
+            rhinoDrawnMesh = rhinoLod->meshes()[lod.level].get();
+            rhinoMorph = lod.morph;
+        }
+        const GLintptr rhinoBlock =
+            objectBuffer->push(ObjectBlock(rhinoMat, glm::vec3(1.0f, 0.71f, 0.29f), false, rhinoMorph));
+
         //>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
         // shadow map
+        g_profiler->push("shadow pass", Profiler::CPU_GPU);
         glEnable(GL_CULL_FACE);
         glCullFace(GL_FRONT);
-        shadowMapShader->use();
-        for(int i=0; i<lights.size(); ++i) {
+        for(int i=0; i<static_cast<int>(lights.size()) && i<MAX_LIGHTS; ++i) {
             Light &light = lights[i];
-            light.setupCameraForShadowMapping(shadowMapShader, scene_center, scene_radius*1.5f);
             light.bindShadowMap();
+            renderState.useProgram(shadowMapShader->id());
+            shadowLightIndex.set(i);
 
-            shadowMapShader->set("depthMVP", light.depthMVP*planeMat);
-            plane->render();
-
-            shadowMapShader->set("depthMVP", light.depthMVP*floorMat);
-            plane->render();
-
-            shadowMapShader->set("depthMVP", light.depthMVP*rhinoMat);
-            rhino->render();
+            queue->submit(shadowMapProgram, RenderQueue::noMaterial, planeMesh, wallBlock);
+            queue->submit(shadowMapProgram, RenderQueue::noMaterial, planeMesh, floorBlock);
+            // the front faces are culled when drawing the shadow maps
+            const DrawRanges *rhinoShadowRanges = nullptr;
+            if (cullRhino)
+            {
+                rhinoDrawnMesh->cull(light.depthMVP * rhinoMat, true, rhinoMorph, rhinoRanges[i]);
+                rhinoShadowRanges = &rhinoRanges[i];
+            }
+            queue->submit(shadowMapProgram, RenderQueue::noMaterial, rhinoDrawn, rhinoBlock, 0.f, 0,
+                          rhinoShadowRanges);
+            queue->flush(renderState, *objectBuffer);
 
             if(saveShadowMapsPpm) {
-                light.shadowMap.savePpmFile(std::string("shadom_map_")+std::to_string(i)+std::string(".ppm"));
+                light.shadowMap.savePpmFile(*capture, std::string("shadom_map_")+std::to_string(i)+std::string(".ppm"));
             }
         }
 
-        shadowMapShader->stop();
+        renderState.useProgram(0);
         saveShadowMapsPpm = false;
+        g_profiler->pop();
 
         //>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
         // main scene
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, g_framebuffer);
         glViewport(0, 0, g_windowWidth, g_windowHeight);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // Erase the color and z buffers.
         // glDisable(GL_CULL_FACE);    // or
         glCullFace(GL_BACK);
-        mainShader->use();
-        // camera
-        mainShader->set("camPos", g_cam->getPosition());
-        mainShader->set("viewMat", g_cam->computeViewMatrix());
-        mainShader->set("projMat", g_cam->computeProjectionMatrix());
-        // lights
-        for (int i = 0; i < lights.size(); ++i)
+        g_profiler->push("main pass", Profiler::CPU_GPU);
+        // the shadow maps stay bound to their units, the samplers point to them since the start
+        queue->submit(mainProgram, wallMaterial, planeMesh, wallBlock, viewDepth(planeMat));
+        queue->submit(mainProgram, floorMaterial, floorMesh, floorBlock, viewDepth(floorMat));
+        const DrawRanges *rhinoMainRanges = nullptr;
+        if (cullRhino)
         {
-            Light &light = lights[i];
-            // sends to fragment shader the light sources
-            mainShader->set(std::string("lightSources[") + std::to_string(i) + std::string("].position"), light.position);
-            mainShader->set(std::string("lightSources[") + std::to_string(i) + std::string("].color"), light.color);
-            mainShader->set(std::string("lightSources[") + std::to_string(i) + std::string("].intensity"), light.intensity);
-            mainShader->set(std::string("lightSources[") + std::to_string(i) + std::string("].isActive"), 1);
-            // sends to fragment shader the shadow textures and shadow mapping
-            mainShader->set(std::string("depthMVP[")+std::to_string(i)+std::string("]"), light.depthMVP);
-            mainShader->set(std::string("depthTex[")+std::to_string(i)+std::string("]"), static_cast<int>(light.shadowMapTexOnGPU));
+            rhinoDrawnMesh->cull(frame.projMat * frame.viewMat * rhinoMat, false, rhinoMorph, rhinoRanges[MAX_LIGHTS]);
+            rhinoMainRanges = &rhinoRanges[MAX_LIGHTS];
         }
+        queue->submit(mainProgram, RenderQueue::noMaterial, rhinoDrawn, rhinoBlock, viewDepth(rhinoMat), 0,
+                      rhinoMainRanges);
+        queue->flush(renderState, *objectBuffer);
+        renderState.useProgram(0);
+        g_profiler->pop();
 
-        mainShader->set("material.albedo", glm::vec3(1.0f, 1.0f, 1.0f));
-
-        // wall
-        mainShader->set("material.uvTexLoaded", 1);
-        glActiveTexture(GL_TEXTURE0 + g_uvTexWallOnGPU);
-        glBindTexture(GL_TEXTURE_2D, g_uvTexWall);
-        mainShader->set("material.uvTex", (int)g_uvTexWallOnGPU);
-        mainShader->set("modelMat", planeMat);
-        mainShader->set("normMat", glm::mat3(glm::inverseTranspose(planeMat)));
-        plane->render();
-
-        // floor
-        glActiveTexture(GL_TEXTURE0 + g_uvTexFloorOnGPU);
-        glBindTexture(GL_TEXTURE_2D, g_uvTexFloor);
-        mainShader->set("material.uvTex", (int)g_uvTexFloorOnGPU);
-        mainShader->set("modelMat", floorMat);
-        mainShader->set("normMat", glm::mat3(glm::inverseTranspose(floorMat)));
-        floor->render();
-
-        // rhino        
-        mainShader->set("material.albedo", glm::vec3(1.0f, 0.71f, 0.29f));
-        mainShader->set("material.uvTexLoaded", 0);
-        mainShader->set("modelMat", rhinoMat);
-        mainShader->set("normMat", glm::mat3(glm::inverseTranspose(rhinoMat)));
-        rhino->render();
-
-        mainShader->stop();
+        // files of the shadow maps saved in the previous frames
+        capture->poll();
         //>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
     }
 
     void subdivideCenterMesh()
     {
-        rhino->subdivideLoop();
+        ProfileScope scope(*g_profiler, "subdivision");
+        rhino->subdivideLoop(g_threadPool.get());
         rhino->init();
-    
+        if (lodRhino)
+            buildCenterMeshLod();
+    }
+
+    // Refine the faces of the rhino that are curved, far from the limit surface or large on screen, as seen from
+    // the camera now
+    void subdivideCenterMeshAdaptive()
+    {
+        ProfileScope scope(*g_profiler, "adaptive subdivision");
+        AdaptiveSubdivisionCriteria criteria;
+        criteria.maxNormalAngle = glm::radians(15.f);
+        criteria.maxLimitDistance = 0.001f * scene_radius;
+        criteria.maxScreenEdge = 32.f;
+        criteria.modelViewProjection = g_cam->computeProjectionMatrix() * g_cam->computeViewMatrix() * rhinoMat;
+        criteria.viewportSize = glm::vec2(g_windowWidth, g_windowHeight);
+        const size_t numRefined = rhino->subdivideLoopAdaptive(criteria, g_threadPool.get());
+        rhino->init();
+        if (lodRhino)
+            buildCenterMeshLod();
+        std::cout << "Adaptive subdivision: " << numRefined << " faces refined, " << rhino->triangleIndices().size()
+                  << " triangles" << std::endl;
+    }
+
+    // Halve the triangles of the rhino with the quadric decimation: its next lighter level of detail, the new
+    // control mesh of the subdivision and of the deformation
+    void simplifyCenterMesh()
+    {
+        ProfileScope scope(*g_profiler, "simplification");
+        const float error = rhino->simplify(rhino->triangleIndices().size() / 2);
+        rhinoRestPositions = rhino->vertexPositions();
+        rhino->init();
+        if (lodRhino)
+            buildCenterMeshLod();
+        std::cout << "Simplification: " << rhino->triangleIndices().size() << " triangles, error " << error
+                  << std::endl;
+    }
+
+    // Wave the control mesh along its height: the subdivided mesh follows with the operators of its levels
+    void deformCenterMesh(float time)
+    {
+        ProfileScope scope(*g_profiler, "deformation");
+        std::vector<glm::vec3> positions = rhinoRestPositions;
+        for (glm::vec3 &p : positions)
+            p.x += 0.05f * scene_radius * std::sin(4.f * time + 6.f * p.y / scene_radius);
+        rhino->setControlPositions(positions, g_threadPool.get());
+        if (lodRhino)
+            rhinoLod->setControlPositions(rhino->drawnPositions(), g_threadPool.get());
+        else
+            rhino->updatePositions();
+    }
+
+    // Levels of detail over the rhino as it is now, drawn instead of it: the finer ones only when close
+    void buildCenterMeshLod()
+    {
+        ProfileScope scope(*g_profiler, "levels of detail");
+        rhinoLod->build(rhino->drawnPositions(), rhino->triangleIndices(), rhino->vertexTexCoords(),
+                        RHINO_LOD_MAX_TRIANGLES, g_threadPool.get());
+        std::cout << "Levels of detail:";
+        for (unsigned int level = 0; level < rhinoLod->numLevels(); ++level)
+            std::cout << " " << rhinoLod->meshes()[level]->triangleIndices().size();
+        std::cout << " triangles" << std::endl;
+    }
+
+    void toggleCenterMeshCulling()
+    {
+        cullRhino = !cullRhino;
+        std::cout << "Meshlet culling " << (cullRhino ? "on" : "off") << std::endl;
+    }
+
+    void toggleCenterMeshLod()
+    {
+        lodRhino = !lodRhino;
+        if (lodRhino)
+            buildCenterMeshLod();
+        else
+            rhinoLod->clear();
+    }
+
+    void traceFrames(unsigned int numFrames)
+    {
+        if (g_profiler->tracing())
+            return;
+        const std::string filename = "trace" + std::to_string(traceCnt++) + ".json";
+        g_profiler->traceFrames(filename, numFrames);
+        std::cout << "Tracing " << numFrames << " frames to " << filename << std::endl;
     }
 };
 
@@ -264,7 +458,15 @@ void printHelp()
               << "    Keyboard commands:" << std::endl
               << "    * H: print this help" << std::endl
               << "    * T: toggle animation" << std::endl
+              << "    * L: subdivide the mesh" << std::endl
+              << "    * A: subdivide the mesh where the error is over the thresholds" << std::endl
+              << "    * K: simplify the mesh to half its triangles" << std::endl
+              << "    * D: toggle the deformation of the control mesh" << std::endl
+              << "    * G: toggle the levels of detail of the mesh, with geomorphs" << std::endl
+              << "    * C: toggle the culling of the meshlets of the mesh out of view or facing away" << std::endl
               << "    * F1: toggle wireframe/surface rendering" << std::endl
+              << "    * F2: show/hide the profiler overlay" << std::endl
+              << "    * F3: trace the next 120 frames (chrome://tracing)" << std::endl
               << "    * ESC: quit the program" << std::endl;
 }
 
@@ -290,6 +492,26 @@ void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods
     {
         g_scene.subdivideCenterMesh();
     }
+    else if (action == GLFW_PRESS && key == GLFW_KEY_A)
+    {
+        g_scene.subdivideCenterMeshAdaptive();
+    }
+    else if (action == GLFW_PRESS && key == GLFW_KEY_K)
+    {
+        g_scene.simplifyCenterMesh();
+    }
+    else if (action == GLFW_PRESS && key == GLFW_KEY_D)
+    {
+        g_scene.deformRhino = !g_scene.deformRhino;
+    }
+    else if (action == GLFW_PRESS && key == GLFW_KEY_G)
+    {
+        g_scene.toggleCenterMeshLod();
+    }
+    else if (action == GLFW_PRESS && key == GLFW_KEY_C)
+    {
+        g_scene.toggleCenterMeshCulling();
+    }
     else if (action == GLFW_PRESS && key == GLFW_KEY_T)
     {
         g_appTimerStoppedP = !g_appTimerStoppedP;
@@ -302,6 +524,14 @@ void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods
         glGetIntegerv(GL_POLYGON_MODE, mode);
         glPolygonMode(GL_FRONT_AND_BACK, mode[1] == GL_FILL ? GL_LINE : GL_FILL);
     }
+    else if (action == GLFW_PRESS && key == GLFW_KEY_F2)
+    {
+        g_profiler->toggleOverlay();
+    }
+    else if (action == GLFW_PRESS && key == GLFW_KEY_F3)
+    {
+        g_scene.traceFrames(120);
+    }
     else if (action == GLFW_PRESS && key == GLFW_KEY_ESCAPE)
     {
         glfwSetWindowShouldClose(window, true); 
@@ -373,7 +603,7 @@ void mouseButtonCallback(GLFWwindow *window, int button, int action, int mods)
     }
 }
 
-void initGLFW()
+void initGLFW(bool visible = true)
 {
     // Initialize GLFW, the library responsible for window management
     if (!glfwInit())
@@ -389,6 +619,7 @@ void initGLFW()
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_RESIZABLE, GL_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, visible ? GL_TRUE : GL_FALSE);
     // Create the window
     g_window = glfwCreateWindow(g_windowWidth, g_windowHeight, "Subdivision Surfaces", nullptr, nullptr);
     if (!g_window)
@@ -414,10 +645,25 @@ void exitOnCriticalError(const std::string &message)
     std::exit(EXIT_FAILURE);
 }
 
+void initOffscreen()
+{
+    try
+    {
+        g_offscreenContext.reset(new OffscreenContext());
+        g_procAddressLoader = OffscreenContext::getProcAddress;
+    }
+    catch (std::exception &e)
+    {
+        // offscreen as well if GLFW is built with GLFW_USE_OSMESA, else needs a display
+        std::cerr << e.what() << ", using a hidden window" << std::endl;
+        initGLFW(false);
+    }
+}
+
 void initOpenGL()
 {
     // Load extensions for modern OpenGL
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    if (!gladLoadGLLoader((GLADloadproc)g_procAddressLoader))
         exitOnCriticalError("[Failed to initialize OpenGL context]");
 
     glCullFace(GL_BACK);                  // Specifies the faces to cull (here the ones pointing away from the camera)
@@ -425,11 +671,22 @@ void initOpenGL()
     glDepthFunc(GL_LESS);                 // Specify the depth test for the z-buffer
     glEnable(GL_DEPTH_TEST);              // Enable the z-buffer test in the rasterization
     glClearColor(1.0f, 1.0f, 1.0f, 1.0f); // specify the background color, used any time the framebuffer is cleared
+
+    // linked programs of the previous runs, when the driver can give them back
+    ShaderProgram::enableBinaryCache("shadercache", g_procAddressLoader);
+
     // Loads and compile the programmable shader pipeline
     try
     {
         g_scene.mainShader = ShaderProgram::genBasicShaderProgram("../src/vertexShader.glsl", "../src/fragmentShader.glsl");
+        g_scene.mainUniforms.resolve(*g_scene.mainShader);
         g_scene.mainShader->stop();
+        g_scene.frameBuffer.reset(new UniformBuffer(sizeof(FrameBlock), FRAME_BLOCK_BINDING));
+        g_scene.objectBuffer.reset(new UniformRingBuffer(sizeof(ObjectBlock), OBJECT_BLOCK_BINDING));
+        g_scene.capture.reset(new FrameCapture());
+        g_profiler.reset(new Profiler());
+        g_profiler->setOverlayProgram(
+            ShaderProgram::genBasicShaderProgram("../src/profilerVertexShader.glsl", "../src/profilerFragmentShader.glsl"));
     }
     catch (std::exception &e)
     {
@@ -437,6 +694,7 @@ void initOpenGL()
     }
     try {
         g_scene.shadowMapShader = ShaderProgram::genBasicShaderProgram("../src/vertexShaderShadowMap.glsl", "../src/fragmentShaderShadowMap.glsl");
+        g_scene.shadowLightIndex = g_scene.shadowMapShader->uniform<int>("lightIndex");
         g_scene.shadowMapShader->stop();
 
     } catch(std::exception &e) {
@@ -447,10 +705,10 @@ void initOpenGL()
 void initScene(const std::string &meshFilename)
 {
     // Init camera
-    int width, height;
-    glfwGetWindowSize(g_window, &width, &height);
     g_cam = std::make_shared<Camera>();
-    g_cam->setAspectRatio(static_cast<float>(width) / static_cast<float>(height));
+    g_cam->setAspectRatio(static_cast<float>(g_windowWidth) / static_cast<float>(g_windowHeight));
+
+    g_threadPool.reset(new ThreadPool());
 
     // Load meshes in the scene
     {
@@ -464,12 +722,14 @@ void initScene(const std::string &meshFilename)
             exitOnCriticalError(std::string("[Error loading mesh]") + e.what());
         }
         g_scene.rhino->init();
+        g_scene.rhinoRestPositions = g_scene.rhino->vertexPositions();
         g_scene.plane = std::make_shared<Mesh>();
         g_scene.plane->addPlan();
         g_scene.plane->init();
         g_scene.floor = std::make_shared<Mesh>();
         g_scene.floor->addPlan();
         g_scene.floor->init();
+        g_scene.rhinoLod.reset(new SubdivisionLod(RHINO_LOD_LEVELS));
         g_scene.planeMat = glm::translate(glm::mat4(1.0), glm::vec3(0, 0, -1.0));
         g_scene.floorMat = glm::translate(glm::mat4(1.0), glm::vec3(0, -1.0, 0)) *
                            glm::rotate(glm::mat4(1.0), (float)(-0.5f * M_PI), glm::vec3(1.0, 0.0, 0.0));
@@ -477,12 +737,10 @@ void initScene(const std::string &meshFilename)
 
     // Load textures to GPU
     {
-        g_uvTexWall = loadTextureFromFileToGPU("../src/walltexture.jpg");
-        g_uvTexWallOnGPU = g_availableTextureSlot;
-        ++g_availableTextureSlot;
-
-        g_uvTexFloor = loadTextureFromFileToGPU("../src/floortexture.jpg");
-        g_uvTexFloorOnGPU = g_availableTextureSlot;
+        g_textureLoader.reset(new TextureLoader());
+        g_uvTexWall = g_textureLoader->load("../src/walltexture.jpg");
+        g_uvTexFloor = g_textureLoader->load("../src/floortexture.jpg");
+        g_uvTexOnGPU = g_availableTextureSlot;
         ++g_availableTextureSlot;
     }
 
@@ -513,6 +771,29 @@ void initScene(const std::string &meshFilename)
     }
 
 
+    // The samplers point to the units of the material texture and of the shadow maps once
+    g_scene.mainShader->use();
+    g_scene.mainUniforms.uvTex.set((int)g_uvTexOnGPU);
+    for (int i = 0; i < static_cast<int>(g_scene.lights.size()) && i < MAX_LIGHTS; ++i)
+        g_scene.mainUniforms.depthTex[i].set(static_cast<int>(g_scene.lights[i].shadowMapTexOnGPU));
+    g_scene.mainShader->stop();
+
+    // Resources of the draws
+    {
+        g_scene.queue.reset(new RenderQueue());
+        g_scene.mainProgram = g_scene.queue->addProgram(g_scene.mainShader);
+        g_scene.shadowMapProgram = g_scene.queue->addProgram(g_scene.shadowMapShader);
+        g_scene.wallMaterial = g_scene.queue->addMaterial(RenderMaterial().texture(g_uvTexOnGPU, g_uvTexWall));
+        g_scene.floorMaterial = g_scene.queue->addMaterial(RenderMaterial().texture(g_uvTexOnGPU, g_uvTexFloor));
+        g_scene.rhinoMesh = g_scene.queue->addMesh(g_scene.rhino);
+        g_scene.planeMesh = g_scene.queue->addMesh(g_scene.plane);
+        g_scene.floorMesh = g_scene.queue->addMesh(g_scene.floor);
+        for (const std::shared_ptr<Mesh> &mesh : g_scene.rhinoLod->meshes())
+            g_scene.rhinoLodMeshes.push_back(g_scene.queue->addMesh(mesh));
+        g_scene.wallObject = ObjectBlock(g_scene.planeMat, glm::vec3(1.0f, 1.0f, 1.0f), true);
+        g_scene.floorObject = ObjectBlock(g_scene.floorMat, glm::vec3(1.0f, 1.0f, 1.0f), true);
+    }
+
     // Adjust the camera to the mesh
     glm::vec3 meshCenter;
     float meshRadius;
@@ -527,7 +808,10 @@ void initScene(const std::string &meshFilename)
 
 void init(const std::string &meshFilename)
 {
-    initGLFW();              // Windowing system
+    if (g_offscreenFrames > 0)
+        initOffscreen();     // No window
+    else
+        initGLFW();          // Windowing system
     initOpenGL();            // OpenGL Context and shader pipeline
     initScene(meshFilename); // Actual g_scene to render
 }
@@ -536,10 +820,20 @@ void clear()
 {
     g_cam.reset();
     g_scene.rhino.reset();
+    g_scene.rhinoLod.reset();
     g_scene.plane.reset();
     g_scene.floor.reset();
     g_scene.mainShader.reset();
     g_scene.shadowMapShader.reset();
+    g_scene.queue.reset();
+    g_scene.frameBuffer.reset();
+    g_scene.objectBuffer.reset();
+    g_scene.capture.reset(); // writes the pending files
+    g_textureLoader.reset();
+    g_profiler.reset();
+    g_threadPool.reset();
+    g_offscreenTarget.reset();
+    g_offscreenContext.reset();
     glfwDestroyWindow(g_window);
     glfwTerminate();
 }
@@ -547,12 +841,18 @@ void clear()
 // The main rendering call
 void render()
 {
+    ProfileScope scope(*g_profiler, "render");
+    {
+        ProfileScope textures(*g_profiler, "textures");
+        g_textureLoader->update(); // textures decoded since the last frame
+    }
     g_scene.render();
 }
 
 // Update any accessible variable based on the current time
 void update(float currentTime)
 {
+    ProfileScope scope(*g_profiler, "update");
     if (!g_appTimerStoppedP)
     {
         // Animate any entity of the program here
@@ -561,28 +861,180 @@ void update(float currentTime)
         g_appTimer += dt;
         // <---- Update here what needs to be animated over time ---->
         g_scene.rhinoMat = glm::rotate(glm::mat4(1.f), (float)g_appTimer, glm::vec3(0.f, 1.f, 0.f));
+        if (g_scene.deformRhino)
+            g_scene.deformCenterMesh(g_appTimer);
     }
 }
 
+// Render numFrames frames along a fixed camera path, with a fixed time step, into the offscreen
+// target. Prints the time and the image hash of each frame, then the statistics.
+void runOffscreen(unsigned int numFrames)
+{
+    try
+    {
+        g_offscreenTarget.reset(new OffscreenTarget(g_windowWidth, g_windowHeight));
+    }
+    catch (std::exception &e)
+    {
+        exitOnCriticalError(e.what());
+    }
+    g_framebuffer = g_offscreenTarget->framebuffer();
+
+    // the final textures from the first frame on, for the hashes to be reproducible
+    g_textureLoader->finish();
+
+    g_appTimerStoppedP = false;
+    g_appTimerLastColckTime = 0.0f;
+    RenderBenchmark benchmark;
+    std::vector<unsigned char> pixels;
+    for (unsigned int i = 0; i < numFrames; ++i)
+    {
+        // the camera swings around the scene and up, one period over the sequence
+        const float phase = static_cast<float>(2.0 * M_PI * i / numFrames);
+        g_cam->setRotation(glm::vec3(-0.2f * (1.0f - std::cos(phase)), 0.5f * std::sin(phase), 0.0f));
+
+        const auto start = std::chrono::steady_clock::now();
+        g_profiler->beginFrame();
+        update((i + 1) / 60.0f);
+        render();
+        glFinish();
+        g_profiler->endFrame();
+        const double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        g_offscreenTarget->read(pixels);
+        benchmark.addFrame(time, pixels);
+    }
+    benchmark.report(std::cout);
+}
+
 void usage(const char *command)
 {
-    std::cerr << "Usage : " << command << " [<file.off>]" << std::endl;
+    std::cerr << "Usage : " << command
+              << " [--offscreen <frames>] [--size <width>x<height>] [--stream <levels> <output>]"
+              << " [--cache-stats <levels>] [<file.off>]"
+              << std::endl;
     std::exit(EXIT_FAILURE);
 }
 
+// Subdivide the mesh to a file too large for memory, see StreamingSubdivision
+int runStreaming(const std::string &meshFilename)
+{
+    try
+    {
+        std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+        loadOFF(meshFilename, mesh);
+        ThreadPool pool;
+        const auto start = std::chrono::steady_clock::now();
+        const StreamingSubdivision::Statistics statistics =
+            StreamingSubdivision(mesh->vertexPositions(), mesh->triangleIndices())
+                .run(static_cast<unsigned int>(g_streamLevels), g_streamFilename, STREAM_PATCH_TRIANGLES, &pool);
+        const double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Streamed " << g_streamLevels << " levels to " << g_streamFilename << ": "
+                  << statistics.numVertices << " vertices, " << statistics.numTriangles << " triangles in "
+                  << statistics.numPatches << " patches of at most " << statistics.maxPatchTriangles
+                  << " triangles, " << time << " s" << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << "[Error streaming the subdivision]" << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+// Post-transform cache efficiency of the triangles of each Loop level, in the order of the subdivision and in the
+// order drawn, see VertexCache.h, for the smallest and the largest common caches
+int runCacheStatistics(const std::string &meshFilename)
+{
+    try
+    {
+        std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+        loadOFF(meshFilename, mesh);
+        ThreadPool pool;
+        for (int level = 0; level <= g_cacheStatsLevels; ++level)
+        {
+            if (level > 0)
+                mesh->subdivideLoop(&pool);
+            const std::vector<glm::uvec3> &triangles = mesh->triangleIndices();
+            const size_t numVertices = mesh->vertexPositions().size();
+            const auto start = std::chrono::steady_clock::now();
+            std::vector<glm::uvec3> ordered = optimizeVertexCache(triangles, mesh->drawnPositions(), numVertices);
+            optimizeVertexFetch(ordered, numVertices);
+            const double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            std::cout << "Level " << level << ": " << triangles.size() << " triangles, ordered in " << time << " ms"
+                      << std::endl;
+            for (unsigned int cacheSize : {16u, 32u})
+            {
+                const VertexCacheStatistics before = analyzeVertexCache(triangles, numVertices, cacheSize);
+                const VertexCacheStatistics after = analyzeVertexCache(ordered, numVertices, cacheSize);
+                std::cout << "    cache " << cacheSize << ": ACMR " << before.acmr << " -> " << after.acmr
+                          << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+            }
+        }
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << "[Error computing the cache statistics]" << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char **argv)
 {
-    if (argc > 2)
-        usage(argv[0]);
-    
-    init(argc == 1 ? DEFAULT_MESH_FILENAME : argv[1]);
+    std::string meshFilename = DEFAULT_MESH_FILENAME;
+    bool hasMeshFilename = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        if (arg == "--offscreen" && i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+            g_offscreenFrames = static_cast<unsigned int>(std::atoi(argv[++i]));
+        else if (arg == "--size" && i + 1 < argc &&
+                 std::sscanf(argv[++i], "%dx%d", &g_windowWidth, &g_windowHeight) == 2 &&
+                 g_windowWidth > 0 && g_windowHeight > 0)
+            continue;
+        else if (arg == "--stream" && i + 2 < argc && std::atoi(argv[i + 1]) >= 0)
+        {
+            g_streamLevels = std::atoi(argv[++i]);
+            g_streamFilename = argv[++i];
+        }
+        else if (arg == "--cache-stats" && i + 1 < argc && std::atoi(argv[i + 1]) >= 0)
+            g_cacheStatsLevels = std::atoi(argv[++i]);
+        else if (arg.compare(0, 2, "--") != 0 && !hasMeshFilename)
+        {
+            meshFilename = arg;
+            hasMeshFilename = true;
+        }
+        else
+            usage(argv[0]);
+    }
+
+    if (g_streamLevels >= 0)
+        return runStreaming(meshFilename);
+    if (g_cacheStatsLevels >= 0)
+        return runCacheStatistics(meshFilename);
+
+    init(meshFilename);
+    if (g_offscreenFrames > 0)
+    {
+        runOffscreen(g_offscreenFrames);
+        clear();
+        return EXIT_SUCCESS;
+    }
 
     while (!glfwWindowShouldClose(g_window))
     {
+        g_profiler->beginFrame();
         update(static_cast<float>(glfwGetTime()));
         render();
-        glfwSwapBuffers(g_window);
+        g_profiler->drawOverlay(g_windowWidth, g_windowHeight);
+        {
+            ProfileScope swap(*g_profiler, "swap");
+            glfwSwapBuffers(g_window);
+        }
         glfwPollEvents();
+        g_profiler->endFrame();
     }
     
     clear();
@@ -0,0 +1,17 @@
+#version 330 core            // minimal GL version support expected from the GPU
+
+// text and bars of the profiler overlay, in pixels from the top left corner of the window
+layout(location=0) in vec2 vPosition;
+layout(location=1) in vec2 vTexCoord;
+layout(location=2) in vec4 vColor;
+
+uniform vec2 screenSize;
+
+out vec2 fTexCoord;
+out vec4 fColor;
+
+void main() {
+    gl_Position = vec4(2.0 * vPosition.x / screenSize.x - 1.0, 1.0 - 2.0 * vPosition.y / screenSize.y, 0.0, 1.0);
+    fTexCoord = vTexCoord;
+    fColor = vColor;
+}
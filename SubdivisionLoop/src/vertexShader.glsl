@@ -1,30 +1,67 @@
-#version 330 core           
-
-layout(location=0) in vec3 vPosition;
-layout(location=1) in vec3 vNormal;
-layout(location=2) in vec2 vTexCoord;
-
-uniform mat4 modelMat, viewMat, projMat;
-uniform mat3 normMat;
-
-uniform mat4 depthMVP[3]; // receives depth matrix for each light in scene
-
-out vec3 fPositionModel;
-out vec3 fPosition;
-out vec3 fNormal;
-out vec2 fTexCoord;
-
-out vec4 fPosShadow[3];
-
-void main() {
-    fPositionModel = vPosition;
-    fPosition = (modelMat*vec4(vPosition, 1.0)).xyz;
-    fNormal = normMat*vNormal;
-    fTexCoord = vTexCoord;
-
-    for (int i = 0; i < depthMVP.length(); i++) {
-        fPosShadow[i] = depthMVP[i] * modelMat * vec4(vPosition, 1.0); // shadows
-    }
-
-    gl_Position =  projMat * viewMat * modelMat * vec4(vPosition, 1.0); 
-}
+#version 330 core           
+
+layout(location=0) in vec3 vPosition;
+layout(location=1) in vec2 vNormal; // octahedral encoding (CPU side: PackedVertex)
+layout(location=2) in vec2 vTexCoord;
+layout(location=3) in vec3 vMorphPosition; // morph target (CPU side: MorphVertex), only read when morph < 1
+layout(location=4) in vec2 vMorphNormal;
+
+struct LightSource {
+  vec3 position;
+  vec3 color;
+  float intensity;
+  int isActive;
+};
+
+// written once per frame (CPU side: FrameBlock in main.cpp), must be the same in every shader
+layout(std140) uniform FrameBlock {
+  mat4 viewMat;
+  mat4 projMat;
+  vec3 camPos;
+  LightSource lightSources[3];
+  mat4 depthMVP[3]; // depth matrix of each light in the scene
+};
+
+// written for each object (CPU side: ObjectBlock in main.cpp), must be the same in every shader
+layout(std140) uniform ObjectBlock {
+  mat4 modelMat;
+  mat3 normMat;
+  vec3 albedo;
+  int uvTexLoaded;
+  float morph; // 1 unless the mesh morphs from its morph targets, see SubdivisionLod
+};
+
+out vec3 fPositionModel;
+out vec3 fPosition;
+out vec3 fNormal;
+out vec2 fTexCoord;
+
+out vec4 fPosShadow[3];
+
+// inverse of octEncode in VertexFormat.h
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+void main() {
+    vec3 position = vPosition;
+    vec3 normal = octDecode(vNormal);
+    if (morph < 1.0) { // geomorph, the meshes without morph targets are drawn with morph = 1
+        position = mix(vMorphPosition, vPosition, morph);
+        normal = normalize(mix(octDecode(vMorphNormal), normal, morph));
+    }
+
+    fPositionModel = position;
+    fPosition = (modelMat*vec4(position, 1.0)).xyz;
+    fNormal = normMat*normal;
+    fTexCoord = vTexCoord;
+
+    for (int i = 0; i < depthMVP.length(); i++) {
+        fPosShadow[i] = depthMVP[i] * modelMat * vec4(position, 1.0); // shadows
+    }
+
+    gl_Position =  projMat * viewMat * modelMat * vec4(position, 1.0); 
+}
@@ -1,10 +1,37 @@
 #version 330 core         
 
 layout(location=0) in vec3 vPosition;
+layout(location=3) in vec3 vMorphPosition; // morph target, see vertexShader.glsl
 
-uniform mat4 depthMVP;
+struct LightSource {
+  vec3 position;
+  vec3 color;
+  float intensity;
+  int isActive;
+};
+
+// written once per frame (CPU side: FrameBlock in main.cpp), must be the same in every shader
+layout(std140) uniform FrameBlock {
+  mat4 viewMat;
+  mat4 projMat;
+  vec3 camPos;
+  LightSource lightSources[3];
+  mat4 depthMVP[3]; // depth matrix of each light in the scene
+};
+
+// written for each object (CPU side: ObjectBlock in main.cpp), must be the same in every shader
+layout(std140) uniform ObjectBlock {
+  mat4 modelMat;
+  mat3 normMat;
+  vec3 albedo;
+  int uvTexLoaded;
+  float morph; // 1 unless the mesh morphs from its morph targets, see SubdivisionLod
+};
+
+uniform int lightIndex; // light whose shadow map is rendered
 
 void main() 
 {
-    gl_Position = depthMVP*vec4(vPosition, 1);
+    vec3 position = morph < 1.0 ? mix(vMorphPosition, vPosition, morph) : vPosition;
+    gl_Position = depthMVP[lightIndex]*modelMat*vec4(position, 1);
 }